@@ -0,0 +1,83 @@
+"""
+cbmsim.py -- numpy interface to libcbmsim.
+
+Wraps the _cbmsim extension module so that buffer accessors return read-only
+numpy arrays sharing memory with the running simulation (no copies are made).
+Those arrays are refreshed in place by the simulation: their contents are
+only meaningful until the next call to step or run_trial, so call .copy() on
+anything that should be kept.
+
+Example:
+
+    import cbmsim
+    sim = cbmsim.Sim()
+    sim.set_plasticity(cbmsim.Plasticity.GRADED, cbmsim.Plasticity.OFF)
+    sim.load("../data/inputs/some_bunny.sim")
+    pc_vm = []
+    sim.on_step(lambda ts: pc_vm.append(sim.vm(cbmsim.Cell.PC).copy()))
+    sim.run_trial(cs_onset=2000, cs_len=500, us_onset=2500)
+    weights = sim.pfpc_weights()
+"""
+
+from enum import IntEnum
+
+import numpy as np
+
+import _cbmsim
+
+
+class Cell(IntEnum):
+    MF = 0
+    GR = 1
+    GO = 2
+    BC = 3
+    SC = 4
+    PC = 5
+    IO = 6
+    NC = 7
+
+
+class Plasticity(IntEnum):
+    OFF = 0
+    GRADED = 1
+    BINARY = 2
+    ABBOTT_CASCADE = 3
+    MAUK_CASCADE = 4
+
+
+def _as_array(buf, dtype):
+    # frombuffer keeps buf (and through it the Sim) alive as the array's base,
+    # and inherits its read-only flag
+    return np.frombuffer(buf, dtype=dtype)
+
+
+class Sim(_cbmsim.Sim):
+    """In-process simulation. step and run_trial release the GIL.
+
+    While one thread is in load, build, save, step or run_trial, other
+    threads get a RuntimeError from every method; the callbacks of the
+    running call may read buffers and call set_cs and set_us.
+    """
+
+    def spikes(self, cell):
+        """uint8 spikes of the given population at the current step."""
+        return _as_array(super().spikes(int(cell)), np.uint8)
+
+    def vm(self, cell):
+        """float32 membrane potentials (every population but MF)."""
+        return _as_array(super().vm(int(cell)), np.float32)
+
+    def pfpc_weights(self):
+        """float32 parallel fiber to purkinje cell weights, one per granule."""
+        return _as_array(super().pfpc_weights(), np.float32)
+
+    def mfnc_weights(self):
+        """float32 mossy fiber to deep nucleus weights."""
+        return _as_array(super().mfnc_weights(), np.float32)
+
+    def num_cells(self, cell):
+        return super().num_cells(int(cell))
+
+    def set_plasticity(self, pfpc, mfnc, stp=False):
+        """set the plasticity modes. pfpc must be set before load or build."""
+        super().set_plasticity(int(pfpc), int(mfnc), stp)
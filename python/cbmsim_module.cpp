@@ -0,0 +1,578 @@
+/** @file cbmsim_module.cpp
+ *  @brief CPython extension module (_cbmsim) wrapping libcbmsim's CBMSim.
+ *
+ *  Buffer accessors (spikes, vm, pfpc_weights, mfnc_weights) return small
+ *  Buffer objects that implement the buffer protocol directly on top of the
+ *  simulation's own host arrays: numpy.frombuffer, memoryview and friends can
+ *  read them without a copy. A Buffer keeps its Sim alive, but its contents
+ *  change with every step, exactly like the underlying views. The cbmsim.py
+ *  wrapper turns them into read-only numpy arrays.
+ *
+ *  load, build, save, step and run_trial release the GIL while they run.
+ *  Python callbacks registered with on_step or on_trial_end re-acquire it
+ *  when called; an exception raised by a callback is re-raised once the
+ *  releasing call returns, and no further callbacks are run until then.
+ *  While such a call runs, the Sim is busy: other threads get a RuntimeError
+ *  from every method, and its own callbacks may only read buffers and switch
+ *  the cs and us. A Sim is initialised once, so its Buffers never outlive the
+ *  simulation they point into.
+ *
+ *  @author Sean Gallogly (sean.gallo@austin.utexas.edu)
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <memory>
+
+#include "cbmsim.h"
+
+/* ------------------------------- Buffer ---------------------------------- */
+
+typedef struct {
+  PyObject_HEAD
+  PyObject *owner; /* the Sim the data belongs to */
+  const void *data;
+  Py_ssize_t num_elems;
+  Py_ssize_t item_size;
+  const char *format; /* struct-module format code: "B" or "f" */
+} BufferObject;
+
+static int Buffer_getbuffer(BufferObject *self, Py_buffer *view, int flags) {
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "simulation buffers are read-only");
+    return -1;
+  }
+  view->obj = (PyObject *)self;
+  Py_INCREF(self);
+  view->buf = (void *)self->data;
+  view->len = self->num_elems * self->item_size;
+  view->readonly = 1;
+  view->itemsize = self->item_size;
+  view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+  view->ndim = 1;
+  view->shape = (flags & PyBUF_ND) ? &self->num_elems : NULL;
+  view->strides = (flags & PyBUF_STRIDES) ? &self->item_size : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static void Buffer_dealloc(BufferObject *self) {
+  Py_XDECREF(self->owner);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t Buffer_len(BufferObject *self) { return self->num_elems; }
+
+static PyBufferProcs Buffer_as_buffer = {(getbufferproc)Buffer_getbuffer,
+                                         NULL};
+
+static PySequenceMethods Buffer_as_sequence = {
+    (lenfunc)Buffer_len, /* sq_length */
+    NULL,                /* sq_concat */
+    NULL,                /* sq_repeat */
+    NULL,                /* sq_item */
+    NULL,                /* was_sq_slice */
+    NULL,                /* sq_ass_item */
+    NULL,                /* was_sq_ass_slice */
+    NULL,                /* sq_contains */
+    NULL,                /* sq_inplace_concat */
+    NULL,                /* sq_inplace_repeat */
+};
+
+// the type objects are filled in by PyInit__cbmsim; their member list
+// changes between python versions, so no initializer could be complete
+static PyTypeObject BufferType = PyTypeObject();
+
+template <typename Type>
+static PyObject *new_buffer(PyObject *owner, cbm_view<Type> view,
+                            const char *format) {
+  BufferObject *buf = PyObject_New(BufferObject, &BufferType);
+  if (!buf)
+    return NULL;
+  Py_INCREF(owner);
+  buf->owner = owner;
+  buf->data = view.data;
+  buf->num_elems = view.data ? (Py_ssize_t)view.size : 0;
+  buf->item_size = sizeof(Type);
+  buf->format = format;
+  return (PyObject *)buf;
+}
+
+/* --------------------------------- Sim ----------------------------------- */
+
+typedef struct {
+  PyObject_HEAD
+  CBMSim *sim;
+  bool busy; /* a call is running with the GIL released */
+  unsigned long busy_thread; /* the thread running it */
+  /* first exception raised by a python callback while the GIL was released */
+  PyObject *cb_type, *cb_value, *cb_traceback;
+} SimObject;
+
+static int Sim_init(SimObject *self, PyObject *args, PyObject *kwds) {
+  static const char *kwlist[] = {"gpu_index", "gpu_p2", NULL};
+  unsigned int gpu_index = 0, gpu_p2 = 2;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|II", (char **)kwlist,
+                                   &gpu_index, &gpu_p2))
+    return -1;
+  if (self->sim) {
+    PyErr_SetString(PyExc_RuntimeError, "Sim is already initialised");
+    return -1;
+  }
+  self->sim = new CBMSim(gpu_index, gpu_p2);
+  return 0;
+}
+
+/*
+ * Implementation Notes:
+ *     busy is only read and written with the GIL held, so checking it and
+ * setting it cannot race. The thread that made the sim busy is still let
+ * through when from_callback is true, as its callbacks run in the middle of
+ * the busy call.
+ */
+static bool sim_ready(SimObject *self, bool from_callback) {
+  if (!self->sim) {
+    PyErr_SetString(PyExc_RuntimeError, "Sim.__init__ has not been called");
+    return false;
+  }
+  if (!self->busy)
+    return true;
+  bool own_thread = self->busy_thread == PyThread_get_thread_ident();
+  if (from_callback && own_thread)
+    return true;
+  PyErr_SetString(PyExc_RuntimeError,
+                  own_thread ? "not allowed from a simulation callback"
+                             : "the simulation is busy in another thread");
+  return false;
+}
+
+static void set_busy(SimObject *self) {
+  self->busy = true;
+  self->busy_thread = PyThread_get_thread_ident();
+}
+
+static void Sim_dealloc(SimObject *self) {
+  delete self->sim;
+  Py_XDECREF(self->cb_type);
+  Py_XDECREF(self->cb_value);
+  Py_XDECREF(self->cb_traceback);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+ * Implementation Notes:
+ *     runs with the GIL held (we are called from inside a callback wrapper).
+ * Once an exception has been stashed, later callbacks are skipped so that the
+ * first error is the one reported.
+ */
+static bool call_py_callback(SimObject *self, PyObject *callback,
+                             uint32_t arg) {
+  if (self->cb_type)
+    return false;
+  PyObject *result = PyObject_CallFunction(callback, "I", arg);
+  if (!result) {
+    PyErr_Fetch(&self->cb_type, &self->cb_value, &self->cb_traceback);
+    return false;
+  }
+  Py_DECREF(result);
+  return true;
+}
+
+/* re-raise a stashed callback exception. Returns NULL if one was pending */
+static PyObject *raise_pending_callback_error(SimObject *self,
+                                              PyObject *result) {
+  if (self->cb_type) {
+    Py_XDECREF(result);
+    PyErr_Restore(self->cb_type, self->cb_value, self->cb_traceback);
+    self->cb_type = self->cb_value = self->cb_traceback = NULL;
+    return NULL;
+  }
+  return result;
+}
+
+static PyObject *Sim_load(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, false))
+    return NULL;
+  const char *in_sim_file;
+  if (!PyArg_ParseTuple(args, "s", &in_sim_file))
+    return NULL;
+  std::string file_name(in_sim_file);
+  bool ok;
+  set_busy(self);
+  Py_BEGIN_ALLOW_THREADS
+  ok = self->sim->load(file_name);
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+  return PyBool_FromLong(ok);
+}
+
+static PyObject *Sim_build(SimObject *self, PyObject *Py_UNUSED(args)) {
+  if (!sim_ready(self, false))
+    return NULL;
+  bool ok;
+  set_busy(self);
+  Py_BEGIN_ALLOW_THREADS
+  ok = self->sim->build();
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+  return PyBool_FromLong(ok);
+}
+
+static PyObject *Sim_save(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, false))
+    return NULL;
+  const char *out_sim_file;
+  if (!PyArg_ParseTuple(args, "s", &out_sim_file))
+    return NULL;
+  std::string file_name(out_sim_file);
+  bool ok;
+  set_busy(self);
+  Py_BEGIN_ALLOW_THREADS
+  ok = self->sim->save(file_name);
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+  return PyBool_FromLong(ok);
+}
+
+static bool valid_plasticity(int plast) {
+  return plast >= OFF && plast <= MAUK_CASCADE;
+}
+
+static bool valid_cell(int cell) { return cell >= CBM_MF && cell <= CBM_NC; }
+
+static PyObject *Sim_set_plasticity(SimObject *self, PyObject *args,
+                                    PyObject *kwds) {
+  if (!sim_ready(self, false))
+    return NULL;
+  static const char *kwlist[] = {"pfpc", "mfnc", "stp", NULL};
+  int pfpc, mfnc, stp = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "ii|p", (char **)kwlist, &pfpc,
+                                   &mfnc, &stp))
+    return NULL;
+  if (!valid_plasticity(pfpc) || !valid_plasticity(mfnc)) {
+    PyErr_SetString(PyExc_ValueError, "invalid plasticity mode");
+    return NULL;
+  }
+  if (!self->sim->set_plasticity((enum plasticity)pfpc, (enum plasticity)mfnc,
+                                 stp)) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "the pf-pc plasticity mode cannot change after load");
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_begin_trial(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, false))
+    return NULL;
+  int use_cs, use_us;
+  if (!PyArg_ParseTuple(args, "pp", &use_cs, &use_us))
+    return NULL;
+  self->sim->begin_trial(use_cs, use_us);
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_set_cs(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, true))
+    return NULL;
+  int on;
+  if (!PyArg_ParseTuple(args, "p", &on))
+    return NULL;
+  self->sim->set_cs(on);
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_set_us(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, true))
+    return NULL;
+  float err_drive = 0.3;
+  if (!PyArg_ParseTuple(args, "|f", &err_drive))
+    return NULL;
+  self->sim->set_us(err_drive);
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_step(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, false))
+    return NULL;
+  unsigned int num_steps = 1;
+  if (!PyArg_ParseTuple(args, "|I", &num_steps))
+    return NULL;
+  if (!self->sim->is_loaded()) {
+    PyErr_SetString(PyExc_RuntimeError, "no simulation loaded or built");
+    return NULL;
+  }
+  set_busy(self);
+  Py_BEGIN_ALLOW_THREADS
+  for (uint32_t i = 0; i < num_steps; i++)
+    self->sim->step();
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+  Py_INCREF(Py_None);
+  return raise_pending_callback_error(self, Py_None);
+}
+
+static PyObject *Sim_run_trial(SimObject *self, PyObject *args,
+                               PyObject *kwds) {
+  if (!sim_ready(self, false))
+    return NULL;
+  static const char *kwlist[] = {"trial_len", "use_cs", "cs_onset", "cs_len",
+                                 "use_us",    "us_onset", NULL};
+  unsigned int trial_len = 5000, cs_onset = 2000, cs_len = 500,
+               us_onset = 2500;
+  int use_cs = 1, use_us = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|IpIIpI", (char **)kwlist,
+                                   &trial_len, &use_cs, &cs_onset, &cs_len,
+                                   &use_us, &us_onset))
+    return NULL;
+  if (!self->sim->is_loaded()) {
+    PyErr_SetString(PyExc_RuntimeError, "no simulation loaded or built");
+    return NULL;
+  }
+  cbm_trial trial = {trial_len,     (bool)use_cs, cs_onset,
+                     cs_len,        (bool)use_us, us_onset};
+  set_busy(self);
+  Py_BEGIN_ALLOW_THREADS
+  self->sim->run_trial(trial);
+  Py_END_ALLOW_THREADS
+  self->busy = false;
+  Py_INCREF(Py_None);
+  return raise_pending_callback_error(self, Py_None);
+}
+
+/*
+ * Implementation Notes:
+ *     the C++ callback owns a reference to the python callable for as long as
+ * it is registered; the shared_ptr's deleter drops it (under the GIL) when
+ * the callbacks are cleared or the sim is destroyed.
+ */
+static std::shared_ptr<PyObject> hold_callable(PyObject *callable) {
+  Py_INCREF(callable);
+  return std::shared_ptr<PyObject>(callable, [](PyObject *obj) {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    Py_DECREF(obj);
+    PyGILState_Release(gstate);
+  });
+}
+
+static PyObject *Sim_on_step(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, false))
+    return NULL;
+  PyObject *callable;
+  if (!PyArg_ParseTuple(args, "O", &callable))
+    return NULL;
+  if (!PyCallable_Check(callable)) {
+    PyErr_SetString(PyExc_TypeError, "callback must be callable");
+    return NULL;
+  }
+  std::shared_ptr<PyObject> held = hold_callable(callable);
+  self->sim->on_step([self, held](CBMSim &, uint32_t ts) {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    call_py_callback(self, held.get(), ts);
+    PyGILState_Release(gstate);
+  });
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_on_trial_end(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, false))
+    return NULL;
+  PyObject *callable;
+  if (!PyArg_ParseTuple(args, "O", &callable))
+    return NULL;
+  if (!PyCallable_Check(callable)) {
+    PyErr_SetString(PyExc_TypeError, "callback must be callable");
+    return NULL;
+  }
+  std::shared_ptr<PyObject> held = hold_callable(callable);
+  self->sim->on_trial_end([self, held](CBMSim &, uint32_t trial) {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    call_py_callback(self, held.get(), trial);
+    PyGILState_Release(gstate);
+  });
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_clear_callbacks(SimObject *self,
+                                     PyObject *Py_UNUSED(args)) {
+  if (!sim_ready(self, false))
+    return NULL;
+  self->sim->clear_callbacks();
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sim_spikes(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, true))
+    return NULL;
+  int cell;
+  if (!PyArg_ParseTuple(args, "i", &cell))
+    return NULL;
+  if (!valid_cell(cell)) {
+    PyErr_SetString(PyExc_ValueError, "invalid cell id");
+    return NULL;
+  }
+  return new_buffer((PyObject *)self, self->sim->spikes((enum cbm_cell)cell),
+                    "B");
+}
+
+static PyObject *Sim_vm(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, true))
+    return NULL;
+  int cell;
+  if (!PyArg_ParseTuple(args, "i", &cell))
+    return NULL;
+  if (!valid_cell(cell)) {
+    PyErr_SetString(PyExc_ValueError, "invalid cell id");
+    return NULL;
+  }
+  return new_buffer((PyObject *)self, self->sim->vm((enum cbm_cell)cell), "f");
+}
+
+static PyObject *Sim_pfpc_weights(SimObject *self, PyObject *Py_UNUSED(args)) {
+  if (!sim_ready(self, true))
+    return NULL;
+  return new_buffer((PyObject *)self, self->sim->pfpc_weights(), "f");
+}
+
+static PyObject *Sim_mfnc_weights(SimObject *self, PyObject *Py_UNUSED(args)) {
+  if (!sim_ready(self, true))
+    return NULL;
+  return new_buffer((PyObject *)self, self->sim->mfnc_weights(), "f");
+}
+
+static PyObject *Sim_num_cells(SimObject *self, PyObject *args) {
+  if (!sim_ready(self, true))
+    return NULL;
+  int cell;
+  if (!PyArg_ParseTuple(args, "i", &cell))
+    return NULL;
+  if (!valid_cell(cell)) {
+    PyErr_SetString(PyExc_ValueError, "invalid cell id");
+    return NULL;
+  }
+  return PyLong_FromUnsignedLong(self->sim->num_cells((enum cbm_cell)cell));
+}
+
+static PyObject *Sim_get_ts(SimObject *self, void *Py_UNUSED(closure)) {
+  if (!sim_ready(self, true))
+    return NULL;
+  return PyLong_FromUnsignedLong(self->sim->get_ts());
+}
+
+static PyObject *Sim_get_trial(SimObject *self, void *Py_UNUSED(closure)) {
+  if (!sim_ready(self, true))
+    return NULL;
+  return PyLong_FromUnsignedLong(self->sim->get_trial());
+}
+
+static PyObject *Sim_get_loaded(SimObject *self, void *Py_UNUSED(closure)) {
+  if (!sim_ready(self, true))
+    return NULL;
+  return PyBool_FromLong(self->sim->is_loaded());
+}
+
+static PyMethodDef Sim_methods[] = {
+    {"load", (PyCFunction)Sim_load, METH_VARARGS,
+     "load(in_sim_file) -> bool: load a simulation from a .sim file"},
+    {"build", (PyCFunction)Sim_build, METH_NOARGS,
+     "build() -> bool: build a new simulation"},
+    {"save", (PyCFunction)Sim_save, METH_VARARGS,
+     "save(out_sim_file) -> bool: write the simulation to a .sim file"},
+    {"set_plasticity", (PyCFunction)(void (*)(void))Sim_set_plasticity,
+     METH_VARARGS | METH_KEYWORDS,
+     "set_plasticity(pfpc, mfnc, stp=False): set plasticity modes. pfpc is "
+     "fixed once a simulation is loaded or built"},
+    {"begin_trial", (PyCFunction)Sim_begin_trial, METH_VARARGS,
+     "begin_trial(use_cs, use_us): start a manually stepped trial"},
+    {"set_cs", (PyCFunction)Sim_set_cs, METH_VARARGS,
+     "set_cs(on): switch the cs on or off from the next step on"},
+    {"set_us", (PyCFunction)Sim_set_us, METH_VARARGS,
+     "set_us(err_drive=0.3): deliver the us at the next step"},
+    {"step", (PyCFunction)Sim_step, METH_VARARGS,
+     "step(num_steps=1): advance by num_steps ms, GIL released"},
+    {"run_trial", (PyCFunction)(void (*)(void))Sim_run_trial,
+     METH_VARARGS | METH_KEYWORDS,
+     "run_trial(trial_len=5000, use_cs=True, cs_onset=2000, cs_len=500, "
+     "use_us=True, us_onset=2500): run a full trial, GIL released"},
+    {"on_step", (PyCFunction)Sim_on_step, METH_VARARGS,
+     "on_step(callback): call callback(ts) after every step"},
+    {"on_trial_end", (PyCFunction)Sim_on_trial_end, METH_VARARGS,
+     "on_trial_end(callback): call callback(trial) after every trial"},
+    {"clear_callbacks", (PyCFunction)Sim_clear_callbacks, METH_NOARGS,
+     "clear_callbacks(): drop all registered callbacks"},
+    {"spikes", (PyCFunction)Sim_spikes, METH_VARARGS,
+     "spikes(cell) -> Buffer of uint8 spikes for the given population"},
+    {"vm", (PyCFunction)Sim_vm, METH_VARARGS,
+     "vm(cell) -> Buffer of float32 membrane potentials (all but MF)"},
+    {"pfpc_weights", (PyCFunction)Sim_pfpc_weights, METH_NOARGS,
+     "pfpc_weights() -> Buffer of float32 pf-pc weights"},
+    {"mfnc_weights", (PyCFunction)Sim_mfnc_weights, METH_NOARGS,
+     "mfnc_weights() -> Buffer of float32 mf-nc weights"},
+    {"num_cells", (PyCFunction)Sim_num_cells, METH_VARARGS,
+     "num_cells(cell) -> number of cells in the given population"},
+    {NULL, NULL, 0, NULL}};
+
+static PyGetSetDef Sim_getset[] = {
+    {"ts", (getter)Sim_get_ts, NULL, "time step within the current trial",
+     NULL},
+    {"trial", (getter)Sim_get_trial, NULL, "number of completed trials", NULL},
+    {"loaded", (getter)Sim_get_loaded, NULL, "whether a sim is loaded", NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
+static PyTypeObject SimType = PyTypeObject();
+
+/* -------------------------------- module --------------------------------- */
+
+static PyModuleDef cbmsim_module = {
+    PyModuleDef_HEAD_INIT,
+    "_cbmsim", /* m_name */
+    "Low-level bindings to libcbmsim. See cbmsim.py for the numpy interface.",
+    -1,   /* m_size */
+    NULL, /* m_methods */
+    NULL, /* m_slots */
+    NULL, /* m_traverse */
+    NULL, /* m_clear */
+    NULL, /* m_free */
+};
+
+PyMODINIT_FUNC PyInit__cbmsim(void) {
+  // PyVarObject_HEAD_INIT ends in a comma, so it can only start a list
+  const PyVarObject type_head[] = {PyVarObject_HEAD_INIT(NULL, 0)};
+  BufferType.ob_base = type_head[0];
+  BufferType.tp_name = "_cbmsim.Buffer";
+  BufferType.tp_basicsize = sizeof(BufferObject);
+  BufferType.tp_dealloc = (destructor)Buffer_dealloc;
+  BufferType.tp_as_buffer = &Buffer_as_buffer;
+  BufferType.tp_as_sequence = &Buffer_as_sequence;
+  BufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+  BufferType.tp_doc = "read-only view into a simulation buffer";
+
+  SimType.ob_base = type_head[0];
+  SimType.tp_name = "_cbmsim.Sim";
+  SimType.tp_basicsize = sizeof(SimObject);
+  SimType.tp_dealloc = (destructor)Sim_dealloc;
+  SimType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE;
+  SimType.tp_doc = "in-process cerebellar simulation";
+  SimType.tp_methods = Sim_methods;
+  SimType.tp_getset = Sim_getset;
+  SimType.tp_init = (initproc)Sim_init;
+  SimType.tp_new = PyType_GenericNew;
+
+  if (PyType_Ready(&BufferType) < 0 || PyType_Ready(&SimType) < 0)
+    return NULL;
+
+  PyObject *m = PyModule_Create(&cbmsim_module);
+  if (!m)
+    return NULL;
+  Py_INCREF(&SimType);
+  Py_INCREF(&BufferType);
+  if (PyModule_AddObject(m, "Sim", (PyObject *)&SimType) < 0 ||
+      PyModule_AddObject(m, "Buffer", (PyObject *)&BufferType) < 0) {
+    Py_DECREF(&SimType);
+    Py_DECREF(&BufferType);
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}
@@ -0,0 +1,186 @@
+"""
+spike_stream.py -- reader for the live spike stream of a running cbm_sim.
+
+cbm_sim publishes one frame per time step to the shared-memory ring
+'/cbm_stream_BASENAME' when run with '-m' (see src/cxx_tools/spike_stream.h for
+the layout, which this module mirrors). The reader never slows the simulation
+down: if it falls a whole ring behind, it skips ahead and counts the frames it
+lost in `dropped`.
+
+Example:
+
+    import spike_stream
+    with spike_stream.SpikeStream("acquisition") as stream:
+        for frame in stream.frames():
+            pc = frame.spikes("PC")  # numpy uint8 array of 0/1
+            print(frame.trial, frame.ts, frame.cr, pc.sum())
+
+Running this file directly prints per-step spike counts of every streamed
+population:
+
+    python3 spike_stream.py BASENAME
+"""
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = b"CBMSTRM1"
+VERSION = 1
+CELL_IDS = ["MF", "GR", "GO", "BC", "SC", "PC", "IO", "NC"]
+ENC_BITS = 0
+ENC_AER = 1
+STATE_DONE = 2
+
+_HEADER = struct.Struct("<8sIIIIQ")  # magic .. slot_offset
+_POPS_OFFSET = 32
+_HEAD_OFFSET = 128
+_STATE_OFFSET = 136
+_SLOT_SEQ_BYTES = 64
+_FRAME = struct.Struct("<QIIfIII")
+_POP = struct.Struct("<IIII")
+_U64 = struct.Struct("<Q")
+_U32 = struct.Struct("<I")
+
+
+def _round8(n):
+    return (n + 7) // 8 * 8
+
+
+class Frame:
+    """One time step: trial, ts, cr and the encoded population blocks."""
+
+    def __init__(self, number, trial, ts, cr, blocks):
+        self.number = number
+        self.trial = trial
+        self.ts = ts
+        self.cr = cr
+        # cell id -> (encoding, num_cells, bytes)
+        self.blocks = blocks
+
+    def spike_count(self, cell):
+        enc, num_cells, data = self.blocks[cell]
+        if enc == ENC_AER:
+            return len(data) // 4
+        return sum(bin(b).count("1") for b in data)
+
+    def spikes(self, cell):
+        """0/1 uint8 numpy array of the given population's spikes."""
+        import numpy as np
+
+        enc, num_cells, data = self.blocks[cell]
+        if enc == ENC_AER:
+            out = np.zeros(num_cells, dtype=np.uint8)
+            out[np.frombuffer(data, dtype="<u4")] = 1
+            return out
+        bits = np.frombuffer(data, dtype=np.uint8)
+        return np.unpackbits(bits, count=num_cells, bitorder="little")
+
+
+class SpikeStream:
+    def __init__(self, basename):
+        path = "/dev/shm/cbm_stream_" + basename
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            self._map = mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        (magic, version, self.num_pops, self.num_slots, self.slot_bytes,
+         self.slot_offset) = _HEADER.unpack_from(self._map, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("%s is not a version %d spike stream"
+                             % (path, VERSION))
+        self.pops = []
+        for i in range(self.num_pops):
+            cell_id, num_cells = struct.unpack_from(
+                "<II", self._map, _POPS_OFFSET + 8 * i)
+            self.pops.append((CELL_IDS[cell_id], num_cells))
+        self.dropped = 0
+        self._next = self._head() + 1
+
+    def close(self):
+        self._map.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def _head(self):
+        return _U64.unpack_from(self._map, _HEAD_OFFSET)[0]
+
+    def done(self):
+        return _U32.unpack_from(self._map, _STATE_OFFSET)[0] == STATE_DONE
+
+    def next(self):
+        """The next frame, or None if the simulation has not produced it."""
+        while True:
+            head = self._head()
+            if self._next > head:
+                return None
+            oldest = head - self.num_slots + 1 if head > self.num_slots else 1
+            if self._next < oldest:
+                self.dropped += oldest - self._next
+                self._next = oldest
+            number = self._next
+            slot = (self.slot_offset
+                    + ((number - 1) % self.num_slots) * self.slot_bytes)
+            seq = _U64.unpack_from(self._map, slot)[0]
+            frame = None
+            if seq == 2 * number:
+                frame = self._decode(slot + _SLOT_SEQ_BYTES)
+            # copy first, then check the writer did not lap us meanwhile
+            if frame is not None and _U64.unpack_from(self._map, slot)[0] == seq:
+                self._next += 1
+                return frame
+            self.dropped += 1
+            self._next += 1
+
+    def _decode(self, offset):
+        number, trial, ts, cr, num_pops, payload_bytes, _ = \
+            _FRAME.unpack_from(self._map, offset)
+        if num_pops != self.num_pops:
+            return None
+        cap = self.slot_bytes - _SLOT_SEQ_BYTES - _FRAME.size
+        offset += _FRAME.size
+        end = offset + min(payload_bytes, cap)
+        blocks = {}
+        for _ in range(num_pops):
+            if offset + _POP.size > end:
+                return None
+            cell_id, enc, num_cells, num_bytes = _POP.unpack_from(
+                self._map, offset)
+            offset += _POP.size
+            if cell_id >= len(CELL_IDS) or offset + num_bytes > end:
+                return None
+            blocks[CELL_IDS[cell_id]] = (
+                enc, num_cells, self._map[offset:offset + num_bytes])
+            offset += _round8(num_bytes)
+        return Frame(number, trial, ts, cr, blocks)
+
+    def frames(self, poll_interval=0.001):
+        """Yields frames until the simulation is done."""
+        while True:
+            frame = self.next()
+            if frame is not None:
+                yield frame
+            elif self.done():
+                return
+            else:
+                time.sleep(poll_interval)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("usage: %s BASENAME" % sys.argv[0])
+    with SpikeStream(sys.argv[1]) as stream:
+        names = [name for name, _ in stream.pops]
+        print("trial ts cr " + " ".join(names))
+        for frame in stream.frames():
+            counts = " ".join(str(frame.spike_count(n)) for n in names)
+            print("%d %d %.3f %s" % (frame.trial + 1, frame.ts, frame.cr,
+                                     counts))
+        print("dropped %d frames" % stream.dropped, file=sys.stderr)
@@ -0,0 +1,293 @@
+#!/usr/bin/env python3
+"""
+run_bench.py -- end-to-end benchmark scenarios for cbm_sim.
+
+Runs each scenario in scenarios.json as a real session of the release binary
+and reports, per scenario:
+
+    sim_ms_per_s  simulated milliseconds per wall-clock second, over the trials
+    startup_s     wall time from launch to the start of the first trial
+    peak_rss_mb   peak resident set size of the process
+    output_mb     bytes written to data/outputs/bench_NAME
+
+Every run is deterministic: the bunny is built, and every session run, with
+the fixed seed in scenarios.json ('-e'), so differences between two runs of
+the same binary come from the machine, not the network.
+
+Budgets are per machine (throughput depends on the GPU), so they live in a
+budgets file rather than in scenarios.json. Calibrate once on a known-good
+build, then check later builds against it:
+
+    python3 scripts/bench/run_bench.py --calibrate       # writes budgets.json
+    python3 scripts/bench/run_bench.py                   # fails on regression
+    python3 scripts/bench/run_bench.py -k small          # only 'small*' runs
+    python3 scripts/bench/run_bench.py --dry-run         # no simulation
+
+The script exits with 1 if any scenario misses a budget, 2 if a run fails.
+"""
+
+import argparse
+import fnmatch
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.normpath(os.path.join(BENCH_DIR, "..", ".."))
+BUILD_DIR = os.path.join(ROOT, "build")
+INPUT_DIR = os.path.join(ROOT, "data", "inputs")
+OUTPUT_DIR = os.path.join(ROOT, "data", "outputs")
+SESSION_DIR = os.path.join(INPUT_DIR, "bench")
+BUNNY = "bench_bunny"
+
+# mirrors Control::trialTime (src/control.h)
+TRIAL_MS = 5000
+
+# metric -> (budget key, True if larger is better)
+METRICS = {
+    "sim_ms_per_s": ("min_sim_ms_per_s", True),
+    "startup_s": ("max_startup_s", False),
+    "peak_rss_mb": ("max_peak_rss_mb", False),
+    "output_mb": ("max_output_mb", False),
+}
+
+TRIAL_START_RE = re.compile(r"Trial number: (\d+)")
+TRIAL_TOOK_RE = re.compile(r"'[^']*' took ([0-9.]+)s")
+
+
+def session_json(config, size):
+    return {
+        "trials": config["trials"],
+        "blocks": {},
+        "session": config["sizes"][size],
+    }
+
+
+def num_trials(config, size):
+    return sum(n for item in config["sizes"][size] for n in item.values())
+
+
+def dir_bytes(path):
+    total = 0
+    for dirpath, _, filenames in os.walk(path):
+        for name in filenames:
+            total += os.path.getsize(os.path.join(dirpath, name))
+    return total
+
+
+def run_cbm_sim(binary, args, verbose):
+    """Runs cbm_sim from the build directory, as its data paths expect.
+
+    Returns (exit status, stderr lines with their arrival time relative to
+    launch, peak rss in kB, wall time).
+    """
+    start = time.monotonic()
+    proc = subprocess.Popen([binary] + args, cwd=BUILD_DIR,
+                            stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE, text=True)
+    lines = []
+    for line in proc.stderr:
+        lines.append((time.monotonic() - start, line.rstrip("\n")))
+        if verbose:
+            sys.stderr.write(line)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    wall = time.monotonic() - start
+    # wait4 reaped the child, so tell Popen not to try again
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    proc.stderr.close()
+    return proc.returncode, lines, rusage.ru_maxrss, wall
+
+
+def build_bunny(binary, seed, verbose):
+    shutil.rmtree(os.path.join(OUTPUT_DIR, BUNNY), ignore_errors=True)
+    status, _, _, wall = run_cbm_sim(
+        binary, ["-o", BUNNY, "-e", str(seed)], verbose)
+    if status != 0:
+        sys.exit("building the benchmark bunny failed with status %d" % status)
+    print("built %s in %.1fs" % (BUNNY, wall))
+
+
+def run_scenario(binary, config, scenario, verbose):
+    name = scenario["name"]
+    basename = "bench_" + name
+    sess_file = basename + ".json"
+    out_dir = os.path.join(OUTPUT_DIR, basename)
+    shutil.rmtree(out_dir, ignore_errors=True)
+    args = (["-s", sess_file, "-i", BUNNY + ".sim", "-o", basename,
+             "-e", str(config["seed"])]
+            + config["plasticity"][scenario["plasticity"]]
+            + config["recording"][scenario["recording"]])
+    status, lines, max_rss_kb, wall = run_cbm_sim(binary, args, verbose)
+    if status != 0:
+        for _, line in lines[-20:]:
+            print("    " + line, file=sys.stderr)
+        return None
+
+    startup = None
+    trial_secs = []
+    for t, line in lines:
+        if startup is None and TRIAL_START_RE.search(line):
+            startup = t
+        took = TRIAL_TOOK_RE.search(line)
+        if took:
+            trial_secs.append(float(took.group(1)))
+    expected = num_trials(config, scenario["size"])
+    if len(trial_secs) != expected:
+        print("%s: expected %d trials, saw %d" % (name, expected,
+                                                   len(trial_secs)),
+              file=sys.stderr)
+        return None
+    sim_secs = sum(trial_secs)
+    return {
+        "trials": expected,
+        "wall_s": wall,
+        "sim_ms_per_s": expected * TRIAL_MS / sim_secs if sim_secs else 0.0,
+        "startup_s": startup,
+        "peak_rss_mb": max_rss_kb / 1024.0,
+        "output_mb": dir_bytes(out_dir) / (1024.0 * 1024.0),
+    }
+
+
+def check_budgets(name, result, budgets):
+    """Returns the list of budget violations of one scenario."""
+    failures = []
+    for metric, (key, larger_is_better) in METRICS.items():
+        limit = budgets.get(key)
+        if limit is None:
+            continue
+        value = result[metric]
+        if (value < limit) if larger_is_better else (value > limit):
+            failures.append("%s: %s = %.3f, budget %s %.3f"
+                            % (name, metric, value,
+                               ">=" if larger_is_better else "<=", limit))
+    return failures
+
+
+def calibrate(results, headroom):
+    budgets = {}
+    for name, result in results.items():
+        entry = {}
+        for metric, (key, larger_is_better) in METRICS.items():
+            scale = (1.0 - headroom) if larger_is_better else (1.0 + headroom)
+            entry[key] = round(result[metric] * scale, 3)
+        budgets[name] = entry
+    return budgets
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run the cbm_sim benchmark scenarios.")
+    parser.add_argument("-k", "--scenario", action="append", default=[],
+                        help="only run scenarios matching this glob "
+                             "(repeatable; default: all)")
+    parser.add_argument("--binary", default=os.path.join(BUILD_DIR, "cbm_sim"),
+                        help="cbm_sim executable (default: build/cbm_sim)")
+    parser.add_argument("--config", default=os.path.join(BENCH_DIR,
+                                                         "scenarios.json"))
+    parser.add_argument("--budgets", default=os.path.join(BENCH_DIR,
+                                                          "budgets.json"),
+                        help="per-machine budgets file")
+    parser.add_argument("--calibrate", action="store_true",
+                        help="write the budgets file from this run instead "
+                             "of checking against it")
+    parser.add_argument("--headroom", type=float, default=0.15,
+                        help="fractional slack given to calibrated budgets")
+    parser.add_argument("--json", help="also write the results to this file")
+    parser.add_argument("--dry-run", action="store_true",
+                        help="write the session files and print the commands "
+                             "without running anything")
+    parser.add_argument("--list", action="store_true",
+                        help="list the scenarios and exit")
+    parser.add_argument("--verbose", action="store_true",
+                        help="echo cbm_sim's log")
+    args = parser.parse_args()
+
+    with open(args.config) as f:
+        config = json.load(f)
+    scenarios = [s for s in config["scenarios"]
+                 if not args.scenario
+                 or any(fnmatch.fnmatch(s["name"], p) for p in args.scenario)]
+    if args.list:
+        for s in config["scenarios"]:
+            print("%-22s %-7s %-8s %-5s %3d trials"
+                  % (s["name"], s["size"], s["plasticity"], s["recording"],
+                     num_trials(config, s["size"])))
+        return 0
+    if not scenarios:
+        sys.exit("no scenario matches %s" % args.scenario)
+
+    os.makedirs(SESSION_DIR, exist_ok=True)
+    for s in scenarios:
+        with open(os.path.join(SESSION_DIR, "bench_%s.json" % s["name"]),
+                  "w") as f:
+            json.dump(session_json(config, s["size"]), f, indent=3)
+
+    if args.dry_run:
+        print("cd %s" % BUILD_DIR)
+        print("%s -o %s -e %d" % (args.binary, BUNNY, config["seed"]))
+        for s in scenarios:
+            print(" ".join([args.binary, "-s", "bench_%s.json" % s["name"],
+                            "-i", BUNNY + ".sim", "-o", "bench_" + s["name"],
+                            "-e", str(config["seed"])]
+                           + config["plasticity"][s["plasticity"]]
+                           + config["recording"][s["recording"]]))
+        return 0
+
+    if not os.access(args.binary, os.X_OK):
+        sys.exit("%s not found: build the release target first ('make')"
+                 % args.binary)
+    budgets = {}
+    if not args.calibrate and os.path.exists(args.budgets):
+        with open(args.budgets) as f:
+            budgets = json.load(f)
+
+    build_bunny(args.binary, config["seed"], args.verbose)
+    print("%-22s %12s %10s %12s %10s"
+          % ("scenario", "sim ms/s", "startup s", "peak rss MB", "output MB"))
+    results = {}
+    failures = []
+    run_failed = False
+    for s in scenarios:
+        result = run_scenario(args.binary, config, s, args.verbose)
+        if result is None:
+            print("%-22s FAILED" % s["name"])
+            run_failed = True
+            continue
+        results[s["name"]] = result
+        print("%-22s %12.1f %10.2f %12.1f %10.1f"
+              % (s["name"], result["sim_ms_per_s"], result["startup_s"],
+                 result["peak_rss_mb"], result["output_mb"]))
+        failures += check_budgets(s["name"], result,
+                                  budgets.get(s["name"], {}))
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=3)
+    if args.calibrate:
+        # keep the budgets of scenarios that were not run this time
+        old = {}
+        if os.path.exists(args.budgets):
+            with open(args.budgets) as f:
+                old = json.load(f)
+        old.update(calibrate(results, args.headroom))
+        with open(args.budgets, "w") as f:
+            json.dump(old, f, indent=3, sort_keys=True)
+        print("wrote budgets for %d scenarios to %s"
+              % (len(results), args.budgets))
+    elif not budgets:
+        print("no budgets in %s: run with --calibrate on a known-good build"
+              % args.budgets)
+
+    for failure in failures:
+        print("REGRESSION " + failure)
+    if run_failed:
+        return 2
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
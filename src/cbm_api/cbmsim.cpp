@@ -0,0 +1,290 @@
+/** @file cbmsim.cpp
+ *  @brief Implementation of the in-process simulation interface.
+ *
+ *  @author Sean Gallogly (sean.gallo@austin.utexas.edu)
+ */
+
+#include <omp.h>
+
+#include "cbmsim.h"
+#include "direct_out.h"
+#include "logger.h"
+
+/*
+ * Implementation Notes:
+ *     the logger asserts when it is used before being initialized, and an
+ * embedding program has no reason to know that. If the caller has not set up
+ * a logger of its own, log to stderr.
+ */
+CBMSim::CBMSim(uint32_t gpu_index, uint32_t gpu_p2)
+    : gpu_index(gpu_index), gpu_p2(gpu_p2) {
+  if (!logger_isInitialized())
+    logger_initConsoleLogger(stderr);
+}
+
+CBMSim::~CBMSim() {
+  if (sim_core)
+    delete sim_core;
+  if (sim_state)
+    delete sim_state;
+  if (mfs)
+    delete mfs;
+}
+
+/*
+ * Implementation Notes:
+ *     same read order as Control::init_sim: mossy fibers, then state.
+ */
+bool CBMSim::load(std::string in_sim_file) {
+  if (mfs || sim_state) {
+    LOG_ERROR("A simulation is already loaded.");
+    return false;
+  }
+  std::fstream sim_file_buf(in_sim_file.c_str(),
+                            std::ios::in | std::ios::binary);
+  if (!sim_file_buf.is_open()) {
+    LOG_ERROR("Could not open simulation file '%s'.", in_sim_file.c_str());
+    return false;
+  }
+  LOG_DEBUG("Loading simulation from '%s'...", in_sim_file.c_str());
+  mfs = new ECMFPopulation(sim_file_buf);
+  sim_state = new CBMState(num_zones, pf_pc_plast, sim_file_buf);
+  sim_file_buf.close();
+  init_core();
+  return true;
+}
+
+bool CBMSim::build() {
+  if (mfs || sim_state) {
+    LOG_ERROR("A simulation is already loaded.");
+    return false;
+  }
+  mfs = new ECMFPopulation();
+  sim_state = new CBMState(num_zones);
+  init_core();
+  return true;
+}
+
+void CBMSim::init_core() {
+  // InNet's host loops use schedule(runtime): keep them on the even static
+  // split, and leave the thread count to the embedding program
+  omp_set_schedule(omp_sched_static, 0);
+  sim_core = new CBMSimCore(sim_state, gpu_index, gpu_p2);
+  mf_ap = mfs->getAPs();
+  sim_core->setTrueMFs(mfs->getCollIds());
+  ts = 0;
+  trial = 0;
+}
+
+bool CBMSim::save(std::string out_sim_file) {
+  if (!sim_core) {
+    LOG_ERROR("Trying to save an uninitialized simulation.");
+    return false;
+  }
+  DirectOutBuf sim_out_buf;
+  if (!sim_out_buf.open(out_sim_file))
+    return false;
+  std::fstream out_sim_file_buf;
+  attach_direct_out(out_sim_file_buf, sim_out_buf);
+  mfs->writeToFile(out_sim_file_buf);
+  sim_core->writeState(out_sim_file_buf);
+  return sim_out_buf.close();
+}
+
+/*
+ * Implementation Notes:
+ *     load hands the pf-pc mode to CBMState, which initializes the cascade
+ * synapse variables from it. Switching to another mode afterwards would step
+ * a state that was never set up for it, so refuse that instead.
+ */
+bool CBMSim::set_plasticity(enum plasticity pfpc, enum plasticity mfnc,
+                            bool stp) {
+  if (sim_core && pfpc != pf_pc_plast) {
+    LOG_ERROR("Cannot change the pf-pc plasticity mode of a loaded "
+              "simulation.");
+    return false;
+  }
+  pf_pc_plast = pfpc;
+  mf_nc_plast = mfnc;
+  stp_on = stp;
+  return true;
+}
+
+void CBMSim::begin_trial(bool use_cs, bool use_us) {
+  trial_use_cs = use_cs;
+  trial_use_us = use_us;
+  cs_on = false;
+  us_pending = false;
+  ts = 0;
+}
+
+void CBMSim::set_cs(bool on) { cs_on = on; }
+
+void CBMSim::set_us(float err_drive) {
+  us_err_drive = err_drive;
+  us_pending = true;
+}
+
+/*
+ * Implementation Notes:
+ *     mirrors the body of the time step loop in Control::runSession.
+ */
+void CBMSim::step() {
+  if (us_pending) {
+    sim_core->updateErrDrive(0, us_err_drive);
+    us_pending = false;
+  }
+  mfs->calcGammaActivity(cs_on ? CS : BKGD, sim_core->getMZoneList());
+  sim_core->updateMFInput(mf_ap);
+  sim_core->calcActivity(spill_frac, pf_pc_plast, mf_nc_plast, trial_use_cs,
+                         trial_use_us, stp_on);
+  for (auto &callback : step_callbacks)
+    callback(*this, ts);
+  ts++;
+}
+
+void CBMSim::run_trial(const cbm_trial &trial_def) {
+  begin_trial(trial_def.use_cs, trial_def.use_us);
+  for (uint32_t t = 0; t < trial_def.trial_len; t++) {
+    if (trial_def.use_us && t == trial_def.us_onset)
+      set_us();
+    set_cs(trial_def.use_cs && t >= trial_def.cs_onset &&
+           t < trial_def.cs_onset + trial_def.cs_len);
+    step();
+  }
+  cs_on = false;
+  for (auto &callback : trial_callbacks)
+    callback(*this, trial);
+  trial++;
+}
+
+void CBMSim::on_step(cbm_step_callback callback) {
+  step_callbacks.push_back(callback);
+}
+
+void CBMSim::on_trial_end(cbm_trial_callback callback) {
+  trial_callbacks.push_back(callback);
+}
+
+void CBMSim::clear_callbacks() {
+  step_callbacks.clear();
+  trial_callbacks.clear();
+}
+
+uint32_t CBMSim::num_cells(enum cbm_cell cell) const {
+  switch (cell) {
+  case CBM_MF:
+    return num_mf;
+  case CBM_GR:
+    return num_gr;
+  case CBM_GO:
+    return num_go;
+  case CBM_BC:
+    return num_bc;
+  case CBM_SC:
+    return num_sc;
+  case CBM_PC:
+    return num_pc;
+  case CBM_IO:
+    return num_io;
+  case CBM_NC:
+    return num_nc;
+  }
+  return 0;
+}
+
+/*
+ * Implementation Notes:
+ *     granule spikes live on the device, so exportAPGR copies them into the
+ * host buffer owned by InNet before we return a pointer to it. Every other
+ * population is computed on the host, so its pointer is returned as-is.
+ */
+cbm_view<uint8_t> CBMSim::spikes(enum cbm_cell cell) {
+  cbm_view<uint8_t> view = {NULL, 0};
+  if (!sim_core)
+    return view;
+  switch (cell) {
+  case CBM_MF:
+    view.data = mf_ap;
+    break;
+  case CBM_GR:
+    view.data = sim_core->getInputNet()->exportAPGR();
+    break;
+  case CBM_GO:
+    view.data = sim_core->getInputNet()->exportAPGO();
+    break;
+  case CBM_BC:
+    view.data = sim_core->getMZoneList()[0]->exportAPBC();
+    break;
+  case CBM_SC:
+    view.data = sim_core->getMZoneList()[0]->exportAPSC();
+    break;
+  case CBM_PC:
+    view.data = sim_core->getMZoneList()[0]->exportAPPC();
+    break;
+  case CBM_IO:
+    view.data = sim_core->getMZoneList()[0]->exportAPIO();
+    break;
+  case CBM_NC:
+    view.data = sim_core->getMZoneList()[0]->exportAPNC();
+    break;
+  }
+  view.size = num_cells(cell);
+  return view;
+}
+
+/*
+ * Implementation Notes:
+ *     mossy fibers have no membrane potential and get an empty view. Granule
+ * potentials live on the gpus and are copied back on every call.
+ */
+cbm_view<float> CBMSim::vm(enum cbm_cell cell) {
+  cbm_view<float> view = {NULL, 0};
+  if (!sim_core)
+    return view;
+  switch (cell) {
+  case CBM_GR:
+    view.data = sim_core->getInputNet()->exportVmGR();
+    break;
+  case CBM_GO:
+    view.data = sim_core->getInputNet()->exportVmGO();
+    break;
+  case CBM_BC:
+    view.data = sim_core->getMZoneList()[0]->exportVmBC();
+    break;
+  case CBM_SC:
+    view.data = sim_core->getMZoneList()[0]->exportVmSC();
+    break;
+  case CBM_PC:
+    view.data = sim_core->getMZoneList()[0]->exportVmPC();
+    break;
+  case CBM_IO:
+    view.data = sim_core->getMZoneList()[0]->exportVmIO();
+    break;
+  case CBM_NC:
+    view.data = sim_core->getMZoneList()[0]->exportVmNC();
+    break;
+  default:
+    return view;
+  }
+  view.size = num_cells(cell);
+  return view;
+}
+
+cbm_view<float> CBMSim::pfpc_weights() {
+  cbm_view<float> view = {NULL, 0};
+  if (!sim_core)
+    return view;
+  view.data = sim_core->getMZoneList()[0]->exportPFPCWeights();
+  view.size = num_gr;
+  return view;
+}
+
+cbm_view<float> CBMSim::mfnc_weights() {
+  cbm_view<float> view = {NULL, 0};
+  if (!sim_core)
+    return view;
+  view.data = sim_core->getMZoneList()[0]->exportMFDCNWeights();
+  view.size = (uint64_t)num_nc * num_p_nc_from_mf_to_nc;
+  return view;
+}
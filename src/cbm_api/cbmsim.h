@@ -0,0 +1,191 @@
+/** @file cbmsim.h
+ *  @brief In-process interface to the simulation, built into libcbmsim.
+ *
+ *  Unlike Control, CBMSim never creates directories or writes output files
+ *  on its own: it owns the mossy fiber population, the simulation state and
+ *  the simulation core, and hands callers read-only views into their buffers.
+ *  Views point straight at the arrays the core already keeps on the host, so
+ *  reading one costs nothing beyond, for granule spikes, granule membrane
+ *  potentials and pf-pc weights, the device-to-host copy that the core itself
+ *  performs on export.
+ *
+ *  A view is only valid until the next call to step (or until the object is
+ *  destroyed): copy the data out if it needs to outlive that.
+ *
+ *  @author Sean Gallogly (sean.gallo@austin.utexas.edu)
+ */
+
+#ifndef _CBMSIM_H
+#define _CBMSIM_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "cbmsimcore.h"
+#include "cbmstate.h"
+#include "ecmfpopulation.h"
+
+/*
+ * cell populations addressable through the api. Kept separate from Control's
+ * cell_id so that the library does not depend on control.h
+ */
+enum cbm_cell { CBM_MF, CBM_GR, CBM_GO, CBM_BC, CBM_SC, CBM_PC, CBM_IO, CBM_NC };
+
+/*
+ * read-only, borrowed view into a buffer owned by the simulation. size is a
+ * count of elements, not bytes.
+ */
+template <typename Type> struct cbm_view {
+  const Type *data;
+  uint64_t size;
+};
+
+/*
+ * trial description for CBMSim::run_trial. Times are in ms from the start of
+ * the trial, as in the session file.
+ */
+typedef struct {
+  uint32_t trial_len;
+  bool use_cs;
+  uint32_t cs_onset;
+  uint32_t cs_len;
+  bool use_us;
+  uint32_t us_onset;
+} cbm_trial;
+
+class CBMSim;
+
+typedef std::function<void(CBMSim &sim, uint32_t ts)> cbm_step_callback;
+typedef std::function<void(CBMSim &sim, uint32_t trial)> cbm_trial_callback;
+
+/** @class CBMSim cbmsim.h "src/cbm_api/cbmsim.h"
+ *  @brief Drives a single simulation in-process: load or build, step, run
+ *  trials and observe buffers without any intermediate file i/o.
+ */
+class CBMSim {
+public:
+  /**
+   *  @brief Construct an empty simulation. Call load or build before
+   *  stepping.
+   *  @param gpu_index Index of the first gpu to use.
+   *  @param gpu_p2 Log base 2 of the number of gpus to use.
+   */
+  CBMSim(uint32_t gpu_index = 0, uint32_t gpu_p2 = 2);
+  ~CBMSim();
+
+  /**
+   *  @brief Load a simulation from a .sim file.
+   *  @param in_sim_file Path to the input simulation file.
+   *  @return false if the file could not be opened or a sim is already loaded.
+   */
+  bool load(std::string in_sim_file);
+
+  /**
+   *  @brief Build a new simulation from the current connectivity and activity
+   *  parameters, ready to be stepped.
+   *  @return false if a sim is already loaded.
+   */
+  bool build();
+
+  /**
+   *  @brief Write the current simulation to a .sim file. This is the only
+   *  method that touches the filesystem, and only when asked to.
+   *  @param out_sim_file Path to the output simulation file.
+   *  @return false if there is no sim or the file could not be opened.
+   */
+  bool save(std::string out_sim_file);
+
+  /**
+   *  @brief Set plasticity modes used by subsequent steps. The pf-pc mode
+   *  also decides how load sets up the pf-pc synapses, so set it before
+   *  calling load or build: once a sim is loaded it can no longer change.
+   *  The mf-nc and stp modes can be changed at any time.
+   *  @return false if a sim is loaded and pfpc differs from its mode.
+   */
+  bool set_plasticity(enum plasticity pfpc, enum plasticity mfnc, bool stp);
+
+  /**
+   *  @brief Start a new trial: resets the in-trial time step and records the
+   *  trial-level cs/us flags used by short-term plasticity.
+   */
+  void begin_trial(bool use_cs, bool use_us);
+
+  /**
+   *  @brief Switch the conditioned stimulus (cs mossy fiber input) on or off
+   *  from the next step on.
+   */
+  void set_cs(bool on);
+
+  /**
+   *  @brief Deliver the unconditioned stimulus (error drive to the inferior
+   *  olive) at the next step.
+   *  @param err_drive Relative error drive. 0.3 is what Control delivers.
+   */
+  void set_us(float err_drive = 0.3);
+
+  /**
+   *  @brief Advance the simulation by one 1ms time step, then run all
+   *  registered step callbacks.
+   */
+  void step();
+
+  /**
+   *  @brief Run a full trial, switching the cs and us according to the given
+   *  description, then run all registered trial callbacks.
+   */
+  void run_trial(const cbm_trial &trial);
+
+  /* callbacks are run in the order they were registered */
+  void on_step(cbm_step_callback callback);
+  void on_trial_end(cbm_trial_callback callback);
+  void clear_callbacks();
+
+  /* read-only views. See file description for their lifetime */
+  cbm_view<uint8_t> spikes(enum cbm_cell cell);
+  cbm_view<float> vm(enum cbm_cell cell);
+  cbm_view<float> pfpc_weights();
+  cbm_view<float> mfnc_weights();
+
+  uint32_t num_cells(enum cbm_cell cell) const;
+  uint32_t get_ts() const { return ts; }
+  uint32_t get_trial() const { return trial; }
+  bool is_loaded() const { return sim_core != NULL; }
+
+  /* escape hatches for callers that need the full core interface */
+  CBMSimCore *get_sim_core() { return sim_core; }
+  CBMState *get_sim_state() { return sim_state; }
+  ECMFPopulation *get_mfs() { return mfs; }
+
+private:
+  uint32_t gpu_index;
+  uint32_t gpu_p2;
+  uint32_t num_zones = 1;
+
+  ECMFPopulation *mfs = NULL;
+  CBMState *sim_state = NULL;
+  CBMSimCore *sim_core = NULL;
+  const uint8_t *mf_ap = NULL;
+
+  enum plasticity pf_pc_plast = OFF;
+  enum plasticity mf_nc_plast = OFF;
+  bool stp_on = false;
+  float spill_frac = 0.15;
+
+  bool cs_on = false;
+  bool us_pending = false;
+  float us_err_drive = 0.3;
+  bool trial_use_cs = false;
+  bool trial_use_us = false;
+
+  uint32_t ts = 0;
+  uint32_t trial = 0;
+
+  std::vector<cbm_step_callback> step_callbacks;
+  std::vector<cbm_trial_callback> trial_callbacks;
+
+  void init_core();
+};
+
+#endif /* _CBMSIM_H */
@@ -6,7 +6,9 @@
  */
 
 #include "cbmsimcore.h"
+#include "file_utility.h"
 #include "logger.h"
+#include "rng_seed.h"
 
 //#define NO_ASYNC
 //#define DISP_CUDA_ERR
@@ -14,7 +16,7 @@
 CBMSimCore::CBMSimCore() {}
 
 CBMSimCore::CBMSimCore(CBMState *state, int gpuIndStart, int numGPUP2) {
-  CRandomSFMT0 randGen(time(0));
+  CRandomSFMT0 randGen(next_rng_seed());
   int *mzoneRSeed = new int[state->getNumZones()];
 
   for (int i = 0; i < state->getNumZones(); i++) {
@@ -56,9 +58,34 @@ void CBMSimCore::writeToState() {
   }
 }
 
-void CBMSimCore::writeState(std::fstream &outfile) {
+void CBMSimCore::writeState(std::fstream &outfile, bool thin) {
   writeToState();
-  simState->writeState(outfile); // using internal cp
+  simState->writeState(outfile, thin); // using internal cp
+  for (int i = 0; i < numZones; i++) {
+    zones[i]->restoreLazyNCConductances();
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     the split of the granules over the gpus decides both the layout of the
+ * device state and the order of the sums over it, so a checkpoint is only
+ * restored onto as many gpus as it was written from.
+ */
+void CBMSimCore::checkpointRW(std::fstream &file, bool read) {
+  uint32_t fileNumGPUs = numGPUs;
+  rawBytesRW((char *)&fileNumGPUs, sizeof(uint32_t), read, file);
+  if (read && fileNumGPUs != (uint32_t)numGPUs) {
+    LOG_FATAL("Checkpoint was written from %u gpus, but %d are in use. "
+              "Exiting...",
+              fileNumGPUs, numGPUs);
+    exit(1);
+  }
+  rawBytesRW((char *)&curTime, sizeof(uint32_t), read, file);
+  inputNet->checkpointRW(file, read);
+  for (int i = 0; i < numZones; i++) {
+    zones[i]->checkpointRW(file, read);
+  }
 }
 
 void CBMSimCore::initCUDAStreams() {
@@ -96,17 +123,17 @@ void CBMSimCore::initCUDAStreams() {
 
 void CBMSimCore::initAuxVars() { curTime = 0; }
 
-void CBMSimCore::syncCUDA(std::string title) {
+void CBMSimCore::syncCUDA(const char *title) {
   cudaError_t error;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
 #ifdef DISP_CUDA_ERR
-    LOG_TRACE("sync point  %s, switching to gpu %d", title.c_str(), i);
+    LOG_TRACE("sync point  %s, switching to gpu %d", title, i);
     LOG_TRACE("%s", cudaGetErrorString(error));
 #endif
     error = cudaDeviceSynchronize();
 #ifdef DISP_CUDA_ERR
-    LOG_TRACE("sync point  %s, switching to gpu %d", title.c_str(), i);
+    LOG_TRACE("sync point  %s, switching to gpu %d", title, i);
     LOG_TRACE("%s", cudaGetErrorString(error));
 #endif
   }
@@ -119,8 +146,8 @@ void CBMSimCore::calcActivity(float spillFrac, enum plasticity pf_pc_plast,
 
   curTime++;
 
-  // cp mf spike activity to gpu
-  inputNet->cpyAPMFHosttoGPUCUDA(streams, 6);
+  // cp mf spike activity to gpu, on the stream that pushes it to gr below
+  inputNet->cpyAPMFHosttoGPUCUDA(streams, 0);
   // update mf -> gr synaptic variables
   inputNet->updateMFtoGROut();
   // cpy mf -> gr depression amplitude to gpu
@@ -158,8 +185,8 @@ void CBMSimCore::calcActivity(float spillFrac, enum plasticity pf_pc_plast,
       streams, 2); // NOTE: currently does nothing (08/11/2022)
   // copy dynamic amplitude from host to device
   inputNet->cpyDynamicAmpGOGRHosttoGPUCUDA(streams, 3);
-  // copy go spikes to device
-  inputNet->cpyAPGOHosttoGPUCUDA(streams, 7);
+  // copy go spikes to device, on the stream that pushes them to gr below
+  inputNet->cpyAPGOHosttoGPUCUDA(streams, 1);
 
   // syncCUDA("2");
   // run update input function go -> gr synapse
@@ -41,7 +41,11 @@ public:
   void updateErrDrive(unsigned int zoneN, float errDriveRelative);
 
   void writeToState();
-  void writeState(std::fstream &outfile);
+  void writeState(std::fstream &outfile, bool thin = false);
+  // reads or writes the runtime state that writeState leaves out: the step
+  // counter, the generators and the device-only state. A checkpoint is a
+  // (thin) sim written with writeState plus this, written right after it
+  void checkpointRW(std::fstream &file, bool read);
 
   InNet *getInputNet();
   MZone **getMZoneList();
@@ -50,7 +54,7 @@ protected:
   void initCUDAStreams();
   void initAuxVars();
 
-  void syncCUDA(std::string title);
+  void syncCUDA(const char *title);
 
   CBMState *simState;
 
@@ -0,0 +1,59 @@
+/*
+ * File: device_rw.h
+ *
+ * Description:
+ *     This is the interface file for reading and writing arrays that are kept
+ * once per gpu, such as the per-granule device state of InNet and MZone. Used
+ * by the checkpoints of the runtime state (see CBMSimCore::checkpointRW),
+ * which hold what the sim file does not: every gpu's slice is written in gpu
+ * order, so the slices of a per-granule array make up the whole population.
+ */
+#ifndef DEVICE_RW_H_
+#define DEVICE_RW_H_
+
+#include <cstdint>
+#include <cuda.h>
+#include <cuda_runtime.h>
+#include <fstream>
+#include <vector>
+
+#include "file_utility.h"
+
+/*
+ * Description:
+ *     reads into or writes from the device arrays gpuData[0..numGPUs), each
+ * numPerGPU elements long, through a host buffer. Synchronous: on return,
+ * the device arrays hold what was read.
+ */
+template <typename Type>
+void deviceArraysRW(Type **gpuData, uint64_t numPerGPU, int numGPUs,
+                    int gpuIndStart, bool read, std::fstream &file) {
+  std::vector<Type> hostBuf(numPerGPU);
+  uint64_t numBytes = numPerGPU * sizeof(Type);
+  for (int i = 0; i < numGPUs; i++) {
+    cudaSetDevice(i + gpuIndStart);
+    if (read) {
+      rawBytesRW((char *)hostBuf.data(), numBytes, true, file);
+      cudaMemcpy(gpuData[i], hostBuf.data(), numBytes,
+                 cudaMemcpyHostToDevice);
+    } else {
+      cudaMemcpy(hostBuf.data(), gpuData[i], numBytes,
+                 cudaMemcpyDeviceToHost);
+      rawBytesRW((char *)hostBuf.data(), numBytes, false, file);
+    }
+  }
+}
+
+/*
+ * Description:
+ *     reads into or writes from the host arrays hostData[0..numGPUs), each
+ * numPerGPU elements long, such as the pinned staging arrays of each gpu.
+ */
+template <typename Type>
+void perGPUHostArraysRW(Type **hostData, uint64_t numPerGPU, int numGPUs,
+                        bool read, std::fstream &file) {
+  for (int i = 0; i < numGPUs; i++)
+    rawBytesRW((char *)hostData[i], numPerGPU * sizeof(Type), read, file);
+}
+
+#endif /* DEVICE_RW_H_ */
@@ -8,9 +8,11 @@
 
 #include <iostream>
 #include <math.h>
+#include <vector>
 
 #include "activityparams.h"
 #include "connectivityparams.h"
+#include "device_rw.h"
 #include "dynamic2darray.h"
 #include "innet.h"
 #include "logger.h"
@@ -30,6 +32,10 @@ InNet::InNet(InNetConnectivityState *cs, InNetActivityState *as,
   this->gpuIndStart = gpuIndStart;
   this->numGPUs = numGPUs;
 
+  procedural = cs->procedural;
+  if (procedural)
+    proceduralParams = cs->proceduralParams();
+
   // use transpose arrays as makes for better layout in gpu memory
   // when copied over to device
   gGOGRT = allocate2DArray<float>(max_num_p_gr_from_go_to_gr, num_gr);
@@ -37,10 +43,14 @@ InNet::InNet(InNetConnectivityState *cs, InNetActivityState *as,
 
   pGRDelayfromGRtoGOT =
       allocate2DArray<uint32_t>(max_num_p_gr_from_gr_to_go, num_gr);
-  pGRfromMFtoGRT =
-      allocate2DArray<uint32_t>(max_num_p_gr_from_mf_to_gr, num_gr);
-  pGRfromGOtoGRT =
-      allocate2DArray<uint32_t>(max_num_p_gr_from_go_to_gr, num_gr);
+  pGRfromMFtoGRT = NULL;
+  pGRfromGOtoGRT = NULL;
+  if (!procedural) {
+    pGRfromMFtoGRT =
+        allocate2DArray<uint32_t>(max_num_p_gr_from_mf_to_gr, num_gr);
+    pGRfromGOtoGRT =
+        allocate2DArray<uint32_t>(max_num_p_gr_from_go_to_gr, num_gr);
+  }
   pGRfromGRtoGOT =
       allocate2DArray<uint32_t>(max_num_p_gr_from_gr_to_go, num_gr);
 
@@ -60,8 +70,10 @@ InNet::~InNet() {
   delete2DArray<float>(gMFGRT);
 
   delete2DArray<uint32_t>(pGRDelayfromGRtoGOT);
-  delete2DArray<uint32_t>(pGRfromMFtoGRT);
-  delete2DArray<uint32_t>(pGRfromGOtoGRT);
+  if (!procedural) {
+    delete2DArray<uint32_t>(pGRfromMFtoGRT);
+    delete2DArray<uint32_t>(pGRfromGOtoGRT);
+  }
   delete2DArray<uint32_t>(pGRfromGRtoGOT);
 
   // go, external to initCUDA
@@ -73,14 +85,23 @@ InNet::~InNet() {
     cudaSetDevice(i + gpuIndStart);
 
     // mf variables
-    cudaFree(apMFGPU[i]);
     cudaFreeHost(apMFH[i]);
+    cudaFree(spikeListMFGPU[i]);
+    cudaFree(mfConOutGRGPU[i]);
+    cudaFree(numMFOutGRGPU[i]);
+    cudaFree(glMFGPU[i]);
+    cudaFree(apMFGPU[i]);
     cudaFree(depAmpMFGPU[i]);
     cudaFreeHost(depAmpMFH[i]);
 
     cudaDeviceSynchronize();
   }
 
+  cudaFreeHost(spikeListMFH);
+  delete[] spikeListMFGPU;
+  delete[] mfConOutGRGPU;
+  delete[] numMFOutGRGPU;
+  delete[] glMFGPU;
   delete[] apMFGPU;
   delete[] apMFH;
   delete[] depAmpMFH;
@@ -97,6 +118,8 @@ InNet::~InNet() {
     cudaFree(gLeakGRGPU[i]);
     cudaFree(gNMDAGRGPU[i]);
     cudaFree(gNMDAIncGRGPU[i]);
+    cudaFree(inputMFCountGRGPU[i]);
+    cudaFree(inputGOCountGRGPU[i]);
     cudaFree(gEGRGPU[i]);
     cudaFree(gEGRSumGPU[i]);
     cudaFree(gEDirectGPU[i]);
@@ -126,6 +149,8 @@ InNet::~InNet() {
   }
 
   // GR CUDA
+  delete[] inputMFCountGRGPU;
+  delete[] inputGOCountGRGPU;
   delete[] gEGRGPU;
   delete[] gEGRGPUP;
   delete[] gEGRSumGPU;
@@ -172,6 +197,7 @@ InNet::~InNet() {
 
   delete[] outputGRH;
   // cudaFreeHost(outputGRH);
+  freeSubsetGR();
 
   // GO CUDA
   for (int i = 0; i < numGPUs; i++) {
@@ -182,6 +208,10 @@ InNet::~InNet() {
     cudaFreeHost(depAmpGOH[i]);
     cudaFreeHost(dynamicAmpGOH[i]);
 
+    cudaFree(spikeListGOGPU[i]);
+    cudaFree(goConOutGRGPU[i]);
+    cudaFree(numGOOutGRGPU[i]);
+    cudaFree(glGOGPU[i]);
     cudaFree(apGOGPU[i]);
     cudaFree(depAmpGOGPU[i]);
     cudaFree(dynamicAmpGOGPU[i]);
@@ -193,6 +223,11 @@ InNet::~InNet() {
 
   delete[] grInputGOSumH;
   delete[] apGOH;
+  cudaFreeHost(spikeListGOH);
+  delete[] spikeListGOGPU;
+  delete[] goConOutGRGPU;
+  delete[] numGOOutGRGPU;
+  delete[] glGOGPU;
   delete[] apGOGPU;
   delete[] grInputGOGPU;
   delete[] grInputGOGPUP;
@@ -258,6 +293,65 @@ void InNet::writeToState() {
   }
 }
 
+/*
+ * Implementation Notes:
+ *     the sim file holds the gr state that writeToState copies back, the go
+ * and mf state kept on the host, and the connectivity. Left are the gr
+ * conductances, depression and spillover terms that only live on the
+ * devices, the go copies and sums each device keeps, and the host staging
+ * arrays. Many of the latter are rewritten every step before they are read,
+ * but they are small, and keeping them spares reasoning about each.
+ */
+void InNet::checkpointRW(std::fstream &file, bool read) {
+  deviceArraysRW<float>(gLeakGRGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(gNMDAGRGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(gNMDAIncGRGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                        read, file);
+  deviceArraysRW<float>(gEDirectGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(gESpilloverGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                        read, file);
+  deviceArraysRW<float>(gIDirectGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(gISpilloverGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                        read, file);
+  deviceArraysRW<float>(depAmpMFGRGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                        read, file);
+  deviceArraysRW<float>(depAmpGOGRGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                        read, file);
+  deviceArraysRW<float>(dynamicAmpGOGRGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                        read, file);
+  deviceArraysRW<uint8_t>(outputGRGPU, numGRPerGPU, numGPUs, gpuIndStart,
+                          read, file);
+  deviceArraysRW<uint32_t>(apGRGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                           file);
+  deviceArraysRW<int>(apMFtoGRGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                      file);
+  deviceArraysRW<uint32_t>(inputMFCountGRGPU, numGRPerGPU, numGPUs,
+                           gpuIndStart, read, file);
+  deviceArraysRW<uint32_t>(inputGOCountGRGPU, numGRPerGPU, numGPUs,
+                           gpuIndStart, read, file);
+
+  deviceArraysRW<uint32_t>(grInputGOSumGPU, num_go, numGPUs, gpuIndStart,
+                           read, file);
+  deviceArraysRW<float>(depAmpGOGPU, num_go, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(dynamicAmpGOGPU, num_go, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(depAmpMFGPU, num_mf, numGPUs, gpuIndStart, read,
+                        file);
+
+  perGPUHostArraysRW<uint32_t>(grInputGOSumH, num_go, numGPUs, read, file);
+  perGPUHostArraysRW<uint32_t>(apGOH, num_go, numGPUs, read, file);
+  perGPUHostArraysRW<float>(depAmpGOH, num_go, numGPUs, read, file);
+  perGPUHostArraysRW<float>(dynamicAmpGOH, num_go, numGPUs, read, file);
+  perGPUHostArraysRW<uint32_t>(apMFH, num_mf, numGPUs, read, file);
+  perGPUHostArraysRW<float>(depAmpMFH, num_mf, numGPUs, read, file);
+  rawBytesRW((char *)counter, num_go * sizeof(int), read, file);
+}
+
 // void InNet::grStim(int startGRStim, int numGRStim)
 //{
 //	// might be a useless operation. would the state of these arrays
@@ -300,6 +394,18 @@ const uint8_t *InNet::exportAPGR() {
   return (const uint8_t *)outputGRH;
 }
 
+const float *InNet::exportVmGO() { return (const float *)as->vGO.get(); }
+
+const float *InNet::exportVmGR() {
+  cudaError_t error = getGRGPUData<float>(vGRGPU, as->vGR.get());
+  return (const float *)as->vGR.get();
+}
+
+const uint32_t *InNet::exportAPBufGR() {
+  cudaError_t error = getGRGPUData<uint32_t>(apBufGRGPU, as->apBufGR.get());
+  return (const uint32_t *)as->apBufGR.get();
+}
+
 const uint32_t *InNet::exportSumGRInputGO() {
   return (const uint32_t *)sumGRInputGO;
 }
@@ -326,6 +432,41 @@ const float *InNet::exportGISumGR() {
   return (const float *)as->gGOSumGR.get();
 }
 
+void InNet::setSubsetGR(const uint32_t *grInds, uint32_t numInds) {
+  freeSubsetGR();
+  numSubsetGR = numInds;
+  subsetNumGRPerGPU = new uint32_t[numGPUs]();
+  subsetIndsGRGPU = new uint32_t *[numGPUs];
+  subsetOutGRGPU = new float *[numGPUs];
+  std::vector<uint32_t> localInds(numInds);
+  for (uint32_t i = 0; i < numInds; i++) {
+    subsetNumGRPerGPU[grInds[i] / numGRPerGPU]++;
+    localInds[i] = grInds[i] % numGRPerGPU;
+  }
+  uint32_t offset = 0;
+  for (int i = 0; i < numGPUs; i++) {
+    cudaSetDevice(i + gpuIndStart);
+    uint32_t num = subsetNumGRPerGPU[i];
+    cudaMalloc((void **)&subsetIndsGRGPU[i], num * sizeof(uint32_t));
+    cudaMalloc((void **)&subsetOutGRGPU[i], num * sizeof(float));
+    cudaMemcpy(subsetIndsGRGPU[i], &localInds[offset], num * sizeof(uint32_t),
+               cudaMemcpyHostToDevice);
+    offset += num;
+  }
+  // one slice per Subset export, so that the three can be held at once
+  cudaMallocHost((void **)&subsetOutGRH, 3 * numInds * sizeof(float));
+}
+
+const float *InNet::exportVmSubsetGR() { return getGRSubsetData(vGRGPU, 0); }
+
+const float *InNet::exportGESumSubsetGR() {
+  return getGRSubsetData(gEGRSumGPU, 1);
+}
+
+const float *InNet::exportGISumSubsetGR() {
+  return getGRSubsetData(gIGRSumGPU, 2);
+}
+
 const float *InNet::exportgSum_MFGO() {
   return (const float *)as->gSum_MFGO.get();
 }
@@ -343,7 +484,7 @@ void InNet::updateMFActivties(const uint8_t *actInMF) {
 }
 
 void InNet::calcGOActivities() {
-#pragma omp parallel for // an attempt at parallelization using openmp haha
+#pragma omp parallel for schedule(runtime) // see autotune.h
   for (int i = 0; i < num_go; i++) {
     // gather gr -> go input sums copied from all devices into one host array
     sumGRInputGO[i] = 0;
@@ -459,7 +600,7 @@ void InNet::updateGOtoGROutParameters(float spillFrac) {
   float recoveryRate = 1 / recoveryTauGO;
   float baselvl = spillFrac * gogrW;
 
-#pragma omp parallel for
+#pragma omp parallel for schedule(runtime)
   for (int i = 0; i < num_go; i++) {
     // reset depression amplitudes
     as->depAmpGOGR[i] = 1;
@@ -479,17 +620,19 @@ void InNet::updateGOtoGROutParameters(float spillFrac) {
 
 void InNet::updateGOtoGOOut() {
 
-#pragma omp parallel for
+#pragma omp parallel for schedule(runtime)
   for (int i = 0; i < num_go; i++) {
     // update all go this go is connected to if this go spiked
     if (as->apGO[i]) {
       for (int j = 0; j < cs->numpGOGABAOutGOGO[i]; j++) {
+        // several go may target the same go
+#pragma omp atomic
         as->inputGOGO[cs->pGOGABAOutGOGO[i][j]]++;
       }
     }
   }
 
-#pragma omp parallel for
+#pragma omp parallel for schedule(runtime)
   for (int i = 0; i < num_go; i++) {
     for (int j = 0; j < cs->numpGOCoupInGOGO[i]; j++) {
       // update the coupling voltage for every go
@@ -561,11 +704,33 @@ void InNet::cpyDepAmpMFHosttoGPUCUDA(cudaStream_t **sts, int streamN) {
   }
 }
 
+/*
+ * Implementation Notes:
+ *     only the ids of the mfs that spiked are copied, unless procedural grs
+ * need them all to look their inputs up in. Either way runUpdateMFInGRCUDA
+ * reads them, so it has to be given the same stream.
+ */
 void InNet::cpyAPMFHosttoGPUCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
+  if (procedural) {
+    for (int i = 0; i < numGPUs; i++) {
+      error = cudaSetDevice(i + gpuIndStart);
+      error = cudaMemcpyAsync(apMFGPU[i], apMFH[i], num_mf * sizeof(uint32_t),
+                              cudaMemcpyHostToDevice, sts[i][streamN]);
+    }
+    return;
+  }
+  numSpikesMF = 0;
+  for (int i = 0; i < num_mf; i++) {
+    if (apMFH[0][i])
+      spikeListMFH[numSpikesMF++] = i;
+  }
+  if (numSpikesMF == 0)
+    return;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
-    error = cudaMemcpyAsync(apMFGPU[i], apMFH[i], num_mf * sizeof(uint32_t),
+    error = cudaMemcpyAsync(spikeListMFGPU[i], spikeListMFH,
+                            numSpikesMF * sizeof(uint32_t),
                             cudaMemcpyHostToDevice, sts[i][streamN]);
 #ifdef DEBUGOUT
     cerr << "cpyAPMFHosttoGPUCUDA: async copy for gpu #" << i << ": "
@@ -594,11 +759,32 @@ void InNet::cpyDynamicAmpGOGRHosttoGPUCUDA(cudaStream_t **sts, int streamN) {
   }
 }
 
+/*
+ * Implementation Notes:
+ *     as for cpyAPMFHosttoGPUCUDA, runUpdateGOInGRCUDA has to be given the
+ * same stream.
+ */
 void InNet::cpyAPGOHosttoGPUCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
+  if (procedural) {
+    for (int i = 0; i < numGPUs; i++) {
+      error = cudaSetDevice(i + gpuIndStart);
+      error = cudaMemcpyAsync(apGOGPU[i], apGOH[i], num_go * sizeof(uint32_t),
+                              cudaMemcpyHostToDevice, sts[i][streamN]);
+    }
+    return;
+  }
+  numSpikesGO = 0;
+  for (int i = 0; i < num_go; i++) {
+    if (apGOH[0][i])
+      spikeListGOH[numSpikesGO++] = i;
+  }
+  if (numSpikesGO == 0)
+    return;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
-    error = cudaMemcpyAsync(apGOGPU[i], apGOH[i], num_go * sizeof(uint32_t),
+    error = cudaMemcpyAsync(spikeListGOGPU[i], spikeListGOH,
+                            numSpikesGO * sizeof(uint32_t),
                             cudaMemcpyHostToDevice, sts[i][streamN]);
 #ifdef DEBUGOUT
     cerr << "cpyAPGOHosttoGPUCUDA: async copy for gpu #" << i << ": "
@@ -611,13 +797,25 @@ void InNet::runUpdateMFInGRCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
-    callUpdateMFInGROPKernel(
-        sts[i][streamN], updateMFInGRNumBlocks, updateMFInGRNumGRPerB, num_mf,
-        apMFGPU[i], depAmpMFGRGPU[i], gEGRGPU[i], gEGRGPUP[i],
-        grConMFOutGRGPU[i], grConMFOutGRGPUP[i], numMFInPerGRGPU[i],
-        apMFtoGRGPU[i], gEGRSumGPU[i], gEDirectGPU[i], gESpilloverGPU[i],
-        gDirectDecMFtoGR, gIncDirectMFtoGR, gSpilloverDecMFtoGR,
-        gIncFracSpilloverMFtoGR);
+    if (procedural) {
+      callUpdateMFInGRProceduralKernel(
+          sts[i][streamN], updateMFInGRNumBlocks, updateMFInGRNumGRPerB,
+          proceduralParams, glMFGPU[i], apMFGPU[i], numGRPerGPU * i,
+          depAmpMFGRGPU[i], apMFtoGRGPU[i], gEGRSumGPU[i], gEDirectGPU[i],
+          gESpilloverGPU[i], gDirectDecMFtoGR, gIncDirectMFtoGR,
+          gSpilloverDecMFtoGR, gIncFracSpilloverMFtoGR);
+      continue;
+    }
+    callPushSpikesToGRKernel(sts[i][streamN], numSpikesMF,
+                             pushSpikesToGRNumThreads, spikeListMFGPU[i],
+                             mfConOutGRGPU[i], mfConOutGRWidth,
+                             numMFOutGRGPU[i], numGRPerGPU * i, numGRPerGPU,
+                             inputMFCountGRGPU[i]);
+    callUpdateMFInGRFromCountsKernel(
+        sts[i][streamN], updateMFInGRNumBlocks, updateMFInGRNumGRPerB,
+        inputMFCountGRGPU[i], depAmpMFGRGPU[i], apMFtoGRGPU[i], gEGRSumGPU[i],
+        gEDirectGPU[i], gESpilloverGPU[i], gDirectDecMFtoGR, gIncDirectMFtoGR,
+        gSpilloverDecMFtoGR, gIncFracSpilloverMFtoGR);
 #ifdef DEBUGOUT
     error = cudaGetLastError();
     cerr << "runUpdateMFInGRCUDA: kernel launch for gpu #" << i << ": "
@@ -630,6 +828,13 @@ void InNet::runUpdateMFInGRDepressionCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
+    if (procedural) {
+      callUpdateMFInGRDepressionProceduralKernel(
+          sts[i][streamN], updateMFInGRNumBlocks, updateMFInGRNumGRPerB,
+          proceduralParams, glMFGPU[i], depAmpMFGPU[i], numGRPerGPU * i,
+          depAmpMFGRGPU[i]);
+      continue;
+    }
     callUpdateMFInGRDepressionOPKernel(
         sts[i][streamN], updateMFInGRNumBlocks, updateMFInGRNumGRPerB, num_mf,
         depAmpMFGPU[i], grConMFOutGRGPU[i], grConMFOutGRGPUP[i],
@@ -650,12 +855,23 @@ void InNet::runUpdateGOInGRCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
-    callUpdateInGROPKernel(
-        sts[i][streamN], updateGOInGRNumBlocks, updateGOInGRNumGRPerB, num_go,
-        apGOGPU[i], dynamicAmpGOGRGPU[i], gIGRGPU[i], gIGRGPUP[i],
-        grConGOOutGRGPU[i], grConGOOutGRGPUP[i], numGOInPerGRGPU[i],
-        gIGRSumGPU[i], gIDirectGPU[i], gISpilloverGPU[i], gDirectDecGOtoGR,
-        gogrW, gSpilloverDecGOtoGR, gIncFracSpilloverGOtoGR);
+    if (procedural) {
+      callUpdateGOInGRProceduralKernel(
+          sts[i][streamN], updateGOInGRNumBlocks, updateGOInGRNumGRPerB,
+          proceduralParams, glGOGPU[i], max_num_p_gr_from_go_to_gr,
+          apGOGPU[i], numGRPerGPU * i, dynamicAmpGOGRGPU[i], gIGRSumGPU[i],
+          gIDirectGPU[i], gISpilloverGPU[i], gDirectDecGOtoGR, gogrW);
+      continue;
+    }
+    callPushSpikesToGRKernel(sts[i][streamN], numSpikesGO,
+                             pushSpikesToGRNumThreads, spikeListGOGPU[i],
+                             goConOutGRGPU[i], goConOutGRWidth,
+                             numGOOutGRGPU[i], numGRPerGPU * i, numGRPerGPU,
+                             inputGOCountGRGPU[i]);
+    callUpdateGOInGRFromCountsKernel(
+        sts[i][streamN], updateGOInGRNumBlocks, updateGOInGRNumGRPerB,
+        inputGOCountGRGPU[i], dynamicAmpGOGRGPU[i], gIGRSumGPU[i],
+        gIDirectGPU[i], gISpilloverGPU[i], gDirectDecGOtoGR, gogrW);
 #ifdef DEBUGOUT
     error = cudaGetLastError();
     cerr << "runUpdateGOInGRCUDA: kernel launch for gpu #" << i << ": "
@@ -664,8 +880,15 @@ void InNet::runUpdateGOInGRCUDA(cudaStream_t **sts, int streamN) {
   }
 }
 
+/*
+ * Implementation Notes:
+ *     no kernel reads depAmpGOGR, so procedural mode does not regenerate the
+ * go inputs just to fill it.
+ */
 void InNet::runUpdateGOInGRDepressionCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
+  if (procedural)
+    return;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
     callUpdateGOInGRDepressionOPKernel(
@@ -683,6 +906,13 @@ void InNet::runUpdateGOInGRDynamicSpillCUDA(cudaStream_t **sts, int streamN) {
   cudaError_t error;
   for (int i = 0; i < numGPUs; i++) {
     error = cudaSetDevice(i + gpuIndStart);
+    if (procedural) {
+      callUpdateGOInGRDynamicSpillProceduralKernel(
+          sts[i][streamN], updateGOInGRNumBlocks, updateGOInGRNumGRPerB,
+          proceduralParams, glGOGPU[i], max_num_p_gr_from_go_to_gr,
+          dynamicAmpGOGPU[i], numGRPerGPU * i, dynamicAmpGOGRGPU[i]);
+      continue;
+    }
     callUpdateGOInGRDynamicSpillOPKernel(
         sts[i][streamN], updateGOInGRNumBlocks, updateGOInGRNumGRPerB, num_go,
         dynamicAmpGOGPU[i], grConGOOutGRGPU[i], grConGOOutGRGPUP[i],
@@ -744,6 +974,28 @@ void InNet::runUpdateGRHistoryCUDA(cudaStream_t **sts, int streamN,
 /* =========================== PROTECTED FUNCTIONS =============================
  */
 
+/*
+ * Implementation Notes:
+ *     the presynaptic tables are allocated with room for far more targets
+ * than any cell has (max_num_p_mf_from_mf_to_gr...), so rows are cut down to
+ * the longest one in use before they go to the gpus.
+ */
+static uint32_t *flattenConOut(int **conOut, const int *numOut, int numIn,
+                               uint32_t &width) {
+  width = 1;
+  for (int i = 0; i < numIn; i++) {
+    if ((uint32_t)numOut[i] > width)
+      width = numOut[i];
+  }
+  uint32_t *flat = new uint32_t[numIn * width];
+  for (int i = 0; i < numIn; i++) {
+    for (uint32_t j = 0; j < width; j++)
+      flat[i * width + j] =
+          (j < (uint32_t)numOut[i]) ? conOut[i][j] : UINT_MAX;
+  }
+  return flat;
+}
+
 void InNet::initCUDA() {
   cudaError_t error;
   int maxNumGPUs;
@@ -777,6 +1029,9 @@ void InNet::initCUDA() {
   updateGOInGRNumGRPerB = 1024 * (num_go >= 1024) + (num_go < 1024) * num_go;
   updateGOInGRNumBlocks = numGRPerGPU / updateGOInGRNumGRPerB;
 
+  // mfs and gos each have on the order of a thousand gr targets
+  pushSpikesToGRNumThreads = 256;
+
   updateGRHistNumGRPerB = 1024;
   updateGRHistNumBlocks = numGRPerGPU / updateGRHistNumGRPerB;
 
@@ -798,14 +1053,44 @@ void InNet::initCUDA() {
 void InNet::initMFCUDA() {
   apMFH = new uint32_t *[numGPUs];
   depAmpMFH = new float *[numGPUs];
-  apMFGPU = new uint32_t *[numGPUs];
   depAmpMFGPU = new float *[numGPUs];
+  spikeListMFGPU = new uint32_t *[numGPUs];
+  mfConOutGRGPU = new uint32_t *[numGPUs];
+  numMFOutGRGPU = new int32_t *[numGPUs];
+  glMFGPU = new int32_t *[numGPUs];
+  apMFGPU = new uint32_t *[numGPUs];
+
+  numSpikesMF = 0;
+  cudaMallocHost((void **)&spikeListMFH, num_mf * sizeof(uint32_t));
+  uint32_t *mfConOutGR = NULL;
+  int32_t *glMF = NULL;
+  if (procedural) {
+    glMF = new int32_t[num_gl];
+    for (int i = 0; i < num_gl; i++)
+      glMF[i] = cs->haspGLfromMFtoGL[i] ? cs->pGLfromMFtoGL[i] : -1;
+  } else {
+    mfConOutGR = flattenConOut(cs->pMFfromMFtoGR, cs->numpMFfromMFtoGR, num_mf,
+                               mfConOutGRWidth);
+  }
 
   LOG_DEBUG("Allocating MF cuda variables...");
   for (int i = 0; i < numGPUs; i++) {
     cudaSetDevice(i + gpuIndStart);
-    cudaMalloc((void **)&apMFGPU[i], num_mf * sizeof(uint32_t));
     cudaMallocHost((void **)&apMFH[i], num_mf * sizeof(uint32_t));
+    spikeListMFGPU[i] = NULL;
+    mfConOutGRGPU[i] = NULL;
+    numMFOutGRGPU[i] = NULL;
+    glMFGPU[i] = NULL;
+    apMFGPU[i] = NULL;
+    if (procedural) {
+      cudaMalloc((void **)&glMFGPU[i], num_gl * sizeof(int32_t));
+      cudaMalloc((void **)&apMFGPU[i], num_mf * sizeof(uint32_t));
+    } else {
+      cudaMalloc((void **)&spikeListMFGPU[i], num_mf * sizeof(uint32_t));
+      cudaMalloc((void **)&mfConOutGRGPU[i],
+                 num_mf * mfConOutGRWidth * sizeof(uint32_t));
+      cudaMalloc((void **)&numMFOutGRGPU[i], num_mf * sizeof(int32_t));
+    }
     cudaMalloc((void **)&(depAmpMFGPU[i]), num_mf * sizeof(float));
     cudaMallocHost((void **)&depAmpMFH[i], num_mf * sizeof(float));
     cudaDeviceSynchronize();
@@ -819,15 +1104,29 @@ void InNet::initMFCUDA() {
     cudaSetDevice(i + gpuIndStart);
     cudaMemset(apMFH[i], 0, num_mf * sizeof(uint32_t));
     cudaMemset(depAmpMFH[i], 1, num_mf * sizeof(float));
-    cudaMemset(apMFGPU[i], 0, num_mf * sizeof(uint32_t));
     cudaMemset(depAmpMFGPU[i], 1, num_mf * sizeof(float));
+    if (procedural) {
+      cudaMemset(apMFGPU[i], 0, num_mf * sizeof(uint32_t));
+      cudaMemcpy(glMFGPU[i], glMF, num_gl * sizeof(int32_t),
+                 cudaMemcpyHostToDevice);
+    } else {
+      cudaMemcpy(mfConOutGRGPU[i], mfConOutGR,
+                 num_mf * mfConOutGRWidth * sizeof(uint32_t),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(numMFOutGRGPU[i], cs->numpMFfromMFtoGR,
+                 num_mf * sizeof(int32_t), cudaMemcpyHostToDevice);
+    }
     cudaDeviceSynchronize();
   }
+  delete[] mfConOutGR;
+  delete[] glMF;
   // end copying to GPU
   LOG_DEBUG("Finished initializing MF cuda variables.");
 }
 
 void InNet::initGRCUDA() {
+  inputMFCountGRGPU = new uint32_t *[numGPUs];
+  inputGOCountGRGPU = new uint32_t *[numGPUs];
   gEGRGPU = new float *[numGPUs];
   gEGRGPUP = new size_t[numGPUs];
   gEGRSumGPU = new float *[numGPUs];
@@ -881,13 +1180,14 @@ void InNet::initGRCUDA() {
   // allocate memory for GPU
   for (int i = 0; i < numGPUs; i++) {
     cudaSetDevice(i + gpuIndStart);
+    cudaMalloc((void **)&inputMFCountGRGPU[i], numGRPerGPU * sizeof(uint32_t));
+    cudaMalloc((void **)&inputGOCountGRGPU[i], numGRPerGPU * sizeof(uint32_t));
     cudaMallocPitch((void **)&gEGRGPU[i], (size_t *)&gEGRGPUP[i],
                     numGRPerGPU * sizeof(float), max_num_p_gr_from_mf_to_gr);
     cudaMalloc((void **)&gEGRSumGPU[i], numGRPerGPU * sizeof(float));
     cudaMalloc((void **)&gEDirectGPU[i], numGRPerGPU * sizeof(float));
     cudaMalloc((void **)&gESpilloverGPU[i], numGRPerGPU * sizeof(float));
     cudaMalloc((void **)&apMFtoGRGPU[i], numGRPerGPU * sizeof(int));
-    cudaMalloc((void **)&numMFperGR[i], numGRPerGPU * sizeof(int));
     cudaMalloc((void **)&depAmpMFGRGPU[i], numGRPerGPU * sizeof(float));
     cudaMalloc((void **)&depAmpGOGRGPU[i], numGRPerGPU * sizeof(float));
     cudaMalloc((void **)&dynamicAmpGOGRGPU[i], numGRPerGPU * sizeof(float));
@@ -922,15 +1222,26 @@ void InNet::initGRCUDA() {
                     (size_t *)&grConGROutGOGPUP[i],
                     numGRPerGPU * sizeof(uint32_t), max_num_p_gr_from_gr_to_go);
 
-    cudaMalloc((void **)&numGOInPerGRGPU[i], numGRPerGPU * sizeof(int32_t));
-    cudaMallocPitch((void **)&grConGOOutGRGPU[i],
-                    (size_t *)&grConGOOutGRGPUP[i],
-                    numGRPerGPU * sizeof(uint32_t), max_num_p_gr_from_go_to_gr);
-
-    cudaMalloc((void **)&numMFInPerGRGPU[i], numGRPerGPU * sizeof(int32_t));
-    cudaMallocPitch((void **)&grConMFOutGRGPU[i],
-                    (size_t *)&grConMFOutGRGPUP[i],
-                    numGRPerGPU * sizeof(uint32_t), max_num_p_gr_from_mf_to_gr);
+    numMFperGR[i] = NULL;
+    numGOInPerGRGPU[i] = NULL;
+    grConGOOutGRGPU[i] = NULL;
+    numMFInPerGRGPU[i] = NULL;
+    grConMFOutGRGPU[i] = NULL;
+    if (!procedural) {
+      cudaMalloc((void **)&numMFperGR[i], numGRPerGPU * sizeof(int));
+
+      cudaMalloc((void **)&numGOInPerGRGPU[i], numGRPerGPU * sizeof(int32_t));
+      cudaMallocPitch((void **)&grConGOOutGRGPU[i],
+                      (size_t *)&grConGOOutGRGPUP[i],
+                      numGRPerGPU * sizeof(uint32_t),
+                      max_num_p_gr_from_go_to_gr);
+
+      cudaMalloc((void **)&numMFInPerGRGPU[i], numGRPerGPU * sizeof(int32_t));
+      cudaMallocPitch((void **)&grConMFOutGRGPU[i],
+                      (size_t *)&grConMFOutGRGPUP[i],
+                      numGRPerGPU * sizeof(uint32_t),
+                      max_num_p_gr_from_mf_to_gr);
+    }
     // end connectivity
 
     cudaDeviceSynchronize();
@@ -946,14 +1257,16 @@ void InNet::initGRCUDA() {
   for (int i = 0; i < max_num_p_gr_from_go_to_gr; i++) {
     for (int j = 0; j < num_gr; j++) {
       gGOGRT[i][j] = as->gGOGR[j * max_num_p_gr_from_go_to_gr + i];
-      pGRfromGOtoGRT[i][j] = cs->pGRfromGOtoGR[j][i];
+      if (!procedural)
+        pGRfromGOtoGRT[i][j] = cs->pGRfromGOtoGR[j][i];
     }
   }
 
   for (int i = 0; i < max_num_p_gr_from_mf_to_gr; i++) {
     for (int j = 0; j < num_gr; j++) {
       gMFGRT[i][j] = as->gMFGR[j * max_num_p_gr_from_mf_to_gr + i];
-      pGRfromMFtoGRT[i][j] = cs->pGRfromMFtoGR[j][i];
+      if (!procedural)
+        pGRfromMFtoGRT[i][j] = cs->pGRfromMFtoGR[j][i];
     }
   }
 
@@ -977,13 +1290,18 @@ void InNet::initGRCUDA() {
     cudaMemcpy(gKCaGRGPU[i], &(as->gKCaGR[cpyStartInd]),
                cpySize * sizeof(float), cudaMemcpyHostToDevice);
 
+    cudaMemset(inputMFCountGRGPU[i], 0, cpySize * sizeof(uint32_t));
+    cudaMemset(inputGOCountGRGPU[i], 0, cpySize * sizeof(uint32_t));
+
     for (int j = 0; j < max_num_p_gr_from_mf_to_gr; j++) {
       cudaMemcpy((void *)((char *)gEGRGPU[i] + j * gEGRGPUP[i]),
                  &gMFGRT[j][cpyStartInd], cpySize * sizeof(float),
                  cudaMemcpyHostToDevice);
-      cudaMemcpy((void *)((char *)grConMFOutGRGPU[i] + j * grConMFOutGRGPUP[i]),
-                 &pGRfromMFtoGRT[j][cpyStartInd], cpySize * sizeof(uint32_t),
-                 cudaMemcpyHostToDevice);
+      if (!procedural)
+        cudaMemcpy(
+            (void *)((char *)grConMFOutGRGPU[i] + j * grConMFOutGRGPUP[i]),
+            &pGRfromMFtoGRT[j][cpyStartInd], cpySize * sizeof(uint32_t),
+            cudaMemcpyHostToDevice);
     }
 
     cudaMemcpy(vGRGPU[i], &(as->vGR[cpyStartInd]), cpySize * sizeof(float),
@@ -994,8 +1312,9 @@ void InNet::initGRCUDA() {
     cudaMemset(gESpilloverGPU[i], 0.0, cpySize * sizeof(float));
     cudaMemcpy(apMFtoGRGPU[i], &(as->apMFtoGR[cpyStartInd]),
                cpySize * sizeof(int), cudaMemcpyHostToDevice);
-    cudaMemcpy(numMFperGR[i], &(cs->numpGRfromMFtoGR[cpyStartInd]),
-               cpySize * sizeof(int), cudaMemcpyHostToDevice);
+    if (!procedural)
+      cudaMemcpy(numMFperGR[i], &(cs->numpGRfromMFtoGR[cpyStartInd]),
+                 cpySize * sizeof(int), cudaMemcpyHostToDevice);
     cudaMemset(depAmpMFGRGPU[i], 1.0, cpySize * sizeof(float));
     cudaMemset(depAmpGOGRGPU[i], 1.0, cpySize * sizeof(float));
     cudaMemset(dynamicAmpGOGRGPU[i], 0.0, cpySize * sizeof(float));
@@ -1004,9 +1323,11 @@ void InNet::initGRCUDA() {
       cudaMemcpy((void *)((char *)gIGRGPU[i] + j * gIGRGPUP[i]),
                  &gGOGRT[j][cpyStartInd], cpySize * sizeof(float),
                  cudaMemcpyHostToDevice);
-      cudaMemcpy((void *)((char *)grConGOOutGRGPU[i] + j * grConGOOutGRGPUP[i]),
-                 &pGRfromGOtoGRT[j][cpyStartInd], cpySize * sizeof(uint32_t),
-                 cudaMemcpyHostToDevice);
+      if (!procedural)
+        cudaMemcpy(
+            (void *)((char *)grConGOOutGRGPU[i] + j * grConGOOutGRGPUP[i]),
+            &pGRfromGOtoGRT[j][cpyStartInd], cpySize * sizeof(uint32_t),
+            cudaMemcpyHostToDevice);
     }
 
     cudaMemcpy(gIGRSumGPU[i], &(as->gGOSumGR[cpyStartInd]),
@@ -1039,11 +1360,13 @@ void InNet::initGRCUDA() {
     cudaMemcpy(numGOOutPerGRGPU[i], &(cs->numpGRfromGRtoGO[cpyStartInd]),
                cpySize * sizeof(int32_t), cudaMemcpyHostToDevice);
 
-    cudaMemcpy(numGOInPerGRGPU[i], &(cs->numpGRfromGOtoGR[cpyStartInd]),
-               cpySize * sizeof(int32_t), cudaMemcpyHostToDevice);
+    if (!procedural) {
+      cudaMemcpy(numGOInPerGRGPU[i], &(cs->numpGRfromGOtoGR[cpyStartInd]),
+                 cpySize * sizeof(int32_t), cudaMemcpyHostToDevice);
 
-    cudaMemcpy(numMFInPerGRGPU[i], &(cs->numpGRfromMFtoGR[cpyStartInd]),
-               cpySize * sizeof(int), cudaMemcpyHostToDevice);
+      cudaMemcpy(numMFInPerGRGPU[i], &(cs->numpGRfromMFtoGR[cpyStartInd]),
+                 cpySize * sizeof(int), cudaMemcpyHostToDevice);
+    }
 
     cudaMemcpy(historyGRGPU[i], &(as->historyGR[cpyStartInd]),
                cpySize * sizeof(uint64_t), cudaMemcpyHostToDevice);
@@ -1061,7 +1384,9 @@ void InNet::initGOCUDA() {
   // FIXME: change the types of some of these arrays (see joe's biasManip sim)
   grInputGOSumH = new uint32_t *[numGPUs];
   apGOH = new uint32_t *[numGPUs];
-  apGOGPU = new uint32_t *[numGPUs];
+  spikeListGOGPU = new uint32_t *[numGPUs];
+  goConOutGRGPU = new uint32_t *[numGPUs];
+  numGOOutGRGPU = new int32_t *[numGPUs];
   grInputGOGPU = new uint32_t *[numGPUs];
   grInputGOGPUP = new size_t[numGPUs];
   grInputGOSumGPU = new uint32_t *[numGPUs];
@@ -1069,11 +1394,26 @@ void InNet::initGOCUDA() {
   depAmpGOGPU = new float *[numGPUs];
   dynamicAmpGOH = new float *[numGPUs];
   dynamicAmpGOGPU = new float *[numGPUs];
+  glGOGPU = new int32_t *[numGPUs];
+  apGOGPU = new uint32_t *[numGPUs];
 
   LOG_DEBUG("Allocating GO cuda variables...");
   counter = new int[num_go];
   memset(counter, 0, num_go * sizeof(int));
 
+  numSpikesGO = 0;
+  cudaMallocHost((void **)&spikeListGOH, num_go * sizeof(uint32_t));
+  uint32_t *goConOutGR = NULL;
+  int32_t *glGO = NULL;
+  if (procedural) {
+    glGO = new int32_t[num_gl];
+    for (int i = 0; i < num_gl; i++)
+      glGO[i] = (cs->numpGLfromGOtoGL[i] > 0) ? cs->pGLfromGOtoGL[i][0] : -1;
+  } else {
+    goConOutGR = flattenConOut(cs->pGOfromGOtoGR, cs->numpGOfromGOtoGR, num_go,
+                               goConOutGRWidth);
+  }
+
   // allocate host and device memory
   for (int i = 0; i < numGPUs; i++) {
     cudaSetDevice(i + gpuIndStart);
@@ -1083,7 +1423,20 @@ void InNet::initGOCUDA() {
     cudaMallocHost((void **)&dynamicAmpGOH[i], num_go * sizeof(float));
 
     // allocate gpu memory
-    cudaMalloc((void **)&apGOGPU[i], num_go * sizeof(uint32_t));
+    spikeListGOGPU[i] = NULL;
+    goConOutGRGPU[i] = NULL;
+    numGOOutGRGPU[i] = NULL;
+    glGOGPU[i] = NULL;
+    apGOGPU[i] = NULL;
+    if (procedural) {
+      cudaMalloc((void **)&glGOGPU[i], num_gl * sizeof(int32_t));
+      cudaMalloc((void **)&apGOGPU[i], num_go * sizeof(uint32_t));
+    } else {
+      cudaMalloc((void **)&spikeListGOGPU[i], num_go * sizeof(uint32_t));
+      cudaMalloc((void **)&goConOutGRGPU[i],
+                 num_go * goConOutGRWidth * sizeof(uint32_t));
+      cudaMalloc((void **)&numGOOutGRGPU[i], num_go * sizeof(int32_t));
+    }
     cudaMalloc((void **)&depAmpGOGPU[i], num_go * sizeof(float));
     cudaMalloc((void **)&dynamicAmpGOGPU[i], num_go * sizeof(float));
 
@@ -1105,7 +1458,17 @@ void InNet::initGOCUDA() {
     cudaMemset(dynamicAmpGOH[i], 1, num_go * sizeof(float));
     cudaMemset(grInputGOSumH[i], 0, num_go * sizeof(uint32_t));
 
-    cudaMemset(apGOGPU[i], 0, num_go * sizeof(uint32_t));
+    if (procedural) {
+      cudaMemset(apGOGPU[i], 0, num_go * sizeof(uint32_t));
+      cudaMemcpy(glGOGPU[i], glGO, num_gl * sizeof(int32_t),
+                 cudaMemcpyHostToDevice);
+    } else {
+      cudaMemcpy(goConOutGRGPU[i], goConOutGR,
+                 num_go * goConOutGRWidth * sizeof(uint32_t),
+                 cudaMemcpyHostToDevice);
+      cudaMemcpy(numGOOutGRGPU[i], cs->numpGOfromGOtoGR,
+                 num_go * sizeof(int32_t), cudaMemcpyHostToDevice);
+    }
     cudaMemset(depAmpGOGPU[i], 1, num_go * sizeof(float));
     cudaMemset(dynamicAmpGOGPU[i], 1, num_go * sizeof(float));
 
@@ -1117,12 +1480,60 @@ void InNet::initGOCUDA() {
 
     cudaDeviceSynchronize();
   }
+  delete[] goConOutGR;
+  delete[] glGO;
   LOG_DEBUG("Finished initializing GO cuda variables.");
 }
 
 /* =========================== PRIVATE FUNCTIONS =============================
  */
 
+/*
+ * Implementation Notes:
+ *     every gpu gathers its share on the default stream, which waits for the
+ * step's kernels, and copies it into the pinned output; the gpus run in
+ * parallel and are waited for at the end.
+ */
+const float *InNet::getGRSubsetData(float **gpuData, uint32_t slice) {
+  cudaStream_t st = 0;
+  float *outH = &subsetOutGRH[slice * numSubsetGR];
+  uint32_t offset = 0;
+  for (int i = 0; i < numGPUs; i++) {
+    uint32_t num = subsetNumGRPerGPU[i];
+    if (num == 0)
+      continue;
+    cudaSetDevice(i + gpuIndStart);
+    callGatherFloatKernel(st, gpuData[i], subsetIndsGRGPU[i],
+                          subsetOutGRGPU[i], num);
+    cudaMemcpyAsync(&outH[offset], subsetOutGRGPU[i],
+                    num * sizeof(float), cudaMemcpyDeviceToHost, st);
+    offset += num;
+  }
+  for (int i = 0; i < numGPUs; i++) {
+    if (subsetNumGRPerGPU[i] == 0)
+      continue;
+    cudaSetDevice(i + gpuIndStart);
+    cudaStreamSynchronize(st);
+  }
+  return (const float *)outH;
+}
+
+void InNet::freeSubsetGR() {
+  if (!subsetNumGRPerGPU)
+    return;
+  for (int i = 0; i < numGPUs; i++) {
+    cudaSetDevice(i + gpuIndStart);
+    cudaFree(subsetIndsGRGPU[i]);
+    cudaFree(subsetOutGRGPU[i]);
+  }
+  cudaFreeHost(subsetOutGRH);
+  delete[] subsetNumGRPerGPU;
+  delete[] subsetIndsGRGPU;
+  delete[] subsetOutGRGPU;
+  subsetNumGRPerGPU = NULL;
+  numSubsetGR = 0;
+}
+
 template <typename Type>
 cudaError_t InNet::getGRGPUData(Type **gpuData, Type *hostData) {
   for (int i = 0; i < numGPUs; i++) {
@@ -15,6 +15,7 @@
 #define INNET_H_
 
 #include <cuda.h>
+#include <fstream>
 #include <omp.h>
 
 #include "innetactivitystate.h"
@@ -30,12 +31,20 @@ public:
   ~InNet();
 
   void writeToState();
+  // reads or writes the runtime state that the sim file leaves out, for
+  // checkpoints (see CBMSimCore::checkpointRW)
+  void checkpointRW(std::fstream &file, bool read);
 
   // silly little functions used to send a const (immutable) pointer to the
   // caller to read this data
   const uint8_t *exportAPGO();
   const uint8_t *exportHistMF();
   const uint8_t *exportAPGR();
+  const float *exportVmGO();
+  // like exportAPGR, copies from the device before returning
+  const float *exportVmGR();
+  // spike history of every gr, this step in bit 0; copies from the device
+  const uint32_t *exportAPBufGR();
 
   const uint32_t *exportSumGRInputGO();
   const float *exportSumGOInputGO();
@@ -48,6 +57,15 @@ public:
 
   const float *exportGESumGR();
   const float *exportGISumGR();
+  // selects the grs, in ascending order, that the Subset exports read; a
+  // later call replaces the selection
+  void setSubsetGR(const uint32_t *grInds, uint32_t numInds);
+  // the selected grs' values, in the order given to setSubsetGR. Gathered on
+  // the device, so only the selection is copied back. Each export has its own
+  // host buffer, valid until its next call
+  const float *exportVmSubsetGR();
+  const float *exportGESumSubsetGR();
+  const float *exportGISumSubsetGR();
   const float *exportgSum_MFGO();
   const float *exportgSum_GRGO();
 
@@ -116,6 +134,8 @@ protected:
   unsigned int updateGOInGRNumGRPerB;
   unsigned int updateGOInGRNumBlocks;
 
+  unsigned int pushSpikesToGRNumThreads;
+
   unsigned int updateGRHistNumGRPerB;
   unsigned int updateGRHistNumBlocks;
 
@@ -132,12 +152,31 @@ protected:
 
   // gpu related variables
   uint32_t **apMFH;
-  uint32_t **apMFGPU;
+
+  // mf -> gr input is event driven: the ids of the mfs that spiked this step
+  // are copied to every gpu, which pushes them along each mf's row of gr
+  // targets (see pushSpikesToGRGPU in kernels.cu)
+  uint32_t *spikeListMFH;
+  uint32_t numSpikesMF;
+  uint32_t **spikeListMFGPU;
+  uint32_t mfConOutGRWidth; // longest row of pMFfromMFtoGR in use
+  uint32_t **mfConOutGRGPU;
+  int32_t **numMFOutGRGPU;
 
   float **depAmpMFH;
   float **depAmpMFGPU;
   float **depAmpMFGRGPU;
 
+  // procedural mode (see procedural_con.h): each gr regenerates its mf and go
+  // inputs every step from the per-gl tables below and dense spike arrays,
+  // and none of the gr input tables are allocated
+  bool procedural;
+  procedural_con_params proceduralParams;
+  int32_t **glMFGPU; // the mf feeding each gl, -1 if none
+  int32_t **glGOGPU; // the go feeding each gl, -1 if none
+  uint32_t **apMFGPU;
+  uint32_t **apGOGPU;
+
   int **numMFperGR;
   int **numUBCperGR;
   // end gpu related variables
@@ -153,7 +192,14 @@ protected:
 
   int *counter;
 
-  uint32_t **apGOGPU;
+  // go -> gr input, event driven like mf -> gr
+  uint32_t *spikeListGOH;
+  uint32_t numSpikesGO;
+  uint32_t **spikeListGOGPU;
+  uint32_t goConOutGRWidth; // longest row of pGOfromGOtoGR in use
+  uint32_t **goConOutGRGPU;
+  int32_t **numGOOutGRGPU;
+
   uint32_t **grInputGOGPU;
   uint32_t **grInputGOSumGPU;
 
@@ -188,6 +234,10 @@ protected:
   uint8_t *outputGRH;
   // end host variables
 
+  // mf and go spikes pushed to each gr this step
+  uint32_t **inputMFCountGRGPU;
+  uint32_t **inputGOCountGRGPU;
+
   float **gEGRGPU;
   size_t *gEGRGPUP;
   float **gEGRSumGPU;
@@ -260,6 +310,16 @@ protected:
 private:
   template <typename Type>
   cudaError_t getGRGPUData(Type **gpuData, Type *hostData);
+  const float *getGRSubsetData(float **gpuData, uint32_t slice);
+  void freeSubsetGR();
+
+  // the grs selected with setSubsetGR: per gpu, their indices local to the
+  // gpu and the values gathered there
+  uint32_t numSubsetGR = 0;
+  uint32_t *subsetNumGRPerGPU = NULL;
+  uint32_t **subsetIndsGRGPU = NULL;
+  float **subsetOutGRGPU = NULL;
+  float *subsetOutGRH = NULL;
 };
 
 #endif /* INNET_H_ */
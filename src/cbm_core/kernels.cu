@@ -391,6 +391,197 @@ __global__ void updateMFGRInOPGPU(unsigned int inNLoads, uint32_t *apIn,
   apMFtoGR[index] = tempApInSum;
 }
 
+/*
+ * event-driven counterpart to the gathers in updateMFGRInOPGPU and
+ * updateGRInOPGPU: one block per input cell that spiked this step walks that
+ * cell's output row and counts a spike at each of its target grs that live on
+ * this gpu. inCountGR must be zero on entry, which the FromCounts kernels
+ * below see to, so that the cost scales with the number of spikes rather
+ * than with the number of grs
+ */
+__global__ void pushSpikesToGRGPU(uint32_t *spikeList, uint32_t *conOut,
+                                  uint32_t conOutWidth, int32_t *numOutPerIn,
+                                  uint32_t grStart, uint32_t numGR,
+                                  uint32_t *inCountGR) {
+  uint32_t in = spikeList[blockIdx.x];
+  uint32_t *conRow = conOut + (size_t)in * conOutWidth;
+  int tempNOut = numOutPerIn[in];
+
+  for (int i = threadIdx.x; i < tempNOut; i += blockDim.x) {
+    // grs below grStart wrap around to large values and are skipped too
+    uint32_t gr = conRow[i] - grStart;
+    if (gr < numGR)
+      atomicAdd(&inCountGR[gr], 1);
+  }
+}
+
+/*
+ * same update as updateMFGRInOPGPU, given the input spike counts that
+ * pushSpikesToGRGPU left, which are reset for the next step
+ */
+__global__ void updateMFGRFromCountsGPU(uint32_t *inCount, float *depAmp,
+                                        int *apMFtoGR, float *gSum,
+                                        float *gDirect, float *gSpillover,
+                                        float gDecayD, float gIncD,
+                                        float gDecayS, float gIncFracS) {
+  int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  int tempApInSum = inCount[index];
+  inCount[index] = 0;
+
+  gDirect[index] =
+      gDirect[index] * gDecayD + gIncD * tempApInSum * depAmp[index];
+  gSpillover[index] = gSpillover[index] * gDecayS +
+                      gIncD * gIncFracS * tempApInSum * depAmp[index];
+
+  gSum[index] = gDirect[index] + gSpillover[index];
+  apMFtoGR[index] = tempApInSum;
+}
+
+/*
+ * same update as updateGRInOPGPU, given the input spike counts that
+ * pushSpikesToGRGPU left, which are reset for the next step
+ */
+__global__ void updateGOGRFromCountsGPU(uint32_t *inCount,
+                                        float *dynamicSpillAmp, float *gSum,
+                                        float *gDirect, float *gSpillover,
+                                        float gDecayD, float gIncD) {
+  int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  int tempApInSum = inCount[index];
+  inCount[index] = 0;
+
+  // compute the direct component
+  gDirect[index] = gDirect[index] * gDecayD + gIncD * tempApInSum;
+  // compute the spillover component
+  gSpillover[index] =
+      gSpillover[index] * 0.99 + dynamicSpillAmp[index] * tempApInSum;
+
+  // combine direct and spillover conductances
+  gSum[index] = gDirect[index] + gSpillover[index];
+}
+
+/*
+ * the input cells of gr 'gr' in procedural mode: those feeding its first
+ * numGLs gls (see procedural_con.h), glIn giving the cell that feeds each gl,
+ * or -1. Returns how many there are
+ */
+__device__ int proceduralInputsGR(const procedural_con_params &params,
+                                  int32_t *glIn, int numGLs, uint32_t gr,
+                                  int32_t *in) {
+  int32_t gls[PROC_MAX_GL_PER_GR];
+  int numDrawn = procedural_gr_gls(params, gr, gls);
+  if (numDrawn < numGLs)
+    numGLs = numDrawn;
+
+  int numIn = 0;
+  for (int i = 0; i < numGLs; i++) {
+    int32_t cell = glIn[gls[i]];
+    if (cell >= 0)
+      in[numIn++] = cell;
+  }
+  return numIn;
+}
+
+/*
+ * procedural counterpart to updateMFGRDepressionInOPGPU
+ */
+__global__ void updateMFGRDepressionProceduralGPU(procedural_con_params params,
+                                                  int32_t *glMF, float *depAmp,
+                                                  uint32_t grStart,
+                                                  float *depAmpMFGRGPU) {
+  int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  int32_t mfs[PROC_MAX_GL_PER_GR];
+  int tempNSyn =
+      proceduralInputsGR(params, glMF, params.num_slots, grStart + index, mfs);
+
+  float tempDepAmpSum = 0;
+  for (int i = 0; i < tempNSyn; i++) {
+    tempDepAmpSum += depAmp[mfs[i]];
+  }
+  // a gr without mf input gets no increment, so any finite value will do
+  depAmpMFGRGPU[index] = (tempNSyn > 0) ? tempDepAmpSum / tempNSyn : 1.0f;
+}
+
+/*
+ * procedural counterpart to updateMFGRInOPGPU: the gr gathers the spikes of
+ * the mfs it regenerates rather than reads from a connectivity table
+ */
+__global__ void updateMFGRProceduralGPU(procedural_con_params params,
+                                        int32_t *glMF, uint32_t *apMF,
+                                        uint32_t grStart, float *depAmp,
+                                        int *apMFtoGR, float *gSum,
+                                        float *gDirect, float *gSpillover,
+                                        float gDecayD, float gIncD,
+                                        float gDecayS, float gIncFracS) {
+  int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  int32_t mfs[PROC_MAX_GL_PER_GR];
+  int tempNSyn =
+      proceduralInputsGR(params, glMF, params.num_slots, grStart + index, mfs);
+
+  int tempApInSum = 0;
+  for (int i = 0; i < tempNSyn; i++) {
+    tempApInSum += apMF[mfs[i]];
+  }
+
+  gDirect[index] =
+      gDirect[index] * gDecayD + gIncD * tempApInSum * depAmp[index];
+  gSpillover[index] = gSpillover[index] * gDecayS +
+                      gIncD * gIncFracS * tempApInSum * depAmp[index];
+
+  gSum[index] = gDirect[index] + gSpillover[index];
+  apMFtoGR[index] = tempApInSum;
+}
+
+/*
+ * procedural counterpart to updateGOGRDynamicSpillInOPGPU. The go inputs of a
+ * gr are those of its first numGLsGO gls, as in translateGOGL
+ */
+__global__ void updateGOGRDynamicSpillProceduralGPU(
+    procedural_con_params params, int32_t *glGO, int numGLsGO,
+    float *dynamicAmp, uint32_t grStart, float *dynamicAmpGOGRGPU) {
+  int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  int32_t gos[PROC_MAX_GL_PER_GR];
+  int tempNSyn =
+      proceduralInputsGR(params, glGO, numGLsGO, grStart + index, gos);
+
+  float tempDynamicAmpSum = 0;
+  for (int i = 0; i < tempNSyn; i++) {
+    tempDynamicAmpSum += dynamicAmp[gos[i]];
+  }
+  dynamicAmpGOGRGPU[index] = tempDynamicAmpSum / numGLsGO;
+}
+
+/*
+ * procedural counterpart to updateGRInOPGPU
+ */
+__global__ void updateGOGRProceduralGPU(procedural_con_params params,
+                                        int32_t *glGO, int numGLsGO,
+                                        uint32_t *apGO, uint32_t grStart,
+                                        float *dynamicSpillAmp, float *gSum,
+                                        float *gDirect, float *gSpillover,
+                                        float gDecayD, float gIncD) {
+  int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  int32_t gos[PROC_MAX_GL_PER_GR];
+  int tempNSyn =
+      proceduralInputsGR(params, glGO, numGLsGO, grStart + index, gos);
+
+  int tempApInSum = 0;
+  for (int i = 0; i < tempNSyn; i++) {
+    tempApInSum += apGO[gos[i]];
+  }
+
+  gDirect[index] = gDirect[index] * gDecayD + gIncD * tempApInSum;
+  gSpillover[index] =
+      gSpillover[index] * 0.99 + dynamicSpillAmp[index] * tempApInSum;
+
+  gSum[index] = gDirect[index] + gSpillover[index];
+}
+
 __global__ void updateGRHistory(uint32_t *apBuf, uint64_t *apHist,
                                 uint32_t bufTestMask) {
   int i = blockIdx.x * blockDim.x + threadIdx.x; // get global id
@@ -806,6 +997,13 @@ __global__ void broadcastValue(Type *val, Type *outArr) {
   outArr[i] = *val;
 }
 
+__global__ void gatherFloat(const float *in, const uint32_t *inds, float *out,
+                            uint32_t numInds) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < numInds)
+    out[i] = in[inds[i]];
+}
+
 //**---------------end common kernels---------**
 
 //**---------------random kernels---------**
@@ -884,6 +1082,14 @@ void callBroadcastKernel(cudaStream_t &st, Type *broadcastVal, Type *outArray,
       <<<nBlocks, rowLength / nBlocks, 0, st>>>(broadcastVal, outArray);
 }
 
+void callGatherFloatKernel(cudaStream_t &st, const float *inGPU,
+                           const uint32_t *indsGPU, float *outGPU,
+                           uint32_t numInds) {
+  const uint32_t numThreads = 256;
+  gatherFloat<<<(numInds + numThreads - 1) / numThreads, numThreads, 0, st>>>(
+      inGPU, indsGPU, outGPU, numInds);
+}
+
 template <typename randState, typename blockDims, typename threadDims>
 void callCurandSetupKernel(cudaStream_t &st, randState *state, uint32_t seed,
                            blockDims &block_dim, threadDims &thread_dim)
@@ -987,6 +1193,78 @@ void callUpdateMFInGROPKernel(
       gSpilloverGPU, gDecayDirect, gIncDirect, gDecaySpill, gIncFracSpill);
 }
 
+void callPushSpikesToGRKernel(cudaStream_t &st, unsigned int numSpikes,
+                              unsigned int numThreads, uint32_t *spikeListGPU,
+                              uint32_t *conOutGPU, uint32_t conOutWidth,
+                              int32_t *numOutPerInGPU, uint32_t grStart,
+                              uint32_t numGR, uint32_t *inCountGRGPU) {
+  // a grid can't be empty
+  if (numSpikes == 0)
+    return;
+  pushSpikesToGRGPU<<<numSpikes, numThreads, 0, st>>>(
+      spikeListGPU, conOutGPU, conOutWidth, numOutPerInGPU, grStart, numGR,
+      inCountGRGPU);
+}
+
+void callUpdateMFInGRFromCountsKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    uint32_t *inCountGRGPU, float *depAmp, int *apMFtoGRGPU, float *gSumGPU,
+    float *gDirectGPU, float *gSpilloverGPU, float gDecayDirect,
+    float gIncDirect, float gDecaySpill, float gIncFracSpill) {
+  updateMFGRFromCountsGPU<<<numBlocks, numGRPerBlock, 0, st>>>(
+      inCountGRGPU, depAmp, apMFtoGRGPU, gSumGPU, gDirectGPU, gSpilloverGPU,
+      gDecayDirect, gIncDirect, gDecaySpill, gIncFracSpill);
+}
+
+void callUpdateGOInGRFromCountsKernel(cudaStream_t &st, unsigned int numBlocks,
+                                      unsigned int numGRPerBlock,
+                                      uint32_t *inCountGRGPU,
+                                      float *dynamicAmpGPU, float *gSumGPU,
+                                      float *gDirectGPU, float *gSpilloverGPU,
+                                      float gDecayD, float gIncD) {
+  updateGOGRFromCountsGPU<<<numBlocks, numGRPerBlock, 0, st>>>(
+      inCountGRGPU, dynamicAmpGPU, gSumGPU, gDirectGPU, gSpilloverGPU, gDecayD,
+      gIncD);
+}
+
+void callUpdateMFInGRDepressionProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glMFGPU, float *depAmpGPU,
+    uint32_t grStart, float *depAmpMFGRGPU) {
+  updateMFGRDepressionProceduralGPU<<<numBlocks, numGRPerBlock, 0, st>>>(
+      params, glMFGPU, depAmpGPU, grStart, depAmpMFGRGPU);
+}
+
+void callUpdateMFInGRProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glMFGPU, uint32_t *apMFGPU,
+    uint32_t grStart, float *depAmp, int *apMFtoGRGPU, float *gSumGPU,
+    float *gDirectGPU, float *gSpilloverGPU, float gDecayDirect,
+    float gIncDirect, float gDecaySpill, float gIncFracSpill) {
+  updateMFGRProceduralGPU<<<numBlocks, numGRPerBlock, 0, st>>>(
+      params, glMFGPU, apMFGPU, grStart, depAmp, apMFtoGRGPU, gSumGPU,
+      gDirectGPU, gSpilloverGPU, gDecayDirect, gIncDirect, gDecaySpill,
+      gIncFracSpill);
+}
+
+void callUpdateGOInGRDynamicSpillProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glGOGPU, int numGLsGO,
+    float *dynamicAmpGPU, uint32_t grStart, float *dynamicAmpGOGRGPU) {
+  updateGOGRDynamicSpillProceduralGPU<<<numBlocks, numGRPerBlock, 0, st>>>(
+      params, glGOGPU, numGLsGO, dynamicAmpGPU, grStart, dynamicAmpGOGRGPU);
+}
+
+void callUpdateGOInGRProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glGOGPU, int numGLsGO,
+    uint32_t *apGOGPU, uint32_t grStart, float *dynamicAmpGPU, float *gSumGPU,
+    float *gDirectGPU, float *gSpilloverGPU, float gDecayD, float gIncD) {
+  updateGOGRProceduralGPU<<<numBlocks, numGRPerBlock, 0, st>>>(
+      params, glGOGPU, numGLsGO, apGOGPU, grStart, dynamicAmpGPU, gSumGPU,
+      gDirectGPU, gSpilloverGPU, gDecayD, gIncD);
+}
+
 void callUpdatePFBCSCOutKernel(cudaStream_t &st, unsigned int numBlocks,
                                unsigned int numGRPerBlock, uint32_t *apBufGPU,
                                uint32_t *delayMaskGPU, uint32_t *inPFBCGPU,
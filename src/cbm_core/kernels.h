@@ -19,6 +19,8 @@
 
 #include <cstdint>
 
+#include "procedural_con.h"
+
 void callTestKernel(cudaStream_t &st, float *a, float *b, float *c);
 
 void callGRActKernel(cudaStream_t &st, unsigned int numBlocks,
@@ -38,6 +40,11 @@ template <typename Type>
 void callBroadcastKernel(cudaStream_t &st, Type *broadCastVal, Type *outArray,
                          unsigned int nBlocks, unsigned int rowLength);
 
+// out[i] = in[inds[i]] for i < numInds
+void callGatherFloatKernel(cudaStream_t &st, const float *inGPU,
+                           const uint32_t *indsGPU, float *outGPU,
+                           uint32_t numInds);
+
 template <typename randState, typename blockDims, typename threadDims>
 void callCurandSetupKernel(cudaStream_t &st, randState *state, uint32_t seed,
                            blockDims &block_dim, threadDims &thread_dim);
@@ -112,6 +119,50 @@ void callUpdateMFInGROPKernel(
     float *gSpilloverGPU, float gDecayDirect, float gIncDirect,
     float gDecaySpill, float gIncFracSpill);
 
+void callPushSpikesToGRKernel(cudaStream_t &st, unsigned int numSpikes,
+                              unsigned int numThreads, uint32_t *spikeListGPU,
+                              uint32_t *conOutGPU, uint32_t conOutWidth,
+                              int32_t *numOutPerInGPU, uint32_t grStart,
+                              uint32_t numGR, uint32_t *inCountGRGPU);
+
+void callUpdateMFInGRFromCountsKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    uint32_t *inCountGRGPU, float *depAmp, int *apMFtoGRGPU, float *gSumGPU,
+    float *gDirectGPU, float *gSpilloverGPU, float gDecayDirect,
+    float gIncDirect, float gDecaySpill, float gIncFracSpill);
+
+void callUpdateGOInGRFromCountsKernel(cudaStream_t &st, unsigned int numBlocks,
+                                      unsigned int numGRPerBlock,
+                                      uint32_t *inCountGRGPU,
+                                      float *dynamicAmpGPU, float *gSumGPU,
+                                      float *gDirectGPU, float *gSpilloverGPU,
+                                      float gDecayD, float gIncD);
+
+// procedural mode (see procedural_con.h): each gr regenerates its inputs
+// through glMF / glGO, the mf or go feeding each gl (-1 if none)
+void callUpdateMFInGRDepressionProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glMFGPU, float *depAmpGPU,
+    uint32_t grStart, float *depAmpMFGRGPU);
+
+void callUpdateMFInGRProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glMFGPU, uint32_t *apMFGPU,
+    uint32_t grStart, float *depAmp, int *apMFtoGRGPU, float *gSumGPU,
+    float *gDirectGPU, float *gSpilloverGPU, float gDecayDirect,
+    float gIncDirect, float gDecaySpill, float gIncFracSpill);
+
+void callUpdateGOInGRDynamicSpillProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glGOGPU, int numGLsGO,
+    float *dynamicAmpGPU, uint32_t grStart, float *dynamicAmpGOGRGPU);
+
+void callUpdateGOInGRProceduralKernel(
+    cudaStream_t &st, unsigned int numBlocks, unsigned int numGRPerBlock,
+    procedural_con_params params, int32_t *glGOGPU, int numGLsGO,
+    uint32_t *apGOGPU, uint32_t grStart, float *dynamicAmpGPU, float *gSumGPU,
+    float *gDirectGPU, float *gSpilloverGPU, float gDecayD, float gIncD);
+
 void callUpdatePFBCSCOutKernel(cudaStream_t &st, unsigned int numBlocks,
                                unsigned int numGRPerBlock, uint32_t *apBufGPU,
                                uint32_t *delayMaskGPU, uint32_t *inPFBCGPU,
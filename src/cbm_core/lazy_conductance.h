@@ -0,0 +1,74 @@
+/*
+ * File: lazy_conductance.h
+ *
+ * Description:
+ *     This is the interface file for event-driven synaptic conductances. A
+ * conductance that only decays between inputs, g(t) = g(t0) * decay^(t - t0),
+ * need not be written every time step: it is stored along with the step it
+ * was last brought up to date, and the decay is applied in closed form when
+ * an input arrives or when the value is read. decay^dt comes from a table of
+ * powers built once per decay constant.
+ *
+ *     This pays off for per-synapse conductances whose individual values are
+ * not needed every step -- only their sum over a cell is, and since every
+ * synapse of the sum shares one decay constant, the sum itself can be decayed
+ * as a single value and bumped by the increments of the synapses that
+ * received input. Per-cell conductances read by every membrane update gain
+ * nothing from this and keep their per-step decay.
+ */
+#ifndef LAZY_CONDUCTANCE_H_
+#define LAZY_CONDUCTANCE_H_
+
+#include <cmath>
+#include <cstdint>
+
+// decay^dt for dt up to this many steps is looked up, beyond it computed.
+// every decay in use is below 1e-9 by then
+const uint32_t LAZY_G_TABLE_SIZE = 1024;
+
+class DecayPowers {
+public:
+  DecayPowers() : decay(-1.0f) {}
+
+  /*
+   * Description:
+   *     (re)builds the table if decay differs from the one it was built for.
+   * Returns true if it did.
+   */
+  bool set(float decay) {
+    if (decay == this->decay)
+      return false;
+    this->decay = decay;
+    powers[0] = 1.0f;
+    for (uint32_t i = 1; i < LAZY_G_TABLE_SIZE; i++)
+      powers[i] = powers[i - 1] * decay;
+    return true;
+  }
+
+  float get_decay() const { return decay; }
+
+  /*
+   * Description:
+   *     decay^dt, for any number of steps dt.
+   */
+  float operator()(uint32_t dt) const {
+    return (dt < LAZY_G_TABLE_SIZE) ? powers[dt] : powf(decay, (float)dt);
+  }
+
+private:
+  float decay;
+  float powers[LAZY_G_TABLE_SIZE];
+};
+
+/*
+ * Description:
+ *     brings conductance g, last up to date at step last_t, up to step t.
+ */
+inline float settle_conductance(float &g, uint32_t &last_t, uint32_t t,
+                                const DecayPowers &powers) {
+  g *= powers(t - last_t);
+  last_t = t;
+  return g;
+}
+
+#endif /* LAZY_CONDUCTANCE_H_ */
@@ -5,16 +5,19 @@
  *   Author: consciousness
  *
  */
+#include <algorithm> /* std::copy */
 #include <fstream>
 #include <iostream>
 #include <math.h>
 
 #include "activityparams.h"
 #include "connectivityparams.h"
+#include "device_rw.h"
 #include "dynamic2darray.h"
 #include "file_utility.h"
 #include "logger.h"
 #include "mzone.h"
+#include "rng_seed.h"
 #include "sfmt.h"
 
 MZone::MZone() {}
@@ -44,6 +47,8 @@ MZone::MZone(cudaStream_t **stream, MZoneConnectivityState *cs,
   pfPCSynWeightStatesLinear = new uint8_t[num_gr];
   pfPCPlastStepIO = new float[num_io];
 
+  initNCConductances();
+
   this->numGPUs = numGPUs;
   this->gpuIndStart = gpuIndStart;
 
@@ -60,6 +65,13 @@ MZone::~MZone() {
   delete[] pfPCSynWeightStatesLinear;
   delete[] pfPCPlastStepIO;
 
+  delete[] lastUpdateMFNC;
+  delete[] lastUpdatePCNC;
+  delete[] gMFAMPASumNC;
+  delete[] gPCNCSumNC;
+  delete[] lazyGMFAMPANC;
+  delete[] lazyGPCNC;
+
   // free cuda host memory
   cudaSetDevice(0 + gpuIndStart);
   cudaFreeHost(inputSumPFPCMZH);
@@ -162,7 +174,7 @@ void MZone::initCUDA(cudaStream_t **stream) {
   // set up rng
   LOG_DEBUG("Initializing curand state...");
 
-  CRandomSFMT cudaRNGSeedGen(time(0));
+  CRandomSFMT cudaRNGSeedGen(next_rng_seed());
 
   int32_t curandInitSeed = cudaRNGSeedGen.IRandom(0, INT_MAX);
 
@@ -356,15 +368,111 @@ void MZone::initSCCUDA() {
   LOG_DEBUG("Finished initializing SC cuda variables...");
 }
 
+/*
+ * Implementation Notes:
+ *     the per-nc sums start from the conductances in the state, which are all
+ * up to date as of step 0.
+ */
+void MZone::initNCConductances() {
+  ncStepN = 0;
+  // should def be in input file
+  mfncDecay.set(exp(-1.0 / 20.0));
+  pcncDecay.set(gDecPCtoNC);
+
+  lastUpdateMFNC = new uint32_t[num_nc * num_p_nc_from_mf_to_nc]();
+  lastUpdatePCNC = new uint32_t[num_nc * num_p_nc_from_pc_to_nc]();
+  gMFAMPASumNC = new float[num_nc]();
+  gPCNCSumNC = new float[num_nc]();
+  lazyGMFAMPANC = new float[num_nc * num_p_nc_from_mf_to_nc];
+  lazyGPCNC = new float[num_nc * num_p_nc_from_pc_to_nc];
+
+  for (int i = 0; i < num_nc; i++) {
+    for (int j = 0; j < num_p_nc_from_mf_to_nc; j++)
+      gMFAMPASumNC[i] += as->gMFAMPANC[i * num_p_nc_from_mf_to_nc + j];
+    for (int j = 0; j < num_p_nc_from_pc_to_nc; j++)
+      gPCNCSumNC[i] += as->gPCNC[i * num_p_nc_from_pc_to_nc + j];
+  }
+}
+
+void MZone::settleNCConductances(uint32_t t) {
+  for (int i = 0; i < num_nc * num_p_nc_from_mf_to_nc; i++)
+    settle_conductance(as->gMFAMPANC[i], lastUpdateMFNC[i], t, mfncDecay);
+  for (int i = 0; i < num_nc * num_p_nc_from_pc_to_nc; i++)
+    settle_conductance(as->gPCNC[i], lastUpdatePCNC[i], t, pcncDecay);
+}
+
+/*
+ * Implementation Notes:
+ *     the sim file holds conductances that are up to date as of now, but
+ * settling the live ones would change the run: g * d^a * d^b is not
+ * g * d^(a + b) in floats. So the lazy values are set aside and the state
+ * gets settled copies, with lastUpdate* left alone, until
+ * restoreLazyNCConductances puts the lazy values back.
+ */
 void MZone::writeToState() {
   // TODO: write everything to state...only doing weights and pfpc input sums :/
   cpyPFPCSynWCUDA();
+  for (int i = 0; i < num_nc * num_p_nc_from_mf_to_nc; i++) {
+    lazyGMFAMPANC[i] = as->gMFAMPANC[i];
+    as->gMFAMPANC[i] *= mfncDecay(ncStepN - lastUpdateMFNC[i]);
+  }
+  for (int i = 0; i < num_nc * num_p_nc_from_pc_to_nc; i++) {
+    lazyGPCNC[i] = as->gPCNC[i];
+    as->gPCNC[i] *= pcncDecay(ncStepN - lastUpdatePCNC[i]);
+  }
 
   for (int i = 0; i < num_pc; i++) {
     as->inputSumPFPC[i] = inputSumPFPCMZH[i];
   }
 }
 
+void MZone::restoreLazyNCConductances() {
+  std::copy(lazyGMFAMPANC, lazyGMFAMPANC + num_nc * num_p_nc_from_mf_to_nc,
+            as->gMFAMPANC.get());
+  std::copy(lazyGPCNC, lazyGPCNC + num_nc * num_p_nc_from_pc_to_nc,
+            as->gPCNC.get());
+}
+
+/*
+ * Implementation Notes:
+ *     the sim file written alongside holds settled nc conductances (see
+ * writeToState), so the lazy ones are written here along with their
+ * bookkeeping and replace the settled values on restore. The running nc sums
+ * are kept as they are rather than summed again on load, as a fresh sum
+ * rounds differently. The generators
+ * are written whole: their states are the positions of their streams.
+ */
+void MZone::checkpointRW(std::fstream &file, bool read) {
+  rawBytesRW((char *)randGen, sizeof(CRandomSFMT0), read, file);
+  deviceArraysRW<curandStateMRG32k3a>(
+      mrg32k3aRNGs, updatePFPCSynWNumGRPerB * updatePFPCSynWNumBlocks,
+      numGPUs, gpuIndStart, read, file);
+
+  deviceArraysRW<float>(grEligGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<float>(pfpcSTPsGPU, numGRPerGPU, numGPUs, gpuIndStart, read,
+                        file);
+  deviceArraysRW<uint8_t>(pfPCSynWeightStatesGPU, numGRPerGPU, numGPUs,
+                          gpuIndStart, read, file);
+
+  rawBytesRW((char *)&ncStepN, sizeof(uint32_t), read, file);
+  rawBytesRW((char *)lastUpdateMFNC,
+             num_nc * num_p_nc_from_mf_to_nc * sizeof(uint32_t), read, file);
+  rawBytesRW((char *)lastUpdatePCNC,
+             num_nc * num_p_nc_from_pc_to_nc * sizeof(uint32_t), read, file);
+  rawBytesRW((char *)gMFAMPASumNC, num_nc * sizeof(float), read, file);
+  rawBytesRW((char *)gPCNCSumNC, num_nc * sizeof(float), read, file);
+  rawBytesRW((char *)as->gMFAMPANC.get(),
+             num_nc * num_p_nc_from_mf_to_nc * sizeof(float), read, file);
+  rawBytesRW((char *)as->gPCNC.get(),
+             num_nc * num_p_nc_from_pc_to_nc * sizeof(float), read, file);
+
+  rawBytesRW((char *)pfPCPlastStepIO, num_io * sizeof(float), read, file);
+  rawBytesRW((char *)inputSumPFPCMZH, num_pc * sizeof(float), read, file);
+  rawBytesRW((char *)inputSumPFBCH, num_bc * sizeof(uint32_t), read, file);
+  rawBytesRW((char *)inputSumPFSCH, num_sc * sizeof(uint32_t), read, file);
+}
+
 void MZone::cpyPFPCSynWCUDA() {
   for (int i = 0; i < numGPUs; i++) {
     cudaSetDevice(i + gpuIndStart);
@@ -482,8 +590,7 @@ void MZone::calcBCActivities() {
 
 void MZone::calcIOActivities() {
   // next few lines used to add a little noise to voltage computation
-  srand(clock());
-  float r = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+  float r = randGen->Random();
   float gNoise = (r - 0.5) * 2.0;
 
   for (int i = 0; i < num_io; i++) {
@@ -529,32 +636,40 @@ void MZone::calcIOActivities() {
   as->errDrive = 0; // honestly not sure why we have to reset this
 }
 
+/*
+ * Implementation Notes:
+ *     only synapses that received input this step are touched: each is
+ * brought up to date in closed form and given its increment, which is also
+ * added to its nc's sum after that sum has been decayed as a whole. For
+ * pc -> nc the increment saturates with the conductance of the previous
+ * step, so that is what the synapse is settled to before the increment.
+ */
 void MZone::calcNCActivities() {
-  // should def be in input file
-  float gDecay = exp(-1.0 / 20.0);
+  // a reloaded gDecTauPCtoNC applies from this step on
+  if (pcncDecay.get_decay() != gDecPCtoNC) {
+    settleNCConductances(ncStepN);
+    pcncDecay.set(gDecPCtoNC);
+  }
+  ncStepN++;
 
   for (int i = 0; i < num_nc; i++) {
     // zero out local conductance sum info
     float gMFNMDASum = 0;
-    float gMFAMPASum = 0;
-    float gPCNCSum = 0;
-
-    int inputPCNCSum = 0;
-    int inputMFNCSum = 0;
 
+    gMFAMPASumNC[i] *= mfncDecay.get_decay();
     for (int j = 0; j < num_p_nc_from_mf_to_nc; j++) {
-      // update mf -> nc input conductance sum
-      inputMFNCSum +=
-          as->inputMFNC[i * num_p_nc_from_mf_to_nc + j]; /* dont use */
-
+      int k = i * num_p_nc_from_mf_to_nc + j;
+      if (!as->inputMFNC[k])
+        continue;
       // update mf -> nc ampa conductance
-      as->gMFAMPANC[i * num_p_nc_from_mf_to_nc + j] =
-          as->gMFAMPANC[i * num_p_nc_from_mf_to_nc + j] * gDecay +
-          (gAMPAIncMFtoNC * as->inputMFNC[i * num_p_nc_from_mf_to_nc + j] *
-           as->mfSynWeightNC[i * num_p_nc_from_mf_to_nc + j]);
-      // compute sum for this nc
-      gMFAMPASum += as->gMFAMPANC[i * num_p_nc_from_mf_to_nc + j];
+      float gInc = gAMPAIncMFtoNC * as->inputMFNC[k] * as->mfSynWeightNC[k];
+      settle_conductance(as->gMFAMPANC[k], lastUpdateMFNC[k], ncStepN,
+                         mfncDecay);
+      as->gMFAMPANC[k] += gInc;
+      // update the sum for this nc
+      gMFAMPASumNC[i] += gInc;
     }
+    float gMFAMPASum = gMFAMPASumNC[i];
 
     // some sort of normalizing
     gMFNMDASum *= msPerTimeStep / ((float)num_p_nc_from_mf_to_nc);
@@ -563,18 +678,21 @@ void MZone::calcNCActivities() {
     // similar type of fudge
     gMFAMPASum *= msPerTimeStep / ((float)num_p_nc_from_mf_to_nc);
 
+    gPCNCSumNC[i] *= pcncDecay.get_decay();
     for (int j = 0; j < num_p_nc_from_pc_to_nc; j++) {
-      // compute pc -> nc input sum
-      inputPCNCSum += as->inputPCNC[i * num_p_nc_from_pc_to_nc + j];
-
+      int k = i * num_p_nc_from_pc_to_nc + j;
+      if (!as->inputPCNC[k])
+        continue;
       // compute the pc -> nc input conductance
-      as->gPCNC[i * num_p_nc_from_pc_to_nc + j] =
-          as->gPCNC[i * num_p_nc_from_pc_to_nc + j] * gDecPCtoNC +
-          as->inputPCNC[i * num_p_nc_from_pc_to_nc + j] * gIncAvgPCtoNC *
-              (1 - as->gPCNC[i * num_p_nc_from_pc_to_nc + j]);
+      float gPrev = settle_conductance(as->gPCNC[k], lastUpdatePCNC[k],
+                                       ncStepN - 1, pcncDecay);
+      float gInc = as->inputPCNC[k] * gIncAvgPCtoNC * (1 - gPrev);
+      as->gPCNC[k] = gPrev * pcncDecay.get_decay() + gInc;
+      lastUpdatePCNC[k] = ncStepN;
       // update the pc -> nc conductance sum
-      gPCNCSum += as->gPCNC[i * num_p_nc_from_pc_to_nc + j];
+      gPCNCSumNC[i] += gInc;
     }
+    float gPCNCSum = gPCNCSumNC[i];
 
     // more FUDGE
     gPCNCSum *= msPerTimeStep / ((float)num_p_nc_from_pc_to_nc);
@@ -1184,6 +1302,8 @@ const float *MZone::exportVmNC() { return (const float *)as->vNC.get(); }
 
 const float *MZone::exportVmIO() { return (const float *)as->vIO.get(); }
 
+const float *MZone::exportVmSC() { return (const float *)as->vSC.get(); }
+
 const unsigned int *MZone::exportAPBufBC() {
   return (const unsigned int *)as->apBufBC.get();
 }
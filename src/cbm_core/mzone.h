@@ -14,8 +14,10 @@
 #define MZONE_H_
 
 #include <cstdint>
+#include <fstream>
 
 #include "kernels.h"
+#include "lazy_conductance.h"
 #include "mzoneactivitystate.h"
 #include "mzoneconnectivitystate.h"
 #include "sfmt.h"
@@ -29,6 +31,12 @@ public:
   ~MZone();
 
   void writeToState();
+  // puts back the lazy nc conductances that writeToState settled for the sim
+  // file. Call once the state has been written
+  void restoreLazyNCConductances();
+  // reads or writes the runtime state that the sim file leaves out, for
+  // checkpoints (see CBMSimCore::checkpointRW)
+  void checkpointRW(std::fstream &file, bool read);
   void cpyPFPCSynWCUDA();
   void cpyPFPCWeightStatesCUDA();
   void setErrDrive(float errDriveRelative);
@@ -78,6 +86,7 @@ public:
   const float *exportVmPC();
   const float *exportVmNC();
   const float *exportVmIO();
+  const float *exportVmSC();
   const float *exportgBCPC();
   const float *exportgPFPC();
   const float *exportGREligToState();
@@ -173,9 +182,27 @@ private:
   // IO cell variables
   float *pfPCPlastStepIO;
 
+  // nucleus cell variables
+  // mf -> nc and pc -> nc conductances are event driven (see
+  // lazy_conductance.h): as->gMFAMPANC and as->gPCNC are only up to date as of
+  // the step in lastUpdateMFNC and lastUpdatePCNC, while the per-nc sums below
+  // are kept current
+  uint32_t ncStepN; // steps taken by calcNCActivities
+  DecayPowers mfncDecay;
+  DecayPowers pcncDecay;
+  uint32_t *lastUpdateMFNC;
+  uint32_t *lastUpdatePCNC;
+  float *gMFAMPASumNC;
+  float *gPCNCSumNC;
+  // the lazy conductances, kept aside while the state holds settled ones
+  float *lazyGMFAMPANC;
+  float *lazyGPCNC;
+
   void initCUDA(cudaStream_t **stream);
   void initBCCUDA();
   void initSCCUDA();
+  void initNCConductances();
+  void settleNCConductances(uint32_t t);
   void testReduction();
 };
 
@@ -7,6 +7,8 @@
 
 #include "activityparams.h"
 #include "connectivityparams.h"
+#include <map>
+#include <set>
 #include <math.h>
 
 float coupleRiRjRatioGO = 0.0;
@@ -81,10 +83,8 @@ float grEligBase = 0.002;
 float grEligMax = 1.0;
 float grEligExpScale = 2.5;
 float grEligDecayTau = 20;
-float grEligDecay = 1.0 - exp(-msPerTimeStep / grEligDecayTau);
 float grStpMax = 0.075;
 float grStpDecayTau = 24.5;
-float grStpDecay = exp(-msPerTimeStep / grStpDecayTau);
 float grStpInc = 0.00025;
 // experimental short term plasticity params
 
@@ -156,53 +156,238 @@ float rawMFGOW = 0.0042; // 0.0035;
 float gogrW = 0.015;
 float gogoW = 0.0125;
 
-/* derived act params */
-float numTSinMFHist = msPerHistBinMF / msPerTimeStep;
-float gLeakGO = rawGLeakGO; // / (6 - msPerTimeStep);
-float gDecMFtoGO = exp(-msPerTimeStep / gDecTauMFtoGO);
-float gDecayMFtoGONMDA = exp(-msPerTimeStep / gDecTauMFtoGONMDA);
-float gDecGRtoGO = exp(-msPerTimeStep / gDecTauGRtoGO);
-float gGABADecGOtoGO = exp(-msPerTimeStep / gGABADecTauGOtoGO);
-float goGABAGOGOSynRec = 1 - exp(-msPerTimeStep / goGABAGOGOSynRecTau);
-float threshDecGO = 1 - exp(-msPerTimeStep / threshDecTauGO);
-float gDirectDecMFtoGR = exp(-msPerTimeStep / gDirectTauMFtoGR);
-float gSpilloverDecMFtoGR = exp(-msPerTimeStep / gSpilloverTauMFtoGR);
-float gDirectDecGOtoGR = exp(-msPerTimeStep / gDirectTauGOtoGR);
-float gSpilloverDecGOtoGR = exp(-msPerTimeStep / gSpilloverTauGOtoGR);
-float threshDecGR = 1 - exp(-msPerTimeStep / threshDecTauGR);
-float tsPerHistBinGR = msPerHistBinGR / msPerTimeStep;
-float gLeakSC = rawGLeakSC / (6 - msPerTimeStep);
-float gDecGRtoSC = exp(-msPerTimeStep / gDecTauGRtoSC);
-float threshDecSC = 1 - exp(-msPerTimeStep / threshDecTauSC);
-float gDecGRtoBC = exp(-msPerTimeStep / gDecTauGRtoBC);
-float gDecPCtoBC = exp(-msPerTimeStep / gDecTauPCtoBC);
-float threshDecBC = 1 - exp(-msPerTimeStep / threshDecTauBC);
-float threshDecPC = 1 - exp(-msPerTimeStep / threshDecTauPC);
-float gLeakPC = rawGLeakPC / (6 - msPerTimeStep);
-float gDecGRtoPC = exp(-msPerTimeStep / gDecTauGRtoPC);
-float gDecBCtoPC = exp(-msPerTimeStep / gDecTauBCtoPC);
-float gDecSCtoPC = exp(-msPerTimeStep / gDecTauSCtoPC);
-float tsPopHistPC = 40 / msPerTimeStep;
-float tsPerPopHistBinPC = 5 / msPerTimeStep;
-// numPopHistBinsPC    =  8.0; tsPopHistPC / tsPerPopHistBinPC
-float gLeakIO = rawGLeakIO / (6 - msPerTimeStep);
-float threshDecIO = 1 - exp(-msPerTimeStep / threshDecTauIO);
-float tsLTDDurationIO = msLTDDurationIO / msPerTimeStep;
-float tsLTDstartAPIO = msLTDStartAPIO / msPerTimeStep;
-float tsLTPstartAPIO = msLTPStartAPIO / msPerTimeStep;
-float tsLTPEndAPIO = msLTPEndAPIO / msPerTimeStep;
-float grPCHistCheckBinIO = abs(msLTPEndAPIO / msPerHistBinGR);
-float gmaxNMDADecMFtoNC = exp(-msPerTimeStep / gmaxNMDADecTauMFtoNC);
-float gmaxAMPADecMFtoNC = exp(-msPerTimeStep / gmaxAMPADecTauMFtoNC);
-float gNMDAIncMFtoNC =
-    rawGMFNMDAIncNC; // 1 - exp(-msPerTimeStep /
-                     // rawGMFNMDAIncNC); // modified 09/29/2022
-float gAMPAIncMFtoNC =
-    rawGMFAMPAIncNC; // 1 - exp(-msPerTimeStep /
-                     // rawGMFAMPAIncNC); // modified 09/29/2022
-float gDecPCtoNC = exp(-msPerTimeStep / gDecTauPCtoNC);
-float gLeakNC = rawGLeakNC / (6 - msPerTimeStep);
-float threshDecNC = 1 - exp(-msPerTimeStep / threshDecTauNC);
-float gLeakBC = rawGLeakBC;
-float grgoW = rawGRGOW * weightScale;
-float mfgoW = rawMFGOW * weightScale;
+/*
+ * derived act params, each with the expression that computes it from the raw
+ * params. The one list both defines them, at the values of the default raw
+ * params, and recomputes them (see recompute_derived_act_params).
+ */
+#define DERIVED_ACT_PARAMS(X)                                                 \
+  X(grEligDecay, 1.0 - exp(-msPerTimeStep / grEligDecayTau))                  \
+  X(grStpDecay, exp(-msPerTimeStep / grStpDecayTau))                          \
+  X(numTSinMFHist, msPerHistBinMF / msPerTimeStep)                            \
+  /* was rawGLeakGO / (6 - msPerTimeStep) */                                  \
+  X(gLeakGO, rawGLeakGO)                                                      \
+  X(gDecMFtoGO, exp(-msPerTimeStep / gDecTauMFtoGO))                          \
+  X(gDecayMFtoGONMDA, exp(-msPerTimeStep / gDecTauMFtoGONMDA))                \
+  X(gDecGRtoGO, exp(-msPerTimeStep / gDecTauGRtoGO))                          \
+  X(gGABADecGOtoGO, exp(-msPerTimeStep / gGABADecTauGOtoGO))                  \
+  X(goGABAGOGOSynRec, 1 - exp(-msPerTimeStep / goGABAGOGOSynRecTau))          \
+  X(threshDecGO, 1 - exp(-msPerTimeStep / threshDecTauGO))                    \
+  X(gDirectDecMFtoGR, exp(-msPerTimeStep / gDirectTauMFtoGR))                 \
+  X(gSpilloverDecMFtoGR, exp(-msPerTimeStep / gSpilloverTauMFtoGR))           \
+  X(gDirectDecGOtoGR, exp(-msPerTimeStep / gDirectTauGOtoGR))                 \
+  X(gSpilloverDecGOtoGR, exp(-msPerTimeStep / gSpilloverTauGOtoGR))           \
+  X(threshDecGR, 1 - exp(-msPerTimeStep / threshDecTauGR))                    \
+  X(tsPerHistBinGR, msPerHistBinGR / msPerTimeStep)                           \
+  X(gLeakSC, rawGLeakSC / (6 - msPerTimeStep))                                \
+  X(gDecGRtoSC, exp(-msPerTimeStep / gDecTauGRtoSC))                          \
+  X(threshDecSC, 1 - exp(-msPerTimeStep / threshDecTauSC))                    \
+  X(gDecGRtoBC, exp(-msPerTimeStep / gDecTauGRtoBC))                          \
+  X(gDecPCtoBC, exp(-msPerTimeStep / gDecTauPCtoBC))                          \
+  X(threshDecBC, 1 - exp(-msPerTimeStep / threshDecTauBC))                    \
+  X(threshDecPC, 1 - exp(-msPerTimeStep / threshDecTauPC))                    \
+  X(gLeakPC, rawGLeakPC / (6 - msPerTimeStep))                                \
+  X(gDecGRtoPC, exp(-msPerTimeStep / gDecTauGRtoPC))                          \
+  X(gDecBCtoPC, exp(-msPerTimeStep / gDecTauBCtoPC))                          \
+  X(gDecSCtoPC, exp(-msPerTimeStep / gDecTauSCtoPC))                          \
+  X(tsPopHistPC, 40 / msPerTimeStep)                                          \
+  X(tsPerPopHistBinPC, 5 / msPerTimeStep)                                     \
+  /* numPopHistBinsPC = 8.0; tsPopHistPC / tsPerPopHistBinPC */               \
+  X(gLeakIO, rawGLeakIO / (6 - msPerTimeStep))                                \
+  X(threshDecIO, 1 - exp(-msPerTimeStep / threshDecTauIO))                    \
+  X(tsLTDDurationIO, msLTDDurationIO / msPerTimeStep)                         \
+  X(tsLTDstartAPIO, msLTDStartAPIO / msPerTimeStep)                           \
+  X(tsLTPstartAPIO, msLTPStartAPIO / msPerTimeStep)                           \
+  X(tsLTPEndAPIO, msLTPEndAPIO / msPerTimeStep)                               \
+  X(grPCHistCheckBinIO, abs(msLTPEndAPIO / msPerHistBinGR))                   \
+  X(gmaxNMDADecMFtoNC, exp(-msPerTimeStep / gmaxNMDADecTauMFtoNC))            \
+  X(gmaxAMPADecMFtoNC, exp(-msPerTimeStep / gmaxAMPADecTauMFtoNC))            \
+  /* was 1 - exp(-msPerTimeStep / rawGMFNMDAIncNC) until 09/29/2022 */        \
+  X(gNMDAIncMFtoNC, rawGMFNMDAIncNC)                                          \
+  /* was 1 - exp(-msPerTimeStep / rawGMFAMPAIncNC) until 09/29/2022 */        \
+  X(gAMPAIncMFtoNC, rawGMFAMPAIncNC)                                          \
+  X(gDecPCtoNC, exp(-msPerTimeStep / gDecTauPCtoNC))                          \
+  X(gLeakNC, rawGLeakNC / (6 - msPerTimeStep))                                \
+  X(threshDecNC, 1 - exp(-msPerTimeStep / threshDecTauNC))                    \
+  X(gLeakBC, rawGLeakBC)                                                      \
+  X(grgoW, rawGRGOW * weightScale)                                            \
+  X(mfgoW, rawMFGOW * weightScale)
+
+#define DEFINE_DERIVED_ACT_PARAM(name, value) float name = value;
+DERIVED_ACT_PARAMS(DEFINE_DERIVED_ACT_PARAM)
+#undef DEFINE_DERIVED_ACT_PARAM
+
+/*
+ * every raw param that may be changed while a sim runs (see param_overlay.h),
+ * plus the resting potentials and thresholds kept in connectivityparams
+ */
+static const std::map<std::string, float *> RAW_ACT_PARAMS = {
+    {"coupleRiRjRatioGO", &coupleRiRjRatioGO},
+    {"coupleRiRjRatioIO", &coupleRiRjRatioIO},
+    {"eBCtoPC", &eBCtoPC},
+    {"eGABAGO", &eGABAGO},
+    {"eGOGR", &eGOGR},
+    {"eMFGR", &eMFGR},
+    {"eMGluRGO", &eMGluRGO},
+    {"eNCtoIO", &eNCtoIO},
+    {"ePCtoBC", &ePCtoBC},
+    {"ePCtoNC", &ePCtoNC},
+    {"eSCtoPC", &eSCtoPC},
+    {"gDecTauBCtoPC", &gDecTauBCtoPC},
+    {"gIncBCtoPC", &gIncBCtoPC},
+    {"gGABADecTauGOtoGO", &gGABADecTauGOtoGO},
+    {"gDirectTauGOtoGR", &gDirectTauGOtoGR},
+    {"gIncFracSpilloverGOtoGR", &gIncFracSpilloverGOtoGR},
+    {"gSpilloverTauGOtoGR", &gSpilloverTauGOtoGR},
+    {"gDecTauGRtoGO", &gDecTauGRtoGO},
+    {"gDecTauMFtoGO", &gDecTauMFtoGO},
+    {"gConstGO", &gConstGO},
+    {"NMDA_AMPAratioMFGO", &NMDA_AMPAratioMFGO},
+    {"gDecTauMFtoGONMDA", &gDecTauMFtoGONMDA},
+    {"gIncDirectMFtoGR", &gIncDirectMFtoGR},
+    {"gDirectTauMFtoGR", &gDirectTauMFtoGR},
+    {"gIncFracSpilloverMFtoGR", &gIncFracSpilloverMFtoGR},
+    {"gSpilloverTauMFtoGR", &gSpilloverTauMFtoGR},
+    {"recoveryTauMF", &recoveryTauMF},
+    {"fracDepMF", &fracDepMF},
+    {"recoveryTauGO", &recoveryTauGO},
+    {"fracDepGO", &fracDepGO},
+    {"gIncMFtoUBC", &gIncMFtoUBC},
+    {"gIncGOtoUBC", &gIncGOtoUBC},
+    {"gIncUBCtoUBC", &gIncUBCtoUBC},
+    {"gIncUBCtoGO", &gIncUBCtoGO},
+    {"gIncUBCtoGR", &gIncUBCtoGR},
+    {"gKIncUBC", &gKIncUBC},
+    {"gKTauUBC", &gKTauUBC},
+    {"gConstUBC", &gConstUBC},
+    {"threshTauUBC", &threshTauUBC},
+    {"gMGluRDecGRtoGO", &gMGluRDecGRtoGO},
+    {"gMGluRIncDecayGO", &gMGluRIncDecayGO},
+    {"gMGluRIncScaleGO", &gMGluRIncScaleGO},
+    {"gMGluRScaleGRtoGO", &gMGluRScaleGRtoGO},
+    {"gDecT0ofNCtoIO", &gDecT0ofNCtoIO},
+    {"gDecTSofNCtoIO", &gDecTSofNCtoIO},
+    {"gDecTTofNCtoIO", &gDecTTofNCtoIO},
+    {"gIncNCtoIO", &gIncNCtoIO},
+    {"gIncTauNCtoIO", &gIncTauNCtoIO},
+    {"gDecTauPCtoBC", &gDecTauPCtoBC},
+    {"gDecTauPCtoNC", &gDecTauPCtoNC},
+    {"gIncAvgPCtoNC", &gIncAvgPCtoNC},
+    {"gDecTauGRtoBC", &gDecTauGRtoBC},
+    {"gDecTauGRtoPC", &gDecTauGRtoPC},
+    {"gDecTauGRtoSC", &gDecTauGRtoSC},
+    {"gIncGRtoPC", &gIncGRtoPC},
+    {"gDecTauSCtoPC", &gDecTauSCtoPC},
+    {"gIncSCtoPC", &gIncSCtoPC},
+    {"gluDecayGO", &gluDecayGO},
+    {"gluScaleGO", &gluScaleGO},
+    {"goGABAGOGOSynDepF", &goGABAGOGOSynDepF},
+    {"goGABAGOGOSynRecTau", &goGABAGOGOSynRecTau},
+    {"grEligBase", &grEligBase},
+    {"grEligMax", &grEligMax},
+    {"grEligExpScale", &grEligExpScale},
+    {"grEligDecayTau", &grEligDecayTau},
+    {"grStpMax", &grStpMax},
+    {"grStpDecayTau", &grStpDecayTau},
+    {"grStpInc", &grStpInc},
+    {"fracSynWLow", &fracSynWLow},
+    {"fracLowState", &fracLowState},
+    {"cascPlastProbMin", &cascPlastProbMin},
+    {"cascPlastProbMax", &cascPlastProbMax},
+    {"cascPlastWeightLow", &cascPlastWeightLow},
+    {"cascPlastWeightHigh", &cascPlastWeightHigh},
+    {"binPlastProbMin", &binPlastProbMin},
+    {"binPlastProbMax", &binPlastProbMax},
+    {"binPlastWeightLow", &binPlastWeightLow},
+    {"binPlastWeightHigh", &binPlastWeightHigh},
+    {"synLTDStepSizeGRtoPC", &synLTDStepSizeGRtoPC},
+    {"synLTPStepSizeGRtoPC", &synLTPStepSizeGRtoPC},
+    {"mGluRDecayGO", &mGluRDecayGO},
+    {"mGluRScaleGO", &mGluRScaleGO},
+    {"maxExtIncVIO", &maxExtIncVIO},
+    {"gmaxAMPADecTauMFtoNC", &gmaxAMPADecTauMFtoNC},
+    {"synLTDStepSizeMFtoNC", &synLTDStepSizeMFtoNC},
+    {"synLTDPCPopActThreshMFtoNC", &synLTDPCPopActThreshMFtoNC},
+    {"synLTPStepSizeMFtoNC", &synLTPStepSizeMFtoNC},
+    {"synLTPPCPopActThreshMFtoNC", &synLTPPCPopActThreshMFtoNC},
+    {"gmaxNMDADecTauMFtoNC", &gmaxNMDADecTauMFtoNC},
+    {"msLTDDurationIO", &msLTDDurationIO},
+    {"msLTDStartAPIO", &msLTDStartAPIO},
+    {"msLTPEndAPIO", &msLTPEndAPIO},
+    {"msLTPStartAPIO", &msLTPStartAPIO},
+    {"msPerHistBinGR", &msPerHistBinGR},
+    {"msPerHistBinMF", &msPerHistBinMF},
+    {"relPDecT0ofNCtoIO", &relPDecT0ofNCtoIO},
+    {"relPDecTSofNCtoIO", &relPDecTSofNCtoIO},
+    {"relPDecTTofNCtoIO", &relPDecTTofNCtoIO},
+    {"relPIncNCtoIO", &relPIncNCtoIO},
+    {"relPIncTauNCtoIO", &relPIncTauNCtoIO},
+    {"gIncPCtoBC", &gIncPCtoBC},
+    {"gIncGRtoBC", &gIncGRtoBC},
+    {"gIncGRtoSC", &gIncGRtoSC},
+    {"rawGLeakBC", &rawGLeakBC},
+    {"rawGLeakGO", &rawGLeakGO},
+    {"rawGLeakGR", &rawGLeakGR},
+    {"rawGLeakIO", &rawGLeakIO},
+    {"rawGLeakNC", &rawGLeakNC},
+    {"rawGLeakPC", &rawGLeakPC},
+    {"rawGLeakSC", &rawGLeakSC},
+    {"rawGMFAMPAIncNC", &rawGMFAMPAIncNC},
+    {"rawGMFNMDAIncNC", &rawGMFNMDAIncNC},
+    {"threshDecTauBC", &threshDecTauBC},
+    {"threshDecTauGO", &threshDecTauGO},
+    {"threshDecTauUBC", &threshDecTauUBC},
+    {"threshDecTauGR", &threshDecTauGR},
+    {"threshDecTauIO", &threshDecTauIO},
+    {"threshDecTauNC", &threshDecTauNC},
+    {"threshDecTauPC", &threshDecTauPC},
+    {"threshDecTauSC", &threshDecTauSC},
+    {"threshMaxBC", &threshMaxBC},
+    {"threshMaxGO", &threshMaxGO},
+    {"threshMaxGR", &threshMaxGR},
+    {"threshMaxIO", &threshMaxIO},
+    {"threshMaxNC", &threshMaxNC},
+    {"threshMaxPC", &threshMaxPC},
+    {"threshMaxSC", &threshMaxSC},
+    {"weightScale", &weightScale},
+    {"rawGRGOW", &rawGRGOW},
+    {"rawMFGOW", &rawMFGOW},
+    {"gogrW", &gogrW},
+    {"gogoW", &gogoW},
+    {"eLeakGO", &eLeakGO},
+    {"threshRestGO", &threshRestGO},
+    {"eLeakGR", &eLeakGR},
+    {"threshRestGR", &threshRestGR},
+    {"eLeakSC", &eLeakSC},
+    {"threshRestSC", &threshRestSC},
+    {"eLeakBC", &eLeakBC},
+    {"threshRestBC", &threshRestBC},
+    {"eLeakPC", &eLeakPC},
+    {"threshRestPC", &threshRestPC},
+    {"eLeakIO", &eLeakIO},
+    {"threshRestIO", &threshRestIO},
+    {"eLeakNC", &eLeakNC},
+    {"threshRestNC", &threshRestNC}
+};
+
+/*
+ * the raw params read only while the network is built (see
+ * mzoneactivitystate.cpp), so changing them afterwards does nothing
+ */
+static const std::set<std::string> INIT_ONLY_ACT_PARAMS = {"fracSynWLow",
+                                                           "fracLowState"};
+
+float *find_act_param(std::string name) {
+  auto entry = RAW_ACT_PARAMS.find(name);
+  return (entry == RAW_ACT_PARAMS.end()) ? NULL : entry->second;
+}
+
+bool act_param_is_init_only(std::string name) {
+  return INIT_ONLY_ACT_PARAMS.count(name) > 0;
+}
+
+void recompute_derived_act_params() {
+#define RECOMPUTE_DERIVED_ACT_PARAM(name, value) name = value;
+  DERIVED_ACT_PARAMS(RECOMPUTE_DERIVED_ACT_PARAM)
+#undef RECOMPUTE_DERIVED_ACT_PARAM
+}
@@ -8,6 +8,8 @@
 #ifndef ACTIVITYPARAMS_H_
 #define ACTIVITYPARAMS_H_
 
+#include <string>
+
 /* raw params */
 extern float coupleRiRjRatioGO;
 extern float coupleRiRjRatioIO;
@@ -199,4 +201,22 @@ extern float gLeakBC;
 extern float grgoW;
 extern float mfgoW;
 
+/*
+ * returns a pointer to the raw act param called name, or NULL if there is no
+ * such param. Derived params cannot be looked up: change their raw params and
+ * call recompute_derived_act_params.
+ */
+float *find_act_param(std::string name);
+
+/*
+ * returns true if the raw act param called name is only read while the
+ * network is built, so that changing it afterwards has no effect
+ */
+bool act_param_is_init_only(std::string name);
+
+/*
+ * recomputes every derived act param from the current raw params
+ */
+void recompute_derived_act_params();
+
 #endif /* ACTIVITYPARAMS_H_ */
@@ -6,19 +6,25 @@
  */
 
 #include "cbmstate.h"
+#include "con_store.h"
 #include "logger.h"
+#include "rng_seed.h"
+
+// "THIN": starts the state of a sim whose connectivity is in the store
+const uint32_t THIN_SIM_MAGIC = 0x4E494854;
 
 CBMState::CBMState() {}
 
-CBMState::CBMState(unsigned int nZones) : numZones(nZones) {
+CBMState::CBMState(unsigned int nZones, bool proceduralGR)
+    : numZones(nZones) {
   LOG_DEBUG("Generating cbm state...");
-  CRandomSFMT randGen(time(0));
+  CRandomSFMT randGen(next_rng_seed());
 
   int innetCRSeed = randGen.IRandom(0, INT_MAX);
   int *mzoneCRSeed = new int[nZones];
   int *mzoneARSeed = new int[nZones];
 
-  innetConState = new InNetConnectivityState(innetCRSeed);
+  innetConState = new InNetConnectivityState(innetCRSeed, proceduralGR);
   innetActState = new InNetActivityState();
 
   mzoneConStates = new MZoneConnectivityState *[nZones];
@@ -35,18 +41,27 @@ CBMState::CBMState(unsigned int nZones) : numZones(nZones) {
 }
 
 CBMState::CBMState(unsigned int nZones, enum plasticity plast_type,
-                   std::fstream &sim_file_buf)
+                   std::fstream &sim_file_buf,
+                   std::function<void()> on_section)
     : numZones(nZones) {
   LOG_DEBUG("Initializing cbm state from file...");
-  innetConState = new InNetConnectivityState(sim_file_buf);
+  std::fstream con_blob;
+  std::fstream &con_buf = openConnectivity(sim_file_buf, con_blob);
+  innetConState = new InNetConnectivityState(con_buf);
+  if (on_section)
+    on_section();
   innetActState = new InNetActivityState(sim_file_buf);
+  if (on_section)
+    on_section();
 
   mzoneConStates = new MZoneConnectivityState *[nZones];
   mzoneActStates = new MZoneActivityState *[nZones];
 
   for (int i = 0; i < nZones; i++) {
-    mzoneConStates[i] = new MZoneConnectivityState(sim_file_buf);
+    mzoneConStates[i] = new MZoneConnectivityState(con_buf);
     mzoneActStates[i] = new MZoneActivityState(plast_type, sim_file_buf);
+    if (on_section)
+      on_section();
   }
   LOG_DEBUG("Finished initializing cbm state.");
 }
@@ -83,22 +98,80 @@ CBMState::~CBMState() {
 }
 
 void CBMState::readState(std::fstream &infile) {
-  innetConState->readState(infile);
+  std::fstream con_blob;
+  std::fstream &con_buf = openConnectivity(infile, con_blob);
+  innetConState->readState(con_buf);
   innetActState->readState(infile);
 
   for (int i = 0; i < numZones; i++) {
-    mzoneConStates[i]->readState(infile);
+    mzoneConStates[i]->readState(con_buf);
     mzoneActStates[i]->readState(infile);
   }
 }
 
-void CBMState::writeState(std::fstream &outfile) {
-  innetConState->writeState(outfile);
+/*
+ * Implementation Notes:
+ *     a thin sim keeps the order of the sections of a full one, with the
+ * connectivity sections moved, in the same order, to the blob. Reading both
+ * streams section by section is then the same code for either kind of file.
+ */
+void CBMState::writeState(std::fstream &outfile, bool thin) {
+  if (!thin) {
+    innetConState->writeState(outfile);
+    innetActState->writeState(outfile);
+    for (int i = 0; i < numZones; i++) {
+      mzoneConStates[i]->writeState(outfile);
+      mzoneActStates[i]->writeState(outfile);
+    }
+    return;
+  }
+  if (!conRefKnown) {
+    conRef = con_store_put([this](std::fstream &blob) {
+      innetConState->writeState(blob);
+      for (int i = 0; i < numZones; i++)
+        mzoneConStates[i]->writeState(blob);
+    });
+    conRefKnown = true;
+  }
+  uint32_t magic = THIN_SIM_MAGIC;
+  outfile.write((char *)&magic, sizeof(uint32_t));
+  outfile.write((char *)&conRef.hash, sizeof(uint64_t));
+  outfile.write((char *)&conRef.num_bytes, sizeof(uint64_t));
   innetActState->writeState(outfile);
-  for (int i = 0; i < numZones; i++) {
-    mzoneConStates[i]->writeState(outfile);
+  for (int i = 0; i < numZones; i++)
     mzoneActStates[i]->writeState(outfile);
+}
+
+/*
+ * Implementation Notes:
+ *     a full sim starts its state with the innet connectivity, whose first
+ * word is the procedural magic or four bools, never THIN_SIM_MAGIC, so the
+ * word is peeked and put back if it is not the magic.
+ */
+std::fstream &CBMState::openConnectivity(std::fstream &sim_file_buf,
+                                         std::fstream &con_blob) {
+  std::streampos start = sim_file_buf.tellg();
+  uint32_t magic = 0;
+  sim_file_buf.read((char *)&magic, sizeof(uint32_t));
+  if (!sim_file_buf || magic != THIN_SIM_MAGIC) {
+    sim_file_buf.clear();
+    sim_file_buf.seekg(start);
+    conRefKnown = false;
+    return sim_file_buf;
+  }
+  con_blob_ref ref;
+  sim_file_buf.read((char *)&ref.hash, sizeof(uint64_t));
+  sim_file_buf.read((char *)&ref.num_bytes, sizeof(uint64_t));
+  if (!con_store_open(ref, con_blob)) {
+    LOG_FATAL("Could not open the connectivity of this thin sim file. "
+              "Exiting...");
+    exit(1);
   }
+  LOG_DEBUG("Reading connectivity from '%s'...",
+            con_store_path(ref).c_str());
+  conRef = ref;
+  conRefKnown = true;
+  return con_blob;
 }
 
 uint32_t CBMState::getNumZones() { return numZones; }
@@ -118,3 +191,100 @@ InNetConnectivityState *CBMState::getInnetConStateInternal() {
 MZoneConnectivityState *CBMState::getMZoneConStateInternal(unsigned int zoneN) {
   return mzoneConStates[zoneN];
 }
+
+/*
+ * Implementation Notes:
+ *     the pre-synaptic view is what the edge lists are written from. Where
+ * connectivity is only made on one side, both views are that side: mf -> nc
+ * has no pre-synaptic array, io -> io only fills pIOInIOIO (the array
+ * MZone couples through), and bc -> pc and pc -> bc only fill their
+ * pre-synaptic arrays. The other arrays stay zero-filled, which would read as
+ * synapses onto cell 0.
+ * The in net arrays are int, padded with -1; read as uint32_t, the padding
+ * falls outside the valid ids like the UINT_MAX padding of the mzone arrays.
+ * The gr inputs of a procedural sim have to be materialized first.
+ */
+con_table CBMState::getConTable(const std::string &synId, bool post) {
+  InNetConnectivityState *innet = innetConState;
+  MZoneConnectivityState *mzone = mzoneConStates[0];
+  if (synId == "MFGR")
+    return post ? con_table{(const uint32_t *)innet->pGRfromMFtoGR[0],
+                            innet->numpGRfromMFtoGR, (uint32_t)num_gr,
+                            (uint32_t)max_num_p_gr_from_mf_to_gr,
+                            (uint32_t)num_mf, true}
+                : con_table{(const uint32_t *)innet->pMFfromMFtoGR[0],
+                            innet->numpMFfromMFtoGR, (uint32_t)num_mf,
+                            (uint32_t)max_num_p_mf_from_mf_to_gr,
+                            (uint32_t)num_gr, false};
+  if (synId == "GRGO")
+    return post ? con_table{(const uint32_t *)innet->pGOfromGRtoGO[0],
+                            innet->numpGOfromGRtoGO, (uint32_t)num_go,
+                            (uint32_t)max_num_p_go_from_gr_to_go,
+                            (uint32_t)num_gr, true}
+                : con_table{(const uint32_t *)innet->pGRfromGRtoGO[0],
+                            innet->numpGRfromGRtoGO, (uint32_t)num_gr,
+                            (uint32_t)max_num_p_gr_from_gr_to_go,
+                            (uint32_t)num_go, false};
+  if (synId == "MFGO")
+    return post ? con_table{(const uint32_t *)innet->pGOfromMFtoGO[0],
+                            innet->numpGOfromMFtoGO, (uint32_t)num_go,
+                            (uint32_t)max_num_p_go_from_mf_to_go,
+                            (uint32_t)num_mf, true}
+                : con_table{(const uint32_t *)innet->pMFfromMFtoGO[0],
+                            innet->numpMFfromMFtoGO, (uint32_t)num_mf,
+                            (uint32_t)max_num_p_mf_from_mf_to_go,
+                            (uint32_t)num_go, false};
+  if (synId == "GOGO")
+    return post ? con_table{(const uint32_t *)innet->pGOGABAInGOGO[0],
+                            innet->numpGOGABAInGOGO, (uint32_t)num_go,
+                            (uint32_t)num_con_go_to_go, (uint32_t)num_go,
+                            true}
+                : con_table{(const uint32_t *)innet->pGOGABAOutGOGO[0],
+                            innet->numpGOGABAOutGOGO, (uint32_t)num_go,
+                            (uint32_t)num_con_go_to_go, (uint32_t)num_go,
+                            false};
+  if (synId == "GOGR")
+    return post ? con_table{(const uint32_t *)innet->pGRfromGOtoGR[0],
+                            innet->numpGRfromGOtoGR, (uint32_t)num_gr,
+                            (uint32_t)max_num_p_gr_from_go_to_gr,
+                            (uint32_t)num_go, true}
+                : con_table{(const uint32_t *)innet->pGOfromGOtoGR[0],
+                            innet->numpGOfromGOtoGR, (uint32_t)num_go,
+                            (uint32_t)max_num_p_go_from_go_to_gr,
+                            (uint32_t)num_gr, false};
+  if (synId == "BCPC")
+    return con_table{mzone->pBCfromBCtoPC[0], NULL, (uint32_t)num_bc,
+                     (uint32_t)num_p_bc_from_bc_to_pc, (uint32_t)num_pc,
+                     false};
+  if (synId == "SCPC")
+    return post ? con_table{mzone->pPCfromSCtoPC[0], NULL, (uint32_t)num_pc,
+                            (uint32_t)num_p_pc_from_sc_to_pc,
+                            (uint32_t)num_sc, true}
+                : con_table{mzone->pSCfromSCtoPC[0], NULL, (uint32_t)num_sc,
+                            (uint32_t)num_p_sc_from_sc_to_pc,
+                            (uint32_t)num_pc, false};
+  if (synId == "PCBC")
+    return con_table{mzone->pPCfromPCtoBC[0], NULL, (uint32_t)num_pc,
+                     (uint32_t)num_p_pc_from_pc_to_bc, (uint32_t)num_bc,
+                     false};
+  if (synId == "PCNC")
+    return post ? con_table{mzone->pNCfromPCtoNC[0], NULL, (uint32_t)num_nc,
+                            (uint32_t)num_p_nc_from_pc_to_nc,
+                            (uint32_t)num_pc, true}
+                : con_table{mzone->pPCfromPCtoNC[0], NULL, (uint32_t)num_pc,
+                            (uint32_t)num_p_pc_from_pc_to_nc,
+                            (uint32_t)num_nc, false};
+  if (synId == "IOIO")
+    return con_table{mzone->pIOInIOIO[0], NULL, (uint32_t)num_io,
+                     (uint32_t)num_p_io_in_io_to_io, (uint32_t)num_io, true};
+  if (synId == "NCIO")
+    return post ? con_table{mzone->pIOfromNCtoIO[0], NULL, (uint32_t)num_io,
+                            (uint32_t)num_p_io_from_nc_to_io,
+                            (uint32_t)num_nc, true}
+                : con_table{mzone->pNCfromNCtoIO[0], NULL, (uint32_t)num_nc,
+                            (uint32_t)num_p_nc_from_nc_to_io,
+                            (uint32_t)num_io, false};
+  // MFNC
+  return {mzone->pNCfromMFtoNC[0], NULL, (uint32_t)num_nc,
+          (uint32_t)num_p_nc_from_mf_to_nc, (uint32_t)num_mf, true};
+}
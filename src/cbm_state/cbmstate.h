@@ -13,11 +13,14 @@
 #define CBMSTATE_H_
 
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits.h>
 #include <time.h>
 
 #include "activityparams.h"
+#include "con_edges.h"
+#include "con_store.h"
 #include "connectivityparams.h" // <-- added in 06/01/2022
 #include "innetactivitystate.h"
 #include "innetconnectivitystate.h"
@@ -28,13 +31,19 @@
 class CBMState {
 public:
   CBMState();
-  CBMState(unsigned int nZones);
+  // proceduralGR: regenerate the granule layer's inputs from a seed rather
+  // than store them (see procedural_con.h)
+  CBMState(unsigned int nZones, bool proceduralGR = false);
+  // on_section, if given, is called after each state section is read
   CBMState(unsigned int nZones, enum plasticity plast_type,
-           std::fstream &sim_file_buf);
+           std::fstream &sim_file_buf,
+           std::function<void()> on_section = nullptr);
   ~CBMState();
 
   void readState(std::fstream &infile);
-  void writeState(std::fstream &outfile);
+  // thin: write the connectivity to the connectivity store (see con_store.h)
+  // and only a reference to it to outfile
+  void writeState(std::fstream &outfile, bool thin = false);
 
   uint32_t getNumZones();
 
@@ -44,9 +53,31 @@ public:
   InNetConnectivityState *getInnetConStateInternal();
   MZoneConnectivityState *getMZoneConStateInternal(unsigned int zoneN);
 
+  // the dense array that holds the synapses of synId (one of MFGR, GRGO, MFGO,
+  // GOGO, GOGR, BCPC, SCPC, PCBC, PCNC, IOIO, NCIO, MFNC) in the first mzone,
+  // seen from the pre-synaptic side, or with post, the post-synaptic side.
+  // Synapse types with connectivity on one side only give it for both
+  con_table getConTable(const std::string &synId, bool post = false);
+
 private:
+  /*
+   * Description:
+   *     reads the thin sim header at the current position of sim_file_buf, if
+   * there is one, and opens the blob it refers to as con_blob. Returns the
+   * stream the connectivity sections are to be read from: con_blob for a thin
+   * sim, sim_file_buf itself otherwise.
+   */
+  std::fstream &openConnectivity(std::fstream &sim_file_buf,
+                                 std::fstream &con_blob);
+
   uint32_t numZones;
 
+  // the blob of the connectivity, once it is known to be in the store. The
+  // connectivity never changes once built, so thin sims written after the
+  // first (such as checkpoints) refer to it without writing and hashing it
+  bool conRefKnown = false;
+  con_blob_ref conRef;
+
   InNetConnectivityState *innetConState;
   MZoneConnectivityState **mzoneConStates;
 
@@ -6,6 +6,7 @@
  */
 
 #include <random>
+#include <sstream>
 
 #include "ecmfpopulation.h"
 #include "file_utility.h"
@@ -101,6 +102,41 @@ void ECMFPopulation::writeToFile(std::fstream &outfile) {
   rawBytesRW((char *)mZoneIndex, num_mf * sizeof(uint32_t), false, outfile);
 }
 
+/*
+ * Implementation Notes:
+ *     the sfmt generators are plain data and written whole. The standard
+ * generator and distribution of the noise are only portable through their
+ * stream operators, so they go as text, prefixed by its length.
+ */
+void ECMFPopulation::runtimeStateRW(std::fstream &file, bool read) {
+  uint32_t fileNThreads = nThreads;
+  rawBytesRW((char *)&fileNThreads, sizeof(uint32_t), read, file);
+  if (read && fileNThreads != nThreads) {
+    LOG_FATAL("Checkpoint holds %u mf generators, expected %u. Exiting...",
+              fileNThreads, nThreads);
+    exit(1);
+  }
+  rawBytesRW((char *)randSeedGen, sizeof(CRandomSFMT0), read, file);
+  for (uint32_t i = 0; i < nThreads; i++)
+    rawBytesRW((char *)randGens[i], sizeof(CRandomSFMT0), read, file);
+
+  std::stringstream noiseBuf;
+  if (!read)
+    noiseBuf << *noiseRandGen << ' ' << *normDist;
+  std::string noiseStr = noiseBuf.str();
+  uint64_t noiseLen = noiseStr.size();
+  rawBytesRW((char *)&noiseLen, sizeof(uint64_t), read, file);
+  noiseStr.resize(noiseLen);
+  rawBytesRW((char *)noiseStr.data(), noiseLen, read, file);
+  if (read) {
+    noiseBuf.str(noiseStr);
+    noiseBuf >> *noiseRandGen >> *normDist;
+  }
+
+  rawBytesRW((char *)aps, num_mf * sizeof(uint8_t), read, file);
+  rawBytesRW((char *)apBufs, num_mf * sizeof(uint32_t), read, file);
+}
+
 void ECMFPopulation::writeMFLabels(std::string labelFileName) {
   LOG_DEBUG("Writing MF labels...");
   std::fstream mflabels(labelFileName.c_str(), std::fstream::out);
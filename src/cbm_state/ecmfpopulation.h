@@ -32,6 +32,9 @@ public:
   ~ECMFPopulation();
 
   void writeToFile(std::fstream &outfile);
+  // reads or writes the generators and spike buffers, which writeToFile
+  // leaves out, for checkpoints (see CBMSimCore::checkpointRW)
+  void runtimeStateRW(std::fstream &file, bool read);
   void writeMFLabels(std::string labelFileName);
 
   const float *getBGFreq();
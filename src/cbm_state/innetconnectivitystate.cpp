@@ -8,7 +8,12 @@
 #include "connectivityparams.h"
 #include "logger.h"
 
-InNetConnectivityState::InNetConnectivityState(int randSeed) {
+// marks a procedural state in a sim file. Legacy files start with the bools
+// of haspGLfromMFtoGL, so no byte of theirs can match it. Reads "PROC"
+const uint32_t PROCEDURAL_CON_MAGIC = 0x434F5250;
+
+InNetConnectivityState::InNetConnectivityState(int randSeed, bool procedural)
+    : procedural(procedural), proceduralSeed((uint32_t)randSeed) {
   CRandomSFMT0 randGen(randSeed);
 
   LOG_DEBUG("allocating and initializing connectivity arrays...");
@@ -20,8 +25,13 @@ InNetConnectivityState::InNetConnectivityState(int randSeed) {
   LOG_DEBUG("Connecting MF and GL");
   connectMFGL_noUBC();
 
-  LOG_DEBUG("Connecting GR and GL");
-  connectGLGR(randGen);
+  if (procedural) {
+    LOG_DEBUG("GR and GL will be connected procedurally from seed %u",
+              proceduralSeed);
+  } else {
+    LOG_DEBUG("Connecting GR and GL");
+    connectGLGR(randGen);
+  }
 
   LOG_DEBUG("Connecting GR to GO");
   connectGRGO();
@@ -36,10 +46,14 @@ InNetConnectivityState::InNetConnectivityState(int randSeed) {
   connectGOGO_GJ(randGen);
 
   LOG_DEBUG("Translating MF GL");
-  translateMFGL();
+  if (!procedural)
+    translateMFGR();
+  translateMFGO();
 
-  LOG_DEBUG("Translating GO and GL");
-  translateGOGL();
+  if (!procedural) {
+    LOG_DEBUG("Translating GO and GL");
+    translateGOGL();
+  }
 
   LOG_DEBUG("Assigning GR delays");
   assignGRDelays();
@@ -48,6 +62,7 @@ InNetConnectivityState::InNetConnectivityState(int randSeed) {
 }
 
 InNetConnectivityState::InNetConnectivityState(std::fstream &infile) {
+  proceduralHeaderRW(true, infile);
   allocateMemory();
   stateRW(true, infile);
 }
@@ -55,13 +70,61 @@ InNetConnectivityState::InNetConnectivityState(std::fstream &infile) {
 InNetConnectivityState::~InNetConnectivityState() { deallocMemory(); }
 
 void InNetConnectivityState::readState(std::fstream &infile) {
+  bool wasProcedural = procedural;
+  proceduralHeaderRW(true, infile);
+  if (procedural != wasProcedural) {
+    LOG_FATAL("Cannot read a %s innet connectivity state into a %s one. "
+              "Exiting...",
+              procedural ? "procedural" : "stored",
+              wasProcedural ? "procedural" : "stored");
+    exit(1);
+  }
   stateRW(true, infile);
 }
 
 void InNetConnectivityState::writeState(std::fstream &outfile) {
+  proceduralHeaderRW(false, outfile);
   stateRW(false, outfile);
 }
 
+procedural_con_params InNetConnectivityState::proceduralParams() {
+  if (max_num_p_gr_from_gl_to_gr > PROC_MAX_GL_PER_GR) {
+    LOG_FATAL("Procedural connectivity supports at most %d gls per gr, not %d. "
+              "Exiting...",
+              PROC_MAX_GL_PER_GR, max_num_p_gr_from_gl_to_gr);
+    exit(1);
+  }
+  return {proceduralSeed,
+          gr_x,
+          gl_x,
+          gl_y,
+          (float)gr_x / (float)gl_x,
+          span_gl_to_gr_x,
+          span_gl_to_gr_y,
+          max_num_p_gr_from_gl_to_gr};
+}
+
+/*
+ * Implementation Notes:
+ *     the arrays are filled just as the constructor fills them for a stored
+ * state, only with gl -> gr drawn by fillProceduralGLGR.
+ */
+void InNetConnectivityState::materializeGRInputs() {
+  if (!procedural || pGRfromGLtoGR)
+    return;
+  LOG_DEBUG("Materializing procedural gr inputs...");
+  allocateGRInputs();
+  initializeGRInputVals();
+  fillProceduralGLGR();
+  translateMFGR();
+  translateGOGL();
+}
+
+void InNetConnectivityState::releaseGRInputs() {
+  if (procedural)
+    deallocGRInputs();
+}
+
 void InNetConnectivityState::numPMFfromMFtoGRRW(std::fstream &file, bool read) {
   rawBytesRW((char *)numpMFfromMFtoGR, num_mf * sizeof(int), read, file);
 }
@@ -192,17 +255,11 @@ void InNetConnectivityState::allocateMemory() {
   numpGLfromGOtoGL = new int[num_gl];
   pGLfromGOtoGL = allocate2DArray<int>(num_gl, max_num_p_gl_from_go_to_gl);
 
-  numpGLfromGLtoGR = new int[num_gl];
-  pGLfromGLtoGR = allocate2DArray<int>(num_gl, max_num_p_gl_from_gl_to_gr);
-
   pGLfromMFtoGL = new int[num_gl];
 
   numpMFfromMFtoGL = new int[num_mf];
   pMFfromMFtoGL = allocate2DArray<int>(num_mf, max_num_p_mf_from_mf_to_gl);
 
-  numpMFfromMFtoGR = new int[num_mf];
-  pMFfromMFtoGR = allocate2DArray<int>(num_mf, max_num_p_mf_from_mf_to_gr);
-
   numpMFfromMFtoGO = new int[num_mf];
   pMFfromMFtoGO = allocate2DArray<int>(num_mf, max_num_p_mf_from_mf_to_go);
 
@@ -216,9 +273,6 @@ void InNetConnectivityState::allocateMemory() {
   numpGOfromMFtoGO = new int[num_go];
   pGOfromMFtoGO = allocate2DArray<int>(num_go, max_num_p_go_from_mf_to_go);
 
-  numpGOfromGOtoGR = new int[num_go];
-  pGOfromGOtoGR = allocate2DArray<int>(num_go, max_num_p_go_from_go_to_gr);
-
   numpGOfromGRtoGO = new int[num_go];
   pGOfromGRtoGO = allocate2DArray<int>(num_go, max_num_p_go_from_gr_to_go);
 
@@ -239,15 +293,29 @@ void InNetConnectivityState::allocateMemory() {
   pGOCoupOutGOGOCCoeff = allocate2DArray<float>(num_go, num_p_go_to_go_gj);
   pGOCoupInGOGOCCoeff = allocate2DArray<float>(num_go, num_p_go_to_go_gj);
 
-  numpGRfromGLtoGR = new int[num_gr];
-  pGRfromGLtoGR = allocate2DArray<int>(num_gr, max_num_p_gr_from_gl_to_gr);
-
   numpGRfromGRtoGO = new int[num_gr];
   pGRfromGRtoGO = allocate2DArray<int>(num_gr, max_num_p_gr_from_gr_to_go);
 
   pGRDelayMaskfromGRtoGO =
       allocate2DArray<int>(num_gr, max_num_p_gr_from_gr_to_go);
 
+  if (!procedural)
+    allocateGRInputs();
+}
+
+void InNetConnectivityState::allocateGRInputs() {
+  numpGLfromGLtoGR = new int[num_gl];
+  pGLfromGLtoGR = allocate2DArray<int>(num_gl, max_num_p_gl_from_gl_to_gr);
+
+  numpMFfromMFtoGR = new int[num_mf];
+  pMFfromMFtoGR = allocate2DArray<int>(num_mf, max_num_p_mf_from_mf_to_gr);
+
+  numpGOfromGOtoGR = new int[num_go];
+  pGOfromGOtoGR = allocate2DArray<int>(num_go, max_num_p_go_from_go_to_gr);
+
+  numpGRfromGLtoGR = new int[num_gr];
+  pGRfromGLtoGR = allocate2DArray<int>(num_gr, max_num_p_gr_from_gl_to_gr);
+
   numpGRfromGOtoGR = new int[num_gr];
   pGRfromGOtoGR = allocate2DArray<int>(num_gr, max_num_p_gr_from_go_to_gr);
 
@@ -266,20 +334,12 @@ void InNetConnectivityState::initializeVals() {
   std::fill(pGLfromGOtoGL[0],
             pGLfromGOtoGL[0] + num_gl * max_num_p_gl_from_go_to_gl, UINT_MAX);
 
-  std::fill(numpGLfromGLtoGR, numpGLfromGLtoGR + num_gl, 0);
-  std::fill(pGLfromGLtoGR[0],
-            pGLfromGLtoGR[0] + num_gl * max_num_p_gl_from_gl_to_gr, UINT_MAX);
-
   std::fill(pGLfromMFtoGL, pGLfromMFtoGL + num_gl, 0);
 
   std::fill(numpMFfromMFtoGL, numpMFfromMFtoGL + num_mf, 0);
   std::fill(pMFfromMFtoGL[0],
             pMFfromMFtoGL[0] + num_mf * max_num_p_mf_from_mf_to_gl, UINT_MAX);
 
-  std::fill(numpMFfromMFtoGR, numpMFfromMFtoGR + num_mf, 0);
-  std::fill(pMFfromMFtoGR[0],
-            pMFfromMFtoGR[0] + num_mf * max_num_p_mf_from_mf_to_gr, UINT_MAX);
-
   std::fill(numpMFfromMFtoGO, numpMFfromMFtoGO + num_mf, 0);
   std::fill(pMFfromMFtoGO[0],
             pMFfromMFtoGO[0] + num_mf * max_num_p_mf_from_mf_to_go, UINT_MAX);
@@ -296,10 +356,6 @@ void InNetConnectivityState::initializeVals() {
   std::fill(pGOfromMFtoGO[0],
             pGOfromMFtoGO[0] + num_go * max_num_p_go_from_mf_to_go, UINT_MAX);
 
-  std::fill(numpGOfromGOtoGR, numpGOfromGOtoGR + num_go, 0);
-  std::fill(pGOfromGOtoGR[0],
-            pGOfromGOtoGR[0] + num_go * max_num_p_go_from_go_to_gr, UINT_MAX);
-
   std::fill(numpGOfromGRtoGO, numpGOfromGRtoGO + num_go, 0);
   std::fill(pGOfromGRtoGO[0],
             pGOfromGRtoGO[0] + num_go * max_num_p_go_from_gr_to_go, UINT_MAX);
@@ -326,10 +382,6 @@ void InNetConnectivityState::initializeVals() {
   std::fill(pGOCoupInGOGOCCoeff[0],
             pGOCoupInGOGOCCoeff[0] + num_go * num_p_go_to_go_gj, UINT_MAX);
 
-  std::fill(numpGRfromGLtoGR, numpGRfromGLtoGR + num_gr, 0);
-  std::fill(pGRfromGLtoGR[0],
-            pGRfromGLtoGR[0] + num_gr * max_num_p_gr_from_gl_to_gr, UINT_MAX);
-
   std::fill(numpGRfromGRtoGO, numpGRfromGRtoGO + num_gr, 0);
   std::fill(pGRfromGRtoGO[0],
             pGRfromGRtoGO[0] + num_gr * max_num_p_gr_from_gr_to_go, UINT_MAX);
@@ -338,6 +390,27 @@ void InNetConnectivityState::initializeVals() {
             pGRDelayMaskfromGRtoGO[0] + num_gr * max_num_p_gr_from_gr_to_go,
             UINT_MAX);
 
+  if (!procedural)
+    initializeGRInputVals();
+}
+
+void InNetConnectivityState::initializeGRInputVals() {
+  std::fill(numpGLfromGLtoGR, numpGLfromGLtoGR + num_gl, 0);
+  std::fill(pGLfromGLtoGR[0],
+            pGLfromGLtoGR[0] + num_gl * max_num_p_gl_from_gl_to_gr, UINT_MAX);
+
+  std::fill(numpMFfromMFtoGR, numpMFfromMFtoGR + num_mf, 0);
+  std::fill(pMFfromMFtoGR[0],
+            pMFfromMFtoGR[0] + num_mf * max_num_p_mf_from_mf_to_gr, UINT_MAX);
+
+  std::fill(numpGOfromGOtoGR, numpGOfromGOtoGR + num_go, 0);
+  std::fill(pGOfromGOtoGR[0],
+            pGOfromGOtoGR[0] + num_go * max_num_p_go_from_go_to_gr, UINT_MAX);
+
+  std::fill(numpGRfromGLtoGR, numpGRfromGLtoGR + num_gr, 0);
+  std::fill(pGRfromGLtoGR[0],
+            pGRfromGLtoGR[0] + num_gr * max_num_p_gr_from_gl_to_gr, UINT_MAX);
+
   std::fill(numpGRfromGOtoGR, numpGRfromGOtoGR + num_gr, 0);
   std::fill(pGRfromGOtoGR[0],
             pGRfromGOtoGR[0] + num_gr * max_num_p_gr_from_go_to_gr, UINT_MAX);
@@ -354,13 +427,9 @@ void InNetConnectivityState::deallocMemory() {
   delete2DArray<int>(pGLfromGLtoGO);
   delete[] numpGLfromGOtoGL;
   delete2DArray<int>(pGLfromGOtoGL);
-  delete[] numpGLfromGLtoGR;
-  delete2DArray<int>(pGLfromGLtoGR);
   delete[] pGLfromMFtoGL;
   delete[] numpMFfromMFtoGL;
   delete2DArray<int>(pMFfromMFtoGL);
-  delete[] numpMFfromMFtoGR;
-  delete2DArray<int>(pMFfromMFtoGR);
   delete[] numpMFfromMFtoGO;
   delete2DArray<int>(pMFfromMFtoGO);
 
@@ -371,8 +440,6 @@ void InNetConnectivityState::deallocMemory() {
   delete2DArray<int>(pGOfromGOtoGL);
   delete[] numpGOfromMFtoGO;
   delete2DArray<int>(pGOfromMFtoGO);
-  delete[] numpGOfromGOtoGR;
-  delete2DArray<int>(pGOfromGOtoGR);
   delete[] numpGOfromGRtoGO;
   delete2DArray<int>(pGOfromGRtoGO);
 
@@ -391,15 +458,65 @@ void InNetConnectivityState::deallocMemory() {
   delete2DArray<float>(pGOCoupInGOGOCCoeff);
 
   // granule
-  delete[] numpGRfromGLtoGR;
-  delete2DArray<int>(pGRfromGLtoGR);
   delete[] numpGRfromGRtoGO;
   delete2DArray<int>(pGRfromGRtoGO);
   delete2DArray<int>(pGRDelayMaskfromGRtoGO);
+
+  deallocGRInputs();
+}
+
+void InNetConnectivityState::deallocGRInputs() {
+  if (!pGRfromGLtoGR)
+    return;
+  delete[] numpGLfromGLtoGR;
+  delete2DArray<int>(pGLfromGLtoGR);
+  delete[] numpMFfromMFtoGR;
+  delete2DArray<int>(pMFfromMFtoGR);
+  delete[] numpGOfromGOtoGR;
+  delete2DArray<int>(pGOfromGOtoGR);
+  delete[] numpGRfromGLtoGR;
+  delete2DArray<int>(pGRfromGLtoGR);
   delete[] numpGRfromGOtoGR;
   delete2DArray<int>(pGRfromGOtoGR);
   delete[] numpGRfromMFtoGR;
   delete2DArray<int>(pGRfromMFtoGR);
+
+  numpGLfromGLtoGR = nullptr;
+  pGLfromGLtoGR = nullptr;
+  numpMFfromMFtoGR = nullptr;
+  pMFfromMFtoGR = nullptr;
+  numpGOfromGOtoGR = nullptr;
+  pGOfromGOtoGR = nullptr;
+  numpGRfromGLtoGR = nullptr;
+  pGRfromGLtoGR = nullptr;
+  numpGRfromGOtoGR = nullptr;
+  pGRfromGOtoGR = nullptr;
+  numpGRfromMFtoGR = nullptr;
+  pGRfromMFtoGR = nullptr;
+}
+
+/*
+ * Implementation Notes:
+ *     a procedural state is written as the magic number and its seed, followed
+ * by stateRW's arrays minus the gr inputs. A file without the magic number is
+ * a stored state, so reading one leaves the stream where it was.
+ */
+void InNetConnectivityState::proceduralHeaderRW(bool read, std::fstream &file) {
+  uint32_t magic = PROCEDURAL_CON_MAGIC;
+  if (read) {
+    std::streampos start = file.tellg();
+    file.read((char *)&magic, sizeof(uint32_t));
+    procedural = file && magic == PROCEDURAL_CON_MAGIC;
+    if (!procedural) {
+      file.clear();
+      file.seekg(start);
+      return;
+    }
+    file.read((char *)&proceduralSeed, sizeof(uint32_t));
+  } else if (procedural) {
+    file.write((char *)&magic, sizeof(uint32_t));
+    file.write((char *)&proceduralSeed, sizeof(uint32_t));
+  }
 }
 
 void InNetConnectivityState::stateRW(bool read, std::fstream &file) {
@@ -411,9 +528,11 @@ void InNetConnectivityState::stateRW(bool read, std::fstream &file) {
   rawBytesRW((char *)numpGLfromGOtoGL, num_gl * sizeof(int), read, file);
   rawBytesRW((char *)pGLfromGOtoGL[0],
              num_gl * max_num_p_gl_from_go_to_gl * sizeof(int), read, file);
-  rawBytesRW((char *)numpGLfromGLtoGR, num_gl * sizeof(int), read, file);
-  rawBytesRW((char *)pGLfromGLtoGR[0],
-             num_gl * max_num_p_gl_from_gl_to_gr * sizeof(int), read, file);
+  if (!procedural) {
+    rawBytesRW((char *)numpGLfromGLtoGR, num_gl * sizeof(int), read, file);
+    rawBytesRW((char *)pGLfromGLtoGR[0],
+               num_gl * max_num_p_gl_from_gl_to_gr * sizeof(int), read, file);
+  }
   rawBytesRW((char *)pGLfromMFtoGL, num_gl * sizeof(int), read, file);
 
   // mossy fibers
@@ -421,9 +540,11 @@ void InNetConnectivityState::stateRW(bool read, std::fstream &file) {
   rawBytesRW((char *)pMFfromMFtoGL[0],
              num_mf * max_num_p_mf_from_mf_to_gl * sizeof(int), read, file);
 
-  rawBytesRW((char *)numpMFfromMFtoGR, num_mf * sizeof(int), read, file);
-  rawBytesRW((char *)pMFfromMFtoGR[0],
-             num_mf * max_num_p_mf_from_mf_to_gr * sizeof(int), read, file);
+  if (!procedural) {
+    rawBytesRW((char *)numpMFfromMFtoGR, num_mf * sizeof(int), read, file);
+    rawBytesRW((char *)pMFfromMFtoGR[0],
+               num_mf * max_num_p_mf_from_mf_to_gr * sizeof(int), read, file);
+  }
 
   rawBytesRW((char *)numpMFfromMFtoGO, num_mf * sizeof(int), read, file);
   rawBytesRW((char *)pMFfromMFtoGO[0],
@@ -442,9 +563,11 @@ void InNetConnectivityState::stateRW(bool read, std::fstream &file) {
   rawBytesRW((char *)pGOfromMFtoGO[0],
              num_go * max_num_p_go_from_mf_to_go * sizeof(int), read, file);
 
-  rawBytesRW((char *)numpGOfromGOtoGR, num_go * sizeof(int), read, file);
-  rawBytesRW((char *)pGOfromGOtoGR[0],
-             num_go * max_num_p_go_from_go_to_gr * sizeof(int), read, file);
+  if (!procedural) {
+    rawBytesRW((char *)numpGOfromGOtoGR, num_go * sizeof(int), read, file);
+    rawBytesRW((char *)pGOfromGOtoGR[0],
+               num_go * max_num_p_go_from_go_to_gr * sizeof(int), read, file);
+  }
 
   rawBytesRW((char *)numpGOfromGRtoGO, num_go * sizeof(int), read, file);
   rawBytesRW((char *)pGOfromGRtoGO[0],
@@ -471,9 +594,11 @@ void InNetConnectivityState::stateRW(bool read, std::fstream &file) {
   rawBytesRW((char *)pGOCoupInGOGOCCoeff[0],
              num_go * num_p_go_to_go_gj * sizeof(float), read, file);
 
-  rawBytesRW((char *)numpGRfromGLtoGR, num_gr * sizeof(int), read, file);
-  rawBytesRW((char *)pGRfromGLtoGR[0],
-             num_gr * max_num_p_gr_from_gl_to_gr * sizeof(int), read, file);
+  if (!procedural) {
+    rawBytesRW((char *)numpGRfromGLtoGR, num_gr * sizeof(int), read, file);
+    rawBytesRW((char *)pGRfromGLtoGR[0],
+               num_gr * max_num_p_gr_from_gl_to_gr * sizeof(int), read, file);
+  }
 
   rawBytesRW((char *)numpGRfromGRtoGO, num_gr * sizeof(int), read, file);
   rawBytesRW((char *)pGRfromGRtoGO[0],
@@ -481,13 +606,15 @@ void InNetConnectivityState::stateRW(bool read, std::fstream &file) {
   rawBytesRW((char *)pGRDelayMaskfromGRtoGO[0],
              num_gr * max_num_p_gr_from_gr_to_go * sizeof(int), read, file);
 
-  rawBytesRW((char *)numpGRfromGOtoGR, num_gr * sizeof(int), read, file);
-  rawBytesRW((char *)pGRfromGOtoGR[0],
-             num_gr * max_num_p_gr_from_go_to_gr * sizeof(int), read, file);
+  if (!procedural) {
+    rawBytesRW((char *)numpGRfromGOtoGR, num_gr * sizeof(int), read, file);
+    rawBytesRW((char *)pGRfromGOtoGR[0],
+               num_gr * max_num_p_gr_from_go_to_gr * sizeof(int), read, file);
 
-  rawBytesRW((char *)numpGRfromMFtoGR, num_gr * sizeof(int), read, file);
-  rawBytesRW((char *)pGRfromMFtoGR[0],
-             num_gr * max_num_p_gr_from_mf_to_gr * sizeof(int), read, file);
+    rawBytesRW((char *)numpGRfromMFtoGR, num_gr * sizeof(int), read, file);
+    rawBytesRW((char *)pGRfromMFtoGR[0],
+               num_gr * max_num_p_gr_from_mf_to_gr * sizeof(int), read, file);
+  }
 }
 
 void InNetConnectivityState::connectMFGL_noUBC() {
@@ -670,6 +797,36 @@ void InNetConnectivityState::connectGLGR(CRandomSFMT &randGen) {
   LOG_DEBUG("Correct number: %d", num_gr * max_num_p_gr_from_gl_to_gr);
 }
 
+/*
+ * Implementation Notes:
+ *     fills gl -> gr as connectGLGR would, but with the gls drawn by
+ * procedural_gr_gls, the same ones the gpus regenerate each step. Without a
+ * cap per gl, a gl could in principle be drawn by more grs than pGLfromGLtoGR
+ * has room for; those grs keep the gl, only its list of grs is cut short.
+ */
+void InNetConnectivityState::fillProceduralGLGR() {
+  procedural_con_params params = proceduralParams();
+  int32_t gls[PROC_MAX_GL_PER_GR];
+  int numDropped = 0;
+
+  for (int i = 0; i < num_gr; i++) {
+    int numGLs = procedural_gr_gls(params, i, gls);
+    for (int j = 0; j < numGLs; j++) {
+      pGRfromGLtoGR[i][j] = gls[j];
+      numpGRfromGLtoGR[i]++;
+      if (numpGLfromGLtoGR[gls[j]] < max_num_p_gl_from_gl_to_gr) {
+        pGLfromGLtoGR[gls[j]][numpGLfromGLtoGR[gls[j]]] = i;
+        numpGLfromGLtoGR[gls[j]]++;
+      } else {
+        numDropped++;
+      }
+    }
+  }
+  if (numDropped > 0)
+    LOG_WARN("%d gl -> gr connections did not fit in their gl's list of grs",
+             numDropped);
+}
+
 void InNetConnectivityState::connectGRGO() {
   int spanArrayPFtoGOX[span_pf_to_go_x + 1] = {0};
   int spanArrayPFtoGOY[span_pf_to_go_y + 1] = {0};
@@ -1229,10 +1386,9 @@ void InNetConnectivityState::connectGOGO_GJ(CRandomSFMT &randGen) {
 
 /**
  * @details translates mf -> gl connections
- * to mf -> gr and mf -> go connections
+ * to mf -> gr connections
  */
-void InNetConnectivityState::translateMFGL() {
-  // Mossy fiber to Granule
+void InNetConnectivityState::translateMFGR() {
   for (int i = 0; i < num_gr; i++) {
     for (int j = 0; j < numpGRfromGLtoGR[i]; j++) {
       int glIndex = pGRfromGLtoGR[i][j];
@@ -1262,8 +1418,13 @@ void InNetConnectivityState::translateMFGL() {
   }
   LOG_DEBUG("MF-GR average divergence: %0.2f",
             grMFOutputCounter / (float)num_mf);
+}
 
-  // Mossy fiber to Golgi
+/**
+ * @details translates mf -> gl connections
+ * to mf -> go connections
+ */
+void InNetConnectivityState::translateMFGO() {
   for (int i = 0; i < num_go; i++) {
     for (int j = 0; j < numpGOfromGLtoGO[i]; j++) {
       int glIndex = pGOfromGLtoGO[i][j];
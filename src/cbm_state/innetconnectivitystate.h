@@ -17,6 +17,11 @@
  *    mf -> go
  *    gr -> go
  *    go -> gr
+ *
+ *  In procedural mode (see procedural_con.h) gl -> gr is not drawn here, and
+ *  neither it nor the mf -> gr and go -> gr connections translated from it are
+ *  stored: the gr input arrays below are nullptr until materializeGRInputs
+ *  fills them from the seed.
  */
 
 #ifndef INNETCONNECTIVITYSTATE_H_
@@ -32,19 +37,30 @@
 
 #include "dynamic2darray.h"
 #include "file_utility.h"
+#include "procedural_con.h"
 #include "sfmt.h"
 #include <cstdint>
 
 class InNetConnectivityState {
 public:
   InNetConnectivityState();
-  InNetConnectivityState(int randSeed);
+  InNetConnectivityState(int randSeed, bool procedural = false);
   InNetConnectivityState(std::fstream &infile);
   ~InNetConnectivityState();
 
   void readState(std::fstream &infile);
   void writeState(std::fstream &outfile);
 
+  // the parameters from which procedural mode regenerates gl -> gr
+  procedural_con_params proceduralParams();
+
+  // allocates and fills the gr input arrays of a procedural state from its
+  // seed, for the consumers that need them stored (eg saving the mf -> gr and
+  // go -> gr connectivity arrays). Does nothing if they are already there.
+  void materializeGRInputs();
+  // frees what materializeGRInputs allocated
+  void releaseGRInputs();
+
   // file IO arrays
 
   // who the MFs connect to...
@@ -94,19 +110,23 @@ public:
   void numPGRfromMFtoGRRW(std::fstream &file, bool read);
   void pGRfromMFtoGRRW(std::fstream &file, bool read);
 
+  // whether gl -> gr is regenerated from proceduralSeed instead of stored
+  bool procedural = false;
+  uint32_t proceduralSeed = 0;
+
   // glomerulus
   bool *haspGLfromMFtoGL;
   int *numpGLfromGLtoGO;
   int **pGLfromGLtoGO;
   int *numpGLfromGOtoGL;
   int **pGLfromGOtoGL;
-  int *numpGLfromGLtoGR;
-  int **pGLfromGLtoGR;
+  int *numpGLfromGLtoGR = nullptr;
+  int **pGLfromGLtoGR = nullptr;
   int *pGLfromMFtoGL;
   int *numpMFfromMFtoGL;
   int **pMFfromMFtoGL;
-  int *numpMFfromMFtoGR;
-  int **pMFfromMFtoGR;
+  int *numpMFfromMFtoGR = nullptr;
+  int **pMFfromMFtoGR = nullptr;
   int *numpMFfromMFtoGO;
   int **pMFfromMFtoGO;
 
@@ -117,8 +137,8 @@ public:
   int **pGOfromGOtoGL;
   int *numpGOfromMFtoGO;
   int **pGOfromMFtoGO;
-  int *numpGOfromGOtoGR;
-  int **pGOfromGOtoGR;
+  int *numpGOfromGOtoGR = nullptr;
+  int **pGOfromGOtoGR = nullptr;
   int *numpGOfromGRtoGO;
   int **pGOfromGRtoGO;
 
@@ -137,20 +157,24 @@ public:
   float **pGOCoupInGOGOCCoeff;
 
   // granule
-  int *numpGRfromGLtoGR;
-  int **pGRfromGLtoGR;
+  int *numpGRfromGLtoGR = nullptr;
+  int **pGRfromGLtoGR = nullptr;
   int *numpGRfromGRtoGO;
   int **pGRfromGRtoGO;
   int **pGRDelayMaskfromGRtoGO;
-  int *numpGRfromGOtoGR;
-  int **pGRfromGOtoGR;
-  int *numpGRfromMFtoGR;
-  int **pGRfromMFtoGR;
+  int *numpGRfromGOtoGR = nullptr;
+  int **pGRfromGOtoGR = nullptr;
+  int *numpGRfromMFtoGR = nullptr;
+  int **pGRfromMFtoGR = nullptr;
 
 protected:
   void allocateMemory();
+  void allocateGRInputs();
   void initializeVals();
+  void initializeGRInputVals();
   void deallocMemory();
+  void deallocGRInputs();
+  void proceduralHeaderRW(bool read, std::fstream &file);
   void stateRW(bool read, std::fstream &file);
 
   void connectMFGL_noUBC();
@@ -159,7 +183,9 @@ protected:
   void connectGOGL(CRandomSFMT &randGen);
   void connectGOGODecayP(CRandomSFMT &randGen);
   void connectGOGO_GJ(CRandomSFMT &randGen);
-  void translateMFGL();
+  void fillProceduralGLGR();
+  void translateMFGR();
+  void translateMFGO();
   void translateGOGL();
   void assignGRDelays();
 };
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <fstream>
+#include <sys/stat.h> // stat (POSIX ONLY)
+
+#include "activityparams.h"
+#include "json.hpp"
+#include "logger.h"
+#include "param_overlay.h"
+
+using json = nlohmann::json;
+
+typedef struct {
+  int64_t mtime_ns;
+  int64_t size;
+} file_stamp;
+
+static file_stamp stamp_of(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return {-1, -1};
+  return {(int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec,
+          (int64_t)st.st_size};
+}
+
+ParamOverlay::ParamOverlay(std::string watch_file) : watch_file(watch_file) {
+  if (watch_file.empty())
+    return;
+  load_watch_file();
+  watcher = std::thread(&ParamOverlay::watch_loop, this);
+}
+
+ParamOverlay::~ParamOverlay() {
+  if (!watcher.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  watcher.join();
+}
+
+bool ParamOverlay::stage(std::string name, float value) {
+  if (!find_act_param(name) || act_param_is_init_only(name))
+    return false;
+  std::lock_guard<std::mutex> guard(lock);
+  pending[name] = value;
+  has_pending.store(true, std::memory_order_release);
+  return true;
+}
+
+bool ParamOverlay::apply_pending() {
+  if (!has_pending.load(std::memory_order_acquire))
+    return false;
+  std::map<std::string, float> batch;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    batch.swap(pending);
+    has_pending.store(false, std::memory_order_relaxed);
+  }
+  bool changed = false;
+  for (auto &entry : batch) {
+    float *param = find_act_param(entry.first);
+    if (*param == entry.second)
+      continue;
+    LOG_INFO("Setting '%s' from %g to %g", entry.first.c_str(), *param,
+             entry.second);
+    *param = entry.second;
+    changed = true;
+  }
+  if (changed)
+    recompute_derived_act_params();
+  return changed;
+}
+
+/*
+ * Implementation Notes:
+ *     a file that fails to parse is most likely mid-save, so it is reported
+ * and skipped: the write that completes it changes its stamp again.
+ */
+void ParamOverlay::load_watch_file() {
+  std::ifstream in_buf(watch_file);
+  if (!in_buf.is_open()) {
+    LOG_WARN("Couldn't open parameter file '%s'.", watch_file.c_str());
+    return;
+  }
+  json params = json::parse(in_buf, nullptr, false);
+  if (params.is_discarded() || !params.is_object()) {
+    LOG_WARN("Parameter file '%s' is not a json object of name-value pairs. "
+             "Ignoring it until it changes...",
+             watch_file.c_str());
+    return;
+  }
+  for (auto &param : params.items()) {
+    if (!param.value().is_number()) {
+      LOG_WARN("Value of '%s' in '%s' is not a number. Ignoring it...",
+               param.key().c_str(), watch_file.c_str());
+    } else if (act_param_is_init_only(param.key())) {
+      LOG_WARN("'%s' in '%s' is only read when the network is built, so it "
+               "can't be changed while a sim runs. Ignoring it...",
+               param.key().c_str(), watch_file.c_str());
+    } else if (!stage(param.key(), param.value().get<float>())) {
+      LOG_WARN("Unknown activity parameter '%s' in '%s'. Ignoring it...",
+               param.key().c_str(), watch_file.c_str());
+    }
+  }
+}
+
+void ParamOverlay::watch_loop() {
+  file_stamp last = stamp_of(watch_file);
+  std::unique_lock<std::mutex> guard(lock);
+  while (!wake.wait_for(guard,
+                        std::chrono::milliseconds(PARAM_WATCH_INTERVAL_MS),
+                        [this] { return stopping; })) {
+    guard.unlock();
+    file_stamp now = stamp_of(watch_file);
+    if (now.mtime_ns != last.mtime_ns || now.size != last.size) {
+      last = now;
+      if (now.size >= 0) {
+        LOG_DEBUG("Parameter file '%s' changed. Reloading...",
+                  watch_file.c_str());
+        load_watch_file();
+      }
+    }
+    guard.lock();
+  }
+}
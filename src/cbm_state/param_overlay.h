@@ -0,0 +1,82 @@
+/*
+ * File: param_overlay.h
+ *
+ * Description:
+ *     This is the interface file for hot parameter reload. A ParamOverlay
+ * collects changes to raw activity parameters (see find_act_param in
+ * activityparams.h) from any thread -- the gui's tuning window, or a json file
+ * of {"name": value} pairs that is watched for changes -- and applies them
+ * only when the simulation thread calls apply_pending at a time step boundary.
+ * A batch is applied all at once, followed by a single recomputation of the
+ * derived parameters, so no step ever sees half of an edit or a derived
+ * constant that disagrees with its raw parameter.
+ *
+ *     The kernels and host stages take their parameters as arguments on
+ * every launch, so a change applied between two steps takes effect on the
+ * next one. Connectivity and the time step (msPerTimeStep) cannot be changed
+ * this way.
+ */
+#ifndef PARAM_OVERLAY_H_
+#define PARAM_OVERLAY_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// how often the watched file's modification time is checked
+const uint32_t PARAM_WATCH_INTERVAL_MS = 250;
+
+class ParamOverlay {
+public:
+  /*
+   * Description:
+   *     watch_file is a json file of raw parameter values, read once now and
+   * again whenever it changes. Pass an empty string to take changes only
+   * through stage.
+   */
+  ParamOverlay(std::string watch_file);
+
+  /*
+   * Description:
+   *     stops the watcher. Changes still pending are dropped.
+   */
+  ~ParamOverlay();
+
+  /*
+   * Description:
+   *     queues 'value' for the raw parameter 'name'. Returns false, and queues
+   * nothing, if there is no such parameter or it is only read when the
+   * network is built (see act_param_is_init_only). Safe to call from any
+   * thread.
+   */
+  bool stage(std::string name, float value);
+
+  /*
+   * Description:
+   *     applies every queued change and recomputes the derived parameters.
+   * Must only be called from the simulation thread, between steps. Returns
+   * true if anything was applied.
+   */
+  bool apply_pending();
+
+private:
+  void watch_loop();
+  void load_watch_file();
+
+  std::string watch_file;
+
+  // guard the queued changes
+  std::mutex lock;
+  std::map<std::string, float> pending;
+  // set with pending, so that apply_pending costs one load when idle
+  std::atomic<bool> has_pending{false};
+
+  std::condition_variable wake;
+  bool stopping = false;
+  std::thread watcher;
+};
+
+#endif /* PARAM_OVERLAY_H_ */
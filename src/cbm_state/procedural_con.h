@@ -0,0 +1,119 @@
+/*
+ * File: procedural_con.h
+ *
+ * Description:
+ *     This is the interface file for procedural granule connectivity. Instead
+ * of drawing each gr's glomeruli from a sequential random number generator and
+ * storing them (and the mf -> gr and go -> gr tables translated from them),
+ * slot i of gr n is drawn from a counter-based hash of (seed, n, i, attempt).
+ * Any gr's inputs can then be regenerated, in any order and on host or device
+ * alike, from the seed and the small per-glomerulus tables (which mf and which
+ * go feeds each gl), so the gpus recompute them during the step rather than
+ * reading them from memory.
+ *
+ *     The placement rule is that of InNetConnectivityState::connectGLGR: a
+ * gr's gls are drawn around its position scaled to the gl grid, within
+ * span_gl_to_gr_x by span_gl_to_gr_y, and are unique per gr. The one rule
+ * that cannot be kept is the cap on the number of grs per gl, which depends on
+ * the order in which the grs were connected: every slot is filled, and the
+ * number of grs per gl follows from the spans alone.
+ *
+ *     Everything here is plain arithmetic on integers and exactly rounded
+ * floats, so that host and device draw the same gls.
+ */
+#ifndef PROCEDURAL_CON_H_
+#define PROCEDURAL_CON_H_
+
+#include <cmath>
+#include <cstdint>
+
+#ifdef __CUDACC__
+#define CBM_HD __host__ __device__
+#else
+#define CBM_HD
+#endif
+
+// room for the gls of one gr; max_num_p_gr_from_gl_to_gr may not exceed it
+const int PROC_MAX_GL_PER_GR = 8;
+
+// draws per slot before it is left empty. With 25 candidate gls per gr, none
+// more likely than 1/16, a slot is left empty with probability below 1e-38
+const int PROC_MAX_ATTEMPTS = 64;
+
+/*
+ * the connectivity parameters the draw depends on, gathered on the host so
+ * that kernels, which cannot read the globals in connectivityparams, can be
+ * given them by value
+ */
+typedef struct {
+  uint32_t seed;
+  int gr_x;
+  int gl_x;
+  int gl_y;
+  float scale_x; // gr_x / gl_x, also used along y, as in connectGLGR
+  int span_x;
+  int span_y;
+  int num_slots; // gls per gr
+} procedural_con_params;
+
+/*
+ * Description:
+ *     64 bits of hash of one draw. Two rounds of the splitmix64 finalizer, so
+ * that neighbouring cells, slots and attempts give unrelated values.
+ */
+CBM_HD inline uint64_t con_hash(uint32_t seed, uint32_t cell, uint32_t slot,
+                                uint32_t attempt) {
+  uint64_t z = ((uint64_t)seed << 32 | cell) + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= (z >> 31) ^ ((uint64_t)slot << 32 | attempt);
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * Description:
+ *     fills gls with the glomeruli of gr 'gr' and returns how many there are
+ * (num_slots, but for a vanishingly unlikely empty slot). gls must have room
+ * for num_slots entries.
+ */
+CBM_HD inline int procedural_gr_gls(const procedural_con_params &p,
+                                    uint32_t gr, int32_t *gls) {
+  int srcPosX = gr % p.gr_x;
+  int srcPosY = gr / p.gr_x;
+  int basePosX = (int)roundf(srcPosX / p.scale_x);
+  int basePosY = (int)roundf(srcPosY / p.scale_x);
+
+  int num_gls = 0;
+  for (int slot = 0; slot < p.num_slots; slot++) {
+    for (int attempt = 0; attempt < PROC_MAX_ATTEMPTS; attempt++) {
+      uint64_t h = con_hash(p.seed, gr, slot, attempt);
+      // two independent 24-bit uniforms in [0, 1), exact as floats
+      float ux = (float)(h >> 40) * (1.0f / 16777216.0f);
+      float uy = (float)((h >> 8) & 0xFFFFFF) * (1.0f / 16777216.0f);
+
+      int destPosX = basePosX + (int)roundf((ux - 0.5f) * p.span_x);
+      int destPosY = basePosY + (int)roundf((uy - 0.5f) * p.span_y);
+      destPosX = (destPosX % p.gl_x + p.gl_x) % p.gl_x;
+      destPosY = (destPosY % p.gl_y + p.gl_y) % p.gl_y;
+      int32_t destIndex = destPosY * p.gl_x + destPosX;
+
+      bool unique = true;
+      for (int j = 0; j < num_gls; j++) {
+        if (gls[j] == destIndex) {
+          unique = false;
+          break;
+        }
+      }
+      if (unique) {
+        gls[num_gls++] = destIndex;
+        break;
+      }
+    }
+  }
+  return num_gls;
+}
+
+#endif /* PROCEDURAL_CON_H_ */
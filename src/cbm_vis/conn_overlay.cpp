@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+
+#include "conn_overlay.h"
+#include "connectivityparams.h"
+
+typedef struct {
+  int **rows;  // partner ids of each selected cell
+  int *counts; // number of valid entries in each row
+  uint32_t num_rows;
+} conn_rows;
+
+static conn_rows rows_of(const InNetConnectivityState *conn_state,
+                         enum conn_win_opts type) {
+  switch (type) {
+  case GRGO:
+    return {conn_state->pGOfromGRtoGO, conn_state->numpGOfromGRtoGO,
+            (uint32_t)num_go};
+  case GOGO:
+    return {conn_state->pGOGABAOutGOGO, conn_state->numpGOGABAOutGOGO,
+            (uint32_t)num_go};
+  case GOGOGJ:
+    return {conn_state->pGOCoupInGOGO, conn_state->numpGOCoupInGOGO,
+            (uint32_t)num_go};
+  case GOGR:
+    return {conn_state->pGRfromGOtoGR, conn_state->numpGRfromGOtoGR,
+            (uint32_t)num_gr};
+  case MFGO:
+    return {conn_state->pGOfromMFtoGO, conn_state->numpGOfromMFtoGO,
+            (uint32_t)num_go};
+  case MFGR:
+  default:
+    return {conn_state->pMFfromMFtoGR, conn_state->numpMFfromMFtoGR,
+            (uint32_t)num_mf};
+  }
+}
+
+void conn_selected_grid(enum conn_win_opts type, uint32_t &x, uint32_t &y) {
+  switch (type) {
+  case GOGR:
+    x = gr_x;
+    y = gr_y;
+    break;
+  case MFGR:
+    x = mf_x;
+    y = mf_y;
+    break;
+  default: // the go rows of GRGO, GOGO, GOGOGJ and MFGO
+    x = go_x;
+    y = go_y;
+    break;
+  }
+}
+
+void conn_partner_grid(enum conn_win_opts type, uint32_t &x, uint32_t &y) {
+  switch (type) {
+  case GRGO:
+  case MFGR:
+    x = gr_x;
+    y = gr_y;
+    break;
+  case MFGO:
+    x = mf_x;
+    y = mf_y;
+    break;
+  default: // the go partners of GOGO, GOGOGJ and GOGR
+    x = go_x;
+    y = go_y;
+    break;
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     black through red and yellow to white, with a square root so that the
+ * low counts of sparse synapse types are still visible.
+ */
+static uint32_t heat_color(float frac) {
+  float v = sqrtf(std::min(std::max(frac, 0.0f), 1.0f)) * 3.0f;
+  uint32_t r = (uint32_t)(255 * std::min(v, 1.0f));
+  uint32_t g = (uint32_t)(255 * std::min(std::max(v - 1.0f, 0.0f), 1.0f));
+  uint32_t b = (uint32_t)(255 * std::min(std::max(v - 2.0f, 0.0f), 1.0f));
+  return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+/*
+ * Implementation Notes:
+ *     the row counts say how many entries of a row are in use, so the unused
+ * tail (UINT_MAX) is never read. Ids outside the partner population are
+ * skipped all the same, in case a sim file was written with a different
+ * network size. The gr input rows of a procedural sim are not stored, so its
+ * MFGR and GOGR overlays stay blank.
+ */
+conn_overlay make_conn_overlay(const InNetConnectivityState *conn_state,
+                               enum conn_win_opts type, int32_t cell) {
+  conn_overlay overlay;
+  conn_partner_grid(type, overlay.width, overlay.height);
+  uint32_t num_partners = overlay.width * overlay.height;
+  overlay.pixels.assign(num_partners, 0);
+  overlay.max_count = 0;
+  conn_rows conn = rows_of(conn_state, type);
+  if (!conn.rows)
+    return overlay;
+
+  if (cell != CONN_DENSITY) {
+    if ((uint32_t)cell >= conn.num_rows)
+      return overlay;
+    for (int i = 0; i < conn.counts[cell]; i++) {
+      uint32_t partner = conn.rows[cell][i];
+      if (partner < num_partners)
+        overlay.pixels[partner] = CONN_PARTNER_COLOR;
+    }
+    return overlay;
+  }
+
+  std::vector<uint32_t> counts(num_partners, 0);
+  for (uint32_t row = 0; row < conn.num_rows; row++) {
+    for (int i = 0; i < conn.counts[row]; i++) {
+      uint32_t partner = conn.rows[row][i];
+      if (partner < num_partners)
+        counts[partner]++;
+    }
+  }
+  overlay.max_count = *std::max_element(counts.begin(), counts.end());
+  if (overlay.max_count == 0)
+    return overlay;
+  for (uint32_t i = 0; i < num_partners; i++) {
+    if (counts[i] > 0)
+      overlay.pixels[i] = heat_color(counts[i] / (float)overlay.max_count);
+  }
+  return overlay;
+}
+
+ConnOverlayCache::ConnOverlayCache(const InNetConnectivityState *conn_state,
+                                   size_t max_bytes,
+                                   std::function<void()> on_ready)
+    : conn_state(conn_state), max_bytes(max_bytes), on_ready(on_ready) {
+  worker = std::thread(&ConnOverlayCache::work_loop, this);
+}
+
+ConnOverlayCache::~ConnOverlayCache() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  worker.join();
+}
+
+std::shared_ptr<const conn_overlay>
+ConnOverlayCache::get(enum conn_win_opts type, int32_t cell) {
+  overlay_key key(type, cell);
+  std::lock_guard<std::mutex> guard(lock);
+  auto entry = cached.find(key);
+  if (entry != cached.end()) {
+    lru.splice(lru.begin(), lru, entry->second.second);
+    return entry->second.first;
+  }
+  // newest first, so the cell clicked last is drawn first
+  auto queued = std::find(pending.begin(), pending.end(), key);
+  if (queued != pending.end())
+    pending.erase(queued);
+  pending.push_front(key);
+  if (pending.size() > CONN_OVERLAY_MAX_PENDING)
+    pending.pop_back();
+  wake.notify_one();
+  return NULL;
+}
+
+bool ConnOverlayCache::reads(const InNetConnectivityState *conn_state) {
+  return this->conn_state == conn_state;
+}
+
+void ConnOverlayCache::insert(overlay_key key,
+                              std::shared_ptr<const conn_overlay> overlay) {
+  size_t bytes = overlay->pixels.size() * sizeof(uint32_t);
+  // keep at least the new overlay, even if it alone is over budget
+  while (!lru.empty() && cached_bytes + bytes > max_bytes) {
+    auto victim = cached.find(lru.back());
+    cached_bytes -= victim->second.first->pixels.size() * sizeof(uint32_t);
+    cached.erase(victim);
+    lru.pop_back();
+  }
+  lru.push_front(key);
+  cached[key] = {overlay, lru.begin()};
+  cached_bytes += bytes;
+}
+
+void ConnOverlayCache::work_loop() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard, [this] { return !pending.empty() || stopping; });
+    if (stopping)
+      return;
+    overlay_key key = pending.front();
+    pending.pop_front();
+    if (cached.find(key) != cached.end())
+      continue;
+    guard.unlock();
+    auto overlay = std::make_shared<const conn_overlay>(make_conn_overlay(
+        conn_state, (enum conn_win_opts)key.first, key.second));
+    guard.lock();
+    insert(key, overlay);
+    guard.unlock();
+    on_ready();
+    guard.lock();
+  }
+}
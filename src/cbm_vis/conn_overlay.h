@@ -0,0 +1,131 @@
+/*
+ * File: conn_overlay.h
+ *
+ * Description:
+ *     This is the interface file for the connectivity window's overlays. For
+ * each synapse type the window shows one population, whose cells are picked
+ * with the mouse (the selected population: go for gr -> go, gr for go -> gr,
+ * mf for mf -> gr...), and draws their partners in the other population. An
+ * overlay is an ARGB32 image with one pixel per cell of the partner
+ * population, ready to be wrapped in a cairo image surface and scaled to the
+ * window. Two kinds exist:
+ *
+ *     - cell overlays mark the partners of one selected cell
+ *     - density maps colour every partner cell by how many synapses of the
+ *       type it takes part in, over the whole selected population
+ *
+ *     Overlays are computed on a worker thread from the (immutable) innet
+ * connectivity and kept in a least-recently-used cache bounded in bytes, so
+ * that a redraw or a click on a cell already seen costs one image blit instead
+ * of a pass over the connectivity arrays. This file does not depend on gtk.
+ */
+#ifndef CONN_OVERLAY_H_
+#define CONN_OVERLAY_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "innetconnectivitystate.h"
+
+enum conn_win_opts { GRGO, GOGO, GOGOGJ, GOGR, MFGO, MFGR };
+
+// the cell id that requests a density map rather than a cell overlay
+const int32_t CONN_DENSITY = -1;
+
+// 32 full-resolution granule overlays (4MB each), or thousands of the go and
+// mf ones, which are far smaller
+const size_t CONN_OVERLAY_CACHE_BYTES = 128 * 1024 * 1024;
+
+// requests beyond this many waiting are dropped, oldest first
+const size_t CONN_OVERLAY_MAX_PENDING = 8;
+
+const uint32_t CONN_PARTNER_COLOR = 0xFF00FF00; // opaque green
+
+typedef struct {
+  uint32_t width;  // cells along x of the partner population
+  uint32_t height; // cells along y of the partner population
+  std::vector<uint32_t> pixels; // row-major, row y holds cells y*width...
+  uint32_t max_count;           // density maps: largest synapse count
+} conn_overlay;
+
+/*
+ * Description:
+ *     dimensions of the grid of the selected or the partner population of
+ * synapse type 'type'.
+ */
+void conn_selected_grid(enum conn_win_opts type, uint32_t &x, uint32_t &y);
+void conn_partner_grid(enum conn_win_opts type, uint32_t &x, uint32_t &y);
+
+/*
+ * Description:
+ *     computes the overlay of selected cell 'cell' of synapse type 'type', or
+ * the density map if cell is CONN_DENSITY.
+ */
+conn_overlay make_conn_overlay(const InNetConnectivityState *conn_state,
+                               enum conn_win_opts type, int32_t cell);
+
+class ConnOverlayCache {
+public:
+  /*
+   * Description:
+   *     on_ready is called on the worker thread each time an overlay has been
+   * computed; gui code should only schedule a redraw from it.
+   */
+  ConnOverlayCache(const InNetConnectivityState *conn_state, size_t max_bytes,
+                   std::function<void()> on_ready);
+
+  /*
+   * Description:
+   *     stops the worker after the overlay it is computing, if any.
+   */
+  ~ConnOverlayCache();
+
+  /*
+   * Description:
+   *     returns the cached overlay, or NULL after queueing its computation.
+   * The returned overlay stays valid for as long as the caller holds it, even
+   * if the cache evicts it meanwhile.
+   */
+  std::shared_ptr<const conn_overlay> get(enum conn_win_opts type,
+                                          int32_t cell);
+
+  /*
+   * Description:
+   *     returns true if the overlays are computed from conn_state. A cache
+   * must be deleted, which joins its worker, before the state it reads is.
+   */
+  bool reads(const InNetConnectivityState *conn_state);
+
+private:
+  typedef std::pair<int, int32_t> overlay_key; // (type, cell)
+
+  void work_loop();
+  void insert(overlay_key key, std::shared_ptr<const conn_overlay> overlay);
+
+  const InNetConnectivityState *conn_state;
+  size_t max_bytes;
+  std::function<void()> on_ready;
+
+  // guard everything below
+  std::mutex lock;
+  std::condition_variable wake;
+  std::list<overlay_key> lru; // most recently used first
+  std::map<overlay_key,
+           std::pair<std::shared_ptr<const conn_overlay>,
+                     std::list<overlay_key>::iterator>>
+      cached;
+  size_t cached_bytes = 0;
+  std::deque<overlay_key> pending; // newest first
+  bool stopping = false;
+  std::thread worker;
+};
+
+#endif /* CONN_OVERLAY_H_ */
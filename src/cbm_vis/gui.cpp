@@ -1,3 +1,6 @@
+#include <iomanip>
+#include <set>
+#include <sstream>
 #include <sys/stat.h>
 
 #include "array_util.h"
@@ -7,6 +10,16 @@
 
 enum conn_win_opts conn_win_state = GOGO;
 
+/* connectivity window: the last clicked position, as a fraction of the
+ * window from the bottom left, and the overlays computed so far */
+struct {
+  double x = -1;
+  double y = -1;
+} conn_selection;
+bool conn_show_density = false;
+ConnOverlayCache *conn_overlays = NULL;
+std::set<GtkWidget *> conn_drawing_areas;
+
 struct {
   double x = -1;
   double y = -1;
@@ -25,6 +38,9 @@ std::map<std::string, bool> init_all_weights_map = {
 /* forward declarations */
 static void set_gui_menu_helper(struct menu *menu);
 static void set_gui_menu_item_helper(struct menu_item *menu_item);
+static void on_toggle_run(GtkWidget *widget, struct gui *gui);
+static gboolean redraw_conn_windows(gpointer data);
+static void drop_conn_overlays();
 
 // temp function so gtk doesn't whine abt NULL callbacks
 static void null_callback(GtkWidget *widget, gpointer data) {}
@@ -38,9 +54,19 @@ static bool assert_for_callback(bool expr, const char *error_string,
   return true;
 }
 
+static bool sim_is_loading(Control *control) {
+  if (control->sim_loading) {
+    LOG_WARN("A simulation is still loading. Try again once it has loaded.");
+    return true;
+  }
+  return false;
+}
+
 static void load_file(GtkWidget *widget, Control *control,
                       void (Control::*on_file_load_func)(std::string),
                       std::string err_msg) {
+  if (sim_is_loading(control))
+    return;
   std::string in_file_std_str = "";
   GtkWidget *dialog = gtk_file_chooser_dialog_new(
       "Open File", NULL, /* no parent window is fine for now */
@@ -122,7 +148,101 @@ static void on_load_session_file(GtkWidget *widget, Control *control) {
             "[ERROR]: Could not open session file.");
 }
 
-static void on_load_sim_file(GtkWidget *widget, Control *control) {
+static gboolean start_queued_run(struct gui *gui) {
+  on_toggle_run(gui->normal_buttons[0].widget, gui);
+  return G_SOURCE_REMOVE;
+}
+
+static const gchar *load_stage_text(int stage) {
+  switch (stage) {
+  case LOAD_READING:
+    return "Reading simulation file";
+  case LOAD_DEVICES:
+    return "Initializing devices";
+  case LOAD_TUNING:
+    return "Tuning host parallelism";
+  case LOAD_RECORDERS:
+    return "Allocating recorders";
+  default:
+    return "Finishing";
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     polled from the main loop while a sim loads on Control's loader thread.
+ * Only the reading stage has a known length; the others pulse the bar.
+ */
+static gboolean update_load_window(struct gui *gui) {
+  Control *control = gui->ctrl_ptr;
+  if (control->poll_init_sim_async()) {
+    gtk_widget_destroy(gui->lw.window);
+    gui->lw.window = NULL;
+    if (control->sim_initialized) {
+      LOG_INFO("Simulation loaded.");
+      if (gui->run_queued)
+        g_idle_add((GSourceFunc)start_queued_run, gui);
+    } else {
+      LOG_INFO("Simulation loading cancelled.");
+    }
+    gui->run_queued = false;
+    return G_SOURCE_REMOVE;
+  }
+  int stage = control->load_stage;
+  std::stringstream text;
+  text << load_stage_text(stage);
+  if (stage == LOAD_READING) {
+    uint64_t read = control->load_bytes_read;
+    uint64_t total = control->load_bytes_total;
+    text << std::fixed << std::setprecision(1) << ": " << read / 1048576.0
+         << " of " << total / 1048576.0 << " MB";
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(gui->lw.progress_bar),
+                                  (total > 0) ? (double)read / total : 0.0);
+  } else {
+    gtk_progress_bar_pulse(GTK_PROGRESS_BAR(gui->lw.progress_bar));
+  }
+  if (control->load_cancel_requested)
+    text << " (cancelling...)";
+  gtk_progress_bar_set_text(GTK_PROGRESS_BAR(gui->lw.progress_bar),
+                            text.str().c_str());
+  return G_SOURCE_CONTINUE;
+}
+
+static void on_cancel_load(GtkWidget *widget, struct gui *gui) {
+  gui->ctrl_ptr->cancel_init_sim_async();
+  gtk_widget_set_sensitive(widget, FALSE);
+}
+
+static void open_load_window(struct gui *gui) {
+  gui->lw.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  gui->lw.box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+  gui->lw.progress_bar = gtk_progress_bar_new();
+  gui->lw.cancel_button = gtk_button_new_with_label("Cancel");
+
+  gtk_window_set_title(GTK_WINDOW(gui->lw.window), "Loading Simulation");
+  gtk_window_set_default_size(GTK_WINDOW(gui->lw.window),
+                              DEFAULT_LOAD_WINDOW_WIDTH,
+                              DEFAULT_LOAD_WINDOW_HEIGHT);
+  gtk_window_set_position(GTK_WINDOW(gui->lw.window), GTK_WIN_POS_CENTER);
+  gtk_window_set_resizable(GTK_WINDOW(gui->lw.window), FALSE);
+  // closed by update_load_window once the loader is done
+  gtk_window_set_deletable(GTK_WINDOW(gui->lw.window), FALSE);
+  gtk_container_set_border_width(GTK_CONTAINER(gui->lw.window), 5);
+
+  gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(gui->lw.progress_bar), TRUE);
+  g_signal_connect(gui->lw.cancel_button, "clicked",
+                   G_CALLBACK(on_cancel_load), gui);
+  gtk_box_pack_start(GTK_BOX(gui->lw.box), gui->lw.progress_bar, TRUE, TRUE,
+                     0);
+  gtk_box_pack_start(GTK_BOX(gui->lw.box), gui->lw.cancel_button, FALSE,
+                     FALSE, 0);
+  gtk_container_add(GTK_CONTAINER(gui->lw.window), gui->lw.box);
+  gtk_widget_show_all(gui->lw.window);
+  g_timeout_add(LOAD_POLL_INTERVAL_MS, (GSourceFunc)update_load_window, gui);
+}
+
+static void on_load_sim_file(GtkWidget *widget, struct gui *gui) {
+  Control *control = gui->ctrl_ptr;
   // terribly stupid design atm. act params initialized when session is
   // initialized, so user needs to load session file before initializing
   // simulation. FIX IT
@@ -131,13 +251,24 @@ static void on_load_sim_file(GtkWidget *widget, Control *control) {
                  "file before loading in a simulation file...\n";
     return;
   }
-  load_file(widget, control, &Control::init_sim,
+  if (control->sim_initialized) {
+    LOG_WARN("A simulation is already loaded.");
+    return;
+  }
+  // the loader runs on its own thread; the main loop keeps running, and a
+  // run requested meanwhile starts once the sim has loaded
+  drop_conn_overlays();
+  load_file(widget, control, &Control::init_sim_async,
             "[ERROR]: Could not open simulation file.");
+  if (control->sim_loading)
+    open_load_window(gui);
 }
 
 // FIXME: initialize filenames from output_sim_name, coming from either:
 // a) commandline b) output dir creation user flow
 static void on_save_file(GtkWidget *widget, save_data *data) {
+  if (sim_is_loading(data->ctrl_ptr))
+    return;
   if (data->opt == data->opt % (2 * NUM_CELL_TYPES)) {
     if (data->opt == data->opt % NUM_CELL_TYPES) {
       if (!data->ctrl_ptr->raster_filenames_created) {
@@ -427,8 +558,17 @@ static void on_firing_rates_window(GtkWidget *widget, struct gui *gui) {
   gtk_widget_show_all(gui->frw.window);
 }
 
-static void on_update_weight(GtkWidget *spin_button, float *weight) {
-  *weight = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin_button));
+/*
+ * Implementation Notes:
+ *     weight is the name of a raw act param. The new value is staged rather
+ * than written, so that the sim thread applies it between two steps, along
+ * with the derived params that depend on it.
+ */
+static void on_update_weight(GtkWidget *spin_button, const gchar *weight) {
+  Control *control =
+      (Control *)g_object_get_data(G_OBJECT(spin_button), "control");
+  control->param_overlay->stage(
+      weight, gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin_button)));
 }
 
 static void on_tuning_window(GtkWidget *widget, struct gui *gui) {
@@ -442,99 +582,112 @@ static void on_tuning_window(GtkWidget *widget, struct gui *gui) {
            0,
            4,
            {NULL, "MF-GR", 0, 0},
-           {"activate", G_CALLBACK(on_update_weight), &gIncDirectMFtoGR,
-            false}},
-          {gtk_adjustment_new(mfgoW, 0.0, 1.0, 0.0001, 0.1, 0.0),
+           {"activate", G_CALLBACK(on_update_weight),
+            (gpointer)"gIncDirectMFtoGR", false}},
+          {gtk_adjustment_new(rawMFGOW, 0.0, 1.0, 0.0001, 0.1, 0.0),
            NULL,
            1,
            1,
            4,
            {NULL, "MF-GO", 0, 1},
-           {"activate", G_CALLBACK(on_update_weight), &mfgoW, false}},
-          {gtk_adjustment_new(grgoW, 0.0, 1.0, 0.0001, 0.1, 0.0),
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"rawMFGOW",
+            false}},
+          {gtk_adjustment_new(rawGRGOW, 0.0, 1.0, 0.0001, 0.1, 0.0),
            NULL,
            1,
            2,
            4,
            {NULL, "GR-GO", 0, 2},
-           {"activate", G_CALLBACK(on_update_weight), &grgoW, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"rawGRGOW",
+            false}},
           {gtk_adjustment_new(gogrW, 0.0, 1.0, 0.01, 0.1, 0.0),
            NULL,
            1,
            3,
            2,
            {NULL, "GO-GR", 0, 3},
-           {"activate", G_CALLBACK(on_update_weight), &gogrW, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gogrW",
+            false}},
           {gtk_adjustment_new(gogoW, 0.0, 1.0, 0.01, 0.1, 0.0),
            NULL,
            3,
            0,
            2,
            {NULL, "GO-GO", 2, 0},
-           {"activate", G_CALLBACK(on_update_weight), &gogoW, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gogoW",
+            false}},
           {gtk_adjustment_new(gIncGRtoPC, 0.0, 1.0, 0.000001, 0.1, 0.0),
            NULL,
            3,
            1,
            6,
            {NULL, "GR-PC", 2, 1},
-           {"activate", G_CALLBACK(on_update_weight), &gIncGRtoPC, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncGRtoPC",
+            false}},
           {gtk_adjustment_new(gIncGRtoSC, 0.0, 1.0, 0.001, 0.1, 0.0),
            NULL,
            3,
            2,
            3,
            {NULL, "GR-SC", 2, 2},
-           {"activate", G_CALLBACK(on_update_weight), &gIncGRtoSC, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncGRtoSC",
+            false}},
           {gtk_adjustment_new(gIncGRtoBC, 0.0, 1.0, 0.001, 0.1, 0.0),
            NULL,
            3,
            3,
            3,
            {NULL, "GR-BC", 2, 3},
-           {"activate", G_CALLBACK(on_update_weight), &gIncGRtoBC, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncGRtoBC",
+            false}},
           {gtk_adjustment_new(gIncSCtoPC, 0.0, 1.0, 0.00001, 0.1, 0.0),
            NULL,
            5,
            0,
            5,
            {NULL, "SC-PC", 4, 0},
-           {"activate", G_CALLBACK(on_update_weight), &gIncSCtoPC, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncSCtoPC",
+            false}},
           {gtk_adjustment_new(gIncBCtoPC, 0.0, 1.0, 0.00001, 0.1, 0.0),
            NULL,
            5,
            1,
            5,
            {NULL, "BC-PC", 4, 1},
-           {"activate", G_CALLBACK(on_update_weight), &gIncBCtoPC, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncBCtoPC",
+            false}},
           {gtk_adjustment_new(gIncPCtoBC, 0.0, 1.0, 0.01, 0.1, 0.0),
            NULL,
            5,
            2,
            2,
            {NULL, "PC-BC", 4, 2},
-           {"activate", G_CALLBACK(on_update_weight), &gIncPCtoBC, false}},
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncPCtoBC",
+            false}},
           {gtk_adjustment_new(gIncAvgPCtoNC, 0.0, 1.0, 0.001, 0.1, 0.0),
            NULL,
            5,
            3,
            3,
            {NULL, "PC-DCN", 4, 3},
-           {"activate", G_CALLBACK(on_update_weight), &gIncAvgPCtoNC, false}},
-          {gtk_adjustment_new(gAMPAIncMFtoNC, 0.0, 1.0, 0.001, 0.1, 0.0),
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncAvgPCtoNC",
+            false}},
+          {gtk_adjustment_new(rawGMFAMPAIncNC, 0.0, 10.0, 0.001, 0.1, 0.0),
            NULL,
            7,
            0,
            3,
            {NULL, "MF-DCN", 6, 0},
-           {"activate", G_CALLBACK(on_update_weight), &gAMPAIncMFtoNC, false}},
+           {"activate", G_CALLBACK(on_update_weight),
+            (gpointer)"rawGMFAMPAIncNC", false}},
           {gtk_adjustment_new(gIncNCtoIO, 0.0, 1.0, 0.0001, 0.1, 0.0),
            NULL,
            7,
            1,
            4,
            {NULL, "DCN-IO", 6, 1},
-           {"activate", G_CALLBACK(on_update_weight), &gIncNCtoIO, false}}}};
+           {"activate", G_CALLBACK(on_update_weight), (gpointer)"gIncNCtoIO",
+            false}}}};
 
   // set window props
   gtk_window_set_title(GTK_WINDOW(tw.window), "Tuning");
@@ -561,6 +714,7 @@ static void on_tuning_window(GtkWidget *widget, struct gui *gui) {
     gtk_widget_set_hexpand(b->widget, true);
     gtk_widget_set_vexpand(b->widget, true);
     gtk_grid_attach(GTK_GRID(tw.grid), b->widget, b->col, b->row, 1, 1);
+    g_object_set_data(G_OBJECT(b->widget), "control", gui->ctrl_ptr);
     g_signal_connect(b->widget, b->signal.signal, b->signal.handler,
                      b->signal.data);
   }
@@ -570,6 +724,11 @@ static void on_tuning_window(GtkWidget *widget, struct gui *gui) {
 }
 
 static void on_toggle_run(GtkWidget *widget, struct gui *gui) {
+  if (gui->ctrl_ptr->sim_loading) {
+    gui->run_queued = true;
+    LOG_INFO("The simulation is still loading. It will run once loaded.");
+    return;
+  }
   if (gui->ctrl_ptr->simState && gui->ctrl_ptr->simCore && gui->ctrl_ptr->mfs) {
     switch (gui->ctrl_ptr->run_state) {
     case NOT_IN_RUN:
@@ -812,16 +971,17 @@ static void set_child_window_props(GtkWidget *child_window, const gchar *title,
   gtk_window_set_resizable(GTK_WINDOW(child_window), resizable);
 }
 
-static void generate_plot(GtkWidget *widget,
-                          void (*draw_func)(GtkWidget *, cairo_t *, Control *),
-                          Control *control, GtkWidget *v_box = NULL) {
-  if (!control->sim_initialized) {
+static GtkWidget *generate_plot(GtkWidget *widget,
+                                void (*draw_func)(GtkWidget *, cairo_t *,
+                                                  Control *),
+                                Control *control, GtkWidget *v_box = NULL) {
+  if (control->sim_loading || !control->sim_initialized) {
     LOG_ERROR("[ERROR]: Simulation not initialized. Nothing to show...");
-    return;
+    return NULL;
   }
   if (!widget) {
     LOG_ERROR("[ERROR]: Cannot generate plot on a non-existant window...");
-    return;
+    return NULL;
   }
   gint width, height;
   gtk_window_get_size(GTK_WINDOW(widget), &width, &height);
@@ -837,10 +997,48 @@ static void generate_plot(GtkWidget *widget,
   g_signal_connect(G_OBJECT(drawing_area), "button-press-event",
                    G_CALLBACK(on_mouse_click_connectivity), control);
   gtk_widget_add_events(drawing_area, GDK_BUTTON_PRESS_MASK);
+  return drawing_area;
+}
+
+// called from the overlay worker through g_idle_add, so on the gtk thread
+static gboolean redraw_conn_windows(gpointer data) {
+  for (GtkWidget *drawing_area : conn_drawing_areas)
+    gtk_widget_queue_draw(drawing_area);
+  return G_SOURCE_REMOVE;
+}
+
+static void drop_conn_overlays() {
+  delete conn_overlays;
+  conn_overlays = NULL;
+}
+
+/*
+ * Implementation Notes:
+ *     connectivity does not change while a sim is loaded, so one cache serves
+ * every connectivity window. It is rebuilt if the sim it was made for has
+ * been replaced, and is dropped (see drop_conn_overlays) before a sim is
+ * loaded or the gui quits, so that its worker never reads a deleted state.
+ */
+static ConnOverlayCache *conn_overlays_for(Control *control) {
+  if (control->sim_loading || !control->sim_initialized) {
+    drop_conn_overlays();
+    return NULL;
+  }
+  const InNetConnectivityState *conn_state =
+      control->simState->getInnetConStateInternal();
+  if (conn_overlays && !conn_overlays->reads(conn_state))
+    drop_conn_overlays();
+  if (!conn_overlays)
+    conn_overlays =
+        new ConnOverlayCache(conn_state, CONN_OVERLAY_CACHE_BYTES, []() {
+          g_idle_add(redraw_conn_windows, NULL);
+        });
+  return conn_overlays;
 }
 
 static void on_quit(GtkWidget *widget, Control *control) {
   control->run_state = NOT_IN_RUN;
+  drop_conn_overlays();
   gtk_main_quit();
 }
 
@@ -861,228 +1059,92 @@ static bool on_connectivity_radio(GtkWidget *widget, gpointer data) {
       conn_win_state = MFGO;
     else if (strcmp(this_rad_label, "mf -> gr") == 0)
       conn_win_state = MFGR;
-    gtk_widget_queue_draw(widget);
+    redraw_conn_windows(NULL);
   }
   return true;
 }
 
-static void draw_grgo(const InNetConnectivityState *conn_state, gint height,
-                      gint width, cairo_t *cr) {
-  float conn_matrix_to_pixel_scale_y = height / (float)go_y;
-  float conn_matrix_to_pixel_scale_x = width / (float)go_x;
-
-  float grid_scale_y = (float)go_y / gr_y;
-  float grid_scale_x = (float)go_x / gr_x;
-
+/*
+ * Implementation Notes:
+ *     the overlay's pixels are wrapped, not copied, so the surface must not
+ * outlive the overlay. Row 0 of the overlay is drawn at the bottom, as the
+ * cell grids are indexed from the bottom left.
+ */
+static void draw_conn_overlay(cairo_t *cr, const conn_overlay &overlay,
+                              gint width, gint height) {
+  cairo_surface_t *surface = cairo_image_surface_create_for_data(
+      (unsigned char *)overlay.pixels.data(), CAIRO_FORMAT_ARGB32,
+      overlay.width, overlay.height, overlay.width * sizeof(uint32_t));
+  cairo_save(cr);
   cairo_translate(cr, 0, height);
-  cairo_scale(cr, conn_matrix_to_pixel_scale_x, -conn_matrix_to_pixel_scale_y);
-  // point color
-  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-
-  uint32_t go_id =
-      uint32_t(mouse_coords.x / conn_matrix_to_pixel_scale_x) +
-      uint32_t((height - mouse_coords.y) / conn_matrix_to_pixel_scale_y) * go_x;
-
-  cairo_rectangle(cr, go_id % go_x, int(go_id / go_x), 1, 1);
-  cairo_fill(cr);
-
-  cairo_set_source_rgb(cr, 0.0, 1.0, 0.0);
-  for (size_t i = 0; i < max_num_p_go_from_gr_to_go; i++) {
-    if (conn_state->pGOfromGRtoGO[go_id][i] != UINT_MAX) {
-      uint32_t dest_id = conn_state->pGOfromGRtoGO[go_id][i];
-      cairo_rectangle(cr, (dest_id % gr_x) * grid_scale_x,
-                      int(dest_id / gr_x) * grid_scale_y, grid_scale_x,
-                      grid_scale_y);
-      cairo_fill(cr);
-    }
-  }
-}
-
-static void draw_gogo(const InNetConnectivityState *conn_state, gint height,
-                      gint width, cairo_t *cr) {
-  float conn_matrix_to_pixel_scale_y = height / (float)go_y;
-  float conn_matrix_to_pixel_scale_x = width / (float)go_x;
-
-  cairo_translate(cr, 0, height);
-  cairo_scale(cr, conn_matrix_to_pixel_scale_x, -conn_matrix_to_pixel_scale_y);
-  // point color
-  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-
-  uint32_t go_id =
-      uint32_t(mouse_coords.x / conn_matrix_to_pixel_scale_x) +
-      uint32_t((height - mouse_coords.y) / conn_matrix_to_pixel_scale_y) * go_x;
-
-  cairo_rectangle(cr, go_id % go_x, int(go_id / go_x), 1, 1);
-  cairo_fill(cr);
-
-  cairo_set_source_rgb(cr, 0.0, 1.0, 0.0);
-  for (size_t i = 0; i < num_con_go_to_go; i++) {
-    if (conn_state->pGOGABAOutGOGO[go_id][i] != INT_MAX) {
-      uint32_t dest_id = conn_state->pGOGABAOutGOGO[go_id][i];
-      cairo_rectangle(cr, dest_id % go_x, int(dest_id / go_x), 1, 1);
-      cairo_fill(cr);
-    }
-  }
+  cairo_scale(cr, width / (double)overlay.width,
+              -height / (double)overlay.height);
+  cairo_set_source_surface(cr, surface, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+  cairo_paint(cr);
+  cairo_restore(cr);
+  cairo_surface_destroy(surface);
 }
 
-static void draw_gogogj(const InNetConnectivityState *conn_state, gint height,
-                        gint width, cairo_t *cr) {
-  float conn_matrix_to_pixel_scale_y = height / (float)go_y;
-  float conn_matrix_to_pixel_scale_x = width / (float)go_x;
-
-  cairo_translate(cr, 0, height);
-  cairo_scale(cr, conn_matrix_to_pixel_scale_x, -conn_matrix_to_pixel_scale_y);
-  // point color
-  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+static void draw_connectivity(GtkWidget *widget, cairo_t *cr,
+                              Control *control) {
+  // background color setup
+  cairo_set_source_rgb(cr, 0, 0, 0);
+  cairo_paint(cr);
 
-  uint32_t go_id =
-      uint32_t(mouse_coords.x / conn_matrix_to_pixel_scale_x) +
-      uint32_t((height - mouse_coords.y) / conn_matrix_to_pixel_scale_y) * go_x;
+  /* GtkDrawingArea size */
+  GdkRectangle da;
+  GdkWindow *window = gtk_widget_get_window(GTK_WIDGET(widget));
 
-  cairo_rectangle(cr, go_id % go_x, int(go_id / go_x), 1, 1);
-  cairo_fill(cr);
+  /* Determine GtkDrawingArea dimensions */
+  gdk_window_get_geometry(window, &da.x, &da.y, &da.width, &da.height);
 
-  cairo_set_source_rgb(cr, 0.0, 1.0, 0.0);
-  for (size_t i = 0; i < num_p_go_to_go_gj; i++) {
-    if (conn_state->pGOCoupInGOGO[go_id][i] != UINT_MAX) {
-      uint32_t dest_id = conn_state->pGOCoupInGOGO[go_id][i];
-      cairo_rectangle(cr, dest_id % go_x, int(dest_id / go_x), 1, 1);
-      cairo_fill(cr);
-    }
+  // keep the click as a position, so that it survives a change of synapse
+  // type or of window size
+  if (mouse_coords.x > 0 && mouse_coords.y > 0) {
+    conn_selection.x = mouse_coords.x / da.width;
+    conn_selection.y = 1.0 - mouse_coords.y / da.height;
+    mouse_coords.x = -1;
+    mouse_coords.y = -1;
   }
-}
-
-static void draw_gogr(const InNetConnectivityState *conn_state, gint height,
-                      gint width, cairo_t *cr) {
-  float conn_matrix_to_pixel_scale_y = height / (float)gr_y;
-  float conn_matrix_to_pixel_scale_x = width / (float)gr_x;
-
-  float grid_scale_y = (float)gr_y / go_y;
-  float grid_scale_x = (float)gr_x / go_x;
-
-  cairo_translate(cr, 0, height);
-  cairo_scale(cr, conn_matrix_to_pixel_scale_x, -conn_matrix_to_pixel_scale_y);
-  // point color
-  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-
-  uint32_t gr_id =
-      uint32_t(mouse_coords.x / conn_matrix_to_pixel_scale_x) +
-      uint32_t((height - mouse_coords.y) / conn_matrix_to_pixel_scale_y) * gr_x;
-
-  cairo_rectangle(cr, gr_id % gr_x, int(gr_id / gr_x), 1, 1);
-  cairo_fill(cr);
+  ConnOverlayCache *overlays = conn_overlays_for(control);
+  if (!overlays)
+    return;
 
-  cairo_set_source_rgb(cr, 0.0, 1.0, 0.0);
-  for (size_t i = 0; i < max_num_p_gr_from_go_to_gr; i++) {
-    if (conn_state->pGRfromGOtoGR[gr_id][i] != UINT_MAX) {
-      uint32_t dest_id = conn_state->pGRfromGOtoGR[gr_id][i];
-      cairo_rectangle(cr, (dest_id % go_x) * grid_scale_x,
-                      int(dest_id / go_x) * grid_scale_y, grid_scale_x,
-                      grid_scale_y);
-      cairo_fill(cr);
-    }
+  uint32_t sel_x, sel_y, sel_col = 0, sel_row = 0;
+  conn_selected_grid(conn_win_state, sel_x, sel_y);
+  int32_t cell = CONN_DENSITY;
+  if (!conn_show_density) {
+    if (conn_selection.x < 0)
+      return;
+    sel_col = std::min(uint32_t(conn_selection.x * sel_x), sel_x - 1);
+    sel_row = std::min(uint32_t(conn_selection.y * sel_y), sel_y - 1);
+    cell = sel_row * sel_x + sel_col;
   }
-}
-
-static void draw_mfgo(const InNetConnectivityState *conn_state, gint height,
-                      gint width, cairo_t *cr) {
-  float conn_matrix_to_pixel_scale_y = height / (float)mf_y;
-  float conn_matrix_to_pixel_scale_x = width / (float)mf_x;
 
-  float grid_scale_y = (float)go_y / mf_y;
-  float grid_scale_x = (float)go_x / mf_x;
-
-  cairo_translate(cr, 0, height);
-  cairo_scale(cr, conn_matrix_to_pixel_scale_x, -conn_matrix_to_pixel_scale_y);
-  // point color
-  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-
-  uint32_t mf_id =
-      uint32_t(mouse_coords.x / conn_matrix_to_pixel_scale_x) +
-      uint32_t((height - mouse_coords.y) / conn_matrix_to_pixel_scale_y) * mf_x;
-
-  cairo_set_source_rgb(cr, 0.0, 1.0, 0.0);
-  for (size_t i = 0; i < max_num_p_go_from_mf_to_go; i++) {
-    if (conn_state->pGOfromMFtoGO[mf_id][i] != UINT_MAX) {
-      uint32_t dest_id = conn_state->pGOfromMFtoGO[mf_id][i];
-      cairo_rectangle(cr, (dest_id % go_x) * grid_scale_x,
-                      int(dest_id / go_x) * grid_scale_y, grid_scale_x,
-                      grid_scale_y);
-      cairo_fill(cr);
-    }
+  // drawn once the worker has it, see redraw_conn_windows
+  std::shared_ptr<const conn_overlay> overlay =
+      overlays->get(conn_win_state, cell);
+  if (overlay)
+    draw_conn_overlay(cr, *overlay, da.width, da.height);
+
+  if (cell != CONN_DENSITY) {
+    // point color
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_rectangle(cr, sel_col * da.width / (double)sel_x,
+                    da.height - (sel_row + 1) * da.height / (double)sel_y,
+                    da.width / (double)sel_x, da.height / (double)sel_y);
+    cairo_fill(cr);
   }
 }
 
-static void draw_mfgr(const InNetConnectivityState *conn_state, gint height,
-                      gint width, cairo_t *cr) {
-  float conn_matrix_to_pixel_scale_y = height / (float)mf_y;
-  float conn_matrix_to_pixel_scale_x = width / (float)mf_x;
-
-  float grid_scale_y = (float)gr_y / mf_y;
-  float grid_scale_x = (float)gr_x / mf_x;
-
-  cairo_translate(cr, 0, height);
-  cairo_scale(cr, conn_matrix_to_pixel_scale_x, -conn_matrix_to_pixel_scale_y);
-  // point color
-  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-
-  uint32_t mf_id =
-      uint32_t(mouse_coords.x / conn_matrix_to_pixel_scale_x) +
-      uint32_t((height - mouse_coords.y) / conn_matrix_to_pixel_scale_y) * mf_x;
-
-  cairo_set_source_rgb(cr, 0.0, 1.0, 0.0);
-  for (size_t i = 0; i < max_num_p_mf_from_mf_to_gr; i++) {
-    if (conn_state->pMFfromMFtoGR[mf_id][i] != UINT_MAX) {
-      uint32_t dest_id = conn_state->pMFfromMFtoGR[mf_id][i];
-      cairo_rectangle(cr, (dest_id % gr_x) / grid_scale_x,
-                      int(dest_id / gr_x) / grid_scale_y, 1 / grid_scale_x,
-                      1 / grid_scale_y);
-      cairo_fill(cr);
-    }
-  }
+static void on_conn_density(GtkWidget *widget, gpointer data) {
+  conn_show_density = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+  redraw_conn_windows(NULL);
 }
 
-static void draw_connectivity(GtkWidget *widget, cairo_t *cr,
-                              Control *control) {
-  if (mouse_coords.x > 0 && mouse_coords.y > 0) {
-    const InNetConnectivityState *conn_state =
-        control->simState->getInnetConStateInternal();
-    // background color setup
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_paint(cr);
-
-    /* GtkDrawingArea size */
-    GdkRectangle da;
-    GdkWindow *window = gtk_widget_get_window(GTK_WIDGET(widget));
-
-    /* Determine GtkDrawingArea dimensions */
-    gdk_window_get_geometry(window, &da.x, &da.y, &da.width, &da.height);
-    switch (conn_win_state) {
-    case GRGO:
-      draw_grgo(conn_state, da.height, da.width, cr);
-      break;
-    case GOGO:
-      draw_gogo(conn_state, da.height, da.width, cr);
-      break;
-    case GOGOGJ:
-      draw_gogogj(conn_state, da.height, da.width, cr);
-      break;
-    case GOGR:
-      draw_gogr(conn_state, da.height, da.width, cr);
-      break;
-    case MFGO:
-      draw_mfgo(conn_state, da.height, da.width, cr);
-      break;
-    case MFGR:
-      draw_mfgr(conn_state, da.height, da.width, cr);
-      break;
-    }
-    mouse_coords.x = -1;
-    mouse_coords.y = -1;
-  } else {
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_paint(cr);
-  }
+static void on_conn_area_destroy(GtkWidget *widget, gpointer data) {
+  conn_drawing_areas.erase(widget);
 }
 
 static void on_connectivity_window(GtkWidget *widget, Control *control) {
@@ -1149,10 +1211,23 @@ static void on_connectivity_window(GtkWidget *widget, Control *control) {
                      r->signal.data);
   }
 
+  GtkWidget *density_button = gtk_check_button_new_with_label("Density Map");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(density_button),
+                               conn_show_density);
+  gtk_box_pack_start(GTK_BOX(v_box), density_button, FALSE, TRUE, 0);
+  g_signal_connect(density_button, "toggled", G_CALLBACK(on_conn_density),
+                   NULL);
+
   GtkWidget *h_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
   gtk_container_add(GTK_CONTAINER(child_window), h_box);
   gtk_box_pack_start(GTK_BOX(h_box), v_box, FALSE, TRUE, 0);
-  generate_plot(child_window, draw_connectivity, control, h_box);
+  GtkWidget *drawing_area =
+      generate_plot(child_window, draw_connectivity, control, h_box);
+  if (drawing_area) {
+    conn_drawing_areas.insert(drawing_area);
+    g_signal_connect(drawing_area, "destroy",
+                     G_CALLBACK(on_conn_area_destroy), NULL);
+  }
   gtk_widget_show_all(child_window);
 }
 
@@ -1441,7 +1516,7 @@ int gui_init_and_run(int *argc, char ***argv, Control *control) {
                                {"Simulation File",
                                 gtk_menu_item_new(),
                                 {"activate", G_CALLBACK(on_load_sim_file),
-                                 control, false},
+                                 &gui, false},
                                 {}}}}},
                          {"Save Sim",
                           gtk_menu_item_new(),
@@ -1719,6 +1794,7 @@ int gui_init_and_run(int *argc, char ***argv, Control *control) {
 
   // manually delete objects we created
   free_gui_menus(&gui);
+  drop_conn_overlays();
 
   return 0;
 }
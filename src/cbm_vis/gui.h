@@ -1,6 +1,7 @@
 #ifndef GUI_H_
 #define GUI_H_
 
+#include "conn_overlay.h"
 #include "control.h"
 #include <gtk/gtk.h>
 #include <stdio.h>
@@ -35,6 +36,11 @@
 #define DEFAULT_TUNING_WINDOW_WIDTH 800
 #define DEFAULT_TUNING_WINDOW_HEIGHT 200
 
+/* load window constants */
+#define DEFAULT_LOAD_WINDOW_WIDTH 360
+#define DEFAULT_LOAD_WINDOW_HEIGHT 80
+#define LOAD_POLL_INTERVAL_MS 100
+
 /* raster window constants */
 #define DEFAULT_RASTER_WINDOW_WIDTH 540
 #define DEFAULT_RASTER_WINDOW_HEIGHT 960
@@ -70,8 +76,6 @@
 #define DEFAULT_SC_PSTH_FILE_NAME "sc_psth.bin"
 #define DEFAULT_MF_PSTH_FILE_NAME "mf_psth.bin"
 
-enum conn_win_opts { GRGO, GOGO, GOGOGJ, GOGR, MFGO, MFGR };
-
 typedef struct {
   Control *ctrl_ptr;
   enum save_opts opt;
@@ -128,6 +132,13 @@ struct tuning_window {
   struct tuning_button tuning_buttons[NUM_TUNING_BUTTONS];
 };
 
+struct load_window {
+  GtkWidget *window;
+  GtkWidget *box;
+  GtkWidget *progress_bar;
+  GtkWidget *cancel_button;
+};
+
 // TODO: combine with tuning button label
 struct firing_rate_label {
   GtkWidget *label;
@@ -154,6 +165,8 @@ struct gui {
   struct menu menu_bar;
   struct firing_rate_window frw;
   Control *ctrl_ptr;
+  struct load_window lw;
+  bool run_queued; /* run pressed while a sim was loading */
 };
 
 gboolean firing_rates_win_visible(struct gui *gui);
@@ -1,16 +1,44 @@
 #include <gtk/gtk.h>
 #include <iomanip>
-#include <sys/stat.h> // mkdir (POSIX ONLY)
+#include <sstream>
+#include <sys/stat.h> // mkdir, stat (POSIX ONLY)
 
 #include "array_util.h"
+#include "autotune.h"
 #include "control.h"
+#include "direct_out.h"
 #include "file_parse.h"
 #include "gui.h" /* tenuous inclide at best :pogO: */
 #include "logger.h"
 #include "red_nucleus.h"
+#include "rng_seed.h"
+
+static uint64_t hash_file(const std::string &path) {
+  std::ifstream in_buf(path, std::ios::in | std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(in_buf)),
+                       std::istreambuf_iterator<char>());
+  return trace_hash(contents.data(), contents.size());
+}
+
+// path of checkpoint trial of run, without extension: RUN_tK, K from 1
+static std::string checkpoint_path(const std::string &dir,
+                                   const std::string &run, uint32_t trial) {
+  char trial_str[16];
+  snprintf(trial_str, sizeof(trial_str), "_t%05u", trial + 1);
+  return dir + "/" + run + trial_str;
+}
 
 Control::Control(parsed_commandline &p_cl) {
+  // before anything is built or loaded, so that every generator is covered
+  if (!p_cl.seed.empty())
+    set_rng_seed(atoi(p_cl.seed.c_str()));
   use_gui = (p_cl.vis_mode == "GUI") ? true : false;
+  autotune_mode = p_cl.autotune;
+  procedural_con = !p_cl.procedural.empty();
+  thin_sim = !p_cl.thin.empty();
+  con_edges = !p_cl.con_edges.empty();
+  // the gui's tuning window stages its changes here, so create it in any mode
+  param_overlay = new ParamOverlay(p_cl.act_params_file);
   data_out_path = OUTPUT_DATA_PATH + p_cl.output_basename;
   data_out_base_name = p_cl.output_basename;
   LOG_DEBUG("Using '%s' as the output directory...", data_out_path.c_str());
@@ -35,10 +63,43 @@ Control::Control(parsed_commandline &p_cl) {
     create_out_bvi_filename();                    // default
     create_out_dat_filename();                    // default
     create_raster_filenames(p_cl.raster_files);   // optional
+    create_raster_store_filename();               // optional
     create_psth_filenames(p_cl.psth_files);       // optional
     create_weights_filenames(p_cl.weights_files); // optional
     create_con_arrs_filenames(p_cl.conn_arrs_files); // optional
-    init_sim(p_cl.input_sim_file);
+    if (!p_cl.checkpoint_interval.empty() || !p_cl.replay.empty())
+      session_hash = hash_file(sess_file_name);
+    if (!p_cl.checkpoint_interval.empty()) {
+      checkpoint_interval = atoi(p_cl.checkpoint_interval.c_str());
+      checkpoint_dir = data_out_path + "/" + CKPT_DIR;
+      if (mkdir(checkpoint_dir.c_str(), 0775) == -1) {
+        LOG_FATAL("Could not create directory '%s'. Exiting...",
+                  checkpoint_dir.c_str());
+        exit(10);
+      }
+    }
+    if (!p_cl.replay.empty())
+      init_replay(p_cl.replay);
+    else
+      init_sim(p_cl.input_sim_file);
+    if (!p_cl.closed_loop.empty()) {
+      closed_loop = new ClosedLoopServer("/" + p_cl.closed_loop, num_nc);
+      // a second is long enough that a live controller never hits it
+      if (!p_cl.lockstep.empty())
+        cl_max_wait_ns = 1000000000ULL;
+    }
+    create_spike_stream(p_cl.monitor_pops);
+    create_golden_trace(p_cl.trace);
+    create_event_recorder(p_cl.event_file);
+    create_trace_recorder(p_cl.trace_file);
+    create_weight_stats(p_cl.weight_stats_file);
+    create_health_monitor(p_cl.health_file);
+    create_convergence_rule(p_cl.convergence_file);
+    if (!p_cl.status_files.empty())
+      status_reporter = new StatusReporter(
+          p_cl.status_files, data_out_base_name, td.num_trials, trialTime);
+    if (closed_loop || spike_stream || convergence_on)
+      live_rn = new RedNucleus(num_nc);
   } else if (!p_cl.conn_arrs_files.empty()) {
     create_con_arrs_filenames(p_cl.conn_arrs_files);
     if (!p_cl.input_sim_file.empty()) {
@@ -51,6 +112,12 @@ Control::Control(parsed_commandline &p_cl) {
 }
 
 Control::~Control() {
+  // a gui quit while a sim is still loading
+  if (sim_loader.joinable()) {
+    cancel_init_sim_async();
+    sim_loader.join();
+  }
+
   // delete allocated trials_data memory
   if (trials_data_initialized)
     delete_trials_data(td);
@@ -62,6 +129,32 @@ Control::~Control() {
     delete simCore;
   if (mfs)
     delete mfs;
+  if (raster_store)
+    delete raster_store;
+  if (closed_loop)
+    delete closed_loop;
+  if (spike_stream)
+    delete spike_stream;
+  if (golden_trace)
+    delete golden_trace;
+  if (event_recorder)
+    delete event_recorder;
+  if (trace_recorder)
+    delete trace_recorder;
+  if (weight_stats)
+    delete weight_stats;
+  if (status_reporter)
+    delete status_reporter;
+  if (convergence)
+    delete convergence;
+  if (health_monitor)
+    delete health_monitor;
+  if (param_overlay)
+    delete param_overlay;
+  if (live_rn)
+    delete live_rn;
+  if (session_rn)
+    delete session_rn;
 
   // deallocate output arrays
   if (raster_arrays_initialized)
@@ -77,7 +170,7 @@ Control::~Control() {
 void Control::build_sim() {
   if (!simState && !mfs) {
     mfs = new ECMFPopulation();
-    simState = new CBMState(numMZones);
+    simState = new CBMState(numMZones, procedural_con);
   }
 }
 
@@ -92,7 +185,8 @@ void Control::set_plasticity_modes(std::string pfpc_plasticity,
     pf_pc_plast = BINARY;
   else if (pfpc_plasticity == "abbott-cascade")
     pf_pc_plast = ABBOTT_CASCADE;
-  else if (pfpc_plasticity == "mauk-cascade")
+  // '--cascade' on the commandline gives plain "cascade"
+  else if (pfpc_plasticity == "mauk-cascade" || pfpc_plasticity == "cascade")
     pf_pc_plast = MAUK_CASCADE;
 
   if (mfnc_plasticity == "off")
@@ -120,13 +214,22 @@ void Control::initialize_session(std::string sess_file) {
  */
 void Control::init_sim(std::string in_sim_filename) {
   LOG_DEBUG("Initializing simulation...");
-  std::fstream sim_file_buf(in_sim_filename.c_str(),
-                            std::ios::in | std::ios::binary);
-  mfs = new ECMFPopulation(sim_file_buf);
-  simState = new CBMState(numMZones, pf_pc_plast, sim_file_buf);
-  simCore = new CBMSimCore(simState, gpuIndex, gpuP2);
-  mfAP = mfs->getAPs();
-  simCore->setTrueMFs(mfs->getCollIds());
+  if (!load_sim(in_sim_filename))
+    return;
+  load_stage = LOAD_TUNING;
+  if (tune_host_parallelism()) {
+    // tuning stepped the sim, so start over from the file, drawing the same
+    // seeds as a run that did not tune
+    unload_sim();
+    rewind_rng_seed();
+    if (!load_sim(in_sim_filename))
+      return;
+  }
+  if (load_cancel_requested) {
+    unload_sim();
+    return;
+  }
+  load_stage = LOAD_RECORDERS;
   initialize_rast_cell_nums();
   initialize_cell_spikes();
   initialize_rasters();
@@ -135,11 +238,128 @@ void Control::init_sim(std::string in_sim_filename) {
   initialize_raster_save_funcs();
   initialize_psth_save_funcs();
   initialize_spike_sums();
-  sim_file_buf.close();
   sim_initialized = true;
   LOG_DEBUG("Simulation initialized.");
 }
 
+/*
+ * Implementation Notes:
+ *     a cancel request is honoured between sections of the file and before
+ * the devices are initialized; a single section is always read to the end.
+ */
+bool Control::load_sim(std::string in_sim_filename) {
+  std::fstream sim_file_buf(in_sim_filename.c_str(),
+                            std::ios::in | std::ios::binary);
+  if (!sim_file_buf.is_open()) {
+    LOG_ERROR("Could not open simulation file '%s'.", in_sim_filename.c_str());
+    return false;
+  }
+  sim_file_buf.seekg(0, std::ios::end);
+  load_bytes_total = sim_file_buf.tellg();
+  sim_file_buf.seekg(0, std::ios::beg);
+  load_bytes_read = 0;
+  load_stage = LOAD_READING;
+  auto on_section = [this, &sim_file_buf]() {
+    load_bytes_read = sim_file_buf.tellg();
+  };
+  mfs = new ECMFPopulation(sim_file_buf);
+  on_section();
+  if (!load_cancel_requested)
+    simState = new CBMState(numMZones, pf_pc_plast, sim_file_buf, on_section);
+  sim_file_buf.close();
+  if (load_cancel_requested) {
+    unload_sim();
+    return false;
+  }
+  load_stage = LOAD_DEVICES;
+  simCore = new CBMSimCore(simState, gpuIndex, gpuP2);
+  mfAP = mfs->getAPs();
+  simCore->setTrueMFs(mfs->getCollIds());
+  return true;
+}
+
+void Control::unload_sim() {
+  if (simCore)
+    delete simCore;
+  if (simState)
+    delete simState;
+  if (mfs)
+    delete mfs;
+  simCore = NULL;
+  simState = NULL;
+  mfs = NULL;
+}
+
+void Control::init_sim_async(std::string in_sim_filename) {
+  load_cancel_requested = false;
+  load_stage = LOAD_READING;
+  sim_loading = true;
+  sim_loader = std::thread([this, in_sim_filename]() {
+    init_sim(in_sim_filename);
+    load_stage = sim_initialized ? LOAD_DONE : LOAD_CANCELLED;
+  });
+}
+
+bool Control::poll_init_sim_async() {
+  int stage = load_stage;
+  if (stage != LOAD_DONE && stage != LOAD_CANCELLED)
+    return false;
+  sim_loader.join();
+  sim_loading = false;
+  // omp thread counts and schedules are per thread, so the loader's tuning
+  // has to be applied again on the thread that runs the session
+  apply_autotune_config(host_config);
+  return true;
+}
+
+void Control::cancel_init_sim_async() { load_cancel_requested = true; }
+
+/*
+ * Implementation Notes:
+ *     the gpus and the network size are part of the machine description, as
+ * both change how much host work a step has to hide behind the devices.
+ */
+static std::string gpu_and_network_description(uint32_t gpu_p2) {
+  std::stringstream desc;
+  int num_devices = 0;
+  cudaGetDeviceCount(&num_devices);
+  for (int i = 0; i < num_devices; i++) {
+    cudaDeviceProp props;
+    if (cudaGetDeviceProperties(&props, i) == cudaSuccess)
+      desc << props.name << ", ";
+  }
+  desc << "gpu_p2 " << gpu_p2 << "; gr " << num_gr << ", go " << num_go;
+  return desc.str();
+}
+
+bool Control::tune_host_parallelism() {
+  if (autotune_mode == "off")
+    return false;
+  std::string machine =
+      machine_description(gpu_and_network_description(gpuP2));
+  autotune_config cfg;
+  if (autotune_mode != "retune" &&
+      load_autotune_config(AUTOTUNE_CACHE_FILE, machine, cfg)) {
+    apply_autotune_config(cfg);
+    host_config = cfg;
+    LOG_DEBUG("Using tuned host parallelism: %u threads, chunk %u.",
+              cfg.num_threads, cfg.omp_chunk);
+    return false;
+  }
+  cfg = autotune([this]() {
+    mfs->calcGammaActivity(BKGD, simCore->getMZoneList());
+    simCore->updateMFInput(mfAP);
+    simCore->calcActivity(spillFrac, pf_pc_plast, mf_nc_plast, 0, 0, stp_on);
+  });
+  LOG_INFO("Tuned host parallelism: %u threads, chunk %u (%0.1fus/step). "
+           "Saved to '%s'.",
+           cfg.num_threads, cfg.omp_chunk, cfg.step_us,
+           AUTOTUNE_CACHE_FILE.c_str());
+  save_autotune_config(AUTOTUNE_CACHE_FILE, machine, cfg);
+  host_config = cfg;
+  return true;
+}
+
 /**
  *  @details TODO: This function has not been finished: still need to reset
  *  the sim_core, mfFreq, and mfs.
@@ -156,18 +376,151 @@ void Control::reset_sim(std::string in_sim_filename) {
   sim_file_buf.close();
 }
 
+/*
+ * Implementation Notes:
+ *     the state of a sim stopped by a failed health check is broken, so it is
+ * only saved on request, and then under a name that cannot be mistaken for
+ * the result of the session.
+ */
 void Control::save_sim_to_file() {
   if (out_sim_filename_created) {
+    std::string sim_name = out_sim_name;
+    if (health_failed) {
+      if (!health_monitor->config().checkpoint) {
+        LOG_INFO("Not saving the simulation, which failed a health check.");
+        return;
+      }
+      sim_name = data_out_path + "/" + data_out_base_name + "_unhealthy" +
+                 SIM_EXT;
+    }
     LOG_DEBUG("Saving simulation to file...");
-    std::fstream outSimFileBuffer(out_sim_name.c_str(),
-                                  std::ios::out | std::ios::binary);
+    DirectOutBuf sim_out_buf;
+    if (!sim_out_buf.open(sim_name))
+      return;
+    std::fstream outSimFileBuffer;
+    attach_direct_out(outSimFileBuffer, sim_out_buf);
     mfs->writeToFile(outSimFileBuffer);
     if (!simCore)
-      simState->writeState(outSimFileBuffer);
+      simState->writeState(outSimFileBuffer, thin_sim);
     else
-      simCore->writeState(outSimFileBuffer);
-    outSimFileBuffer.close();
+      simCore->writeState(outSimFileBuffer, thin_sim);
+    if (!sim_out_buf.close())
+      LOG_ERROR("Could not save the simulation to '%s'.", sim_name.c_str());
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     the sim holds settled nc conductances while the run goes on from the
+ * lazy ones (see MZone::writeToState), which the runtime state carries. So
+ * taking a checkpoint leaves the run as it was, and a replay restores the
+ * lazy values on top of the sim.
+ */
+void Control::save_checkpoint(uint32_t trial) {
+  std::string path = checkpoint_path(checkpoint_dir, data_out_base_name, trial);
+  LOG_INFO("Saving checkpoint at the start of trial %u...", trial + 1);
+  DirectOutBuf sim_out_buf;
+  if (!sim_out_buf.open(path + SIM_EXT))
+    return;
+  std::fstream sim_out;
+  attach_direct_out(sim_out, sim_out_buf);
+  mfs->writeToFile(sim_out);
+  simCore->writeState(sim_out, true);
+  if (!sim_out_buf.close()) {
+    LOG_ERROR("Could not save the checkpoint '%s'.", (path + SIM_EXT).c_str());
+    return;
+  }
+
+  checkpoint_header header = {};
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = CHECKPOINT_VERSION;
+  header.trial = trial;
+  header.pf_pc_plast = pf_pc_plast;
+  header.mf_nc_plast = mf_nc_plast;
+  header.stp_on = stp_on;
+  header.session_hash = session_hash;
+  DirectOutBuf ckpt_out_buf;
+  if (!ckpt_out_buf.open(path + CKPT_EXT))
+    return;
+  std::fstream ckpt_out;
+  attach_direct_out(ckpt_out, ckpt_out_buf);
+  ckpt_out.write((char *)&header, sizeof(header));
+  mfs->runtimeStateRW(ckpt_out, false);
+  simCore->checkpointRW(ckpt_out, false);
+  if (!ckpt_out_buf.close())
+    LOG_ERROR("Could not save the checkpoint '%s'.",
+              (path + CKPT_EXT).c_str());
+}
+
+/*
+ * Implementation Notes:
+ *     the sim of the checkpoint is loaded as any input sim, tuning included,
+ * and the runtime state is restored on top of it, so that the generators and
+ * the step counter pick up where the checkpointed run left them.
+ */
+void Control::init_replay(std::string replay_spec) {
+  size_t div = replay_spec.rfind(':');
+  std::string run = replay_spec.substr(0, div);
+  replay_trial = atoi(replay_spec.substr(div + 1).c_str()) - 1;
+  if (replay_trial >= td.num_trials) {
+    LOG_FATAL("Cannot replay trial %u: the session has %u trials. Exiting...",
+              replay_trial + 1, td.num_trials);
+    exit(7);
+  }
+  std::string dir = OUTPUT_DATA_PATH + run + "/" + CKPT_DIR;
+  std::string path;
+  bool found = false;
+  struct stat st;
+  for (replay_from = replay_trial + 1; replay_from-- > 0;) {
+    path = checkpoint_path(dir, run, replay_from);
+    if (stat((path + CKPT_EXT).c_str(), &st) == 0) {
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    LOG_FATAL("Run '%s' has no checkpoint at or before trial %u in '%s'. "
+              "Exiting...",
+              run.c_str(), replay_trial + 1, dir.c_str());
+    exit(11);
+  }
+
+  std::fstream ckpt_in((path + CKPT_EXT).c_str(),
+                       std::ios::in | std::ios::binary);
+  checkpoint_header header;
+  ckpt_in.read((char *)&header, sizeof(header));
+  if (!ckpt_in ||
+      memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) ||
+      header.version != CHECKPOINT_VERSION || header.trial != replay_from) {
+    LOG_FATAL("'%s' is not a checkpoint of version %u. Exiting...",
+              (path + CKPT_EXT).c_str(), CHECKPOINT_VERSION);
+    exit(7);
+  }
+  if (header.session_hash != session_hash ||
+      header.pf_pc_plast != pf_pc_plast ||
+      header.mf_nc_plast != mf_nc_plast || header.stp_on != stp_on) {
+    LOG_FATAL("Run '%s' was checkpointed with a different session file or "
+              "different plasticity options. Exiting...",
+              run.c_str());
+    exit(7);
   }
+  LOG_INFO("Replaying trial %u of '%s' from its checkpoint at trial %u...",
+           replay_trial + 1, run.c_str(), replay_from + 1);
+  if_data.p_cl.input_sim_file = path + SIM_EXT;
+  init_sim(path + SIM_EXT);
+  if (!sim_initialized) {
+    LOG_FATAL("Could not load the checkpoint '%s'. Exiting...",
+              (path + SIM_EXT).c_str());
+    exit(11);
+  }
+  mfs->runtimeStateRW(ckpt_in, true);
+  simCore->checkpointRW(ckpt_in, true);
+  if (!ckpt_in) {
+    LOG_FATAL("Checkpoint '%s' is truncated. Exiting...",
+              (path + CKPT_EXT).c_str());
+    exit(7);
+  }
+  replay_on = true;
 }
 
 /**
@@ -205,6 +558,14 @@ void Control::write_header_info(std::fstream &out_buf) {
           << std::setw(HEADER_COL_2_WIDTH) << std::left << if_data.end_time
           << "#\n";
 
+  if (!if_data.early_stop.empty()) {
+    col_1_remaining = HEADER_COL_1_WIDTH - EARLY_STOP_LBL.length();
+    out_buf << "#" << std::setw(1) << "" << EARLY_STOP_LBL
+            << std::setw(col_1_remaining) << ""
+            << " : " << std::setw(HEADER_COL_2_WIDTH) << std::left
+            << if_data.early_stop << "#\n";
+  }
+
   col_1_remaining = HEADER_COL_1_WIDTH - CBM_SIM_VER_LBL.length();
   out_buf << "#" << std::setw(1) << "" << CBM_SIM_VER_LBL
           << std::setw(col_1_remaining) << ""
@@ -481,11 +842,7 @@ void Control::save_pfpc_weights_to_file() {
       return;
     }
     const float *pfpc_weights = simCore->getMZoneList()[0]->exportPFPCWeights();
-    std::fstream outPFPCFileBuffer(pfpc_weights_file.c_str(),
-                                   std::ios::out | std::ios::binary);
-    rawBytesRW((char *)pfpc_weights, num_gr * sizeof(float), false,
-               outPFPCFileBuffer);
-    outPFPCFileBuffer.close();
+    write_direct(pfpc_weights_file, pfpc_weights, num_gr * sizeof(float));
   }
 }
 
@@ -501,11 +858,8 @@ void Control::save_pfpc_weights_at_trial_to_file(uint32_t trial) {
         data_out_path + "/" + get_file_basename(pfpc_weights_file) + "_trial_" +
         std::to_string(trial) + WEIGHTS_EXT[0];
     const float *pfpc_weights = simCore->getMZoneList()[0]->exportPFPCWeights();
-    std::fstream outPFPCFileBuffer(curr_trial_weight_name.c_str(),
-                                   std::ios::out | std::ios::binary);
-    rawBytesRW((char *)pfpc_weights, num_gr * sizeof(float), false,
-               outPFPCFileBuffer);
-    outPFPCFileBuffer.close();
+    write_direct(curr_trial_weight_name, pfpc_weights,
+                 num_gr * sizeof(float));
   }
 }
 
@@ -531,12 +885,8 @@ void Control::save_mfdcn_weights_to_file() {
     }
     const float *mfdcn_weights =
         simCore->getMZoneList()[0]->exportMFDCNWeights();
-    std::fstream outMFDCNFileBuffer(mfnc_weights_file.c_str(),
-                                    std::ios::out | std::ios::binary);
-    rawBytesRW((char *)mfdcn_weights,
-               num_nc * num_p_nc_from_mf_to_nc * sizeof(const float), false,
-               outMFDCNFileBuffer);
-    outMFDCNFileBuffer.close();
+    write_direct(mfnc_weights_file, mfdcn_weights,
+                 num_nc * num_p_nc_from_mf_to_nc * sizeof(float));
   }
 }
 
@@ -587,10 +937,163 @@ void Control::create_raster_filenames(std::map<std::string, bool> &rast_map) {
         rf_names[i] = data_out_path + "/" + data_out_base_name + RAST_EXT[i];
       }
     }
+    if (!rf_names[GR].empty()) {
+      gr_trial_raster_prefix = data_out_path + "/" +
+                               get_file_basename(rf_names[GR]) + "_trial_";
+      // room for any trial number, so that naming a trial never reallocates
+      gr_trial_raster_name.reserve(gr_trial_raster_prefix.size() + 16 +
+                                   RAST_EXT[GR].size());
+    }
     raster_filenames_created = true;
   }
 }
 
+/**
+ *  @details The raster store replaces the per-trial granule raster files. It
+ *  is only used in tui mode, where rasters are not kept around for display.
+ */
+void Control::create_raster_store_filename() {
+  if (data_out_dir_created && raster_filenames_created && !use_gui) {
+    out_raster_store_name = data_out_path + "/" + data_out_base_name + TRS_EXT;
+    raster_store_filename_created = true;
+  }
+}
+
+void Control::create_spike_stream(std::map<std::string, bool> &monitor_map) {
+  if (monitor_map.empty())
+    return;
+  spike_stream_pop pops[NUM_CELL_TYPES];
+  num_stream_pops = 0;
+  for (uint32_t i = 0; i < NUM_CELL_TYPES; i++) {
+    if (monitor_map[CELL_IDS[i]]) {
+      pops[num_stream_pops].cell_id = i;
+      pops[num_stream_pops].num_cells = rast_cell_nums[i];
+      stream_cell_ids[num_stream_pops] = i;
+      stream_spikes[num_stream_pops] = cell_spikes[i];
+      num_stream_pops++;
+    }
+  }
+  spike_stream = new SpikeStreamWriter("/cbm_stream_" + data_out_base_name,
+                                       pops, num_stream_pops);
+}
+
+void Control::create_golden_trace(std::string trace_mode) {
+  if (trace_mode.empty() || !data_out_dir_created)
+    return;
+  std::string out_trace_name =
+      data_out_path + "/" + data_out_base_name + GTR_EXT;
+  LOG_DEBUG("Recording golden trace to '%s'...", out_trace_name.c_str());
+  golden_trace = new GoldenTraceWriter(out_trace_name, rast_cell_nums,
+                                       trace_mode == "full");
+}
+
+void Control::create_event_recorder(std::string event_file) {
+  if (event_file.empty() || !data_out_dir_created)
+    return;
+  event_config cfg = DEFAULT_EVENT_CONFIG;
+  if (!load_event_config(event_file, CELL_IDS, cfg)) {
+    LOG_FATAL("Could not load event recording file '%s'. Exiting...",
+              event_file.c_str());
+    exit(11);
+  }
+  std::string out_event_name =
+      data_out_path + "/" + data_out_base_name + EVT_EXT;
+  LOG_DEBUG("Recording event windows to '%s'...", out_event_name.c_str());
+  event_recorder = new EventRecorder(out_event_name, cfg, rast_cell_nums,
+                                     CELL_IDS, msPerTimeStep);
+}
+
+/*
+ * Implementation Notes:
+ *     a gr trace of some cells only has them gathered on the device, so that
+ * a sample copies back those cells rather than the whole population. Every
+ * variable of a population is traced for the same cells, so one selection
+ * serves them all.
+ */
+void Control::create_trace_recorder(std::string trace_file) {
+  if (trace_file.empty() || !data_out_dir_created)
+    return;
+  trace_config cfg;
+  if (!load_trace_config(trace_file, rast_cell_nums, CELL_IDS, cfg)) {
+    LOG_FATAL("Could not load trace file '%s'. Exiting...",
+              trace_file.c_str());
+    exit(11);
+  }
+  for (const trace_spec &spec : cfg.traces) {
+    if (spec.pop == GR && !spec.all_cells) {
+      simCore->getInputNet()->setSubsetGR(spec.cells.data(),
+                                          spec.cells.size());
+      break;
+    }
+  }
+  std::string out_trace_name =
+      data_out_path + "/" + data_out_base_name + VTR_EXT;
+  LOG_DEBUG("Recording traces to '%s'...", out_trace_name.c_str());
+  trace_recorder =
+      new TraceRecorder(out_trace_name, cfg, rast_cell_nums, msPerTimeStep);
+}
+
+/*
+ * Implementation Notes:
+ *     the bounds of each class default to those of its plasticity rule, which
+ * is fixed for the session by the time this is called.
+ */
+void Control::create_weight_stats(std::string weight_stats_file) {
+  if (weight_stats_file.empty() || !data_out_dir_created)
+    return;
+  weight_stats_config cfg = {1, 64, {}};
+  cfg.classes[WEIGHT_PFPC] = {false, 0.0f, 1.0f, {}};
+  cfg.classes[WEIGHT_MFNC] = {false, 0.0f, 1.0f, {}};
+  uint32_t num_states[WEIGHT_NUM_CLASSES] = {0, 0};
+  if (pf_pc_plast == BINARY) {
+    cfg.classes[WEIGHT_PFPC].low = binPlastWeightLow;
+    cfg.classes[WEIGHT_PFPC].high = binPlastWeightHigh;
+  } else if (pf_pc_plast == ABBOTT_CASCADE || pf_pc_plast == MAUK_CASCADE) {
+    cfg.classes[WEIGHT_PFPC].low = cascPlastWeightLow;
+    cfg.classes[WEIGHT_PFPC].high = cascPlastWeightHigh;
+    num_states[WEIGHT_PFPC] = WEIGHT_MAX_STATES;
+  }
+  uint32_t num_syns[WEIGHT_NUM_CLASSES] = {
+      (uint32_t)num_gr, (uint32_t)(num_nc * num_p_nc_from_mf_to_nc)};
+  uint32_t syns_per_post[WEIGHT_NUM_CLASSES] = {
+      (uint32_t)num_p_pc_from_gr_to_pc, (uint32_t)num_p_nc_from_mf_to_nc};
+  if (!load_weight_stats_config(weight_stats_file, num_syns, cfg)) {
+    LOG_FATAL("Could not load weight statistics file '%s'. Exiting...",
+              weight_stats_file.c_str());
+    exit(11);
+  }
+  std::string out_stats_name =
+      data_out_path + "/" + data_out_base_name + WST_EXT;
+  LOG_DEBUG("Logging weight statistics to '%s'...", out_stats_name.c_str());
+  weight_stats = new WeightStats(out_stats_name, cfg, num_syns, syns_per_post,
+                                 num_states);
+}
+
+void Control::create_health_monitor(std::string health_file) {
+  if (health_file.empty())
+    return;
+  health_config cfg = DEFAULT_HEALTH_CONFIG;
+  if (!load_health_config(health_file, CELL_IDS, cfg)) {
+    LOG_FATAL("Could not load health check file '%s'. Exiting...",
+              health_file.c_str());
+    exit(11);
+  }
+  LOG_DEBUG("Checking network health every %u steps...", cfg.interval);
+  health_monitor =
+      new HealthMonitor(cfg, rast_cell_nums, CELL_IDS, msPerTimeStep);
+}
+
+void Control::create_convergence_rule(std::string convergence_file) {
+  if (convergence_file.empty())
+    return;
+  if (!load_convergence_config(convergence_file, convergence_cfg)) {
+    LOG_FATAL("Could not load convergence file '%s'. Exiting...",
+              convergence_file.c_str());
+    exit(11);
+  }
+  convergence_on = true;
+}
+
 void Control::create_psth_filenames(std::map<std::string, bool> &psth_map) {
   if (data_out_dir_created) {
     for (uint32_t i = 0; i < NUM_CELL_TYPES; i++) {
@@ -622,7 +1125,11 @@ void Control::create_con_arrs_filenames(
     std::map<std::string, bool> &conn_arrs_map) {
   if (data_out_dir_created) {
     for (uint32_t i = 0; i < NUM_SYN_CONS; i++) {
-      if (conn_arrs_map[SYN_CONS_IDS[i]] || use_gui) {
+      if (con_edges && conn_arrs_map[SYN_CONS_IDS[i]]) {
+        con_edges_names[i] = data_out_path + "/" + data_out_base_name +
+                             SYN_CONS_EXT[i] + "e";
+        LOG_DEBUG("Created filename: %s\n", con_edges_names[i].c_str());
+      } else if (conn_arrs_map[SYN_CONS_IDS[i]] || use_gui) {
         pre_con_arrs_names[i] =
             data_out_path + "/" + data_out_base_name + "_PRE" + SYN_CONS_EXT[i];
         post_con_arrs_names[i] = data_out_path + "/" + data_out_base_name +
@@ -741,11 +1248,34 @@ void Control::runSession(struct gui *gui) {
   int goSpkCounter[num_go];
   if (!use_gui)
     run_state = IN_RUN_NO_PAUSE;
-  trial = 0;
-  raster_counter = 0;
+  // a replay starts at its checkpoint, with the session's raster layout
+  trial = replay_on ? replay_from : 0;
+  raster_counter = trial * msMeasure;
+  uint32_t end_trial = replay_on ? replay_trial + 1 : td.num_trials;
+  if (raster_store_filename_created && !raster_store)
+    raster_store = new TrialStoreWriter(out_raster_store_name);
+  if (closed_loop)
+    closed_loop->set_sim_state(CL_SIM_RUNNING);
+  if (spike_stream)
+    spike_stream->set_state(STREAM_RUNNING);
+  if (status_reporter)
+    status_reporter->set_state("running");
+  if (!session_rn)
+    session_rn = new RedNucleus(num_nc);
+  if (convergence_on) {
+    if (convergence)
+      delete convergence;
+    convergence = new ConvergenceRule(
+        convergence_cfg, simCore->getMZoneList()[0]->exportPFPCWeights(),
+        num_gr);
+    if_data.early_stop = "none";
+  }
+  bool converged = false;
   // trial loop
-  while (trial < td.num_trials && run_state != NOT_IN_RUN) {
-    std::string trialName = td.trial_names[trial];
+  while (trial < end_trial && run_state != NOT_IN_RUN && !converged) {
+    const std::string &trialName = td.trial_names[trial];
+    // a replay records the trial it replays, and only that one
+    bool recording = !replay_on || trial == replay_trial;
 
     uint32_t useCS = td.use_css[trial];
     uint32_t onsetCS = td.cs_onsets[trial];
@@ -756,18 +1286,35 @@ void Control::runSession(struct gui *gui) {
     int PSTHCounter = 0;
     float gGRGO_sum = 0;
     float gMFGO_sum = 0;
+    // the red nucleus output never goes below 0
+    float trial_cr = useCS ? 0.0 : NAN;
 
     memset(goSpkCounter, 0, num_go * sizeof(int));
 
     LOG_INFO("Trial number: %d", trial + 1);
+    if (event_recorder)
+      event_recorder->set_armed(recording);
+    if (checkpoint_interval && trial % checkpoint_interval == 0)
+      save_checkpoint(trial);
+    if (live_rn)
+      live_rn->reset();
+    if (closed_loop)
+      closed_loop->reset_stats();
     start = omp_get_wtime();
     for (uint32_t ts = 0; ts < trialTime; ts++) {
-      if (useUS == 1 && ts == onsetUS) // deliver the US
+      param_overlay->apply_pending();
+      bool us_on = (useUS == 1 && ts == onsetUS);
+      // deliver cs if specified at cmdline and within cs duration
+      bool cs_on = (useCS && ts >= onsetCS && ts < onsetCS + csLength);
+      float err_drive = 0.3;
+      if (closed_loop)
+        poll_closed_loop(cs_on, us_on, err_drive);
+
+      if (us_on) // deliver the US
       {
-        simCore->updateErrDrive(0, 0.3);
+        simCore->updateErrDrive(0, err_drive);
       }
-      // deliver cs if specified at cmdline and within cs duration
-      if (useCS && ts >= onsetCS && ts < onsetCS + csLength) {
+      if (cs_on) {
         mfs->calcGammaActivity(CS, simCore->getMZoneList());
       } else { // background mf activity
         mfs->calcGammaActivity(BKGD, simCore->getMZoneList());
@@ -778,6 +1325,30 @@ void Control::runSession(struct gui *gui) {
       // spikes
       simCore->calcActivity(spillFrac, pf_pc_plast, mf_nc_plast, useCS, useUS,
                             stp_on);
+      if (live_rn)
+        live_cr = live_rn->calc_step(cell_spikes[NC]);
+      // the CR is measured from cs onset up to the us, if there is one
+      if (convergence && useCS && ts >= onsetCS && ts < onsetCS + csLength &&
+          !(useUS && ts >= onsetUS))
+        trial_cr = std::max(trial_cr, live_cr);
+      if (closed_loop)
+        publish_closed_loop(ts, cs_on, us_on);
+      if (spike_stream && recording)
+        publish_spike_stream(ts);
+      if (golden_trace && recording)
+        record_golden_trace(ts);
+      if (event_recorder)
+        record_events(ts);
+      if (trace_recorder && recording && trace_recorder->sample_due(ts))
+        record_traces(ts);
+      if (health_monitor) {
+        if (health_monitor->step(cell_spikes))
+          check_health(ts);
+        if (health_monitor->failed()) {
+          run_state = NOT_IN_RUN;
+          break;
+        }
+      }
 
       /* collect conductances used to check tuning */
       /* cs is defined wrt msPreCS, so subtract it and add bun_viz on top */
@@ -803,8 +1374,10 @@ void Control::runSession(struct gui *gui) {
 
       /* data collection */
       if (ts >= onsetCS - msPreCS && ts < onsetCS - msPreCS + msMeasure) {
-        fill_rasters(raster_counter, PSTHCounter);
-        fill_psths(PSTHCounter);
+        if (recording) {
+          fill_rasters(raster_counter, PSTHCounter);
+          fill_psths(PSTHCounter);
+        }
         PSTHCounter++;
         raster_counter++;
       }
@@ -817,7 +1390,28 @@ void Control::runSession(struct gui *gui) {
       }
     }
     end = omp_get_wtime();
+    if (trace_recorder)
+      trace_recorder->end_block();
     LOG_INFO("'%s' took %0.2fs", trialName.c_str(), end - start);
+    if (status_reporter)
+      status_reporter->trial_done(trialName, end - start);
+    if (closed_loop) {
+      const cl_latency_stats &cl_stats = closed_loop->get_stats();
+      if (cl_stats.rtt_count > 0) {
+        LOG_INFO("Closed loop: %lu commands over %lu steps, round trip "
+                 "min/mean/max %0.1f/%0.1f/%0.1fus",
+                 cl_stats.fresh_cmds, cl_stats.polls,
+                 cl_stats.rtt_min_ns / 1000.0,
+                 cl_stats.rtt_sum_ns / cl_stats.rtt_count / 1000.0,
+                 cl_stats.rtt_max_ns / 1000.0);
+      } else {
+        LOG_INFO("Closed loop: %lu commands over %lu steps",
+                 cl_stats.fresh_cmds, cl_stats.polls);
+      }
+      if (cl_stats.timeouts > 0)
+        LOG_WARN("Closed loop: controller missed %lu lockstep deadlines",
+                 cl_stats.timeouts);
+    }
 
     if (use_gui) {
       // for now, compute the mean and median firing rates for all cells if
@@ -836,34 +1430,259 @@ void Control::runSession(struct gui *gui) {
       }
       reset_spike_sums();
     } else {
-      // save gr rasters into new file every trial
-      save_gr_rasters_at_trial_to_file(trial);
+      // append this trial's rasters to the store every trial
+      if (recording)
+        save_rasters_at_trial_to_store(trial);
       // save_pfpc_weights_at_trial_to_file(trial);
     }
+    if (weight_stats && recording && run_state != NOT_IN_RUN &&
+        weight_stats->due(trial))
+      log_weight_stats();
+    if (convergence && run_state != NOT_IN_RUN &&
+        convergence->trial_done(
+            trial_cr, simCore->getMZoneList()[0]->exportPFPCWeights())) {
+      LOG_INFO("Converged after trial %u: CR amplitudes span %0.3f and pf -> "
+               "pc weights change %g per trial over the last %u trials. "
+               "Stopping...",
+               trial + 1, convergence->cr_spread(),
+               convergence->mean_weight_change(), convergence_cfg.window);
+      if_data.early_stop = "trial " + std::to_string(trial + 1) + " of " +
+                           std::to_string(td.num_trials);
+      converged = true;
+    }
     trial++;
   }
   trial--; // setting so that is valid for drawing go rasters after a sim
-  if (run_state == NOT_IN_RUN)
+  // a window still open when the session ends is saved as far as it got
+  if (event_recorder && event_recorder->window_open())
+    event_recorder->close_window(
+        event_recorder->captures(GR) ? simCore->getInputNet()->exportAPBufGR()
+                                     : NULL);
+  if (closed_loop)
+    closed_loop->set_sim_state(CL_SIM_DONE);
+  if (spike_stream)
+    spike_stream->set_state(STREAM_DONE);
+  bool terminated = (run_state == NOT_IN_RUN);
+  health_failed = health_monitor && health_monitor->failed();
+  if (health_failed)
+    LOG_ERROR("Simulation stopped by a failed health check at %s",
+              health_monitor->diagnostic().c_str());
+  else if (terminated)
     LOG_INFO("Simulation terminated.");
   else if (run_state == IN_RUN_NO_PAUSE)
     LOG_INFO("Simulation Completed.");
   run_state = NOT_IN_RUN;
+  if (status_reporter)
+    status_reporter->set_state("saving");
   set_info_file_str_props(AFTER_RUN, if_data);
 
-  RedNucleus rn(num_nc);
-  rn.calc_crs_from((const uint8_t **)rasters[NC], pc_crs, td.num_trials,
-                   BUN_VIZ_MS_MEASURE, BUN_VIZ_MS_PRE_CS, msPreCS, msMeasure);
+  session_rn->calc_crs_from((const uint8_t **)rasters[NC], pc_crs,
+                            td.num_trials, BUN_VIZ_MS_MEASURE,
+                            BUN_VIZ_MS_PRE_CS, msPreCS, msMeasure);
   if (!use_gui) { // go ahead and save everything
                   // if we're not in the gui.
     save_rasters_no_gr();
     save_psths();
     save_pfpc_weights_to_file();
     save_mfdcn_weights_to_file();
-    save_sim_to_file();
+    // the state after a replayed trial is that of the run it replays
+    if (!replay_on)
+      save_sim_to_file();
     save_info_to_file();
     save_bvi_to_file();
     save_dat_to_file();
   }
+  if (status_reporter)
+    status_reporter->set_state(health_failed ? "unhealthy"
+                               : terminated  ? "terminated"
+                                             : "done");
+}
+
+/*
+ * Implementation Notes:
+ *     the last command received stays in effect until the controller sends
+ * another, so cl_cmd is a member. The us trigger count is tracked whatever the
+ * us mode, so that switching to controller-driven us never delivers a us for
+ * increments made while the session was in charge.
+ */
+void Control::poll_closed_loop(bool &cs_on, bool &us_on, float &err_drive) {
+  closed_loop->poll_command(cl_cmd, cl_max_wait_ns);
+  if (cl_cmd.cs_mode == CL_FORCE_OFF)
+    cs_on = false;
+  else if (cl_cmd.cs_mode == CL_FORCE_ON)
+    cs_on = true;
+  if (cl_cmd.us_mode == CL_FORCE_ON) {
+    us_on = (cl_cmd.us_count != cl_us_count);
+    err_drive = cl_cmd.err_drive;
+  }
+  cl_us_count = cl_cmd.us_count;
+}
+
+void Control::publish_closed_loop(uint32_t ts, bool cs_on, bool us_on) {
+  cl_observation obs;
+  obs.trial = trial;
+  obs.ts = ts;
+  obs.cs_on = cs_on;
+  obs.us_on = us_on;
+  obs.cr = live_cr;
+  obs.num_nc = num_nc;
+  memcpy(obs.nc_spikes, cell_spikes[NC], num_nc * sizeof(uint8_t));
+  closed_loop->publish_observation(obs);
+}
+
+/*
+ * Implementation Notes:
+ *     granule spikes are only copied back from the device on export, so they
+ * are re-exported every step. Every other population is computed on the host
+ * and cell_spikes already points at its live array.
+ */
+void Control::publish_spike_stream(uint32_t ts) {
+  for (uint32_t i = 0; i < num_stream_pops; i++) {
+    if (stream_cell_ids[i] == GR)
+      stream_spikes[i] = simCore->getInputNet()->exportAPGR();
+  }
+  spike_stream->publish(trial, ts, live_cr, stream_spikes);
+}
+
+/*
+ * Implementation Notes:
+ *     granule spikes and voltages are copied back from the device here, which
+ * is why tracing slows a session down. Mossy fibers have no voltage.
+ */
+void Control::record_golden_trace(uint32_t ts) {
+  const uint8_t *spikes[NUM_CELL_TYPES];
+  const float *vms[NUM_CELL_TYPES];
+  for (uint32_t i = 0; i < NUM_CELL_TYPES; i++)
+    spikes[i] = cell_spikes[i];
+  spikes[GR] = simCore->getInputNet()->exportAPGR();
+  vms[MF] = NULL;
+  vms[GR] = simCore->getInputNet()->exportVmGR();
+  vms[GO] = simCore->getInputNet()->exportVmGO();
+  vms[BC] = simCore->getMZoneList()[0]->exportVmBC();
+  vms[SC] = simCore->getMZoneList()[0]->exportVmSC();
+  vms[PC] = simCore->getMZoneList()[0]->exportVmPC();
+  vms[IO] = simCore->getMZoneList()[0]->exportVmIO();
+  vms[NC] = simCore->getMZoneList()[0]->exportVmNC();
+  golden_trace->record(trial, ts, spikes, vms);
+}
+
+/*
+ * Implementation Notes:
+ *     granule spikes and voltages are copied back from the device only on
+ * the steps the recorder asks for them: spikes every 32 steps, as history
+ * words, and voltages every sample.
+ */
+void Control::record_events(uint32_t ts) {
+  uint32_t needs = event_recorder->step(trial, ts, cell_spikes);
+  const uint32_t *gr_ap_buf = NULL;
+  if (needs & EVENT_NEEDS_GR_SPIKES)
+    gr_ap_buf = simCore->getInputNet()->exportAPBufGR();
+  if (!(needs & EVENT_NEEDS_VMS)) {
+    event_recorder->commit_step(gr_ap_buf, NULL);
+    return;
+  }
+  const float *vms[NUM_CELL_TYPES] = {};
+  if (event_recorder->captures(GR))
+    vms[GR] = simCore->getInputNet()->exportVmGR();
+  vms[GO] = simCore->getInputNet()->exportVmGO();
+  vms[BC] = simCore->getMZoneList()[0]->exportVmBC();
+  vms[SC] = simCore->getMZoneList()[0]->exportVmSC();
+  vms[PC] = simCore->getMZoneList()[0]->exportVmPC();
+  vms[IO] = simCore->getMZoneList()[0]->exportVmIO();
+  vms[NC] = simCore->getMZoneList()[0]->exportVmNC();
+  event_recorder->commit_step(gr_ap_buf, vms);
+}
+
+/*
+ * Implementation Notes:
+ *     the pf -> pc weights and cascade states are copied back from the
+ * device; the mf -> nc weights are read in place.
+ */
+void Control::log_weight_stats() {
+  MZone *mZone = simCore->getMZoneList()[0];
+  const float *weights[WEIGHT_NUM_CLASSES] = {mZone->exportPFPCWeights(),
+                                              mZone->exportMFDCNWeights()};
+  const uint8_t *states[WEIGHT_NUM_CLASSES] = {NULL, NULL};
+  if (pf_pc_plast == ABBOTT_CASCADE || pf_pc_plast == MAUK_CASCADE)
+    states[WEIGHT_PFPC] = mZone->exportPFPCWeightStates();
+  weight_stats->record(trial, weights, states);
+}
+
+/*
+ * Implementation Notes:
+ *     gr values come back from the device only on sampled steps, and only
+ * for the traced cells when they are a subset. The host values are read in
+ * place.
+ */
+void Control::record_traces(uint32_t ts) {
+  InNet *inNet = simCore->getInputNet();
+  MZone *mZone = simCore->getMZoneList()[0];
+  const trace_config &cfg = trace_recorder->config();
+  const float *values[TRACE_NUM_POPS * TRACE_NUM_VARS];
+  for (uint32_t i = 0; i < cfg.traces.size(); i++) {
+    uint32_t var = cfg.traces[i].var;
+    bool subset = trace_recorder->gathered(i);
+    switch (cfg.traces[i].pop) {
+    case GR:
+      if (var == 0)
+        values[i] = subset ? inNet->exportVmSubsetGR() : inNet->exportVmGR();
+      else if (var == 1)
+        values[i] =
+            subset ? inNet->exportGESumSubsetGR() : inNet->exportGESumGR();
+      else
+        values[i] =
+            subset ? inNet->exportGISumSubsetGR() : inNet->exportGISumGR();
+      break;
+    case GO:
+      if (var == 0)
+        values[i] = inNet->exportVmGO();
+      else if (var == 1)
+        values[i] = inNet->exportgSum_MFGO();
+      else
+        values[i] = inNet->exportgSum_GRGO();
+      break;
+    case BC:
+      values[i] = mZone->exportVmBC();
+      break;
+    case SC:
+      values[i] = mZone->exportVmSC();
+      break;
+    case PC:
+      if (var == 0)
+        values[i] = mZone->exportVmPC();
+      else if (var == 1)
+        values[i] = mZone->exportgPFPC();
+      else
+        values[i] = mZone->exportgBCPC();
+      break;
+    case IO:
+      values[i] = mZone->exportVmIO();
+      break;
+    case NC:
+      values[i] = mZone->exportVmNC();
+      break;
+    }
+  }
+  trace_recorder->record(trial, ts, values);
+}
+
+/*
+ * Implementation Notes:
+ *     as for the golden trace, granule state is copied back from the device
+ * here, but only every check interval.
+ */
+void Control::check_health(uint32_t ts) {
+  const float *vms[NUM_CELL_TYPES];
+  vms[MF] = NULL;
+  vms[GR] = simCore->getInputNet()->exportVmGR();
+  vms[GO] = simCore->getInputNet()->exportVmGO();
+  vms[BC] = simCore->getMZoneList()[0]->exportVmBC();
+  vms[SC] = simCore->getMZoneList()[0]->exportVmSC();
+  vms[PC] = simCore->getMZoneList()[0]->exportVmPC();
+  vms[IO] = simCore->getMZoneList()[0]->exportVmIO();
+  vms[NC] = simCore->getMZoneList()[0]->exportVmNC();
+  health_monitor->check(trial, ts, simCore->getInputNet()->exportAPBufGR(),
+                        vms);
 }
 
 void Control::reset_spike_sums() {
@@ -897,16 +1716,43 @@ void Control::reset_psths() {
   }
 }
 
+/*
+ * Implementation Notes:
+ *     called from the gui at every trial boundary, so the name is rebuilt
+ * inside the buffer reserved in create_raster_filenames.
+ */
 void Control::save_gr_rasters_at_trial_to_file(uint32_t trial) {
   if (!rf_names[GR].empty()) {
-    std::string trial_raster_name =
-        data_out_path + "/" + get_file_basename(rf_names[GR]) + "_trial_" +
-        std::to_string(trial) + RAST_EXT[GR];
+    char trial_str[16];
+    snprintf(trial_str, sizeof(trial_str), "%u", trial);
+    gr_trial_raster_name.assign(gr_trial_raster_prefix)
+        .append(trial_str)
+        .append(RAST_EXT[GR]);
     LOG_DEBUG("Saving granule raster to file...");
-    write2DArray<uint8_t>(trial_raster_name, rasters[GR], num_gr, msMeasure);
+    write2DArray<uint8_t>(gr_trial_raster_name, rasters[GR], num_gr,
+                          msMeasure);
   }
 }
 
+/**
+ *  @details GR rasters only hold a single trial, so the whole array is the
+ *  chunk. The remaining rasters accumulate over the session, so the chunk for
+ *  this trial starts at row trial * msMeasure.
+ */
+void Control::save_rasters_at_trial_to_store(uint32_t trial) {
+  if (!raster_store)
+    return;
+  for (uint32_t i = 0; i < NUM_CELL_TYPES; i++) {
+    if (!rf_names[i].empty()) {
+      uint32_t start_row = (CELL_IDS[i] == "GR") ? 0 : trial * msMeasure;
+      raster_store->append_chunk(i, trial, rasters[i][start_row], msMeasure,
+                                 rast_cell_nums[i], sizeof(uint8_t));
+    }
+  }
+  LOG_DEBUG("Committing trial %d rasters to the raster store...", trial + 1);
+  raster_store->commit();
+}
+
 void Control::save_rasters_no_gr() {
   for (uint32_t i = 0; i < NUM_CELL_TYPES; i++) {
     if (CELL_IDS[i] != "GR") {
@@ -922,7 +1768,9 @@ void Control::save_psths() {
 }
 
 void Control::save_con_arrs() {
-  if (con_arrs_filenames_created) {
+  if (con_arrs_filenames_created && con_edges) {
+    save_con_edges();
+  } else if (con_arrs_filenames_created) {
     for (uint32_t i = 0; i < NUM_SYN_CONS; i++) {
       if (!pre_con_arrs_names[i].empty() && !post_con_arrs_names[i].empty()) {
         LOG_DEBUG("Saving %s connectivity array(s) to file...",
@@ -936,6 +1784,8 @@ void Control::save_con_arrs() {
         std::fstream post_con_arrs_file_buf(post_con_arrs_names[i].c_str(),
                                             std::ios::out | std::ios::binary);
         if (SYN_CONS_IDS[i] == "MFGR") {
+          // a no-op unless the sim was built procedurally
+          simState->getInnetConStateInternal()->materializeGRInputs();
           simState->getInnetConStateInternal()->pMFfromMFtoGRRW(
               pre_con_arrs_file_buf, false);
           simState->getInnetConStateInternal()->pGRfromMFtoGRRW(
@@ -956,6 +1806,7 @@ void Control::save_con_arrs() {
           simState->getInnetConStateInternal()->pGOInfromGOtoGORW(
               post_con_arrs_file_buf, false);
         } else if (SYN_CONS_IDS[i] == "GOGR") {
+          simState->getInnetConStateInternal()->materializeGRInputs();
           simState->getInnetConStateInternal()->pGOfromGOtoGRRW(
               pre_con_arrs_file_buf, false);
           simState->getInnetConStateInternal()->pGRfromGOtoGRRW(
@@ -1003,7 +1854,35 @@ void Control::save_con_arrs() {
         post_con_arrs_file_buf.close();
       }
     }
+    simState->getInnetConStateInternal()->releaseGRInputs();
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     the synapse types are independent, so each is sorted, encoded and
+ * written by its own thread. The gr inputs of a procedural sim are
+ * materialized beforehand, as materializing is not thread-safe.
+ */
+void Control::save_con_edges() {
+  InNetConnectivityState *innet = simState->getInnetConStateInternal();
+  con_table tables[NUM_SYN_CONS];
+  for (uint32_t i = 0; i < NUM_SYN_CONS; i++) {
+    if (con_edges_names[i].empty())
+      continue;
+    if (SYN_CONS_IDS[i] == "MFGR" || SYN_CONS_IDS[i] == "GOGR")
+      innet->materializeGRInputs();
+    tables[i] = simState->getConTable(SYN_CONS_IDS[i]);
+  }
+#pragma omp parallel for schedule(dynamic, 1)
+  for (uint32_t i = 0; i < NUM_SYN_CONS; i++) {
+    if (con_edges_names[i].empty())
+      continue;
+    LOG_DEBUG("Saving %s edge list to file...", SYN_CONS_IDS[i].c_str());
+    if (!write_edge_list(con_edges_names[i], tables[i]))
+      LOG_ERROR("Couldn't save the %s edge list.", SYN_CONS_IDS[i].c_str());
   }
+  innet->releaseGRInputs();
 }
 
 void Control::update_spike_sums(int tts, float onset_cs, float offset_cs) {
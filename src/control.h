@@ -11,6 +11,7 @@
 #define _CONTROL_H
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <ctime>
 #include <fstream>
@@ -18,16 +19,34 @@
 #include <iostream>
 #include <iterator>
 #include <string>
+#include <thread>
 
 #include "activityparams.h"
+#include "autotune.h"
 #include "cbmsimcore.h"
 #include "cbmstate.h"
+#include "closed_loop.h"
 #include "commandline.h"
+#include "con_edges.h"
 #include "connectivityparams.h"
+#include "convergence.h"
 #include "ecmfpopulation.h"
+#include "event_recorder.h"
+#include "golden_trace.h"
+#include "health_monitor.h"
 #include "info_file.h"
 #include "innetactivitystate.h"
 #include "innetconnectivitystate.h"
+#include "param_overlay.h"
+#include "spike_stream.h"
+#include "status_file.h"
+#include "trace_recorder.h"
+#include "trial_store.h"
+#include "weight_stats.h"
+
+// red_nucleus.h defines its members out of line, so it may only be included
+// in one translation unit
+class RedNucleus;
 
 // TODO: place in a common place, as gui uses a constant like this too
 #define NUM_CELL_TYPES 8
@@ -46,6 +65,27 @@ const std::string WEIGHTS_EXT[NUM_WEIGHTS_TYPES] = {".pfpcw", ".mfncw"};
 const std::string SYN_CONS_EXT[NUM_SYN_CONS] = {
     ".mfgr", ".grgo", ".mfgo", ".gogo", ".gogr", ".bcpc",
     ".scpc", ".pcbc", ".pcnc", ".ioio", ".ncio", ".mfnc"};
+const std::string CKPT_EXT = ".ckpt";
+const std::string CKPT_DIR = "checkpoints";
+
+/*
+ * header of the runtime half of a checkpoint, BASE_tK.ckpt, written next to
+ * the thin sim BASE_tK.sim at the start of trial K (counted from 1). It is
+ * followed by ECMFPopulation::runtimeStateRW and CBMSimCore::checkpointRW.
+ * A replay checks that it runs the same session with the same plasticity.
+ */
+const char CHECKPOINT_MAGIC[4] = {'C', 'B', 'M', 'K'};
+const uint32_t CHECKPOINT_VERSION = 2;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t trial; // counted from 0
+  uint32_t pf_pc_plast;
+  uint32_t mf_nc_plast;
+  uint32_t stp_on;
+  uint64_t session_hash;
+} checkpoint_header;
 
 /* convenience enum for indexing output data type */
 enum save_opts {
@@ -114,6 +154,20 @@ struct cell_firing_rates {
  */
 enum sim_run_state { NOT_IN_RUN, IN_RUN_NO_PAUSE, IN_RUN_PAUSE };
 
+/*
+ * stages of loading a simulation, reported to the gui while init_sim_async
+ * runs. LOAD_DONE and LOAD_CANCELLED are final.
+ */
+enum sim_load_stage {
+  LOAD_IDLE,
+  LOAD_READING,
+  LOAD_DEVICES,
+  LOAD_TUNING,
+  LOAD_RECORDERS,
+  LOAD_DONE,
+  LOAD_CANCELLED
+};
+
 /** @class Control control.h "src/control.h"
  *  @brief Controlling class that handles building simulations, running
  *  simulations, and loading data from file and to file.
@@ -159,6 +213,7 @@ public:
   bool out_biv_filename_created = false;
   bool out_dat_filename_created = false;
   bool raster_filenames_created = false;
+  bool raster_store_filename_created = false;
   bool psth_filenames_created = false;
 
   bool pfpc_weights_filenames_created = false;
@@ -168,6 +223,15 @@ public:
 
   enum sim_run_state run_state = NOT_IN_RUN;
 
+  /* background loading (gui only). sim_loading belongs to the gui thread; the
+   * rest is written by the loader thread while it runs */
+  bool sim_loading = false;
+  std::atomic<int> load_stage{LOAD_IDLE};
+  std::atomic<uint64_t> load_bytes_read{0};
+  std::atomic<uint64_t> load_bytes_total{0};
+  std::atomic<bool> load_cancel_requested{false};
+  std::thread sim_loader;
+
   /* params that I do not know how to categorize */
   float goMin = 0.26;
   float spillFrac = 0.15; // go->gr synapse, part of build
@@ -192,6 +256,26 @@ public:
   enum plasticity pf_pc_plast = OFF;
   enum plasticity mf_nc_plast = OFF;
   bool stp_on = false;
+  /* "": use this machine's cached tuning, tuning first if there is none;
+   * "retune": tune even if cached; "off": keep the defaults */
+  std::string autotune_mode = "";
+  autotune_config host_config = DEFAULT_AUTOTUNE_CONFIG;
+  /* build granule inputs procedurally (see procedural_con.h) */
+  bool procedural_con = false;
+
+  /* save the sim thin: its connectivity goes to the store (see con_store.h) */
+  bool thin_sim = false;
+  /* save con arrs as edge lists (see con_edges.h) instead of dense arrays */
+  bool con_edges = false;
+  /* checkpoint the run at the start of every checkpoint_interval-th trial,
+   * or re-simulate replay_trial of an earlier run, from its checkpoint at
+   * replay_from (trials counted from 0) */
+  uint32_t checkpoint_interval = 0;
+  std::string checkpoint_dir = "";
+  bool replay_on = false;
+  uint32_t replay_from = 0;
+  uint32_t replay_trial = 0;
+  uint64_t session_hash = 0;
   /* input and output filenames */
   std::string sess_file_name = "";
   std::string data_out_path = "";
@@ -201,15 +285,21 @@ public:
   std::string out_info_name = "";
   std::string out_bvi_name = "";
   std::string out_dat_name = "";
+  std::string out_raster_store_name = "";
 
   std::string rf_names[NUM_CELL_TYPES];
   std::string pf_names[NUM_CELL_TYPES];
 
+  /* per-trial gr raster file name, rebuilt in place from its fixed prefix */
+  std::string gr_trial_raster_prefix = "";
+  std::string gr_trial_raster_name = "";
+
   std::string pfpc_weights_file = "";
   std::string mfnc_weights_file = "";
 
   std::string pre_con_arrs_names[NUM_SYN_CONS];
   std::string post_con_arrs_names[NUM_SYN_CONS];
+  std::string con_edges_names[NUM_SYN_CONS];
 
   /* instantiation of above structs for firing rate calculations in gui */
   struct cell_spike_sums spike_sums[NUM_CELL_TYPES];
@@ -227,6 +317,55 @@ public:
   uint32_t **psths[NUM_CELL_TYPES];
   float **pc_crs;
 
+  /* per-trial raster chunks are appended here during a tui session */
+  TrialStoreWriter *raster_store = NULL;
+
+  /* closed-loop control of the cs and us by an external process */
+  ClosedLoopServer *closed_loop = NULL;
+  cl_command cl_cmd = {};
+  uint32_t cl_us_count = 0;
+  uint64_t cl_max_wait_ns = 0;
+
+  /* live spike stream of selected cell types, for dashboards */
+  SpikeStreamWriter *spike_stream = NULL;
+  uint32_t num_stream_pops = 0;
+  uint32_t stream_cell_ids[NUM_CELL_TYPES];
+  const uint8_t *stream_spikes[NUM_CELL_TYPES];
+
+  /* per-step fingerprints of the session, for checking engine changes */
+  GoldenTraceWriter *golden_trace = NULL;
+
+  /* full activity of selected populations around triggers, e.g. io spikes */
+  EventRecorder *event_recorder = NULL;
+
+  /* decimated voltages and conductances of selected cells, whole sessions */
+  TraceRecorder *trace_recorder = NULL;
+
+  /* per-trial summaries of the plastic weights, and traces of a few */
+  WeightStats *weight_stats = NULL;
+
+  /* progress file for batch schedulers, rewritten at trial boundaries */
+  StatusReporter *status_reporter = NULL;
+
+  /* periodic checks of the network state, and whether one stopped the run */
+  HealthMonitor *health_monitor = NULL;
+  bool health_failed = false;
+
+  /* ends the session once learning has plateaued; made anew every session */
+  bool convergence_on = false;
+  convergence_config convergence_cfg = DEFAULT_CONVERGENCE_CONFIG;
+  ConvergenceRule *convergence = NULL;
+
+  /* act param changes from the gui or a watched file, applied between steps */
+  ParamOverlay *param_overlay = NULL;
+
+  /* red nucleus stepped every ts for the closed loop and the spike stream */
+  RedNucleus *live_rn = NULL;
+  float live_cr = 0.0;
+
+  /* red nucleus turning the nc rasters into crs at the end of a session */
+  RedNucleus *session_rn = NULL;
+
   /* save functions for time series data (srry I need them here for the gui */
   std::function<void()> raster_save_funcs[NUM_CELL_TYPES];
   std::function<void()> psth_save_funcs[NUM_CELL_TYPES];
@@ -264,6 +403,51 @@ public:
    */
   void init_sim(std::string in_sim_filename);
 
+  /**
+   *  @brief start init_sim on a background thread, so that the gui stays
+   *  responsive while a large simulation loads. Progress is published in
+   *  load_stage, load_bytes_read and load_bytes_total.
+   *  @param in_sim_filename String representing the filepath of the input
+   *  simulation file.
+   */
+  void init_sim_async(std::string in_sim_filename);
+
+  /**
+   *  @brief check on a load started by init_sim_async from the thread that
+   *  started it. Once the loader has finished, joins it and applies the host
+   *  parallelism it chose to the calling thread.
+   *  @return true once the load is over, whether it completed or was
+   *  cancelled (see sim_initialized).
+   */
+  bool poll_init_sim_async();
+
+  /**
+   *  @brief ask a load started by init_sim_async to stop at its next stage
+   *  boundary and release what it has loaded so far.
+   */
+  void cancel_init_sim_async();
+
+  /**
+   *  @brief read mfs, cbm state and cbm core from in_sim_filename.
+   *  @param in_sim_filename String representing the filepath of the input
+   *  simulation file.
+   *  @return false if the load was cancelled, in which case nothing remains
+   *  loaded.
+   */
+  bool load_sim(std::string in_sim_filename);
+
+  /**
+   *  @brief delete mfs, cbm state and cbm core.
+   */
+  void unload_sim();
+
+  /**
+   *  @brief apply this machine's cached host thread count and chunk size,
+   *  tuning them on the loaded sim first if none are cached.
+   *  @return true if tuning stepped the sim, which must then be reloaded.
+   */
+  bool tune_host_parallelism();
+
   /**
    *  @brief reset cbm state and cbm core to initial values from
    *  in_sim_filename.
@@ -277,6 +461,23 @@ public:
    */
   void save_sim_to_file();
 
+  /**
+   *  @brief Save a checkpoint of the run at the start of the given trial to
+   *  checkpoint_dir: a thin sim, and the generators and device state that the
+   *  sim leaves out.
+   *  @param trial the trial about to start, counted from 0.
+   */
+  void save_checkpoint(uint32_t trial);
+
+  /**
+   *  @brief Find the latest checkpoint of run at or before the trial in
+   *  replay_spec ("RUN:K"), and load the simulation from it. Exits if there is
+   *  none, or if it was written by a different session or with different
+   *  plasticity.
+   *  @param replay_spec the '-y' option as given.
+   */
+  void init_replay(std::string replay_spec);
+
   /**
    *  @brief Write run time and duration parameters to info file.
    *  @param out_buf Output buffer to send textual data to.
@@ -366,6 +567,62 @@ public:
    */
   void create_raster_filenames(std::map<std::string, bool> &rast_map);
 
+  /**
+   *  @brief Create the full-path filename of the output raster trial store
+   */
+  void create_raster_store_filename();
+
+  /**
+   *  @brief Create the live spike stream for the requested cell types. The
+   *  shared-memory name is derived from the output basename.
+   *  @param monitor_map Reference to map of cell type to bool which encodes
+   *  whether that cell type is streamed.
+   */
+  void create_spike_stream(std::map<std::string, bool> &monitor_map);
+
+  /**
+   *  @brief Create the golden trace writer, which records a fingerprint of
+   *  every time step to OUTPUT_BASE.gtr.
+   *  @param trace_mode "hash" for step hashes only, "full" for per-population
+   *  detail as well. Does nothing if empty.
+   */
+  void create_golden_trace(std::string trace_mode);
+
+  /**
+   *  @brief Create the event recorder from its json configuration file, which
+   *  saves windows around triggers to OUTPUT_BASE.evt. Exits if the file is
+   *  malformed. Does nothing if event_file is empty.
+   */
+  void create_event_recorder(std::string event_file);
+
+  /**
+   *  @brief Create the trace recorder from its json configuration file, which
+   *  saves voltages and conductances to OUTPUT_BASE.vtr. Exits if the file is
+   *  malformed. Does nothing if trace_file is empty.
+   */
+  void create_trace_recorder(std::string trace_file);
+
+  /**
+   *  @brief Create the weight statistics log from its json configuration
+   *  file, which appends a summary of the weights to OUTPUT_BASE.wst at the
+   *  end of trials. Exits if the file is malformed. Does nothing if
+   *  weight_stats_file is empty.
+   */
+  void create_weight_stats(std::string weight_stats_file);
+
+  /**
+   *  @brief Create the health monitor from its json configuration file.
+   *  Exits if the file is malformed. Does nothing if health_file is empty.
+   */
+  void create_health_monitor(std::string health_file);
+
+  /**
+   *  @brief Load the configuration of the convergence rule, which every
+   *  session then applies. Exits if the file is malformed. Does nothing if
+   *  convergence_file is empty.
+   */
+  void create_convergence_rule(std::string convergence_file);
+
   /**
    *  @brief Create the full-path filenames of cmdline-specified psth
    *  @param psth_map Reference to map of cell type to bool which encodes
@@ -405,6 +662,57 @@ public:
    */
   void runSession(struct gui *gui);
 
+  /**
+   *  @brief Poll the closed-loop mailbox for the latest command and apply it
+   *  to the cs and us decided by the session file for this step.
+   *  @param cs_on Whether the cs is on this step. Overridden by the command.
+   *  @param us_on Whether to deliver the us this step. Overridden by the
+   *  command.
+   *  @param err_drive Error drive of the us. Overridden by the command.
+   */
+  void poll_closed_loop(bool &cs_on, bool &us_on, float &err_drive);
+
+  /**
+   *  @brief Publish this step's nucleus spikes and red nucleus output to the
+   *  closed-loop mailbox.
+   */
+  void publish_closed_loop(uint32_t ts, bool cs_on, bool us_on);
+
+  /**
+   *  @brief Publish this step's spikes of the streamed cell types and the red
+   *  nucleus output to the spike stream.
+   */
+  void publish_spike_stream(uint32_t ts);
+
+  /**
+   *  @brief Append this step's fingerprint to the golden trace.
+   */
+  void record_golden_trace(uint32_t ts);
+
+  /**
+   *  @brief Hand this step's spikes to the event recorder, along with the
+   *  granule spike history and voltages when it asks for them.
+   */
+  void record_events(uint32_t ts);
+
+  /**
+   *  @brief Hand this step's sample of every traced variable to the trace
+   *  recorder.
+   */
+  void record_traces(uint32_t ts);
+
+  /**
+   *  @brief Append the summary of the weights at the end of this trial to
+   *  the weight statistics log.
+   */
+  void log_weight_stats();
+
+  /**
+   *  @brief Hand this step's voltages and granule spike history to the
+   *  health monitor for a check.
+   */
+  void check_health(uint32_t ts);
+
   /* reset functions for data collected during a session */
   void reset_spike_sums();
   void reset_rasters();
@@ -444,10 +752,22 @@ public:
   /* save data objects to file functions */
   void save_weights();
   void save_gr_rasters_at_trial_to_file(uint32_t trial);
+  /**
+   *  @brief Append the rasters collected during the given trial to the raster
+   *  trial store, one chunk per cell type, and commit them so that they are
+   *  visible to readers while the session is still running.
+   *  @param trial the trial whose rasters are to be appended.
+   */
+  void save_rasters_at_trial_to_store(uint32_t trial);
   void save_rasters_no_gr();
   void save_psths();
   /* NOTE: for now, saving 2d arrays, only from pre-synaptic side */
   void save_con_arrs();
+  /**
+   *  @brief Save the cmdline-specified con arrs as edge lists, one synapse
+   *  type per thread. Called by save_con_arrs when '--edges' was given.
+   */
+  void save_con_edges();
 
   /* delete data objects from memory. Only run in destructor */
   void delete_rasters();
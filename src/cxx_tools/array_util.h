@@ -11,6 +11,7 @@
 // loop over an array of known size
 #define FOREACH(array, iter) FOREACH_NELEM(array, NELEM(array), iter)
 
+#include "rng_seed.h"
 #include "sfmt.h"
 #include <time.h>
 
@@ -19,7 +20,7 @@
 
 /* Arrange the N elements of ARRAY in random order, using fisher-yates method */
 template <typename T> void fisher_yates_shuffle(T *array, size_t N) {
-  CRandomSFMT0 randGen(time(0));
+  CRandomSFMT0 randGen(next_rng_seed());
   for (size_t i = 0; i < N; i++) {
     size_t j = i + randGen.IRandom(0, N - i - 1); // TRIPLE CHECK!
     T t = array[j];
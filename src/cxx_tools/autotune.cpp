@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <fstream>
+#include <omp.h>
+#include <sstream>
+#include <vector>
+
+#include "autotune.h"
+#include "file_utility.h"
+#include "json.hpp"
+#include "logger.h"
+
+using json = nlohmann::json;
+
+// enough steps that a candidate's timing is not dominated by timer noise, few
+// enough that tuning takes a few seconds
+static const uint32_t AUTOTUNE_WARMUP_STEPS = 20;
+static const uint32_t AUTOTUNE_STEPS = 40;
+static const uint32_t AUTOTUNE_REPS = 3;
+static const uint32_t AUTOTUNE_CHUNKS[] = {0, 16, 64, 256};
+
+static std::string cpu_model() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.find("model name") == 0) {
+      size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        std::string model = line.substr(colon + 1);
+        ltrim(model, ' ');
+        return model;
+      }
+    }
+  }
+  return "unknown cpu";
+}
+
+std::string machine_description(std::string extra) {
+  std::stringstream desc;
+  desc << cpu_model() << " x" << omp_get_num_procs();
+  if (!extra.empty())
+    desc << "; " << extra;
+  return desc.str();
+}
+
+bool load_autotune_config(std::string cache_file, std::string description,
+                          autotune_config &cfg) {
+  std::ifstream cache_buf(cache_file);
+  if (!cache_buf.is_open())
+    return false;
+  json cache = json::parse(cache_buf, nullptr, false);
+  if (cache.is_discarded() || !cache.contains(description)) {
+    return false;
+  }
+  json entry = cache.at(description);
+  cfg.num_threads = entry.value("num_threads", 1u);
+  cfg.omp_chunk = entry.value("omp_chunk", 0u);
+  cfg.step_us = entry.value("step_us", 0.0);
+  if (cfg.num_threads == 0)
+    cfg.num_threads = 1;
+  return true;
+}
+
+void save_autotune_config(std::string cache_file, std::string description,
+                          const autotune_config &cfg) {
+  json cache = json::object();
+  std::ifstream in_buf(cache_file);
+  if (in_buf.is_open()) {
+    json old = json::parse(in_buf, nullptr, false);
+    if (!old.is_discarded() && old.is_object())
+      cache = old;
+  }
+  in_buf.close();
+  cache[description] = {{"num_threads", cfg.num_threads},
+                        {"omp_chunk", cfg.omp_chunk},
+                        {"step_us", cfg.step_us}};
+
+  // write then rename, so that a concurrent run never reads half a file
+  std::string tmp_file = cache_file + ".tmp";
+  std::ofstream out_buf(tmp_file, std::ios::trunc);
+  if (!out_buf.is_open()) {
+    LOG_WARN("Couldn't write autotune cache '%s'.", cache_file.c_str());
+    return;
+  }
+  out_buf << cache.dump(3) << "\n";
+  out_buf.close();
+  if (rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+    LOG_WARN("Couldn't replace autotune cache '%s'.", cache_file.c_str());
+    remove(tmp_file.c_str());
+  }
+}
+
+void apply_autotune_config(const autotune_config &cfg) {
+  omp_set_num_threads(cfg.num_threads);
+  omp_set_schedule(omp_sched_static, cfg.omp_chunk);
+}
+
+/*
+ * Implementation Notes:
+ *     each candidate is timed AUTOTUNE_REPS times and scored by its fastest
+ * repetition, which is the least disturbed by other processes.
+ */
+static double time_config(std::function<void()> &step,
+                          const autotune_config &cfg) {
+  apply_autotune_config(cfg);
+  double best = 0.0;
+  for (uint32_t rep = 0; rep < AUTOTUNE_REPS; rep++) {
+    double start = omp_get_wtime();
+    for (uint32_t i = 0; i < AUTOTUNE_STEPS; i++)
+      step();
+    double per_step = (omp_get_wtime() - start) / AUTOTUNE_STEPS;
+    if (rep == 0 || per_step < best)
+      best = per_step;
+  }
+  return best * 1e6;
+}
+
+autotune_config autotune(std::function<void()> step) {
+  LOG_INFO("Tuning host parallelism for this machine...");
+  std::vector<uint32_t> thread_counts;
+  uint32_t max_threads = omp_get_num_procs();
+  for (uint32_t n = 1; n < max_threads; n *= 2)
+    thread_counts.push_back(n);
+  thread_counts.push_back(max_threads);
+
+  apply_autotune_config(DEFAULT_AUTOTUNE_CONFIG);
+  for (uint32_t i = 0; i < AUTOTUNE_WARMUP_STEPS; i++)
+    step();
+
+  autotune_config best = DEFAULT_AUTOTUNE_CONFIG;
+  best.step_us = time_config(step, best);
+  for (uint32_t n : thread_counts) {
+    autotune_config cand = {n, 0, 0.0};
+    if (n == best.num_threads)
+      continue;
+    cand.step_us = time_config(step, cand);
+    LOG_DEBUG("  %u threads: %0.1fus/step", n, cand.step_us);
+    if (cand.step_us < best.step_us)
+      best = cand;
+  }
+  if (best.num_threads > 1) {
+    for (uint32_t chunk : AUTOTUNE_CHUNKS) {
+      autotune_config cand = {best.num_threads, chunk, 0.0};
+      if (chunk == best.omp_chunk)
+        continue;
+      cand.step_us = time_config(step, cand);
+      LOG_DEBUG("  %u threads, chunk %u: %0.1fus/step", cand.num_threads,
+                chunk, cand.step_us);
+      if (cand.step_us < best.step_us)
+        best = cand;
+    }
+  }
+  apply_autotune_config(best);
+  return best;
+}
@@ -0,0 +1,73 @@
+/*
+ * File: autotune.h
+ *
+ * Description:
+ *     This is the interface file for the host parallelism autotuner. The host
+ * stages of a time step (the golgi loops in InNet) are OpenMP loops whose best
+ * thread count and chunk size depend on the machine. autotune times a short
+ * run of the caller's step function at candidate configurations and returns
+ * the fastest; the result is cached per machine fingerprint (cpu model,
+ * processor count, gpus and network size) in a json file under the data
+ * directory, so that later runs on the same machine apply it without timing
+ * anything.
+ *
+ *     The tuned loops use schedule(runtime), so apply_autotune_config must be
+ * called (with DEFAULT_AUTOTUNE_CONFIG if nothing is tuned) before the first
+ * step.
+ */
+#ifndef AUTOTUNE_H_
+#define AUTOTUNE_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+typedef struct {
+  uint32_t num_threads;
+  uint32_t omp_chunk; // 0: one even static block per thread
+  double step_us;     // mean wall time per step, 0 if never timed
+} autotune_config;
+
+const autotune_config DEFAULT_AUTOTUNE_CONFIG = {1, 0, 0.0};
+
+/*
+ * Description:
+ *     returns a human-readable description of this machine: cpu model and
+ * number of processors, followed by the caller's extra (gpus, network size).
+ * Machines with the same description share a cache entry.
+ */
+std::string machine_description(std::string extra);
+
+/*
+ * Description:
+ *     looks up the configuration cached for the machine 'description' in
+ * 'cache_file'. Returns false if the file or the entry does not exist.
+ */
+bool load_autotune_config(std::string cache_file, std::string description,
+                          autotune_config &cfg);
+
+/*
+ * Description:
+ *     adds or replaces the entry for 'description' in 'cache_file', keeping
+ * the entries of other machines. The file is replaced atomically.
+ */
+void save_autotune_config(std::string cache_file, std::string description,
+                          const autotune_config &cfg);
+
+/*
+ * Description:
+ *     sets the OpenMP thread count and the runtime schedule.
+ */
+void apply_autotune_config(const autotune_config &cfg);
+
+/*
+ * Description:
+ *     times 'step' at candidate thread counts (powers of two up to the number
+ * of processors), then at candidate chunk sizes for the fastest thread count,
+ * and returns (and applies) the fastest configuration. step advances the
+ * simulation by one time step, so the caller must discard or reload its state
+ * afterwards.
+ */
+autotune_config autotune(std::function<void()> step);
+
+#endif /* AUTOTUNE_H_ */
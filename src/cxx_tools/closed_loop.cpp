@@ -0,0 +1,233 @@
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>    // O_* constants (POSIX ONLY)
+#include <sys/mman.h> // shm_open, mmap (POSIX ONLY)
+#include <unistd.h>   // ftruncate, close (POSIX ONLY)
+
+#include "closed_loop.h"
+#include "logger.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CL_CPU_RELAX() _mm_pause()
+#else
+#define CL_CPU_RELAX() std::atomic_signal_fence(std::memory_order_seq_cst)
+#endif
+
+uint64_t cl_now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * Implementation Notes:
+ *     classic seqlock. The release fence after the odd store keeps the payload
+ * writes from being reordered before it; the final release store publishes the
+ * payload. There is exactly one writer per slot, so a relaxed load of our own
+ * sequence is enough.
+ */
+void cl_seqlock_write(std::atomic<uint64_t> &seq, void *dst, const void *src,
+                      size_t num_bytes) {
+  uint64_t s = seq.load(std::memory_order_relaxed);
+  seq.store(s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(dst, src, num_bytes);
+  seq.store(s + 2, std::memory_order_release);
+}
+
+bool cl_seqlock_read(std::atomic<uint64_t> &seq, void *dst, const void *src,
+                     size_t num_bytes, uint64_t *copy_seq,
+                     uint32_t max_tries) {
+  for (uint32_t i = 0; i < max_tries; i++) {
+    uint64_t s1 = seq.load(std::memory_order_acquire);
+    if (s1 & 1) {
+      CL_CPU_RELAX();
+      continue;
+    }
+    memcpy(dst, src, num_bytes);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t s2 = seq.load(std::memory_order_relaxed);
+    if (s1 == s2) {
+      if (copy_seq)
+        *copy_seq = s1;
+      return true;
+    }
+  }
+  return false;
+}
+
+static cl_mailbox *cl_map_mailbox(int fd, const char *shm_name) {
+  void *addr =
+      mmap(NULL, sizeof(cl_mailbox), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    LOG_FATAL("Could not map closed-loop mailbox '%s': %s. Exiting...",
+              shm_name, strerror(errno));
+    exit(13);
+  }
+  return (cl_mailbox *)addr;
+}
+
+/*
+ * Implementation Notes:
+ *     any segment left behind by a crashed run is unlinked first, so a
+ * controller that is still attached to it sees CL_SIM_DONE on its stale copy
+ * rather than silently talking to nobody. The magic is written last so that a
+ * controller that attaches early never sees a half-initialized segment.
+ */
+ClosedLoopServer::ClosedLoopServer(std::string shm_name, uint32_t num_nc)
+    : shm_name(shm_name) {
+  if (num_nc > CL_MAX_NC) {
+    LOG_FATAL("Closed-loop mailbox carries at most %u nucleus cells, but the "
+              "simulation has %u. Exiting...",
+              CL_MAX_NC, num_nc);
+    exit(13);
+  }
+  shm_unlink(shm_name.c_str());
+  int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+  if (fd == -1) {
+    LOG_FATAL("Could not create closed-loop mailbox '%s': %s. Exiting...",
+              shm_name.c_str(), strerror(errno));
+    exit(13);
+  }
+  if (ftruncate(fd, sizeof(cl_mailbox)) == -1) {
+    LOG_FATAL("Could not size closed-loop mailbox '%s': %s. Exiting...",
+              shm_name.c_str(), strerror(errno));
+    close(fd);
+    shm_unlink(shm_name.c_str());
+    exit(13);
+  }
+  mailbox = cl_map_mailbox(fd, shm_name.c_str());
+  // ftruncate zero-fills, which is a valid initial state for every field
+  mailbox->version = CL_MAILBOX_VERSION;
+  mailbox->num_nc = num_nc;
+  mailbox->sim_state.store(CL_SIM_WAITING, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(mailbox->magic, CL_MAILBOX_MAGIC, sizeof(mailbox->magic));
+  memset(publish_ns, 0, sizeof(publish_ns));
+  reset_stats();
+  LOG_INFO("Closed-loop mailbox ready at '%s'.", shm_name.c_str());
+}
+
+ClosedLoopServer::~ClosedLoopServer() {
+  if (mailbox) {
+    set_sim_state(CL_SIM_DONE);
+    munmap(mailbox, sizeof(cl_mailbox));
+    shm_unlink(shm_name.c_str());
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     a command is fresh if the command sequence moved since the last poll. Its
+ * round-trip time is only counted if the observation it acknowledges is still
+ * in the publish history; an older ack means the controller fell more than
+ * CL_PUBLISH_HISTORY steps behind, and we do not want to guess.
+ *
+ *     when waiting, a command only counts once it answers the latest
+ * observation, so that in lockstep each step sees the controller's reaction to
+ * the step before it.
+ */
+bool ClosedLoopServer::poll_command(cl_command &cmd, uint64_t max_wait_ns) {
+  stats.polls++;
+  // nothing has been published yet, so there is nothing to wait for an answer to
+  if (num_published == 0)
+    max_wait_ns = 0;
+  uint64_t deadline = max_wait_ns ? cl_now_ns() + max_wait_ns : 0;
+  cl_command latest;
+  uint64_t seq;
+  while (true) {
+    if (mailbox->cmd_seq.load(std::memory_order_acquire) != last_cmd_seq &&
+        cl_seqlock_read(mailbox->cmd_seq, &latest, &mailbox->cmd,
+                        sizeof(latest), &seq) &&
+        seq != last_cmd_seq) {
+      if (!max_wait_ns || latest.ack_number >= num_published)
+        break;
+    }
+    if (!max_wait_ns)
+      return false;
+    if (cl_now_ns() >= deadline) {
+      stats.timeouts++;
+      return false;
+    }
+    CL_CPU_RELAX();
+  }
+  uint64_t now = cl_now_ns();
+  last_cmd_seq = seq;
+  cmd = latest;
+  stats.fresh_cmds++;
+  if (cmd.ack_number > 0 && cmd.ack_number <= num_published &&
+      num_published - cmd.ack_number < CL_PUBLISH_HISTORY) {
+    uint64_t rtt =
+        now - publish_ns[(cmd.ack_number - 1) & (CL_PUBLISH_HISTORY - 1)];
+    stats.rtt_count++;
+    stats.rtt_sum_ns += rtt;
+    if (rtt < stats.rtt_min_ns)
+      stats.rtt_min_ns = rtt;
+    if (rtt > stats.rtt_max_ns)
+      stats.rtt_max_ns = rtt;
+  }
+  return true;
+}
+
+void ClosedLoopServer::publish_observation(cl_observation &obs) {
+  num_published++;
+  obs.number = num_published;
+  publish_ns[(num_published - 1) & (CL_PUBLISH_HISTORY - 1)] = cl_now_ns();
+  cl_seqlock_write(mailbox->obs_seq, &mailbox->obs, &obs, sizeof(obs));
+}
+
+void ClosedLoopServer::set_sim_state(enum cl_sim_state state) {
+  mailbox->sim_state.store(state, std::memory_order_release);
+}
+
+void ClosedLoopServer::reset_stats() {
+  memset(&stats, 0, sizeof(stats));
+  stats.rtt_min_ns = UINT64_MAX;
+}
+
+ClosedLoopClient::ClosedLoopClient(std::string shm_name) {
+  int fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+  if (fd == -1) {
+    LOG_FATAL("Could not open closed-loop mailbox '%s': %s. Is the simulation "
+              "running? Exiting...",
+              shm_name.c_str(), strerror(errno));
+    exit(13);
+  }
+  mailbox = cl_map_mailbox(fd, shm_name.c_str());
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (memcmp(mailbox->magic, CL_MAILBOX_MAGIC, sizeof(mailbox->magic)) != 0 ||
+      mailbox->version != CL_MAILBOX_VERSION) {
+    LOG_FATAL("'%s' is not a version %u closed-loop mailbox. Exiting...",
+              shm_name.c_str(), CL_MAILBOX_VERSION);
+    munmap(mailbox, sizeof(cl_mailbox));
+    exit(13);
+  }
+}
+
+ClosedLoopClient::~ClosedLoopClient() {
+  if (mailbox)
+    munmap(mailbox, sizeof(cl_mailbox));
+}
+
+bool ClosedLoopClient::poll_observation(cl_observation &obs) {
+  uint64_t seq;
+  if (mailbox->obs_seq.load(std::memory_order_acquire) == last_obs_seq)
+    return false;
+  if (!cl_seqlock_read(mailbox->obs_seq, &obs, &mailbox->obs, sizeof(obs),
+                       &seq) ||
+      seq == last_obs_seq)
+    return false;
+  last_obs_seq = seq;
+  return true;
+}
+
+void ClosedLoopClient::send_command(const cl_command &cmd) {
+  cl_seqlock_write(mailbox->cmd_seq, &mailbox->cmd, &cmd, sizeof(cmd));
+}
+
+enum cl_sim_state ClosedLoopClient::get_sim_state() const {
+  return (enum cl_sim_state)mailbox->sim_state.load(std::memory_order_acquire);
+}
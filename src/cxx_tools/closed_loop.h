@@ -0,0 +1,177 @@
+/*
+ * File: closed_loop.h
+ *
+ * Description:
+ *     This is the interface file for the closed-loop mailbox, which lets an
+ * external controller process drive the CS and US while a session runs. The
+ * simulation and the controller share a small POSIX shared-memory segment
+ * holding two single-producer/single-consumer slots:
+ *
+ *     observation: written by the simulation after every time step (trial,
+ *                  time step, deep nucleus spikes, red nucleus output i.e. the
+ *                  CR sample, whether the CS/US were on)
+ *     command:     written by the controller whenever it likes (CS on/off or
+ *                  follow session, US trigger count and error drive)
+ *
+ * Each slot is guarded by a sequence lock, so neither side ever blocks the
+ * other: the writer bumps the sequence to an odd value, writes, then bumps it
+ * to the next even value; the reader retries if it saw an odd value or the
+ * sequence changed under it. The simulation polls the command slot once per
+ * step.
+ *
+ *     Every command carries the number of the observation it responded to.
+ * The simulation remembers when it published recent observations and so can
+ * measure the round-trip latency (publish observation -> controller reacts ->
+ * command seen by the simulation) for every fresh command.
+ *
+ *     The segment layout is shared with the stand-in controller in
+ * tools/cl_standin.cpp, so any change here must bump CL_MAILBOX_VERSION.
+ */
+#ifndef CLOSED_LOOP_H_
+#define CLOSED_LOOP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+const char CL_MAILBOX_MAGIC[8] = {'C', 'B', 'M', 'L', 'O', 'O', 'P', '1'};
+const uint32_t CL_MAILBOX_VERSION = 1;
+const uint32_t CL_MAX_NC = 64; // upper bound on num_nc the mailbox can carry
+const uint32_t CL_PUBLISH_HISTORY = 256; // must be a power of 2
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "closed-loop mailbox requires lock-free 64-bit atomics");
+
+/* how the simulation should treat the CS and US */
+enum cl_stim_mode { CL_FOLLOW_SESSION = 0, CL_FORCE_OFF = 1, CL_FORCE_ON = 2 };
+
+/* lifecycle of the simulation side, so a controller knows when to stop */
+enum cl_sim_state { CL_SIM_WAITING = 0, CL_SIM_RUNNING = 1, CL_SIM_DONE = 2 };
+
+typedef struct {
+  uint64_t number; // 1-based count of observations published so far
+  uint32_t trial;
+  uint32_t ts;
+  uint32_t cs_on;
+  uint32_t us_on;
+  float cr; // red nucleus membrane potential at this step (unnormalized)
+  uint32_t num_nc;
+  uint8_t nc_spikes[CL_MAX_NC];
+} cl_observation;
+
+typedef struct {
+  uint64_t ack_number; // number of the observation this command responds to
+  int32_t cs_mode;     // one of cl_stim_mode
+  int32_t us_mode;     // CL_FOLLOW_SESSION or CL_FORCE_ON (controller-driven)
+  uint32_t us_count;   // when us_mode == CL_FORCE_ON, each increment is one US
+  float err_drive;     // relative error drive of a controller-delivered US
+} cl_command;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_nc;
+  alignas(64) std::atomic<uint32_t> sim_state;
+  alignas(64) std::atomic<uint64_t> obs_seq;
+  cl_observation obs;
+  alignas(64) std::atomic<uint64_t> cmd_seq;
+  cl_command cmd;
+} cl_mailbox;
+
+/* round-trip latency statistics, in nanoseconds */
+typedef struct {
+  uint64_t polls;
+  uint64_t fresh_cmds;
+  uint64_t timeouts; // waits that ran out without an answer
+  uint64_t rtt_count;
+  uint64_t rtt_min_ns;
+  uint64_t rtt_max_ns;
+  double rtt_sum_ns;
+} cl_latency_stats;
+
+/*
+ * Description:
+ *     returns a monotonic timestamp in nanoseconds. Both sides of the mailbox
+ * use it, so timestamps are comparable across processes on the same machine.
+ */
+uint64_t cl_now_ns();
+
+/*
+ * Description:
+ *     seqlock helpers. Both functions are safe to call concurrently with one
+ * writer on the other side. cl_seqlock_read returns false if it could not get
+ * a consistent copy within max_tries attempts; on success, the sequence number
+ * of the copy is stored in copy_seq if it is not NULL.
+ */
+void cl_seqlock_write(std::atomic<uint64_t> &seq, void *dst, const void *src,
+                      size_t num_bytes);
+bool cl_seqlock_read(std::atomic<uint64_t> &seq, void *dst, const void *src,
+                     size_t num_bytes, uint64_t *copy_seq = NULL,
+                     uint32_t max_tries = 1024);
+
+/*
+ * Description:
+ *     simulation side of the mailbox. Creates (or replaces) the shared-memory
+ * segment with the given name on construction and unlinks it on destruction.
+ */
+class ClosedLoopServer {
+public:
+  ClosedLoopServer(std::string shm_name, uint32_t num_nc);
+  ~ClosedLoopServer();
+
+  /*
+   * Description:
+   *     copies the most recent command into cmd. Returns true if the command is
+   * new since the last poll. If max_wait_ns is non-zero, spins until a command
+   * acknowledging the latest observation arrives or the wait runs out.
+   */
+  bool poll_command(cl_command &cmd, uint64_t max_wait_ns = 0);
+
+  /*
+   * Description:
+   *     publishes an observation. The number field is filled in here.
+   */
+  void publish_observation(cl_observation &obs);
+
+  void set_sim_state(enum cl_sim_state state);
+
+  const cl_latency_stats &get_stats() const { return stats; }
+  void reset_stats();
+
+private:
+  std::string shm_name;
+  cl_mailbox *mailbox = NULL;
+  uint64_t last_cmd_seq = 0;
+  uint64_t num_published = 0;
+  uint64_t publish_ns[CL_PUBLISH_HISTORY];
+  cl_latency_stats stats;
+};
+
+/*
+ * Description:
+ *     controller side of the mailbox. Attaches to an existing segment; exits
+ * with a fatal log if it does not exist or is from a different version.
+ */
+class ClosedLoopClient {
+public:
+  ClosedLoopClient(std::string shm_name);
+  ~ClosedLoopClient();
+
+  /*
+   * Description:
+   *     copies the latest observation into obs. Returns true if it is newer
+   * than the one returned by the previous call.
+   */
+  bool poll_observation(cl_observation &obs);
+
+  void send_command(const cl_command &cmd);
+
+  enum cl_sim_state get_sim_state() const;
+  uint32_t get_num_nc() const { return mailbox->num_nc; }
+
+private:
+  cl_mailbox *mailbox = NULL;
+  uint64_t last_obs_seq = 0;
+};
+
+#endif /* CLOSED_LOOP_H_ */
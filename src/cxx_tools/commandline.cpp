@@ -14,6 +14,7 @@
 #include <iostream>
 #include <sstream>
 #include <utility>
+#include <sys/stat.h> // stat (POSIX ONLY)
 
 #include "commandline.h"
 #include "logger.h"
@@ -34,7 +35,9 @@ const std::string SYN_CONS_IDS[NUM_SYN_CONS] = {"MFGR", "GRGO", "MFGO", "GOGO",
  * available commandline flags which take no argument
  */
 const std::vector<std::string> command_line_single_opts{
-    "--pfpc-off", "--mfnc-off", "--binary", "--cascade", "--stp", "--verbose",
+    "--pfpc-off", "--mfnc-off", "--binary",  "--cascade",
+    "--stp",      "--verbose",  "--lockstep", "--retune",
+    "--no-tune",  "--procedural", "--thin",   "--edges",
 };
 
 /*
@@ -62,8 +65,34 @@ const std::vector<std::pair<std::string, std::string>> command_line_pair_opts{
                         // information for during a run
     {"-w", "--weights"}, // used to specify what synaptic weights to collect
                          // during a run
-    {"-c", "--con-arrs"} // used to specify what synaptic connectivity arrays
-                         // to collect
+    {"-c", "--con-arrs"}, // used to specify what synaptic connectivity arrays
+                          // to collect
+    {"-l", "--loop"}, // used to specify the name of the shared-memory mailbox
+                      // through which an external controller drives the CS/US
+    {"-m", "--monitor"}, // used to specify what cell types to stream live
+                         // during a run
+    {"-t", "--trace"}, // used to specify whether to record a golden trace of
+                       // a run, and in how much detail
+    {"-e", "--entropy"}, // used to specify the seed from which every random
+                         // number generator is seeded
+    {"-u", "--update-status"}, // used to specify the status files updated at
+                               // every trial boundary for batch schedulers
+    {"-a", "--act-params"}, // used to specify the parameter file watched for
+                            // changes during a run
+    {"-k", "--health"}, // used to specify the health check configuration of
+                        // a run
+    {"-x", "--early-stop"}, // used to specify the convergence rule that ends
+                            // a session early
+    {"-n", "--checkpoint"}, // used to specify every how many trials the run
+                            // state is checkpointed
+    {"-y", "--replay"}, // used to specify the run and trial to re-simulate
+                        // from the checkpoints of that run
+    {"-g", "--events"}, // used to specify the triggers and populations of
+                        // event-triggered recording
+    {"-d", "--vm-traces"}, // used to specify the cells, variables and
+                           // encoding of voltage trace recording
+    {"-f", "--weight-stats"} // used to specify the synapse classes and the
+                             // tracked synapses of the weight statistics log
 };
 
 /*
@@ -118,7 +147,8 @@ static std::string get_opt_param(std::vector<std::string> &token_buf,
  *
  */
 void test_for_valid_id(std::string &opt, std::string &id) {
-  if (opt[1] == 'r' || opt[1] == 'p' || opt[2] == 'r' || opt[2] == 'p') {
+  if (opt[1] == 'r' || opt[1] == 'p' || opt[1] == 'm' || opt[2] == 'r' ||
+      opt[2] == 'p' || opt[2] == 'm') {
     if (std::find(CELL_IDS, CELL_IDS + NUM_CELL_TYPES, id) ==
         CELL_IDS + NUM_CELL_TYPES) {
       LOG_FATAL("Invalid cell id '%s' found for option '%s'. Exiting...",
@@ -225,6 +255,78 @@ void print_usage_info() {
   std::cout << std::right << std::setw(10) << "\t--mfnc-off"
             << "\t\tturns off MFNC plasticity; same as default for now (ie is "
                "not tuned)\n";
+  std::cout << std::right << std::setw(20) << "\t-l, --loop [NAME]"
+            << "\tlet an external controller drive the CS and US through the "
+               "shared-memory mailbox '/NAME' (run mode only)\n";
+  std::cout << std::right << std::setw(10) << "\t--lockstep"
+            << "\t\twith -l, wait up to 1s each step for the controller to "
+               "answer the latest observation\n";
+  std::cout << std::right << std::setw(20) << "\t-t, --trace [hash|full]"
+            << "\trecord a golden trace of every time step to "
+               "BASENAME.gtr: step hashes only, or with per-population "
+               "spike counts and voltage checksums\n";
+  std::cout << std::right << std::setw(20) << "\t-e, --entropy [SEED]"
+            << "\tseed every random number generator from SEED instead of "
+               "the clock, so that repeated builds and runs are identical\n";
+  std::cout << std::right << std::setw(10) << "\t--retune|--no-tune"
+            << "\tre-time this machine's host thread count and chunk size "
+               "before the run, or run with 1 thread instead of the tuned "
+               "values; by default, the values cached in "
+               "'ROOT/data/autotune.json' are used, and tuned on first run\n";
+  std::cout << std::right << std::setw(20) << "\t-u, --update-status [FILES]"
+            << "\tcomma-separated list of status files rewritten at every "
+               "trial boundary (run mode only); FILEs ending in '.prom' are "
+               "written for the Prometheus textfile collector, others as "
+               "json\n";
+  std::cout << std::right << std::setw(20) << "\t-a, --act-params [FILE]"
+            << "\tjson file of raw activity parameter values, applied at the "
+               "start of the run and again, at the next time step, whenever "
+               "FILE changes (run mode only)\n";
+  std::cout << std::right << std::setw(20) << "\t-k, --health [FILE]"
+            << "\tjson file configuring periodic health checks of the "
+               "network state (NaN/Inf and out-of-range voltages, firing "
+               "rates); a failed check stops the session (run mode only)\n";
+  std::cout << std::right << std::setw(20) << "\t-x, --early-stop [FILE]"
+            << "\tjson file configuring a convergence rule: the session ends "
+               "once CR amplitude and pf -> pc weights have plateaued, and "
+               "the stopping trial is recorded in the info file (run mode "
+               "only)\n";
+  std::cout << std::right << std::setw(20) << "\t-n, --checkpoint [N]"
+            << "\tat the start of every N-th trial, save a checkpoint of the "
+               "run to 'BASENAME/checkpoints/': a thin sim plus the "
+               "generators and device state it leaves out (run mode only)\n";
+  std::cout << std::right << std::setw(20) << "\t-y, --replay [RUN:K]"
+            << "\tre-simulate trial K of the checkpointed run RUN, from its "
+               "nearest checkpoint, recording what -r, -p, -t and -m ask for "
+               "during trial K only; needs the session and plasticity "
+               "options of RUN, and no -i (run mode only)\n";
+  std::cout << std::right << std::setw(20) << "\t-g, --events [FILE]"
+            << "\tjson file configuring event-triggered recording: the "
+               "last moments of the chosen populations are kept in memory "
+               "and saved to BASENAME.evt around every trigger, e.g. an io "
+               "spike or a pause of the nc (run mode, TUI only)\n";
+  std::cout << std::right << std::setw(20) << "\t-d, --vm-traces [FILE]"
+            << "\tjson file configuring trace recording: voltages and "
+               "conductances of the chosen cells of any population, sampled "
+               "every so many ms and saved to BASENAME.vtr as floats, halves "
+               "or quantized deltas (run mode, TUI only)\n";
+  std::cout << std::right << std::setw(20) << "\t-f, --weight-stats [FILE]"
+            << "\tjson file configuring the weight statistics log: per-trial "
+               "histograms, per-cell means, fractions at bounds and cascade "
+               "states of the pf -> pc and mf -> nc weights, and the weights "
+               "of chosen synapses, appended to BASENAME.wst (run mode)\n";
+  std::cout << std::right << std::setw(10) << "\t--procedural"
+            << "\t\tbuild the granule layer's inputs procedurally: mf -> gr "
+               "and go -> gr are regenerated from a seed every step instead "
+               "of being stored (build mode only)\n";
+  std::cout << std::right << std::setw(10) << "\t--thin"
+            << "\t\t\tsave a thin sim file: its connectivity is stored once "
+               "in 'ROOT/data/con_store/', shared by every thin sim of the "
+               "same network, and the sim file only refers to it\n";
+  std::cout << std::right << std::setw(10) << "\t--edges"
+            << "\t\t\tsave the connectivity arrays given with '-c' as "
+               "compact edge lists, one file per synapse code with the "
+               "extension '.[code]e', instead of dense pre and post arrays\n";
   std::cout << "\t-c, --con-arrs {[CODE]} comma-separated list of synapse "
                "codes indicating what connectivity arrays are saved.\n";
   std::cout << "\t                        Saves both pre and post arrays "
@@ -254,6 +356,11 @@ void print_usage_info() {
   std::cout << "\t-p, --psth {[CODE]} comma-separated list of cell ids to be "
                "saved for that cell type. Possible CODEs are identical with "
                "those for rasters.\n\n";
+  std::cout << "\t-m, --monitor {[CODE]} comma-separated list of cell ids whose "
+               "spikes are streamed live, with the CR, to the shared-memory "
+               "ring '/cbm_stream_BASENAME'.\n";
+  std::cout << "\t                       Possible CODEs are identical with "
+               "those for rasters.\n\n";
   std::cout << "\t-w, --weights {[CODE]} comma-separated list of weights ids "
                "to be saved. Possible CODEs are:\n\n";
   std::cout << "\t\t\t\t  \tPFPC - parallel-fiber to purkinje synapse\n";
@@ -321,6 +428,21 @@ void parse_commandline(int *argc, char ***argv, parsed_commandline &p_cl) {
         p_cl.verbose = single_opt.substr(2, std::string::npos);
       } else if (single_opt.find("stp") != std::string::npos) {
         p_cl.stp = "on";
+      } else if (single_opt.find("lockstep") != std::string::npos) {
+        p_cl.lockstep = "on";
+      } else if (single_opt.find("tune") != std::string::npos) {
+        if (!p_cl.autotune.empty()) {
+          LOG_FATAL("Mutually exclusive arguments '--retune' and '--no-tune' "
+                    "found. Exiting...");
+          exit(1);
+        }
+        p_cl.autotune = (single_opt == "--retune") ? "retune" : "off";
+      } else if (single_opt.find("procedural") != std::string::npos) {
+        p_cl.procedural = "on";
+      } else if (single_opt.find("thin") != std::string::npos) {
+        p_cl.thin = "on";
+      } else if (single_opt == "--edges") {
+        p_cl.con_edges = "on";
       } else if (!pfpc_opt_found) {
         int offset = (single_opt.find("pfpc") != std::string::npos) ? 7 : 2;
         p_cl.pfpc_plasticity = single_opt.substr(offset, std::string::npos);
@@ -351,8 +473,9 @@ void parse_commandline(int *argc, char ***argv, parsed_commandline &p_cl) {
     case 1:
       this_opt = (first_opt_exist == 1) ? opt.first : opt.second;
       // both give the same thing, it is a matter of which exists, the
-      // long or the short version.
-      opt_char_code = (first_opt_exist == 1) ? this_opt[1] : this_opt[2];
+      // long or the short version. The code comes from the short version, as
+      // not every long version starts with the same letter.
+      opt_char_code = opt.first[1];
       if (opt_char_code == 'h')
         p_cl.print_help = "help";
       else {
@@ -383,6 +506,46 @@ void parse_commandline(int *argc, char ***argv, parsed_commandline &p_cl) {
         break;
       case 'c':
         fill_opt_map(p_cl.conn_arrs_files, this_opt, this_param);
+        break;
+      case 'l':
+        p_cl.closed_loop = this_param;
+        break;
+      case 'm':
+        fill_opt_map(p_cl.monitor_pops, this_opt, this_param);
+        break;
+      case 't':
+        p_cl.trace = this_param;
+        break;
+      case 'e':
+        p_cl.seed = this_param;
+        break;
+      case 'u':
+        p_cl.status_files = this_param;
+        break;
+      case 'a':
+        p_cl.act_params_file = this_param;
+        break;
+      case 'k':
+        p_cl.health_file = this_param;
+        break;
+      case 'x':
+        p_cl.convergence_file = this_param;
+        break;
+      case 'n':
+        p_cl.checkpoint_interval = this_param;
+        break;
+      case 'y':
+        p_cl.replay = this_param;
+        break;
+      case 'g':
+        p_cl.event_file = this_param;
+        break;
+      case 'd':
+        p_cl.trace_file = this_param;
+        break;
+      case 'f':
+        p_cl.weight_stats_file = this_param;
+        break;
       }
       break;
     case 0:
@@ -399,8 +562,35 @@ bool p_cmdline_is_empty(parsed_commandline &p_cl) {
          p_cl.vis_mode.empty() && p_cl.session_file.empty() &&
          p_cl.input_sim_file.empty() && p_cl.output_basename.empty() &&
          p_cl.pfpc_plasticity.empty() && p_cl.mfnc_plasticity.empty() &&
+         p_cl.closed_loop.empty() && p_cl.lockstep.empty() &&
+         p_cl.trace.empty() && p_cl.seed.empty() && p_cl.autotune.empty() &&
+         p_cl.status_files.empty() && p_cl.act_params_file.empty() &&
+         p_cl.health_file.empty() && p_cl.convergence_file.empty() &&
+         p_cl.procedural.empty() && p_cl.thin.empty() &&
+         p_cl.con_edges.empty() && p_cl.checkpoint_interval.empty() &&
+         p_cl.replay.empty() && p_cl.event_file.empty() &&
+         p_cl.trace_file.empty() && p_cl.weight_stats_file.empty() &&
          p_cl.raster_files.empty() && p_cl.psth_files.empty() &&
-         p_cl.weights_files.empty() && p_cl.conn_arrs_files.empty();
+         p_cl.weights_files.empty() && p_cl.conn_arrs_files.empty() &&
+         p_cl.monitor_pops.empty();
+}
+
+/*
+ * Implementation Notes:
+ *     path is taken as given if it exists, else as the name of a file under
+ * {PROJECT_ROOT}data/inputs/, and replaced by the file's full path. 'what'
+ * names the file in the error message.
+ */
+static void resolve_input_file(std::string &path, const char *what) {
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0)
+    return;
+  std::string fullpath;
+  if (!file_exists(INPUT_DATA_PATH, path, fullpath)) {
+    LOG_FATAL("Could not find %s file '%s'. Exiting...", what, path.c_str());
+    exit(11);
+  }
+  path = fullpath;
 }
 
 /*
@@ -431,9 +621,33 @@ void validate_commandline(parsed_commandline &p_cl) {
     if (!p_cl.verbose.empty()) {
       logger_setLevel(LogLevel_DEBUG);
     }
+    if (!p_cl.seed.empty()) {
+      if (p_cl.seed.find_first_not_of("0123456789") != std::string::npos ||
+          p_cl.seed.length() > 9) {
+        LOG_FATAL("Invalid seed '%s': expected a non-negative integer below "
+                  "10^9. Exiting...",
+                  p_cl.seed.c_str());
+        exit(7);
+      }
+      LOG_DEBUG("Seeding random number generators from %s...",
+                p_cl.seed.c_str());
+    }
+    if (!p_cl.con_edges.empty() && p_cl.conn_arrs_files.empty()) {
+      LOG_FATAL("'--edges' needs the connectivity arrays to save, given with "
+                "'-c'. Exiting...");
+      exit(8);
+    }
     if (!p_cl.session_file.empty()) // checking validity of input for run mode
     {
-      if (!p_cl.input_sim_file.empty()) {
+      if (!p_cl.replay.empty()) {
+        // the input of a replay is the nearest checkpoint, found by Control
+        if (!p_cl.input_sim_file.empty()) {
+          LOG_FATAL("A replay starts from a checkpoint of the run it "
+                    "replays, so '-i' may not be given with '-y'. "
+                    "Exiting...");
+          exit(7);
+        }
+      } else if (!p_cl.input_sim_file.empty()) {
         std::string input_sim_file_fullpath;
         // verify whether the input simulation file can be found recursively
         // from {PROJECT_ROOT}data/outputs/
@@ -486,6 +700,101 @@ void validate_commandline(parsed_commandline &p_cl) {
         exit(11);
       }
       p_cl.session_file = input_sess_file_fullpath;
+      if (!p_cl.closed_loop.empty()) {
+        if (p_cl.closed_loop.find('/') != std::string::npos) {
+          LOG_FATAL("Closed-loop mailbox name '%s' may not contain '/'. "
+                    "Exiting...",
+                    p_cl.closed_loop.c_str());
+          exit(7);
+        }
+        LOG_DEBUG("Using closed-loop mailbox '/%s'...",
+                  p_cl.closed_loop.c_str());
+      } else if (!p_cl.lockstep.empty()) {
+        LOG_FATAL("'--lockstep' requires a closed-loop mailbox (-l). "
+                  "Exiting...");
+        exit(7);
+      }
+      if (!p_cl.trace.empty() && p_cl.trace != "hash" && p_cl.trace != "full") {
+        LOG_FATAL("Invalid trace mode '%s': expected 'hash' or 'full'. "
+                  "Exiting...",
+                  p_cl.trace.c_str());
+        exit(7);
+      }
+      if (!p_cl.procedural.empty()) {
+        LOG_FATAL("'--procedural' can only be given in build mode: a sim file "
+                  "records how it was built. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.act_params_file.empty()) {
+        resolve_input_file(p_cl.act_params_file, "parameter");
+        LOG_DEBUG("Watching parameter file '%s'...",
+                  p_cl.act_params_file.c_str());
+      }
+      if (!p_cl.health_file.empty())
+        resolve_input_file(p_cl.health_file, "health check");
+      if (!p_cl.checkpoint_interval.empty()) {
+        if (p_cl.checkpoint_interval.find_first_not_of("0123456789") !=
+                std::string::npos ||
+            p_cl.checkpoint_interval.length() > 9 ||
+            atoi(p_cl.checkpoint_interval.c_str()) == 0) {
+          LOG_FATAL("Invalid checkpoint interval '%s': expected a positive "
+                    "number of trials. Exiting...",
+                    p_cl.checkpoint_interval.c_str());
+          exit(7);
+        }
+      }
+      if (!p_cl.replay.empty()) {
+        size_t div = p_cl.replay.rfind(':');
+        std::string replay_trial =
+            (div == std::string::npos) ? "" : p_cl.replay.substr(div + 1);
+        if (div == 0 || replay_trial.empty() ||
+            replay_trial.find_first_not_of("0123456789") !=
+                std::string::npos ||
+            replay_trial.length() > 9 || atoi(replay_trial.c_str()) == 0) {
+          LOG_FATAL("Invalid replay '%s': expected RUN:K, with K the number "
+                    "of the trial to re-simulate, counted from 1. Exiting...",
+                    p_cl.replay.c_str());
+          exit(7);
+        }
+        if (p_cl.vis_mode == "GUI") {
+          LOG_FATAL("Replays run in visual mode 'TUI' only. Exiting...");
+          exit(7);
+        }
+        if (!p_cl.checkpoint_interval.empty() ||
+            !p_cl.convergence_file.empty()) {
+          LOG_FATAL("A replay runs up to its trial and no further, so it "
+                    "neither saves checkpoints ('-n') nor stops early ('-x'). "
+                    "Exiting...");
+          exit(7);
+        }
+      }
+      if ((!p_cl.checkpoint_interval.empty() || !p_cl.replay.empty()) &&
+          (!p_cl.closed_loop.empty() || !p_cl.act_params_file.empty())) {
+        LOG_FATAL("A run driven from outside ('-l', '-a') cannot be "
+                  "replayed, so it can neither be checkpointed nor be a "
+                  "replay. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.event_file.empty()) {
+        if (p_cl.vis_mode == "GUI") {
+          LOG_FATAL("Event-triggered recording runs in visual mode 'TUI' "
+                    "only. Exiting...");
+          exit(7);
+        }
+        resolve_input_file(p_cl.event_file, "event recording");
+      }
+      if (!p_cl.trace_file.empty()) {
+        if (p_cl.vis_mode == "GUI") {
+          LOG_FATAL("Trace recording runs in visual mode 'TUI' only. "
+                    "Exiting...");
+          exit(7);
+        }
+        resolve_input_file(p_cl.trace_file, "trace");
+      }
+      if (!p_cl.weight_stats_file.empty())
+        resolve_input_file(p_cl.weight_stats_file, "weight statistics");
+      if (!p_cl.convergence_file.empty())
+        resolve_input_file(p_cl.convergence_file, "convergence");
     } else if (!p_cl.input_sim_file.empty()) {
       if (p_cl.vis_mode.empty()) {
         LOG_DEBUG(
@@ -501,6 +810,16 @@ void validate_commandline(parsed_commandline &p_cl) {
                   "Exiting...");
         exit(8);
       }
+      if (!p_cl.procedural.empty()) {
+        LOG_FATAL("'--procedural' can only be given in build mode: a sim file "
+                  "records how it was built. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.thin.empty()) {
+        LOG_FATAL("'--thin' has no effect in connectivity collect mode, where "
+                  "no sim file is saved. Exiting...");
+        exit(7);
+      }
       if (p_cl.output_basename.empty()) {
         LOG_FATAL("You must specify an output basename. Exiting...");
         exit(9);
@@ -516,6 +835,56 @@ void validate_commandline(parsed_commandline &p_cl) {
       }
       p_cl.input_sim_file = input_sim_file_fullpath;
     } else {
+      if (!p_cl.closed_loop.empty()) {
+        LOG_FATAL("A closed-loop mailbox can only be used in run mode. "
+                  "Exiting...");
+        exit(7);
+      }
+      if (!p_cl.monitor_pops.empty()) {
+        LOG_FATAL("Spikes can only be streamed in run mode. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.trace.empty()) {
+        LOG_FATAL("Golden traces can only be recorded in run mode. "
+                  "Exiting...");
+        exit(7);
+      }
+      if (!p_cl.status_files.empty()) {
+        LOG_FATAL("Status files can only be written in run mode. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.act_params_file.empty()) {
+        LOG_FATAL("Parameter files can only be watched in run mode. "
+                  "Exiting...");
+        exit(7);
+      }
+      if (!p_cl.health_file.empty()) {
+        LOG_FATAL("Health checks can only be run in run mode. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.convergence_file.empty()) {
+        LOG_FATAL("Sessions can only be stopped early in run mode. "
+                  "Exiting...");
+        exit(7);
+      }
+      if (!p_cl.checkpoint_interval.empty() || !p_cl.replay.empty()) {
+        LOG_FATAL("Runs can only be checkpointed and replayed in run mode. "
+                  "Exiting...");
+        exit(7);
+      }
+      if (!p_cl.event_file.empty()) {
+        LOG_FATAL("Events can only be recorded in run mode. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.trace_file.empty()) {
+        LOG_FATAL("Traces can only be recorded in run mode. Exiting...");
+        exit(7);
+      }
+      if (!p_cl.weight_stats_file.empty()) {
+        LOG_FATAL("Weight statistics can only be logged in run mode. "
+                  "Exiting...");
+        exit(7);
+      }
       if (p_cl.output_basename.empty()) {
         LOG_FATAL(
             "You must specify an output basename in build mode. Exiting...");
@@ -552,11 +921,29 @@ void cp_parsed_commandline(parsed_commandline &from_p_cl,
   to_p_cl.output_basename = from_p_cl.output_basename;
   to_p_cl.pfpc_plasticity = from_p_cl.pfpc_plasticity;
   to_p_cl.mfnc_plasticity = from_p_cl.mfnc_plasticity;
+  to_p_cl.closed_loop = from_p_cl.closed_loop;
+  to_p_cl.lockstep = from_p_cl.lockstep;
+  to_p_cl.trace = from_p_cl.trace;
+  to_p_cl.seed = from_p_cl.seed;
+  to_p_cl.autotune = from_p_cl.autotune;
+  to_p_cl.status_files = from_p_cl.status_files;
+  to_p_cl.act_params_file = from_p_cl.act_params_file;
+  to_p_cl.health_file = from_p_cl.health_file;
+  to_p_cl.convergence_file = from_p_cl.convergence_file;
+  to_p_cl.procedural = from_p_cl.procedural;
+  to_p_cl.thin = from_p_cl.thin;
+  to_p_cl.con_edges = from_p_cl.con_edges;
+  to_p_cl.checkpoint_interval = from_p_cl.checkpoint_interval;
+  to_p_cl.replay = from_p_cl.replay;
+  to_p_cl.event_file = from_p_cl.event_file;
+  to_p_cl.trace_file = from_p_cl.trace_file;
+  to_p_cl.weight_stats_file = from_p_cl.weight_stats_file;
 
   to_p_cl.raster_files = from_p_cl.raster_files;
   to_p_cl.psth_files = from_p_cl.psth_files;
   to_p_cl.weights_files = from_p_cl.weights_files;
   to_p_cl.conn_arrs_files = from_p_cl.conn_arrs_files;
+  to_p_cl.monitor_pops = from_p_cl.monitor_pops;
 }
 
 std::string parsed_commandline_to_str(parsed_commandline &p_cl) {
@@ -571,6 +958,25 @@ std::string parsed_commandline_to_str(parsed_commandline &p_cl) {
   p_cl_buf << "{ 'output_basename', '" << p_cl.output_basename << "' }\n";
   p_cl_buf << "{ 'pfpc_plasticity', '" << p_cl.pfpc_plasticity << "' }\n";
   p_cl_buf << "{ 'mfnc_plasticity', '" << p_cl.mfnc_plasticity << "' }\n";
+  p_cl_buf << "{ 'closed_loop', '" << p_cl.closed_loop << "' }\n";
+  p_cl_buf << "{ 'lockstep', '" << p_cl.lockstep << "' }\n";
+  p_cl_buf << "{ 'trace', '" << p_cl.trace << "' }\n";
+  p_cl_buf << "{ 'seed', '" << p_cl.seed << "' }\n";
+  p_cl_buf << "{ 'autotune', '" << p_cl.autotune << "' }\n";
+  p_cl_buf << "{ 'status_files', '" << p_cl.status_files << "' }\n";
+  p_cl_buf << "{ 'act_params_file', '" << p_cl.act_params_file << "' }\n";
+  p_cl_buf << "{ 'health_file', '" << p_cl.health_file << "' }\n";
+  p_cl_buf << "{ 'convergence_file', '" << p_cl.convergence_file << "' }\n";
+  p_cl_buf << "{ 'procedural', '" << p_cl.procedural << "' }\n";
+  p_cl_buf << "{ 'thin', '" << p_cl.thin << "' }\n";
+  p_cl_buf << "{ 'con_edges', '" << p_cl.con_edges << "' }\n";
+  p_cl_buf << "{ 'checkpoint_interval', '" << p_cl.checkpoint_interval
+           << "' }\n";
+  p_cl_buf << "{ 'replay', '" << p_cl.replay << "' }\n";
+  p_cl_buf << "{ 'event_file', '" << p_cl.event_file << "' }\n";
+  p_cl_buf << "{ 'trace_file', '" << p_cl.trace_file << "' }\n";
+  p_cl_buf << "{ 'weight_stats_file', '" << p_cl.weight_stats_file
+           << "' }\n";
   p_cl_buf << "{ 'raster_files' :\n";
   for (auto pair : p_cl.raster_files) {
     p_cl_buf << "{ '" << pair.first << "', '" << pair.second << "' }\n";
@@ -591,6 +997,11 @@ std::string parsed_commandline_to_str(parsed_commandline &p_cl) {
     p_cl_buf << "{ '" << pair.first << "', '" << pair.second << "' }\n";
   }
   p_cl_buf << "}\n";
+  p_cl_buf << "{ 'monitor_pops' :\n";
+  for (auto pair : p_cl.monitor_pops) {
+    p_cl_buf << "{ '" << pair.first << "', '" << pair.second << "' }\n";
+  }
+  p_cl_buf << "}\n";
   return p_cl_buf.str();
 }
 
@@ -36,10 +36,28 @@ typedef struct {
   std::string output_basename;
   std::string pfpc_plasticity;
   std::string mfnc_plasticity;
+  std::string closed_loop;
+  std::string lockstep;
+  std::string trace;
+  std::string seed;
+  std::string autotune;
+  std::string status_files;
+  std::string act_params_file;
+  std::string health_file;
+  std::string convergence_file;
+  std::string procedural;
+  std::string thin;
+  std::string con_edges;
+  std::string checkpoint_interval;
+  std::string replay;
+  std::string event_file;
+  std::string trace_file;
+  std::string weight_stats_file;
   std::map<std::string, bool> raster_files;
   std::map<std::string, bool> psth_files;
   std::map<std::string, bool> weights_files;
   std::map<std::string, bool> conn_arrs_files;
+  std::map<std::string, bool> monitor_pops;
 } parsed_commandline;
 
 /*
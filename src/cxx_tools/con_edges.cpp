@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "con_edges.h"
+#include "direct_out.h"
+#include "logger.h"
+
+// the most bytes a LEB128 varint of a uint64_t, and of a uint32_t, takes
+const uint32_t MAX_VARINT_BYTES = 10;
+const uint32_t MAX_ID_VARINT_BYTES = 5;
+
+static inline uint32_t valid_in_row(const con_table &t, uint32_t row) {
+  if (!t.row_counts)
+    return t.row_len;
+  int count = t.row_counts[row];
+  if (count < 0)
+    return 0;
+  return std::min((uint32_t)count, t.row_len);
+}
+
+/*
+ * Implementation Notes:
+ *     with rows of pre-synaptic cells, each row is copied and sorted on its
+ * own. With rows of post-synaptic cells, the synapses are counted per
+ * pre-synaptic cell first and then scattered in row order, which leaves every
+ * row sorted without a sort.
+ */
+static void table_to_csr(const con_table &t, edge_list &edges) {
+  edges.num_pre = t.rows_are_post ? t.num_cols : t.num_rows;
+  edges.num_post = t.rows_are_post ? t.num_rows : t.num_cols;
+  edges.offsets.assign(edges.num_pre + 1, 0);
+  edges.targets.clear();
+  if (!t.rows_are_post) {
+    for (uint32_t i = 0; i < t.num_rows; i++) {
+      const uint32_t *row = t.table + (uint64_t)i * t.row_len;
+      uint32_t n = valid_in_row(t, i);
+      uint64_t row_start = edges.targets.size();
+      for (uint32_t j = 0; j < n; j++) {
+        if (row[j] < t.num_cols)
+          edges.targets.push_back(row[j]);
+      }
+      std::sort(edges.targets.begin() + row_start, edges.targets.end());
+      edges.offsets[i + 1] = edges.targets.size();
+    }
+    return;
+  }
+  for (uint32_t i = 0; i < t.num_rows; i++) {
+    const uint32_t *row = t.table + (uint64_t)i * t.row_len;
+    uint32_t n = valid_in_row(t, i);
+    for (uint32_t j = 0; j < n; j++) {
+      if (row[j] < t.num_cols)
+        edges.offsets[row[j] + 1]++;
+    }
+  }
+  for (uint32_t i = 0; i < edges.num_pre; i++)
+    edges.offsets[i + 1] += edges.offsets[i];
+  edges.targets.resize(edges.offsets[edges.num_pre]);
+  std::vector<uint64_t> next(edges.offsets.begin(), edges.offsets.end() - 1);
+  for (uint32_t i = 0; i < t.num_rows; i++) {
+    const uint32_t *row = t.table + (uint64_t)i * t.row_len;
+    uint32_t n = valid_in_row(t, i);
+    for (uint32_t j = 0; j < n; j++) {
+      if (row[j] < t.num_cols)
+        edges.targets[next[row[j]]++] = i;
+    }
+  }
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint64_t val) {
+  while (val >= 0x80) {
+    *out++ = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  *out++ = (uint8_t)val;
+  return out;
+}
+
+static inline bool get_varint(const uint8_t *&in, const uint8_t *end,
+                              uint64_t &val) {
+  val = 0;
+  for (uint32_t shift = 0; shift < 7 * MAX_VARINT_BYTES; shift += 7) {
+    if (in == end)
+      return false;
+    uint8_t byte = *in++;
+    val |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Implementation Notes:
+ *     the file is built whole in memory, header first, and written in one go
+ * through the output engine. The buffer is sized for the worst case, so that
+ * the encoding loop never checks for room.
+ */
+bool write_edge_list(const std::string &path, const con_table &table) {
+  edge_list edges;
+  table_to_csr(table, edges);
+  uint64_t num_edges = edges.targets.size();
+
+  std::vector<uint8_t> file_buf(sizeof(edge_list_header) +
+                                (uint64_t)edges.num_pre * MAX_VARINT_BYTES +
+                                num_edges * MAX_ID_VARINT_BYTES);
+  uint8_t *body = file_buf.data() + sizeof(edge_list_header);
+  uint8_t *out = body;
+  for (uint32_t i = 0; i < edges.num_pre; i++) {
+    uint64_t start = edges.offsets[i];
+    uint64_t end = edges.offsets[i + 1];
+    out = put_varint(out, end - start);
+    uint32_t prev = 0;
+    for (uint64_t j = start; j < end; j++) {
+      out = put_varint(out, edges.targets[j] - prev);
+      prev = edges.targets[j];
+    }
+  }
+
+  edge_list_header header = {};
+  memcpy(header.magic, EDGE_LIST_MAGIC, sizeof(header.magic));
+  header.version = EDGE_LIST_VERSION;
+  header.num_pre = edges.num_pre;
+  header.num_post = edges.num_post;
+  header.num_edges = num_edges;
+  header.body_bytes = out - body;
+  memcpy(file_buf.data(), &header, sizeof(header));
+  return write_direct(path, file_buf.data(), out - file_buf.data());
+}
+
+bool read_edge_list(const std::string &path, edge_list &edges) {
+  std::ifstream in_buf(path, std::ios::in | std::ios::binary);
+  if (!in_buf.is_open()) {
+    LOG_ERROR("Couldn't open edge list '%s'.", path.c_str());
+    return false;
+  }
+  edge_list_header header;
+  in_buf.read((char *)&header, sizeof(header));
+  if (!in_buf || memcmp(header.magic, EDGE_LIST_MAGIC, sizeof(header.magic)) ||
+      header.version != EDGE_LIST_VERSION) {
+    LOG_ERROR("'%s' is not an edge list of version %u.", path.c_str(),
+              EDGE_LIST_VERSION);
+    return false;
+  }
+  // every cell's degree and every edge take at least a byte, so nothing is
+  // allocated for a header that claims more than the file can hold
+  in_buf.seekg(0, std::ios::end);
+  uint64_t body_room = (uint64_t)in_buf.tellg() - sizeof(header);
+  in_buf.seekg(sizeof(header), std::ios::beg);
+  if (header.body_bytes > body_room) {
+    LOG_ERROR("Edge list '%s' is truncated.", path.c_str());
+    return false;
+  }
+  if (header.num_pre > header.body_bytes ||
+      header.num_edges > header.body_bytes - header.num_pre) {
+    LOG_ERROR("Edge list '%s' claims more cells and edges than it holds.",
+              path.c_str());
+    return false;
+  }
+  std::vector<uint8_t> body(header.body_bytes);
+  in_buf.read((char *)body.data(), header.body_bytes);
+  if (!in_buf) {
+    LOG_ERROR("Edge list '%s' is truncated.", path.c_str());
+    return false;
+  }
+
+  edges.num_pre = header.num_pre;
+  edges.num_post = header.num_post;
+  edges.offsets.assign(header.num_pre + 1, 0);
+  edges.targets.clear();
+  edges.targets.reserve(header.num_edges);
+  const uint8_t *in = body.data();
+  const uint8_t *end = in + body.size();
+  for (uint32_t i = 0; i < header.num_pre; i++) {
+    uint64_t degree;
+    if (!get_varint(in, end, degree) ||
+        edges.targets.size() + degree > header.num_edges) {
+      LOG_ERROR("Edge list '%s' is malformed at pre-synaptic cell %u.",
+                path.c_str(), i);
+      return false;
+    }
+    uint64_t id = 0;
+    for (uint64_t j = 0; j < degree; j++) {
+      uint64_t delta;
+      if (!get_varint(in, end, delta) || id + delta >= header.num_post) {
+        LOG_ERROR("Edge list '%s' is malformed at pre-synaptic cell %u.",
+                  path.c_str(), i);
+        return false;
+      }
+      id += delta;
+      edges.targets.push_back(id);
+    }
+    edges.offsets[i + 1] = edges.targets.size();
+  }
+  if (edges.targets.size() != header.num_edges || in != end) {
+    LOG_ERROR("Edge list '%s' does not hold the %lu edges it claims.",
+              path.c_str(), header.num_edges);
+    return false;
+  }
+  return true;
+}
+
+void transpose_edge_list(const edge_list &in, edge_list &out) {
+  out.num_pre = in.num_post;
+  out.num_post = in.num_pre;
+  out.offsets.assign(in.num_post + 1, 0);
+  for (uint32_t target : in.targets)
+    out.offsets[target + 1]++;
+  for (uint32_t i = 0; i < in.num_post; i++)
+    out.offsets[i + 1] += out.offsets[i];
+  out.targets.resize(in.targets.size());
+  std::vector<uint64_t> next(out.offsets.begin(), out.offsets.end() - 1);
+  for (uint32_t i = 0; i < in.num_pre; i++) {
+    for (uint64_t j = in.offsets[i]; j < in.offsets[i + 1]; j++)
+      out.targets[next[in.targets[j]]++] = i;
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ * File: con_edges.h
+ *
+ * Description:
+ *     This is the interface file for compact connectivity exports. The dense
+ * connectivity arrays ('-c' without '--edges') store every synapse type twice,
+ * once per pre-synaptic and once per post-synaptic cell, each row padded with
+ * UINT_MAX up to the largest in-degree or out-degree. An edge list stores each
+ * synapse type once: for every pre-synaptic cell, its post-synaptic cells in
+ * ascending order, as LEB128 varints of the difference to the previous id.
+ * Neighbouring cells tend to connect to neighbouring cells, so most
+ * differences fit in one byte. The post-synaptic view is derived on load with
+ * transpose_edge_list.
+ *
+ *     File layout: an edge_list_header followed by body_bytes of varints. For
+ * each of the num_pre pre-synaptic cells, in order:
+ *
+ *     varint out-degree
+ *     varint first post id, then varint (id - previous id) for the rest
+ *
+ *     Repeated synapses between the same pair of cells are kept, as a
+ * difference of 0.
+ */
+#ifndef CON_EDGES_H_
+#define CON_EDGES_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const char EDGE_LIST_MAGIC[4] = {'C', 'B', 'M', 'E'};
+const uint32_t EDGE_LIST_VERSION = 1;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_pre;
+  uint32_t num_post;
+  uint64_t num_edges;
+  uint64_t body_bytes;
+} edge_list_header;
+
+/*
+ * a dense connectivity array as the state classes keep it: num_rows rows of
+ * row_len cell ids, row-major. Only ids below num_cols are synapses; the rest
+ * is padding (UINT_MAX, or -1 in the int arrays).
+ */
+typedef struct {
+  const uint32_t *table;
+  const int *row_counts; // valid leading entries of each row, or NULL
+  uint32_t num_rows;
+  uint32_t row_len;
+  uint32_t num_cols;
+  bool rows_are_post; // rows are post-synaptic cells listing their inputs
+} con_table;
+
+/*
+ * a decoded edge list in compressed sparse row form: the targets of row i are
+ * targets[offsets[i]] up to targets[offsets[i + 1]], in ascending order.
+ */
+struct edge_list {
+  uint32_t num_pre = 0;
+  uint32_t num_post = 0;
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> targets;
+};
+
+/*
+ * Description:
+ *     encodes the synapses of table as an edge list and writes it to the file
+ * at path. Returns false, after logging why, if the file could not be
+ * written. Safe to call for different tables from several threads at once.
+ */
+bool write_edge_list(const std::string &path, const con_table &table);
+
+/*
+ * Description:
+ *     reads and decodes the edge list at path into edges. Returns false,
+ * after logging why, if the file is missing or malformed.
+ */
+bool read_edge_list(const std::string &path, edge_list &edges);
+
+/*
+ * Description:
+ *     fills out with the post-synaptic view of in: row j lists the
+ * pre-synaptic cells of post-synaptic cell j, in ascending order.
+ */
+void transpose_edge_list(const edge_list &in, edge_list &out);
+
+#endif /* CON_EDGES_H_ */
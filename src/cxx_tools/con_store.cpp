@@ -0,0 +1,108 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <sys/stat.h> // mkdir, stat (POSIX ONLY)
+#include <unistd.h>   // getpid (POSIX ONLY)
+#include <vector>
+
+#include "con_store.h"
+#include "file_utility.h"
+#include "golden_trace.h"
+#include "logger.h"
+
+std::string con_store_path(con_blob_ref ref) {
+  char name[17];
+  snprintf(name, sizeof(name), "%016" PRIx64, ref.hash);
+  return CON_STORE_PATH + name + CON_EXT;
+}
+
+static int64_t size_of(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return -1;
+  return (int64_t)st.st_size;
+}
+
+/*
+ * Implementation Notes:
+ *     the hash of each chunk, then the hash of the chunk hashes, so that a
+ * blob of several hundred MB is never held in memory whole.
+ */
+static uint64_t hash_blob(std::fstream &blob, uint64_t &num_bytes) {
+  std::vector<char> chunk(CON_STORE_HASH_CHUNK);
+  std::vector<uint64_t> chunk_hashes;
+  num_bytes = 0;
+  blob.seekg(0, std::ios::beg);
+  while (blob.read(chunk.data(), CON_STORE_HASH_CHUNK) || blob.gcount() > 0) {
+    chunk_hashes.push_back(trace_hash(chunk.data(), blob.gcount()));
+    num_bytes += blob.gcount();
+  }
+  return trace_hash(chunk_hashes.data(),
+                    chunk_hashes.size() * sizeof(uint64_t));
+}
+
+/*
+ * Implementation Notes:
+ *     the temporary file is named after the process, so that two sims saving
+ * into the same store at once do not write over each other's blob.
+ */
+con_blob_ref con_store_put(std::function<void(std::fstream &)> write_blob) {
+  if (mkdir(CON_STORE_PATH.c_str(), 0775) != 0 && errno != EEXIST) {
+    LOG_FATAL("Could not create connectivity store '%s'. Exiting...",
+              CON_STORE_PATH.c_str());
+    exit(10);
+  }
+  std::string tmp_path =
+      CON_STORE_PATH + "tmp." + std::to_string(getpid()) + CON_EXT;
+  std::fstream blob(tmp_path.c_str(), std::ios::in | std::ios::out |
+                                          std::ios::binary | std::ios::trunc);
+  if (!blob.is_open()) {
+    LOG_FATAL("Could not open '%s' for writing. Exiting...", tmp_path.c_str());
+    exit(10);
+  }
+  write_blob(blob);
+  blob.flush();
+  if (!blob) {
+    LOG_FATAL("Could not write '%s'. Exiting...", tmp_path.c_str());
+    exit(10);
+  }
+  con_blob_ref ref;
+  ref.hash = hash_blob(blob, ref.num_bytes);
+  blob.close();
+
+  std::string path = con_store_path(ref);
+  int64_t stored_bytes = size_of(path);
+  if (stored_bytes == (int64_t)ref.num_bytes) {
+    LOG_DEBUG("Connectivity is already stored as '%s'.", path.c_str());
+    remove(tmp_path.c_str());
+    return ref;
+  }
+  if (stored_bytes >= 0)
+    LOG_WARN("Replacing '%s', whose size (%ld bytes) does not match its "
+             "hash...",
+             path.c_str(), stored_bytes);
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_FATAL("Could not move '%s' to '%s'. Exiting...", tmp_path.c_str(),
+              path.c_str());
+    exit(10);
+  }
+  LOG_DEBUG("Stored connectivity as '%s' (%lu bytes).", path.c_str(),
+            ref.num_bytes);
+  return ref;
+}
+
+bool con_store_open(con_blob_ref ref, std::fstream &blob) {
+  std::string path = con_store_path(ref);
+  int64_t stored_bytes = size_of(path);
+  if (stored_bytes < 0) {
+    LOG_ERROR("Connectivity blob '%s' is not in the store.", path.c_str());
+    return false;
+  }
+  if (stored_bytes != (int64_t)ref.num_bytes) {
+    LOG_ERROR("Connectivity blob '%s' holds %ld bytes, not %lu.",
+              path.c_str(), stored_bytes, ref.num_bytes);
+    return false;
+  }
+  blob.open(path.c_str(), std::ios::in | std::ios::binary);
+  return blob.is_open();
+}
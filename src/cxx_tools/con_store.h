@@ -0,0 +1,56 @@
+/*
+ * File: con_store.h
+ *
+ * Description:
+ *     This is the interface file for the connectivity store: a directory of
+ * connectivity blobs named by a hash of their contents. A thin sim file holds
+ * the mf population and the activity states (weights included) of a sim, plus
+ * the hash and size of the blob holding its connectivity. Since the
+ * connectivity of a network never changes once built, every sim saved from
+ * it -- trained, forgotten, extinguished -- refers to the same blob, which is
+ * stored once.
+ *
+ *     A blob is written to a temporary file in the store, hashed as it is read
+ * back, and renamed to its hash, so a blob in the store is always complete. A
+ * blob already in the store is not written again. Nothing is ever removed:
+ * blobs no sim refers to anymore have to be deleted by hand.
+ */
+#ifndef CON_STORE_H_
+#define CON_STORE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+const std::string CON_EXT = ".con";
+
+// blobs are read back and hashed in chunks of this many bytes
+const uint64_t CON_STORE_HASH_CHUNK = 16 * 1024 * 1024;
+
+typedef struct {
+  uint64_t hash;
+  uint64_t num_bytes;
+} con_blob_ref;
+
+/*
+ * Description:
+ *     path of the blob ref refers to, under CON_STORE_PATH.
+ */
+std::string con_store_path(con_blob_ref ref);
+
+/*
+ * Description:
+ *     writes a blob with write_blob, adds it to the store unless it is there
+ * already, and returns its reference. Exits if the store cannot be written.
+ */
+con_blob_ref con_store_put(std::function<void(std::fstream &)> write_blob);
+
+/*
+ * Description:
+ *     opens the blob ref refers to for reading. Returns false if it is missing
+ * or its size does not match the reference.
+ */
+bool con_store_open(con_blob_ref ref, std::fstream &blob);
+
+#endif /* CON_STORE_H_ */
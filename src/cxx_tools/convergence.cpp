@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "convergence.h"
+#include "json.hpp"
+#include "logger.h"
+
+using json = nlohmann::json;
+
+bool load_convergence_config(std::string path, convergence_config &cfg) {
+  std::ifstream in_buf(path);
+  if (!in_buf.is_open()) {
+    LOG_ERROR("Couldn't open convergence file '%s'.", path.c_str());
+    return false;
+  }
+  json file = json::parse(in_buf, nullptr, false);
+  if (file.is_discarded() || !file.is_object()) {
+    LOG_ERROR("Convergence file '%s' is not a json object.", path.c_str());
+    return false;
+  }
+  for (auto &entry : file.items()) {
+    const std::string &key = entry.key();
+    const json &value = entry.value();
+    if (key == "window" && value.is_number_unsigned() &&
+        value.get<uint32_t>() > 0) {
+      cfg.window = value.get<uint32_t>();
+    } else if (key == "min_trials" && value.is_number_unsigned()) {
+      cfg.min_trials = value.get<uint32_t>();
+    } else if (key == "cr_tol" && value.is_number() &&
+               value.get<float>() >= 0.0f) {
+      cfg.cr_tol = value.get<float>();
+    } else if (key == "weight_tol" && value.is_number() &&
+               value.get<float>() >= 0.0f) {
+      cfg.weight_tol = value.get<float>();
+    } else {
+      LOG_ERROR("Invalid or unknown entry '%s' in convergence file '%s'.",
+                key.c_str(), path.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+ConvergenceRule::ConvergenceRule(convergence_config cfg,
+                                 const float *initial_weights,
+                                 uint32_t num_weights)
+    : cfg(cfg), crs(cfg.window), weight_changes(cfg.window),
+      prev_weights(initial_weights, initial_weights + num_weights) {}
+
+/*
+ * Implementation Notes:
+ *     the weight change is summed in double: over a million synapses, float
+ * would lose the small changes of a session near convergence.
+ */
+bool ConvergenceRule::trial_done(float cr_amp, const float *weights) {
+  uint32_t n = prev_weights.size();
+  float *prev = prev_weights.data();
+  double change = 0.0;
+#pragma omp simd reduction(+ : change)
+  for (uint32_t i = 0; i < n; i++) {
+    change += fabsf(weights[i] - prev[i]);
+    prev[i] = weights[i];
+  }
+  weight_changes[num_trials % cfg.window] = (n > 0) ? change / n : 0.0f;
+  num_trials++;
+  if (!std::isnan(cr_amp)) {
+    crs[num_crs % cfg.window] = cr_amp;
+    num_crs++;
+  }
+
+  uint32_t num_changes = std::min(num_trials, cfg.window);
+  double change_sum = 0.0;
+  for (uint32_t i = 0; i < num_changes; i++)
+    change_sum += weight_changes[i];
+  last_weight_change = change_sum / num_changes;
+  uint32_t num_window_crs = std::min(num_crs, cfg.window);
+  if (num_window_crs > 0) {
+    auto window_end = crs.begin() + num_window_crs;
+    last_cr_spread = *std::max_element(crs.begin(), window_end) -
+                     *std::min_element(crs.begin(), window_end);
+  }
+
+  return num_trials >= cfg.min_trials && num_trials >= cfg.window &&
+         num_crs >= cfg.window && last_cr_spread <= cfg.cr_tol &&
+         last_weight_change <= cfg.weight_tol;
+}
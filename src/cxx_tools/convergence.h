@@ -0,0 +1,88 @@
+/*
+ * File: convergence.h
+ *
+ * Description:
+ *     This is the interface file for the convergence rule, which ends an
+ * acquisition session once learning has plateaued instead of running out its
+ * fixed trial count. It is evaluated at every trial boundary from two
+ * measures:
+ *
+ *     - the CR amplitude of the trial: the peak membrane potential of the red
+ *       nucleus model between cs onset and us onset (or cs offset). Trials
+ *       without a cs have no CR and are left out of the CR window.
+ *     - the mean absolute change of the pf -> pc weights over the trial
+ *
+ *     The session has converged once at least min_trials trials have run and,
+ * over the last 'window' trials, the CR amplitudes span at most cr_tol and
+ * the mean weight change stays at most weight_tol.
+ *
+ *     The configuration is a json file, every entry of which is optional:
+ *
+ *     {
+ *       "window": 20,          trials
+ *       "min_trials": 50,
+ *       "cr_tol": 1.0,         mV, of the red nucleus model
+ *       "weight_tol": 1e-5     per synapse per trial
+ *     }
+ */
+#ifndef CONVERGENCE_H_
+#define CONVERGENCE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef struct {
+  uint32_t window;
+  uint32_t min_trials;
+  float cr_tol;
+  float weight_tol;
+} convergence_config;
+
+const convergence_config DEFAULT_CONVERGENCE_CONFIG = {20, 50, 1.0f, 1e-5f};
+
+/*
+ * Description:
+ *     fills cfg from the json file at path, keeping the values cfg already
+ * has for anything the file leaves out. Returns false, after logging why, if
+ * the file is missing or malformed.
+ */
+bool load_convergence_config(std::string path, convergence_config &cfg);
+
+class ConvergenceRule {
+public:
+  /*
+   * Description:
+   *     initial_weights are the num_weights pf -> pc weights at the start of
+   * the session, against which the first trial's change is measured.
+   */
+  ConvergenceRule(convergence_config cfg, const float *initial_weights,
+                  uint32_t num_weights);
+
+  /*
+   * Description:
+   *     records the trial that just ended and returns whether the session has
+   * converged. cr_amp is NAN for a trial without a cs.
+   */
+  bool trial_done(float cr_amp, const float *weights);
+
+  // of the last trial_done
+  float cr_spread() const { return last_cr_spread; }
+  float mean_weight_change() const { return last_weight_change; }
+
+private:
+  convergence_config cfg;
+  uint32_t num_trials = 0;
+
+  // the last 'window' values of each measure, oldest overwritten first
+  std::vector<float> crs;
+  uint32_t num_crs = 0;
+  std::vector<float> weight_changes;
+
+  std::vector<float> prev_weights;
+
+  float last_cr_spread = 0.0f;
+  float last_weight_change = 0.0f;
+};
+
+#endif /* CONVERGENCE_H_ */
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>    // open, fcntl, O_DIRECT (POSIX ONLY)
+#include <sys/mman.h> // mmap (POSIX ONLY)
+#include <sys/syscall.h>
+#include <unistd.h> // pwrite, ftruncate (POSIX ONLY)
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#include "direct_out.h"
+#include "logger.h"
+
+/*
+ * Implementation Notes:
+ *     io_uring is driven through its system calls rather than liburing, so
+ * that the engine adds no dependency. Only the pieces a writer needs are
+ * here: one submission per buffer, reaped one completion at a time. The ring
+ * has an entry per buffer, so with at most DIRECT_OUT_NUM_BUFS writes in
+ * flight it can never be full.
+ */
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+struct direct_out_ring {
+  int fd;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map;
+  size_t sq_map_bytes;
+  void *cq_map;
+  size_t cq_map_bytes;
+  size_t sqes_bytes;
+};
+
+static void ring_destroy(direct_out_ring *ring) {
+  if (ring->sqes)
+    munmap(ring->sqes, ring->sqes_bytes);
+  if (ring->cq_map && ring->cq_map != ring->sq_map)
+    munmap(ring->cq_map, ring->cq_map_bytes);
+  if (ring->sq_map)
+    munmap(ring->sq_map, ring->sq_map_bytes);
+  close(ring->fd);
+  delete ring;
+}
+
+static direct_out_ring *ring_create(unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring_fd < 0)
+    return NULL; // no io_uring in this kernel, or it is disabled
+  direct_out_ring *ring = new direct_out_ring();
+  ring->fd = ring_fd;
+  ring->sq_map_bytes =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_map_bytes =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_map) {
+    ring->sq_map_bytes = std::max(ring->sq_map_bytes, ring->cq_map_bytes);
+    ring->cq_map_bytes = ring->sq_map_bytes;
+  }
+  ring->sq_map = mmap(NULL, ring->sq_map_bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED) {
+    ring->sq_map = NULL;
+    ring_destroy(ring);
+    return NULL;
+  }
+  if (single_map) {
+    ring->cq_map = ring->sq_map;
+  } else {
+    ring->cq_map = mmap(NULL, ring->cq_map_bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (ring->cq_map == MAP_FAILED) {
+      ring->cq_map = NULL;
+      ring_destroy(ring);
+      return NULL;
+    }
+  }
+  ring->sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe *)mmap(
+      NULL, ring->sqes_bytes, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    ring_destroy(ring);
+    return NULL;
+  }
+  char *sq = (char *)ring->sq_map;
+  char *cq = (char *)ring->cq_map;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  return ring;
+}
+
+static bool ring_submit(direct_out_ring *ring, int fd, const char *data,
+                        uint32_t num_bytes, uint64_t offset,
+                        uint64_t user_data) {
+  unsigned tail = *ring->sq_tail;
+  unsigned index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)data;
+  sqe->len = num_bytes;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  int submitted;
+  do {
+    submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+  } while (submitted < 0 && errno == EINTR);
+  // the kernel moves the head past every entry it takes, even one it then
+  // fails, and the completion of such an entry still comes through ring_wait
+  if (__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) != tail)
+    return true;
+  // not taken: withdraw it, or the next enter would write it a second time
+  __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+  return false;
+}
+
+static bool ring_wait(direct_out_ring *ring, uint64_t &user_data,
+                      int32_t &res) {
+  while (true) {
+    unsigned head = *ring->cq_head;
+    if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      user_data = cqe->user_data;
+      res = cqe->res;
+      __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+    if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+                NULL, 0) < 0 &&
+        errno != EINTR)
+      return false;
+  }
+}
+
+#else
+
+struct direct_out_ring {};
+
+static direct_out_ring *ring_create(unsigned) { return NULL; }
+static void ring_destroy(direct_out_ring *) {}
+static bool ring_submit(direct_out_ring *, int, const char *, uint32_t,
+                        uint64_t, uint64_t) {
+  return false;
+}
+static bool ring_wait(direct_out_ring *, uint64_t &, int32_t &) {
+  return false;
+}
+
+#endif
+
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
+static inline uint64_t round_up_to_block(uint64_t num_bytes) {
+  return (num_bytes + DIRECT_OUT_ALIGN - 1) & ~(DIRECT_OUT_ALIGN - 1);
+}
+
+DirectOutBuf::~DirectOutBuf() { close(); }
+
+/*
+ * Implementation Notes:
+ *     a file system without O_DIRECT refuses the flag at open with EINVAL, so
+ * the file is opened again without it. Appending after an end that is not
+ * block-aligned cannot be done with O_DIRECT either.
+ */
+bool DirectOutBuf::open(const std::string &path, bool append) {
+  if (fd != -1)
+    close();
+  this->path = path;
+  failed = false;
+  int flags = O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC);
+  fd = ::open(path.c_str(), flags | O_DIRECT, 0664);
+  direct = (fd != -1 && O_DIRECT != 0);
+  if (fd == -1 && errno == EINVAL)
+    fd = ::open(path.c_str(), flags, 0664);
+  if (fd == -1) {
+    LOG_ERROR("Couldn't open '%s' for writing: %s", path.c_str(),
+              strerror(errno));
+    return false;
+  }
+  cur_offset = 0;
+  if (append) {
+    off_t end = lseek(fd, 0, SEEK_END);
+    cur_offset = (end > 0) ? end : 0;
+    if (direct && cur_offset % DIRECT_OUT_ALIGN != 0) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      direct = false;
+    }
+  }
+  ring = ring_create(DIRECT_OUT_NUM_BUFS);
+  num_in_flight = 0;
+  if (!take_free_slot()) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool DirectOutBuf::close() {
+  if (fd == -1)
+    return true;
+  uint64_t num_bytes = pptr() - pbase();
+  uint64_t write_bytes = num_bytes;
+  if (num_bytes > 0 && !failed) {
+    if (direct) {
+      write_bytes = round_up_to_block(num_bytes);
+      memset(pbase() + num_bytes, 0, write_bytes - num_bytes);
+    }
+    submit(cur_slot, write_bytes);
+  }
+  wait_all();
+  if (write_bytes != num_bytes && !failed &&
+      ftruncate(fd, cur_offset + num_bytes) != 0)
+    fail("truncate", errno);
+  if (::close(fd) != 0)
+    fail("close", errno);
+  fd = -1;
+  if (ring) {
+    ring_destroy(ring);
+    ring = NULL;
+  }
+  for (uint32_t i = 0; i < DIRECT_OUT_NUM_BUFS; i++) {
+    free(slots[i].data);
+    slots[i].data = NULL;
+    slots[i].busy = false;
+  }
+  setp(NULL, NULL);
+  return !failed;
+}
+
+bool DirectOutBuf::reserve_buffers() {
+  if (fd == -1 || failed)
+    return false;
+  for (uint32_t i = 0; i < DIRECT_OUT_NUM_BUFS; i++) {
+    if (slots[i].data)
+      continue;
+    if (posix_memalign((void **)&slots[i].data, DIRECT_OUT_ALIGN,
+                       DIRECT_OUT_BUF_BYTES) != 0) {
+      slots[i].data = NULL;
+      fail("allocate a buffer for", ENOMEM);
+      return false;
+    }
+  }
+  return true;
+}
+
+std::streambuf::int_type DirectOutBuf::overflow(int_type c) {
+  if (fd == -1 || failed)
+    return traits_type::eof();
+  if (pptr() == epptr() && !submit_current())
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize DirectOutBuf::xsputn(const char *s, std::streamsize n) {
+  std::streamsize done = 0;
+  while (done < n && fd != -1 && !failed) {
+    if (pptr() == epptr() && !submit_current())
+      break;
+    std::streamsize chunk = std::min<std::streamsize>(epptr() - pptr(),
+                                                      n - done);
+    memcpy(pptr(), s + done, chunk);
+    pbump((int)chunk);
+    done += chunk;
+  }
+  return done;
+}
+
+int DirectOutBuf::sync() {
+  if (fd == -1 || failed)
+    return -1;
+  uint64_t num_bytes = pptr() - pbase();
+  if (!direct) {
+    // whatever is buffered goes out as is
+    if (num_bytes > 0 && !submit_current())
+      return -1;
+    return wait_all() ? 0 : -1;
+  }
+  uint64_t tail_bytes = num_bytes % DIRECT_OUT_ALIGN;
+  const char *tail = pbase() + num_bytes - tail_bytes;
+  if (num_bytes > tail_bytes) {
+    // the whole blocks go out as usual, the tail moves to the next buffer,
+    // read from the old one, which a write in flight leaves untouched
+    if (!submit(cur_slot, num_bytes - tail_bytes))
+      return -1;
+    cur_offset += num_bytes - tail_bytes;
+    if (!take_free_slot())
+      return -1;
+    memcpy(pbase(), tail, tail_bytes);
+    pbump((int)tail_bytes);
+  }
+  // the file only grows past what is already written, so that a reader that
+  // follows it never sees a hole
+  if (!wait_all())
+    return -1;
+  if (tail_bytes > 0) {
+    memset(pbase() + tail_bytes, 0, DIRECT_OUT_ALIGN - tail_bytes);
+    if (!pwrite_all(pbase(), DIRECT_OUT_ALIGN, cur_offset))
+      return -1;
+  }
+  if (tail_bytes > 0 && ftruncate(fd, cur_offset + tail_bytes) != 0) {
+    fail("truncate", errno);
+    return -1;
+  }
+  return 0;
+}
+
+bool DirectOutBuf::submit_current() {
+  uint64_t num_bytes = pptr() - pbase();
+  if (!submit(cur_slot, num_bytes))
+    return false;
+  cur_offset += num_bytes;
+  return take_free_slot();
+}
+
+/*
+ * Implementation Notes:
+ *     buffers are allocated as they are first needed, so that a small file
+ * costs a single buffer.
+ */
+bool DirectOutBuf::take_free_slot() {
+  while (true) {
+    uint32_t pick = DIRECT_OUT_NUM_BUFS;
+    for (uint32_t i = 0; i < DIRECT_OUT_NUM_BUFS; i++) {
+      if (slots[i].busy)
+        continue;
+      if (slots[i].data) {
+        pick = i;
+        break;
+      }
+      if (pick == DIRECT_OUT_NUM_BUFS)
+        pick = i;
+    }
+    if (pick < DIRECT_OUT_NUM_BUFS) {
+      if (!slots[pick].data &&
+          posix_memalign((void **)&slots[pick].data, DIRECT_OUT_ALIGN,
+                         DIRECT_OUT_BUF_BYTES) != 0) {
+        slots[pick].data = NULL;
+        fail("allocate a buffer for", ENOMEM);
+        return false;
+      }
+      cur_slot = pick;
+      setp(slots[pick].data, slots[pick].data + DIRECT_OUT_BUF_BYTES);
+      return true;
+    }
+    if (!wait_one())
+      return false;
+  }
+}
+
+bool DirectOutBuf::submit(uint32_t slot, uint64_t num_bytes) {
+  slots[slot].num_bytes = num_bytes;
+  slots[slot].offset = cur_offset;
+  if (num_bytes == 0)
+    return true;
+  if (ring && ring_submit(ring, fd, slots[slot].data, num_bytes, cur_offset,
+                          slot)) {
+    slots[slot].busy = true;
+    num_in_flight++;
+    return true;
+  }
+  return pwrite_all(slots[slot].data, num_bytes, cur_offset);
+}
+
+bool DirectOutBuf::wait_one() {
+  uint64_t slot;
+  int32_t res;
+  if (!ring_wait(ring, slot, res)) {
+    fail("wait for a write to", errno);
+    drop_ring();
+    return false;
+  }
+  out_slot &done = slots[slot];
+  done.busy = false;
+  num_in_flight--;
+  if (res == -EINVAL || res == -EOPNOTSUPP) {
+    LOG_DEBUG("io_uring cannot write '%s', using pwrite instead.",
+              path.c_str());
+    return fall_back_to_pwrite(done);
+  }
+  if (res < 0) {
+    fail("write", -res);
+    return false;
+  }
+  if ((uint64_t)res < done.num_bytes)
+    return pwrite_all(done.data + res, done.num_bytes - res,
+                      done.offset + res);
+  return true;
+}
+
+/*
+ * Implementation Notes:
+ *     a kernel whose io_uring lacks IORING_OP_WRITE (before 5.6) fails the
+ * write with EINVAL, and most likely every other write in flight with it.
+ * Their completions are collected here, whatever part of each the ring did
+ * not write is written again with pwrite, and the ring is closed, so that
+ * every later buffer goes out with pwrite too.
+ */
+bool DirectOutBuf::fall_back_to_pwrite(out_slot &first) {
+  bool ok = pwrite_all(first.data, first.num_bytes, first.offset);
+  while (num_in_flight > 0) {
+    uint64_t slot;
+    int32_t res;
+    if (!ring_wait(ring, slot, res)) {
+      fail("wait for a write to", errno);
+      ok = false;
+      break;
+    }
+    out_slot &done = slots[slot];
+    done.busy = false;
+    num_in_flight--;
+    uint64_t written = (res > 0) ? res : 0;
+    if (written < done.num_bytes)
+      ok = pwrite_all(done.data + written, done.num_bytes - written,
+                      done.offset + written) &&
+           ok;
+  }
+  drop_ring();
+  return ok && !failed;
+}
+
+/*
+ * Implementation Notes:
+ *     the writes still in flight, if any, are only left when waiting on the
+ * ring failed, which has already failed the file, so they are forgotten.
+ */
+void DirectOutBuf::drop_ring() {
+  for (uint32_t i = 0; i < DIRECT_OUT_NUM_BUFS; i++)
+    slots[i].busy = false;
+  num_in_flight = 0;
+  ring_destroy(ring);
+  ring = NULL;
+}
+
+bool DirectOutBuf::wait_all() {
+  bool ok = true;
+  while (num_in_flight > 0)
+    ok = wait_one() && ok;
+  return ok && !failed;
+}
+
+/*
+ * Implementation Notes:
+ *     some file systems accept O_DIRECT at open and only refuse it at write,
+ * with EINVAL. The file then goes on without it.
+ */
+bool DirectOutBuf::pwrite_all(const char *data, uint64_t num_bytes,
+                              uint64_t offset) {
+  while (num_bytes > 0) {
+    ssize_t written = pwrite(fd, data, num_bytes, offset);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written < 0 && errno == EINVAL && direct) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      direct = false;
+      continue;
+    }
+    if (written <= 0) {
+      fail("write", written < 0 ? errno : EIO);
+      return false;
+    }
+    data += written;
+    num_bytes -= written;
+    offset += written;
+  }
+  return true;
+}
+
+void DirectOutBuf::fail(const char *what, int err) {
+  if (!failed)
+    LOG_ERROR("Couldn't %s '%s': %s", what, path.c_str(), strerror(err));
+  failed = true;
+}
+
+bool write_direct(const std::string &path, const void *data,
+                  uint64_t num_bytes, bool append) {
+  DirectOutBuf out_buf;
+  if (!out_buf.open(path, append))
+    return false;
+  bool ok = out_buf.sputn((const char *)data, num_bytes) ==
+            (std::streamsize)num_bytes;
+  return out_buf.close() && ok;
+}
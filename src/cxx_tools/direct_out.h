@@ -0,0 +1,144 @@
+/*
+ * File: direct_out.h
+ *
+ * Description:
+ *     This is the interface file for the output engine that the sim, raster,
+ * psth and weight writers go through. Result files run to several GB, and
+ * writing them through the page cache evicts the pages of the mapped input
+ * sim and the working sets of other jobs on the node. The engine instead:
+ *
+ *     - opens the file with O_DIRECT, so that writes bypass the page cache.
+ *       File systems without O_DIRECT (tmpfs, some network mounts) get a
+ *       plain descriptor.
+ *     - gathers the output into a few large, block-aligned buffers and
+ *       writes each one as it fills, with io_uring when the kernel offers it
+ *       and with pwrite otherwise. While a buffer is in flight, the writer
+ *       goes on filling the next one; once all of them are in flight, it
+ *       waits for the oldest to complete. At most DIRECT_OUT_NUM_BUFS buffers
+ *       are ever in flight.
+ *     - zero-pads the last block, which O_DIRECT requires, and truncates the
+ *       file back to its real length on close.
+ *
+ *     DirectOutBuf is a std::streambuf, so code written against streams is
+ * pointed at it without change (see attach_direct_out). Every error is
+ * logged once. After an error the stream goes bad, and close returns false.
+ */
+#ifndef DIRECT_OUT_H_
+#define DIRECT_OUT_H_
+
+#include <cstdint>
+#include <fstream>
+#include <streambuf>
+#include <string>
+
+// block size that O_DIRECT offsets, lengths and buffers are aligned to
+const uint64_t DIRECT_OUT_ALIGN = 4096;
+const uint64_t DIRECT_OUT_BUF_BYTES = 4 * 1024 * 1024;
+const uint32_t DIRECT_OUT_NUM_BUFS = 4;
+
+struct direct_out_ring;
+
+class DirectOutBuf : public std::streambuf {
+public:
+  DirectOutBuf() {}
+
+  /*
+   * Description:
+   *     closes the file if it is still open.
+   */
+  ~DirectOutBuf();
+
+  DirectOutBuf(const DirectOutBuf &) = delete;
+  DirectOutBuf &operator=(const DirectOutBuf &) = delete;
+
+  /*
+   * Description:
+   *     creates or truncates the file at path, or with append, writes after
+   * its current end. Returns false, after logging why, if it cannot be opened.
+   */
+  bool open(const std::string &path, bool append = false);
+
+  /*
+   * Description:
+   *     writes out what is still buffered, waits for every write and closes
+   * the file. Returns false if any write failed.
+   */
+  bool close();
+
+  /*
+   * Description:
+   *     allocates every buffer now rather than as it is first needed, for
+   * writers that must not allocate once they are set up. Returns false, after
+   * logging why, if one could not be allocated.
+   */
+  bool reserve_buffers();
+
+  bool is_open() const { return fd != -1; }
+
+  // whether writes bypass the page cache, and go through io_uring
+  bool is_direct() const { return direct; }
+  bool uses_io_uring() const { return ring != NULL; }
+
+protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+  /*
+   * Description:
+   *     makes everything written so far visible in the file, for readers
+   * that follow it while it is written. Under O_DIRECT, the partial last
+   * block is written padded once every earlier write has completed, and kept
+   * in the buffer to be written again whole; the file is then truncated back
+   * to its real length.
+   */
+  int sync() override;
+
+private:
+  typedef struct {
+    char *data;
+    bool busy;
+    uint64_t num_bytes;
+    uint64_t offset;
+  } out_slot;
+
+  bool submit_current();
+  bool take_free_slot();
+  bool submit(uint32_t slot, uint64_t num_bytes);
+  bool wait_one();
+  bool fall_back_to_pwrite(out_slot &first);
+  void drop_ring();
+  bool wait_all();
+  bool pwrite_all(const char *data, uint64_t num_bytes, uint64_t offset);
+  void fail(const char *what, int err);
+
+  std::string path;
+  int fd = -1;
+  bool direct = false;
+  bool failed = false;
+  direct_out_ring *ring = NULL;
+
+  out_slot slots[DIRECT_OUT_NUM_BUFS] = {};
+  uint32_t cur_slot = 0;
+  uint32_t num_in_flight = 0;
+  uint64_t cur_offset = 0; // file offset of the start of the current buffer
+};
+
+/*
+ * Description:
+ *     writes num_bytes from data to the file at path in one go. Returns
+ * false, after logging why, if the file could not be written.
+ */
+bool write_direct(const std::string &path, const void *data,
+                  uint64_t num_bytes, bool append = false);
+
+/*
+ * Description:
+ *     points out at buf, so that writers that take a std::fstream (the sim
+ * file's writeState chain) go through the engine. buf must be open, and must
+ * outlive out's use.
+ */
+inline void attach_direct_out(std::fstream &out, DirectOutBuf &buf) {
+  out.std::ios::rdbuf(&buf);
+}
+
+#endif /* DIRECT_OUT_H_ */
@@ -0,0 +1,76 @@
+#include "double_buf_writer.h"
+
+DoubleBufWriter::~DoubleBufWriter() {
+  if (writer.joinable())
+    stop();
+}
+
+bool DoubleBufWriter::open(const std::string &path) {
+  return out_buf.open(path) && out_buf.reserve_buffers();
+}
+
+void DoubleBufWriter::start(dbw_prepare prepare) {
+  this->prepare = prepare;
+  writer = std::thread(&DoubleBufWriter::write_loop, this);
+}
+
+uint32_t DoubleBufWriter::acquire() {
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this] { return !busy[next_slot]; });
+  return next_slot;
+}
+
+void DoubleBufWriter::submit() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    busy[next_slot] = true;
+  }
+  wake.notify_one();
+  next_slot ^= 1;
+}
+
+bool DoubleBufWriter::stop() {
+  if (writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+  }
+  return out_buf.close();
+}
+
+/*
+ * Implementation Notes:
+ *     a slot handed over before stop is still written: the loop only ends
+ * once the slot it waits on is free.
+ */
+void DoubleBufWriter::write_loop() {
+  uint32_t slot = 0;
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard, [this, slot] { return busy[slot] || stopping; });
+    if (!busy[slot])
+      return;
+    guard.unlock();
+    dbw_chunk chunk = prepare(slot);
+    if (chunk.slot_free) {
+      guard.lock();
+      busy[slot] = false;
+      done.notify_one();
+      guard.unlock();
+    }
+    out_buf.sputn((const char *)chunk.data, chunk.bytes);
+    if (flush_each)
+      out_buf.pubsync();
+    num_chunks++;
+    num_bytes += chunk.bytes;
+    guard.lock();
+    if (!chunk.slot_free) {
+      busy[slot] = false;
+      done.notify_one();
+    }
+    slot ^= 1;
+  }
+}
@@ -0,0 +1,117 @@
+/*
+ * File: double_buf_writer.h
+ *
+ * Description:
+ *     This is the interface file for the double-buffered writer that the
+ * trace and event recorders write their output through. The recording side
+ * fills one of two slots while a helper thread writes out the other, so that
+ * a step only waits for the file when both slots are taken. What a slot holds
+ * is up to the caller: the helper thread asks it, through a prepare function,
+ * for the bytes a filled slot turns into.
+ *
+ *     Slots are handed over and taken alternately, so what is written keeps
+ * the order in which it was handed over.
+ */
+#ifndef DOUBLE_BUF_WRITER_H_
+#define DOUBLE_BUF_WRITER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "direct_out.h"
+
+/*
+ * what a filled slot is written as. With slot_free set, the bytes are not in
+ * the slot itself (e.g. an encoded copy of it), and the slot is given back
+ * before they are written.
+ */
+typedef struct {
+  const void *data;
+  uint64_t bytes;
+  bool slot_free;
+} dbw_chunk;
+
+typedef std::function<dbw_chunk(uint32_t slot)> dbw_prepare;
+
+class DoubleBufWriter {
+public:
+  /*
+   * Description:
+   *     with flush_each, every chunk is flushed once written, so that the
+   * file can be read while it is still being written.
+   */
+  DoubleBufWriter(bool flush_each = false) : flush_each(flush_each) {}
+
+  /*
+   * Description:
+   *     stops the helper thread if stop was not called.
+   */
+  ~DoubleBufWriter();
+
+  DoubleBufWriter(const DoubleBufWriter &) = delete;
+  DoubleBufWriter &operator=(const DoubleBufWriter &) = delete;
+
+  /*
+   * Description:
+   *     opens the file and allocates all of its buffers, so that writing
+   * never allocates. Returns false, after logging why, if either fails.
+   */
+  bool open(const std::string &path);
+
+  /*
+   * Description:
+   *     the file, for whatever goes before the chunks (e.g. a file header).
+   * Only to be written before start.
+   */
+  DirectOutBuf &out() { return out_buf; }
+
+  /*
+   * Description:
+   *     starts the helper thread, which calls prepare on each slot handed
+   * over.
+   */
+  void start(dbw_prepare prepare);
+
+  /*
+   * Description:
+   *     waits until the next slot is free and returns it, for the caller to
+   * fill and then hand over with submit.
+   */
+  uint32_t acquire();
+  void submit();
+
+  /*
+   * Description:
+   *     waits for every slot handed over to be written, stops the helper
+   * thread and closes the file. Returns false if any write failed.
+   */
+  bool stop();
+
+  // counts of what the helper thread wrote; only meaningful after stop
+  uint64_t chunks_written() const { return num_chunks; }
+  uint64_t bytes_written() const { return num_bytes; }
+
+private:
+  void write_loop();
+
+  bool flush_each;
+  dbw_prepare prepare;
+  DirectOutBuf out_buf;
+  uint32_t next_slot = 0;
+  uint64_t num_chunks = 0;
+  uint64_t num_bytes = 0;
+
+  // guard everything below
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool busy[2] = {};
+  bool stopping = false;
+  std::thread writer;
+};
+
+#endif /* DOUBLE_BUF_WRITER_H_ */
@@ -7,6 +7,7 @@
 #ifndef _DYNAMIC2DARRAY_H
 #define _DYNAMIC2DARRAY_H
 
+#include "direct_out.h"
 #include "file_utility.h"
 #include <cstddef>
 #include <cstdio>
@@ -60,22 +61,15 @@ void mult_2d_array_by_val_ip(T **arr, uint64_t numRows, uint64_t numCols,
 }
 
 template <typename Type>
-void write2DArray(std::string out_file_name, Type **inArr,
+void write2DArray(const std::string &out_file_name, Type **inArr,
                   unsigned long long num_row, unsigned long long num_col,
                   bool append = false) {
-  std::ios_base::openmode app_opt =
-      (append) ? std::ios_base::app : (std::ios_base::openmode)0;
-  std::fstream out_file_buf(out_file_name.c_str(),
-                            std::ios::out | std::ios::binary | app_opt);
-
-  if (!out_file_buf.is_open()) {
-    fprintf(stderr, "[ERROR]: Couldn't open '%s' for writing. Exiting...\n",
+  if (!write_direct(out_file_name, inArr[0], num_row * num_col * sizeof(Type),
+                    append)) {
+    fprintf(stderr, "[ERROR]: Couldn't write '%s'. Exiting...\n",
             out_file_name.c_str());
     exit(-1);
   }
-  rawBytesRW((char *)inArr[0], num_row * num_col * sizeof(Type), false,
-             out_file_buf);
-  out_file_buf.close();
 }
 
 template <typename Type> void delete2DArray(Type **array) {
@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "event_recorder.h"
+#include "json.hpp"
+#include "logger.h"
+
+using json = nlohmann::json;
+
+static bool json_pop(const json &value, const std::string *pop_ids,
+                     uint32_t &pop) {
+  if (!value.is_string())
+    return false;
+  for (pop = 0; pop < EVENT_NUM_POPS; pop++) {
+    if (pop_ids[pop] == value.get<std::string>())
+      return true;
+  }
+  return false;
+}
+
+static bool json_ms(const json &value, float &ms) {
+  if (!value.is_number() || value.get<float>() < 0.0f)
+    return false;
+  ms = value.get<float>();
+  return true;
+}
+
+static bool load_triggers(const json &triggers, const std::string *pop_ids,
+                          event_config &cfg) {
+  for (uint32_t i = 0; i < EVENT_NUM_POPS; i++) {
+    cfg.spike_trigger[i] = false;
+    cfg.silence_ms[i] = 0.0f;
+  }
+  for (auto &entry : triggers.items()) {
+    const json &value = entry.value();
+    uint32_t pop;
+    if (entry.key() == "spike" && value.is_array()) {
+      for (const json &id : value) {
+        if (!json_pop(id, pop_ids, pop) || pop == EVENT_GR)
+          return false;
+        cfg.spike_trigger[pop] = true;
+      }
+    } else if (entry.key() == "silence_ms" && value.is_object()) {
+      for (auto &silence : value.items()) {
+        if (!json_pop(silence.key(), pop_ids, pop) || pop == EVENT_GR ||
+            !json_ms(silence.value(), cfg.silence_ms[pop]) ||
+            cfg.silence_ms[pop] == 0.0f)
+          return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool load_event_config(std::string path, const std::string *pop_ids,
+                       event_config &cfg) {
+  std::ifstream in_buf(path);
+  if (!in_buf.is_open()) {
+    LOG_ERROR("Couldn't open event recording file '%s'.", path.c_str());
+    return false;
+  }
+  json file = json::parse(in_buf, nullptr, false);
+  if (file.is_discarded() || !file.is_object()) {
+    LOG_ERROR("Event recording file '%s' is not a json object.",
+              path.c_str());
+    return false;
+  }
+  for (auto &entry : file.items()) {
+    const std::string &key = entry.key();
+    const json &value = entry.value();
+    uint32_t pop;
+    bool valid = true;
+    if (key == "pops" && value.is_array()) {
+      for (uint32_t i = 0; i < EVENT_NUM_POPS; i++)
+        cfg.pops[i] = false;
+      for (const json &id : value) {
+        valid &= json_pop(id, pop_ids, pop);
+        if (valid)
+          cfg.pops[pop] = true;
+      }
+    } else if (key == "pre_ms") {
+      valid = json_ms(value, cfg.pre_ms);
+    } else if (key == "post_ms") {
+      valid = json_ms(value, cfg.post_ms);
+    } else if (key == "vm_every_ms") {
+      valid = json_ms(value, cfg.vm_every_ms);
+    } else if (key == "triggers" && value.is_object()) {
+      valid = load_triggers(value, pop_ids, cfg);
+    } else if (key == "max_windows" && value.is_number_unsigned() &&
+               value.get<uint32_t>() > 0) {
+      cfg.max_windows = value.get<uint32_t>();
+    } else if (key == "max_mb" && value.is_number() &&
+               value.get<double>() > 0.0) {
+      cfg.max_bytes = value.get<double>() * 1024 * 1024;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      LOG_ERROR("Invalid or unknown entry '%s' in event recording file '%s'.",
+                key.c_str(), path.c_str());
+      return false;
+    }
+  }
+  bool any_pop = false;
+  bool any_trigger = false;
+  for (uint32_t i = 0; i < EVENT_NUM_POPS; i++) {
+    any_pop |= cfg.pops[i];
+    any_trigger |= cfg.spike_trigger[i] || cfg.silence_ms[i] > 0.0f;
+  }
+  if (!any_pop || !any_trigger) {
+    LOG_ERROR("Event recording file '%s' needs at least one population in "
+              "'pops' and one trigger.",
+              path.c_str());
+    return false;
+  }
+  return true;
+}
+
+static inline uint32_t ms_to_steps(float ms, float ms_per_step) {
+  return (uint32_t)std::ceil(ms / ms_per_step);
+}
+
+/*
+ * Implementation Notes:
+ *     the ring holds at least 32 steps, so that no granule frame is reused
+ * before the spike history that fills it has been read. A window spans
+ * pre_steps + post_steps + 1 steps, so at most (pre_steps + post_steps) /
+ * vm_every_steps + 1 voltage samples; one more slot in the sample ring keeps
+ * the oldest of them from being overwritten by the sample of the step that
+ * closes the window.
+ */
+EventRecorder::EventRecorder(std::string out_file_name, event_config cfg,
+                             const uint32_t *num_cells,
+                             const std::string *pop_ids, float ms_per_step)
+    : cfg(cfg) {
+  file_head = {};
+  memcpy(file_head.magic, EVENT_MAGIC, sizeof(file_head.magic));
+  file_head.version = EVENT_VERSION;
+  file_head.ms_per_step = ms_per_step;
+  file_head.pre_steps = ms_to_steps(cfg.pre_ms, ms_per_step);
+  file_head.post_steps = ms_to_steps(cfg.post_ms, ms_per_step);
+  if (cfg.vm_every_ms > 0.0f)
+    file_head.vm_every_steps =
+        std::max(1u, (uint32_t)std::lround(cfg.vm_every_ms / ms_per_step));
+  for (uint32_t i = 0; i < EVENT_NUM_POPS; i++) {
+    this->num_cells[i] = num_cells[i];
+    this->pop_ids[i] = pop_ids[i];
+    file_head.num_cells[i] = num_cells[i];
+    silence_steps[i] = (cfg.silence_ms[i] > 0.0f)
+                           ? std::max(1u, ms_to_steps(cfg.silence_ms[i],
+                                                      ms_per_step))
+                           : 0;
+    pop_offsets[i] = spike_frame_bytes;
+    if (!cfg.pops[i])
+      continue;
+    file_head.pop_mask |= 1u << i;
+    spike_frame_bytes += (num_cells[i] + 7) / 8;
+    if (file_head.vm_every_steps > 0 && i != EVENT_MF) {
+      file_head.vm_mask |= 1u << i;
+      vm_frame_bytes += num_cells[i] * sizeof(float);
+    }
+  }
+
+  uint32_t span = file_head.pre_steps + file_head.post_steps;
+  ring_steps = std::max(span + 1, EVENT_GR_HIST_STEPS);
+  ring_samples =
+      (file_head.vm_every_steps > 0) ? span / file_head.vm_every_steps + 2 : 0;
+  spike_ring.assign(ring_steps * spike_frame_bytes, 0);
+  vm_ring.assign(ring_samples * vm_frame_bytes / sizeof(float), 0.0f);
+  max_window_bytes = sizeof(event_window_header) +
+                     (span + 1) * spike_frame_bytes +
+                     (ring_samples ? ring_samples - 1 : 0) * vm_frame_bytes;
+  for (uint32_t i = 0; i < 2; i++)
+    win_bufs[i].resize(max_window_bytes);
+  update_cap();
+
+  if (writer.open(out_file_name))
+    writer.out().sputn((const char *)&file_head, sizeof(file_head));
+  writer.start([this](uint32_t slot) {
+    return dbw_chunk{win_bufs[slot].data(), win_buf_bytes[slot], false};
+  });
+}
+
+EventRecorder::~EventRecorder() {
+  if (!writer.stop())
+    LOG_ERROR("Could not write every event window.");
+  LOG_INFO("Captured %lu event windows (%0.1fMB).", windows_done,
+           bytes_done / (1024.0 * 1024.0));
+  if (triggers_missed > 0)
+    LOG_WARN("%lu triggers fired after the event recording cap was reached.",
+             triggers_missed);
+}
+
+/*
+ * Implementation Notes:
+ *     the spike arrays hold 0 or 1 per cell, so a byte of the frame is built
+ * by shifting, without a branch. Only the first population whose trigger
+ * fires is named in a window header.
+ */
+uint32_t EventRecorder::step(uint32_t trial, uint32_t ts,
+                             const uint8_t *const *spikes) {
+  uint64_t cur = num_steps++;
+  uint8_t *frame =
+      spike_ring.data() + (cur % ring_steps) * spike_frame_bytes;
+  uint32_t fired_kind = 0;
+  uint32_t fired_pop = 0;
+  for (uint32_t i = 0; i < EVENT_NUM_POPS; i++) {
+    if (i == EVENT_GR)
+      continue;
+    const uint8_t *ap = spikes[i];
+    uint32_t n = num_cells[i];
+    if (cfg.pops[i]) {
+      uint8_t *bits = frame + pop_offsets[i];
+      uint32_t num_full = n / 8;
+#pragma omp simd
+      for (uint32_t j = 0; j < num_full; j++) {
+        const uint8_t *cells = ap + 8 * j;
+        bits[j] = cells[0] | cells[1] << 1 | cells[2] << 2 | cells[3] << 3 |
+                  cells[4] << 4 | cells[5] << 5 | cells[6] << 6 |
+                  cells[7] << 7;
+      }
+      if (n % 8 != 0) {
+        uint8_t last = 0;
+        for (uint32_t j = 8 * num_full; j < n; j++)
+          last |= ap[j] << (j % 8);
+        bits[num_full] = last;
+      }
+    }
+    if (!cfg.spike_trigger[i] && silence_steps[i] == 0)
+      continue;
+    uint32_t count = 0;
+#pragma omp simd reduction(+ : count)
+    for (uint32_t j = 0; j < n; j++)
+      count += ap[j];
+    silent_steps[i] = (count > 0) ? 0 : silent_steps[i] + 1;
+    if (fired_kind)
+      continue;
+    if (cfg.spike_trigger[i] && count > 0) {
+      fired_kind = EVENT_TRIGGER_SPIKE;
+      fired_pop = i;
+    } else if (silence_steps[i] > 0 && silent_steps[i] == silence_steps[i]) {
+      fired_kind = EVENT_TRIGGER_SILENCE;
+      fired_pop = i;
+    }
+  }
+  if (cfg.pops[EVENT_GR])
+    gr_steps_pending++;
+
+  if (fired_kind && open) {
+    win.head.num_triggers++;
+  } else if (fired_kind && armed && capped) {
+    triggers_missed++;
+  } else if (fired_kind && armed) {
+    win.head = {};
+    win.head.trial = trial;
+    win.head.ts = ts;
+    win.head.trigger_kind = fired_kind;
+    win.head.trigger_pop = fired_pop;
+    win.head.num_pre = (uint32_t)std::min<uint64_t>(file_head.pre_steps, cur);
+    win.head.num_triggers = 1;
+    win.first_step = cur - win.head.num_pre;
+    open = true;
+  }
+
+  uint32_t needs = 0;
+  vm_due = (file_head.vm_every_steps > 0 &&
+            cur % file_head.vm_every_steps == 0);
+  if (vm_due)
+    needs |= EVENT_NEEDS_VMS;
+  bool closing = open && cur == win.first_step + win.head.num_pre +
+                                    file_head.post_steps;
+  if (cfg.pops[EVENT_GR] &&
+      (gr_steps_pending == EVENT_GR_HIST_STEPS || closing))
+    needs |= EVENT_NEEDS_GR_SPIKES;
+  return needs;
+}
+
+void EventRecorder::commit_step(const uint32_t *gr_ap_buf,
+                                const float *const *vms) {
+  uint64_t cur = num_steps - 1;
+  if (gr_ap_buf)
+    fill_gr_spikes(gr_ap_buf);
+  if (vm_due && vms) {
+    float *sample = vm_ring.data() +
+                    (cur / file_head.vm_every_steps % ring_samples) *
+                        (vm_frame_bytes / sizeof(float));
+    for (uint32_t i = 0; i < EVENT_NUM_POPS; i++) {
+      if (!(file_head.vm_mask & (1u << i)))
+        continue;
+      if (vms[i])
+        memcpy(sample, vms[i], num_cells[i] * sizeof(float));
+      else
+        memset(sample, 0, num_cells[i] * sizeof(float));
+      sample += num_cells[i];
+    }
+  }
+  if (open &&
+      cur == win.first_step + win.head.num_pre + file_head.post_steps)
+    commit_window(file_head.post_steps);
+}
+
+void EventRecorder::close_window(const uint32_t *gr_ap_buf) {
+  if (!open)
+    return;
+  if (gr_ap_buf)
+    fill_gr_spikes(gr_ap_buf);
+  commit_window(num_steps - 1 - win.first_step - win.head.num_pre);
+}
+
+/*
+ * Implementation Notes:
+ *     bit b of a history word is the spike of b steps ago, so the bits of
+ * eight neighbouring cells make up one byte of each of the pending frames.
+ * Each thread builds whole bytes, so no two threads write the same byte.
+ */
+void EventRecorder::fill_gr_spikes(const uint32_t *gr_ap_buf) {
+  uint64_t cur = num_steps - 1;
+  uint32_t num_hist = std::min<uint64_t>(
+      std::min(gr_steps_pending, EVENT_GR_HIST_STEPS), cur + 1);
+  gr_steps_pending = 0;
+  uint64_t frame_offsets[EVENT_GR_HIST_STEPS];
+  for (uint32_t b = 0; b < num_hist; b++)
+    frame_offsets[b] = ((cur - b) % ring_steps) * spike_frame_bytes;
+  uint8_t *gr_base = spike_ring.data() + pop_offsets[EVENT_GR];
+  uint32_t n = num_cells[EVENT_GR];
+  int64_t num_bytes = (n + 7) / 8;
+#pragma omp parallel for schedule(static)
+  for (int64_t j = 0; j < num_bytes; j++) {
+    uint32_t words[8];
+    for (uint32_t t = 0; t < 8; t++) {
+      uint64_t cell = 8 * j + t;
+      words[t] = (cell < n) ? gr_ap_buf[cell] : 0;
+    }
+    for (uint32_t b = 0; b < num_hist; b++) {
+      uint8_t byte = 0;
+      for (uint32_t t = 0; t < 8; t++)
+        byte |= ((words[t] >> b) & 1u) << t;
+      gr_base[frame_offsets[b] + j] = byte;
+    }
+  }
+}
+
+/*
+ * Implementation Notes:
+ *     the window is copied out of the ring into a window buffer here, on the
+ * simulation thread, so that the ring can move on while the helper writes.
+ * With both buffers still being written, the simulation waits.
+ */
+void EventRecorder::commit_window(uint32_t num_post) {
+  open = false;
+  win.head.num_post = num_post;
+  uint64_t num_win_steps = win.head.num_pre + 1 + num_post;
+  uint64_t last_step = win.first_step + num_win_steps - 1;
+  uint64_t first_sample = 0;
+  if (file_head.vm_every_steps > 0) {
+    uint32_t every = file_head.vm_every_steps;
+    first_sample = (win.first_step + every - 1) / every;
+    win.head.first_vm_step = first_sample * every - win.first_step;
+    win.head.num_vm_samples =
+        (last_step >= first_sample * every)
+            ? (last_step - first_sample * every) / every + 1
+            : 0;
+  }
+  win.head.body_bytes = num_win_steps * spike_frame_bytes +
+                        win.head.num_vm_samples * vm_frame_bytes;
+  uint64_t win_bytes = sizeof(event_window_header) + win.head.body_bytes;
+
+  uint32_t slot = writer.acquire();
+  uint8_t *out = win_bufs[slot].data();
+  memcpy(out, &win.head, sizeof(win.head));
+  out += sizeof(win.head);
+  for (uint64_t s = win.first_step; s <= last_step; s++) {
+    memcpy(out, spike_ring.data() + (s % ring_steps) * spike_frame_bytes,
+           spike_frame_bytes);
+    out += spike_frame_bytes;
+  }
+  for (uint32_t k = 0; k < win.head.num_vm_samples; k++) {
+    memcpy(out,
+           vm_ring.data() + ((first_sample + k) % ring_samples) *
+                                (vm_frame_bytes / sizeof(float)),
+           vm_frame_bytes);
+    out += vm_frame_bytes;
+  }
+  win_buf_bytes[slot] = win_bytes;
+  windows_done++;
+  bytes_done += win_bytes;
+  update_cap();
+  writer.submit();
+}
+
+/*
+ * Implementation Notes:
+ *     the caps are checked against the largest window there can be, as soon
+ * as a window is committed, so that a window is only opened if it is sure to
+ * be kept.
+ */
+void EventRecorder::update_cap() {
+  if (capped || (windows_done < cfg.max_windows &&
+                 bytes_done + max_window_bytes <= cfg.max_bytes))
+    return;
+  LOG_WARN("Event recording cap reached after %lu windows (%0.1fMB): no "
+           "more windows are captured this session.",
+           windows_done, bytes_done / (1024.0 * 1024.0));
+  capped = true;
+}
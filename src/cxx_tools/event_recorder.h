@@ -0,0 +1,242 @@
+/*
+ * File: event_recorder.h
+ *
+ * Description:
+ *     This is the interface file for the event recorder, which captures the
+ * full activity of selected populations around the moments that matter (an
+ * inferior olive complex spike, a pause of the deep nucleus) instead of over
+ * whole trials. It keeps the last pre_ms of the selected populations in a
+ * ring buffer: spikes bit-packed, every step, and membrane potentials every
+ * vm_every_ms. When a trigger fires, the recorder goes on for post_ms and
+ * then commits the window, pre-trigger history included, to
+ * OUTPUT_BASE.evt. Triggers that fire while a window is open are counted in
+ * it rather than opening another.
+ *
+ *     Granule spikes are not copied back from the device every step: the
+ * 32-step spike history of every gr (bit 0 the latest step) is read every 32
+ * steps, and when a window closes, and its bits are spread over the ring.
+ * Windows are written by a helper thread; the ring, the window buffers and
+ * the output buffers are all sized up front, so that a step allocates
+ * nothing.
+ *
+ *     The configuration is a json file:
+ *
+ *     {
+ *       "pops": ["GR", "GO", "PC", "NC", "IO"],   populations captured
+ *       "pre_ms": 200,                            kept before the trigger
+ *       "post_ms": 100,                           kept after the trigger
+ *       "vm_every_ms": 5,                         0: spikes only
+ *       "triggers": {
+ *         "spike": ["IO"],                        any spike of these
+ *         "silence_ms": { "NC": 50 }              no spike of these for X ms
+ *       },
+ *       "max_windows": 1000,                      per session
+ *       "max_mb": 4096                            per session
+ *     }
+ *
+ *     Triggers are taken from host populations only (not GR). Once
+ * max_windows windows have been captured, or a window of the full length
+ * would no longer fit in max_mb, no more windows are opened; the triggers of
+ * the rest of the session are only counted.
+ *
+ *     File layout: an event_file_header, then windows, each an
+ * event_window_header followed by body_bytes of:
+ *
+ *     for each of the num_pre + 1 + num_post steps of the window, oldest
+ *     first, for each captured population in the order MF, GR, GO, BC, SC,
+ *     PC, IO, NC: (num_cells + 7) / 8 bytes, cell j in bit j % 8 of byte j / 8
+ *
+ *     for each of the num_vm_samples samples, for each population in vm_mask,
+ *     in the same order: num_cells floats
+ *
+ *     Sample k was taken at step first_vm_step + k * vm_every_steps of the
+ * window, counted from its first step.
+ */
+#ifndef EVENT_RECORDER_H_
+#define EVENT_RECORDER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "double_buf_writer.h"
+
+const char EVENT_MAGIC[4] = {'C', 'B', 'M', 'T'};
+const uint32_t EVENT_VERSION = 1;
+const uint32_t EVENT_NUM_POPS = 8; // MF, GR, GO, BC, SC, PC, IO, NC
+const uint32_t EVENT_MF = 0;       // the population without membrane potential
+const uint32_t EVENT_GR = 1;       // the population kept on the device
+const uint32_t EVENT_GR_HIST_STEPS = 32;
+
+// what Control has to pass to commit_step, as returned by step
+const uint32_t EVENT_NEEDS_GR_SPIKES = 1;
+const uint32_t EVENT_NEEDS_VMS = 2;
+
+// kinds of trigger, as given in a window header
+const uint32_t EVENT_TRIGGER_SPIKE = 1;
+const uint32_t EVENT_TRIGGER_SILENCE = 2;
+
+typedef struct {
+  bool pops[EVENT_NUM_POPS];
+  float pre_ms;
+  float post_ms;
+  float vm_every_ms; // 0: no membrane potentials
+  bool spike_trigger[EVENT_NUM_POPS];
+  float silence_ms[EVENT_NUM_POPS]; // 0: no silence trigger
+  uint32_t max_windows;
+  uint64_t max_bytes;
+} event_config;
+
+const event_config DEFAULT_EVENT_CONFIG = {
+    {false, false, false, false, false, false, false, false},
+    200.0f,
+    100.0f,
+    0.0f,
+    {false, false, false, false, false, false, true, false},
+    {0, 0, 0, 0, 0, 0, 0, 0},
+    1000,
+    4096ULL * 1024 * 1024};
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  float ms_per_step;
+  uint32_t pop_mask; // bit i: population i is captured
+  uint32_t vm_mask;  // bit i: population i has membrane potentials
+  uint32_t pre_steps;
+  uint32_t post_steps;
+  uint32_t vm_every_steps; // 0: no membrane potentials
+  uint32_t num_cells[EVENT_NUM_POPS];
+} event_file_header;
+
+typedef struct {
+  uint32_t trial; // of the trigger, counted from 0
+  uint32_t ts;    // of the trigger
+  uint32_t trigger_kind;
+  uint32_t trigger_pop;
+  uint32_t num_pre;  // below pre_steps if recording started later
+  uint32_t num_post; // below post_steps if the session ended first
+  uint32_t num_triggers; // that fired during the window, the first included
+  uint32_t num_vm_samples;
+  uint32_t first_vm_step;
+  uint32_t reserved;
+  uint64_t body_bytes;
+} event_window_header;
+
+/*
+ * Description:
+ *     fills cfg from the json file at path, keeping the values cfg already
+ * has (e.g. DEFAULT_EVENT_CONFIG) for anything the file leaves out. pop_ids
+ * names the populations, in the order above. Returns false, after logging
+ * why, if the file is missing or malformed, or captures nothing.
+ */
+bool load_event_config(std::string path, const std::string *pop_ids,
+                       event_config &cfg);
+
+class EventRecorder {
+public:
+  /*
+   * Description:
+   *     opens out_file_name and sizes every buffer. num_cells and pop_ids are
+   * indexed by population in the order MF, GR, GO, BC, SC, PC, IO, NC.
+   */
+  EventRecorder(std::string out_file_name, event_config cfg,
+                const uint32_t *num_cells, const std::string *pop_ids,
+                float ms_per_step);
+
+  /*
+   * Description:
+   *     writes the windows still waiting, closes the file and logs what the
+   * session captured.
+   */
+  ~EventRecorder();
+
+  /*
+   * Description:
+   *     whether triggers may open windows. The ring is kept whatever the
+   * value, so that a window opened later has its history.
+   */
+  void set_armed(bool armed) { this->armed = armed; }
+
+  /*
+   * Description:
+   *     packs this step's spikes of the host populations (the gr entry is
+   * ignored) into the ring and checks the triggers. Returns what
+   * commit_step needs for this step, as EVENT_NEEDS_* flags.
+   */
+  uint32_t step(uint32_t trial, uint32_t ts, const uint8_t *const *spikes);
+
+  /*
+   * Description:
+   *     completes the step: gr_ap_buf, the spike history of every gr, if
+   * step asked for EVENT_NEEDS_GR_SPIKES, and vms, indexed by population, if
+   * it asked for EVENT_NEEDS_VMS (NULL otherwise). Hands the window to the
+   * helper thread if it closes with this step.
+   */
+  void commit_step(const uint32_t *gr_ap_buf, const float *const *vms);
+
+  /*
+   * Description:
+   *     whether a window is open, and so has to be closed at the end of a
+   * session by close_window.
+   */
+  bool window_open() const { return open; }
+
+  /*
+   * Description:
+   *     commits the open window early, with what is in the ring so far.
+   * gr_ap_buf is as for commit_step, NULL if gr is not captured.
+   */
+  void close_window(const uint32_t *gr_ap_buf);
+
+  bool captures(uint32_t pop) const { return cfg.pops[pop]; }
+
+private:
+  typedef struct {
+    event_window_header head;
+    uint64_t first_step;
+  } open_window;
+
+  void fill_gr_spikes(const uint32_t *gr_ap_buf);
+  void commit_window(uint32_t num_post);
+  void update_cap();
+
+  event_config cfg;
+  uint32_t num_cells[EVENT_NUM_POPS];
+  std::string pop_ids[EVENT_NUM_POPS];
+  event_file_header file_head;
+  bool armed = true;
+
+  // ring of bit-packed spikes, one frame per step, and of voltage samples
+  uint64_t pop_offsets[EVENT_NUM_POPS]; // within a spike frame
+  uint64_t spike_frame_bytes = 0;
+  uint64_t vm_frame_bytes = 0;
+  uint32_t ring_steps;
+  uint32_t ring_samples;
+  uint64_t max_window_bytes; // header included
+  std::vector<uint8_t> spike_ring;
+  std::vector<float> vm_ring;
+
+  uint64_t num_steps = 0; // steps seen so far, the current one included
+  uint32_t gr_steps_pending = 0; // steps whose gr spikes are not in the ring
+  bool vm_due = false;
+  uint32_t silent_steps[EVENT_NUM_POPS] = {};
+  uint32_t silence_steps[EVENT_NUM_POPS];
+
+  bool open = false;
+  bool capped = false; // no window may be opened any more
+  open_window win;
+  uint64_t windows_done = 0;
+  uint64_t bytes_done = 0;
+  uint64_t triggers_missed = 0; // fired after a cap was reached
+
+  // window buffers; the helper thread owns a buffer while it is busy
+  std::vector<uint8_t> win_bufs[2];
+  uint64_t win_buf_bytes[2] = {};
+
+  // each window is flushed once written, so that it can be read while the
+  // session goes on
+  DoubleBufWriter writer{true};
+};
+
+#endif /* EVENT_RECORDER_H_ */
@@ -31,6 +31,11 @@ const std::string BVI_EXT = ".bvi";
 const std::string DAT_EXT = ".dat";
 const std::string BIN_EXT = ".bin";
 const std::string SIM_EXT = ".sim";
+const std::string TRS_EXT = ".trs";
+const std::string GTR_EXT = ".gtr";
+const std::string EVT_EXT = ".evt";
+const std::string VTR_EXT = ".vtr";
+const std::string WST_EXT = ".wst";
 
 /* the debug executable is contained within {PROJECT_ROOT}build/debug,
  * so the data folder is two directories up, rather than one directory
@@ -39,9 +44,13 @@ const std::string SIM_EXT = ".sim";
 #ifdef DEBUG
 const std::string INPUT_DATA_PATH = "../../data/inputs/";
 const std::string OUTPUT_DATA_PATH = "../../data/outputs/";
+const std::string AUTOTUNE_CACHE_FILE = "../../data/autotune.json";
+const std::string CON_STORE_PATH = "../../data/con_store/";
 #else
 const std::string INPUT_DATA_PATH = "../data/inputs/";
 const std::string OUTPUT_DATA_PATH = "../data/outputs/";
+const std::string AUTOTUNE_CACHE_FILE = "../data/autotune.json";
+const std::string CON_STORE_PATH = "../data/con_store/";
 #endif
 
 /*
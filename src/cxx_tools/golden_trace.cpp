@@ -0,0 +1,152 @@
+#include <cstring>
+#include <omp.h>
+
+#include "golden_trace.h"
+#include "logger.h"
+
+// chunk size is part of the hash definition: changing it changes every hash
+static const uint64_t TRACE_HASH_CHUNK = 64 * 1024;
+static const uint64_t TRACE_HASH_PRIME = 0x9E3779B97F4A7C15ULL;
+
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static uint64_t hash_chunk(const uint8_t *data, uint64_t num_bytes) {
+  uint64_t h = num_bytes * TRACE_HASH_PRIME;
+  uint64_t num_words = num_bytes / 8;
+  for (uint64_t i = 0; i < num_words; i++) {
+    uint64_t word;
+    memcpy(&word, data + 8 * i, sizeof(word));
+    h = (h ^ word) * TRACE_HASH_PRIME;
+    h ^= h >> 29;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + 8 * num_words, num_bytes % 8);
+  h = (h ^ tail) * TRACE_HASH_PRIME;
+  return mix64(h);
+}
+
+/*
+ * Implementation Notes:
+ *     small inputs (every population but GR) are hashed as a single chunk, so
+ * the parallel region is only entered for granule arrays.
+ */
+uint64_t trace_hash(const void *data, uint64_t num_bytes) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  if (num_bytes <= TRACE_HASH_CHUNK)
+    return hash_chunk(bytes, num_bytes);
+  uint64_t num_chunks = (num_bytes + TRACE_HASH_CHUNK - 1) / TRACE_HASH_CHUNK;
+  uint64_t chunk_hashes[num_chunks];
+#pragma omp parallel for
+  for (uint64_t i = 0; i < num_chunks; i++) {
+    uint64_t start = i * TRACE_HASH_CHUNK;
+    uint64_t len = (start + TRACE_HASH_CHUNK <= num_bytes)
+                       ? TRACE_HASH_CHUNK
+                       : num_bytes - start;
+    chunk_hashes[i] = hash_chunk(bytes + start, len);
+  }
+  return hash_chunk((const uint8_t *)chunk_hashes,
+                    num_chunks * sizeof(uint64_t));
+}
+
+GoldenTraceWriter::GoldenTraceWriter(std::string out_file_name,
+                                     const uint32_t *num_cells, bool detailed) {
+  out_buf.open(out_file_name.c_str(),
+               std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out_buf.is_open()) {
+    LOG_FATAL("Couldn't open '%s' for writing. Exiting...",
+              out_file_name.c_str());
+    exit(-1);
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GOLDEN_TRACE_MAGIC, sizeof(header.magic));
+  header.version = GOLDEN_TRACE_VERSION;
+  header.flags = detailed ? GT_DETAILED : 0;
+  header.num_pops = GT_NUM_POPS;
+  memcpy(header.num_cells, num_cells, GT_NUM_POPS * sizeof(uint32_t));
+  out_buf.write((const char *)&header, sizeof(header));
+}
+
+GoldenTraceWriter::~GoldenTraceWriter() { out_buf.close(); }
+
+/*
+ * Implementation Notes:
+ *     the step hash is a hash of the per-population hashes, so that both
+ * modes compute it the same way and a plain trace can be compared against a
+ * detailed one.
+ */
+void GoldenTraceWriter::record(uint32_t trial, uint32_t ts,
+                               const uint8_t *const *spikes,
+                               const float *const *vms) {
+  golden_trace_pop pops[GT_NUM_POPS];
+  uint64_t pop_hashes[2 * GT_NUM_POPS];
+  for (uint32_t i = 0; i < GT_NUM_POPS; i++) {
+    uint32_t n = header.num_cells[i];
+    memset(&pops[i], 0, sizeof(pops[i]));
+    pops[i].spike_hash = trace_hash(spikes[i], n * sizeof(uint8_t));
+    if (vms[i])
+      pops[i].vm_hash = trace_hash(vms[i], n * sizeof(float));
+    pop_hashes[2 * i] = pops[i].spike_hash;
+    pop_hashes[2 * i + 1] = pops[i].vm_hash;
+    if (header.flags & GT_DETAILED) {
+      uint32_t count = 0;
+      for (uint32_t j = 0; j < n; j++)
+        count += spikes[i][j];
+      pops[i].spike_count = count;
+      if (vms[i]) {
+        double sum = 0.0, sq_sum = 0.0;
+        for (uint32_t j = 0; j < n; j++) {
+          sum += vms[i][j];
+          sq_sum += (double)vms[i][j] * vms[i][j];
+        }
+        pops[i].vm_sum = sum;
+        pops[i].vm_sq_sum = sq_sum;
+      }
+    }
+  }
+  golden_trace_step step;
+  step.trial = trial;
+  step.ts = ts;
+  step.step_hash = trace_hash(pop_hashes, sizeof(pop_hashes));
+  out_buf.write((const char *)&step, sizeof(step));
+  if (header.flags & GT_DETAILED)
+    out_buf.write((const char *)pops, sizeof(pops));
+}
+
+GoldenTraceReader::GoldenTraceReader(std::string in_file_name) {
+  in_buf.open(in_file_name.c_str(), std::ios::in | std::ios::binary);
+  if (!in_buf.is_open()) {
+    LOG_FATAL("Couldn't open '%s' for reading. Exiting...",
+              in_file_name.c_str());
+    exit(-1);
+  }
+  in_buf.read((char *)&header, sizeof(header));
+  if (!in_buf ||
+      memcmp(header.magic, GOLDEN_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != GOLDEN_TRACE_VERSION ||
+      header.num_pops != GT_NUM_POPS) {
+    LOG_FATAL("'%s' is not a version %u golden trace. Exiting...",
+              in_file_name.c_str(), GOLDEN_TRACE_VERSION);
+    exit(-1);
+  }
+}
+
+GoldenTraceReader::~GoldenTraceReader() { in_buf.close(); }
+
+bool GoldenTraceReader::next(golden_trace_step &step, golden_trace_pop *pops) {
+  in_buf.read((char *)&step, sizeof(step));
+  if (!in_buf)
+    return false;
+  if (is_detailed()) {
+    in_buf.read((char *)pops, GT_NUM_POPS * sizeof(golden_trace_pop));
+    if (!in_buf)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * File: golden_trace.h
+ *
+ * Description:
+ *     This is the interface file for golden traces: a compact per-time-step
+ * fingerprint of a session, used to check that a change to the step functions
+ * (a new backend, SIMD, reordered loops) leaves the dynamics unchanged. Two
+ * runs of the same sim and session with the same build and seed ('-e') are
+ * bit-identical, so any difference between traces points at the first step
+ * where the dynamics diverged.
+ *
+ *     Each record holds a step hash over the spikes of all eight populations
+ * and the membrane potentials of every population that has one. In detailed
+ * mode, each record additionally holds, per population, the spike hash, the
+ * voltage bit hash, the spike count, and the sum and sum of squares of the
+ * voltages, so that a comparison can name the diverging population and
+ * tolerate float reassociation (see tools/trace_compare.cpp).
+ *
+ *     File layout: a golden_trace_header followed by records, each a
+ * golden_trace_step followed, in detailed mode, by GT_NUM_POPS
+ * golden_trace_pop entries.
+ */
+#ifndef GOLDEN_TRACE_H_
+#define GOLDEN_TRACE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+const char GOLDEN_TRACE_MAGIC[8] = {'C', 'B', 'M', 'G', 'T', 'R', '0', '1'};
+const uint32_t GOLDEN_TRACE_VERSION = 1;
+const uint32_t GT_NUM_POPS = 8; // MF, GR, GO, BC, SC, PC, IO, NC
+const uint32_t GT_DETAILED = 1; // header flag
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t num_pops;
+  uint32_t reserved;
+  uint32_t num_cells[GT_NUM_POPS];
+} golden_trace_header;
+
+typedef struct {
+  uint32_t trial;
+  uint32_t ts;
+  uint64_t step_hash;
+} golden_trace_step;
+
+typedef struct {
+  uint64_t spike_hash;
+  uint64_t vm_hash; // 0 for populations without membrane potentials
+  uint32_t spike_count;
+  uint32_t reserved;
+  double vm_sum;
+  double vm_sq_sum;
+} golden_trace_pop;
+
+/*
+ * Description:
+ *     64-bit hash of num_bytes bytes. The input is hashed in fixed-size chunks
+ * (in parallel for large inputs) whose hashes are then combined in order, so
+ * the result does not depend on the number of threads.
+ */
+uint64_t trace_hash(const void *data, uint64_t num_bytes);
+
+class GoldenTraceWriter {
+public:
+  GoldenTraceWriter(std::string out_file_name, const uint32_t *num_cells,
+                    bool detailed);
+  ~GoldenTraceWriter();
+
+  /*
+   * Description:
+   *     appends the record for one time step. spikes and vms are indexed by
+   * population in the order MF, GR, GO, BC, SC, PC, IO, NC; a NULL vm means
+   * the population has no membrane potential.
+   */
+  void record(uint32_t trial, uint32_t ts, const uint8_t *const *spikes,
+              const float *const *vms);
+
+private:
+  std::fstream out_buf;
+  golden_trace_header header;
+};
+
+class GoldenTraceReader {
+public:
+  GoldenTraceReader(std::string in_file_name);
+  ~GoldenTraceReader();
+
+  /*
+   * Description:
+   *     reads the next record. pops is only filled for detailed traces and
+   * must hold GT_NUM_POPS entries. Returns false at the end of the trace.
+   */
+  bool next(golden_trace_step &step, golden_trace_pop *pops);
+
+  const golden_trace_header &get_header() const { return header; }
+  bool is_detailed() const { return header.flags & GT_DETAILED; }
+
+private:
+  std::fstream in_buf;
+  golden_trace_header header;
+};
+
+#endif /* GOLDEN_TRACE_H_ */
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "health_monitor.h"
+#include "json.hpp"
+#include "logger.h"
+
+using json = nlohmann::json;
+
+// number of bad cells named in a diagnostic, per population and problem
+static const uint32_t HEALTH_MAX_NAMED = 3;
+
+static bool json_bound(const json &value, float &bound) {
+  if (value.is_null()) {
+    bound = -1.0f;
+    return true;
+  }
+  if (!value.is_number() || value.get<float>() < 0.0f)
+    return false;
+  bound = value.get<float>();
+  return true;
+}
+
+bool load_health_config(std::string path, const std::string *pop_ids,
+                        health_config &cfg) {
+  std::ifstream in_buf(path);
+  if (!in_buf.is_open()) {
+    LOG_ERROR("Couldn't open health check file '%s'.", path.c_str());
+    return false;
+  }
+  json file = json::parse(in_buf, nullptr, false);
+  if (file.is_discarded() || !file.is_object()) {
+    LOG_ERROR("Health check file '%s' is not a json object.", path.c_str());
+    return false;
+  }
+  for (auto &entry : file.items()) {
+    const std::string &key = entry.key();
+    const json &value = entry.value();
+    if (key == "interval" && value.is_number_unsigned() &&
+        value.get<uint32_t>() > 0) {
+      cfg.interval = value.get<uint32_t>();
+    } else if (key == "background" && value.is_boolean()) {
+      cfg.background = value.get<bool>();
+    } else if (key == "action" && value.is_string() &&
+               (value == "abort" || value == "checkpoint")) {
+      cfg.checkpoint = (value == "checkpoint");
+    } else if (key == "vm_range" && value.is_array() && value.size() == 2 &&
+               value[0].is_number() && value[1].is_number() &&
+               value[0].get<float>() < value[1].get<float>()) {
+      cfg.vm_min = value[0].get<float>();
+      cfg.vm_max = value[1].get<float>();
+    } else if (key == "rates" && value.is_object()) {
+      for (auto &rate : value.items()) {
+        uint32_t pop = 0;
+        while (pop < HEALTH_NUM_POPS && pop_ids[pop] != rate.key())
+          pop++;
+        if (pop == HEALTH_NUM_POPS || !rate.value().is_array() ||
+            rate.value().size() != 2 ||
+            !json_bound(rate.value()[0], cfg.min_rate_hz[pop]) ||
+            !json_bound(rate.value()[1], cfg.max_rate_hz[pop])) {
+          LOG_ERROR("Invalid rate bounds for '%s' in '%s': expected a "
+                    "population and [min, max] in Hz.",
+                    rate.key().c_str(), path.c_str());
+          return false;
+        }
+      }
+    } else {
+      LOG_ERROR("Invalid or unknown entry '%s' in health check file '%s'.",
+                key.c_str(), path.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+HealthMonitor::HealthMonitor(health_config cfg, const uint32_t *num_cells,
+                             const std::string *pop_ids, float ms_per_step)
+    : cfg(cfg), ms_per_step(ms_per_step) {
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    this->num_cells[i] = num_cells[i];
+    this->pop_ids[i] = pop_ids[i];
+  }
+  if (!cfg.background)
+    return;
+  // every population may have a membrane potential: size the copies once, so
+  // that a check allocates nothing
+  gr_ap_buf_copy.resize(num_cells[HEALTH_GR]);
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++)
+    vm_copies[i].resize(num_cells[i]);
+  worker = std::thread(&HealthMonitor::work_loop, this);
+}
+
+HealthMonitor::~HealthMonitor() {
+  if (!worker.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  worker.join();
+  if (skipped_checks > 0)
+    LOG_DEBUG("Skipped %lu health checks that came due while the previous "
+              "one was running.",
+              skipped_checks);
+}
+
+bool HealthMonitor::step(const uint8_t *const *spikes) {
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    if (i == HEALTH_GR || !spikes[i])
+      continue;
+    const uint8_t *ap = spikes[i];
+    uint32_t count = 0;
+#pragma omp simd reduction(+ : count)
+    for (uint32_t j = 0; j < num_cells[i]; j++)
+      count += ap[j];
+    spike_counts[i] += count;
+  }
+  steps_since_check++;
+  return steps_since_check >= cfg.interval;
+}
+
+void HealthMonitor::check(uint32_t trial, uint32_t ts,
+                          const uint32_t *gr_ap_buf, const float *const *vms) {
+  check_header head;
+  head.trial = trial;
+  head.ts = ts;
+  head.steps = steps_since_check;
+  memcpy(head.spike_counts, spike_counts, sizeof(spike_counts));
+  memset(spike_counts, 0, sizeof(spike_counts));
+  steps_since_check = 0;
+
+  if (!cfg.background) {
+    report(evaluate(head, gr_ap_buf, vms));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (check_pending) {
+      skipped_checks++;
+      return;
+    }
+  }
+  // the helper is idle, so the copies are ours until check_pending is set
+  pending_head = head;
+  has_gr_ap_buf = (gr_ap_buf != NULL);
+  if (has_gr_ap_buf)
+    memcpy(gr_ap_buf_copy.data(), gr_ap_buf,
+           num_cells[HEALTH_GR] * sizeof(uint32_t));
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    has_vm[i] = (vms[i] != NULL);
+    if (has_vm[i])
+      memcpy(vm_copies[i].data(), vms[i], num_cells[i] * sizeof(float));
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    check_pending = true;
+  }
+  wake.notify_one();
+}
+
+std::string HealthMonitor::diagnostic() {
+  std::lock_guard<std::mutex> guard(lock);
+  return first_diagnostic;
+}
+
+/*
+ * Implementation Notes:
+ *     the counting loops carry no early exit, so that they vectorize; the
+ * cells named in the diagnostic are looked up afterwards, only for a
+ * population that failed. Nothing is formatted for a check that passes, so
+ * that it allocates nothing.
+ */
+std::string HealthMonitor::evaluate(const check_header &head,
+                                    const uint32_t *gr_ap_buf,
+                                    const float *const *vms) {
+  uint32_t non_finite[HEALTH_NUM_POPS] = {};
+  uint32_t out_of_range[HEALTH_NUM_POPS] = {};
+  float rates_hz[HEALTH_NUM_POPS];
+  uint32_t rate_steps[HEALTH_NUM_POPS] = {};
+  bool bad_rate[HEALTH_NUM_POPS] = {};
+  bool any_bad = false;
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    if (!vms[i])
+      continue;
+    const float *vm = vms[i];
+    float lo = cfg.vm_min;
+    float hi = cfg.vm_max;
+    uint32_t pop_non_finite = 0;
+    uint32_t pop_out_of_range = 0;
+#pragma omp simd reduction(+ : pop_non_finite, pop_out_of_range)
+    for (uint32_t j = 0; j < num_cells[i]; j++) {
+      uint32_t bits;
+      memcpy(&bits, &vm[j], sizeof(bits));
+      uint32_t bad = (bits & 0x7F800000u) == 0x7F800000u;
+      pop_non_finite += bad;
+      pop_out_of_range += (bad ^ 1u) & ((vm[j] < lo) | (vm[j] > hi));
+    }
+    non_finite[i] = pop_non_finite;
+    out_of_range[i] = pop_out_of_range;
+    any_bad |= (pop_non_finite + pop_out_of_range > 0);
+  }
+
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    if (cfg.min_rate_hz[i] < 0.0f && cfg.max_rate_hz[i] < 0.0f)
+      continue;
+    uint64_t count = head.spike_counts[i];
+    uint32_t steps = head.steps;
+    if (i == HEALTH_GR) {
+      if (!gr_ap_buf)
+        continue;
+      steps = std::min(steps, HEALTH_GR_HIST_STEPS);
+      uint32_t mask = (steps == 32) ? 0xFFFFFFFFu : (1u << steps) - 1;
+      count = 0;
+#pragma omp simd reduction(+ : count)
+      for (uint32_t j = 0; j < num_cells[i]; j++)
+        count += __builtin_popcount(gr_ap_buf[j] & mask);
+    }
+    if (steps == 0)
+      continue;
+    rates_hz[i] =
+        count * 1000.0 / ((double)num_cells[i] * steps * ms_per_step);
+    rate_steps[i] = steps;
+    bad_rate[i] =
+        (cfg.min_rate_hz[i] >= 0.0f && rates_hz[i] < cfg.min_rate_hz[i]) ||
+        (cfg.max_rate_hz[i] >= 0.0f && rates_hz[i] > cfg.max_rate_hz[i]);
+    any_bad |= bad_rate[i];
+  }
+  if (!any_bad)
+    return std::string();
+
+  std::stringstream problems;
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    if (non_finite[i] + out_of_range[i] == 0)
+      continue;
+    const float *vm = vms[i];
+    float lo = cfg.vm_min;
+    float hi = cfg.vm_max;
+    problems << pop_ids[i] << ": " << non_finite[i] << " non-finite and "
+             << out_of_range[i] << " out-of-range vm (";
+    uint32_t named = 0;
+    for (uint32_t j = 0; j < num_cells[i] && named < HEALTH_MAX_NAMED; j++) {
+      if (!(vm[j] >= lo && vm[j] <= hi)) {
+        problems << (named ? ", " : "") << "cell " << j << " = " << vm[j];
+        named++;
+      }
+    }
+    problems << "); ";
+  }
+  for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+    if (!bad_rate[i])
+      continue;
+    bool too_low = rates_hz[i] < cfg.min_rate_hz[i];
+    problems << pop_ids[i] << ": rate " << rates_hz[i] << "Hz over "
+             << rate_steps[i] << " steps is " << (too_low ? "below " : "above ")
+             << (too_low ? cfg.min_rate_hz[i] : cfg.max_rate_hz[i]) << "Hz; ";
+  }
+  std::string found = problems.str();
+  found.resize(found.size() - 2); // the last "; "
+  return "trial " + std::to_string(head.trial + 1) + ", ts " +
+         std::to_string(head.ts) + ": " + found;
+}
+
+void HealthMonitor::report(const std::string &problems) {
+  if (problems.empty())
+    return;
+  LOG_ERROR("Health check failed at %s", problems.c_str());
+  std::lock_guard<std::mutex> guard(lock);
+  if (first_diagnostic.empty())
+    first_diagnostic = problems;
+  has_failed.store(true, std::memory_order_release);
+}
+
+void HealthMonitor::work_loop() {
+  const float *vms[HEALTH_NUM_POPS];
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard, [this] { return check_pending || stopping; });
+    if (stopping)
+      return;
+    guard.unlock();
+    for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++)
+      vms[i] = has_vm[i] ? vm_copies[i].data() : NULL;
+    report(evaluate(pending_head,
+                    has_gr_ap_buf ? gr_ap_buf_copy.data() : NULL, vms));
+    guard.lock();
+    check_pending = false;
+  }
+}
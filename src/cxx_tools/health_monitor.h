@@ -0,0 +1,164 @@
+/*
+ * File: health_monitor.h
+ *
+ * Description:
+ *     This is the interface file for the health monitor, which stops a session
+ * whose state has gone bad instead of letting it run for hours into garbage
+ * output. Every 'interval' time steps it checks:
+ *
+ *     - that no membrane potential is NaN or infinite
+ *     - that every membrane potential lies within [vm_min, vm_max]
+ *     - that the firing rate of each population over the steps since the last
+ *       check lies within that population's bounds, if it has any
+ *
+ *     Spikes of the host populations are counted every step. Granule spikes
+ * live on the device, so the granule rate is measured at the check from the
+ * 32-step spike history of every gr, over the last min(32, interval) steps.
+ *
+ *     The checks are written as plain counting loops that the compiler
+ * vectorizes; NaN and infinity are told from the exponent bits, so they are
+ * caught whatever the floating-point flags. In background mode, the state of
+ * the check step is copied into buffers owned by the monitor and checked on a
+ * helper thread while the session goes on; a failure then surfaces a few steps
+ * after the check step. A check that comes due while the previous one is still
+ * running is skipped.
+ *
+ *     The configuration is a json file:
+ *
+ *     {
+ *       "interval": 1000,          steps between checks
+ *       "background": false,       check on a helper thread
+ *       "action": "abort",         or "checkpoint" (see below)
+ *       "vm_range": [-100, 60],    mV
+ *       "rates": { "GO": [1, 100], "PC": [null, 250] }   Hz, null: unbounded
+ *     }
+ *
+ *     On failure the session stops. "abort" saves the usual outputs but not
+ * the sim, whose state is broken; "checkpoint" also saves the sim, as
+ * OUTPUT_BASE_unhealthy.sim, for inspection.
+ */
+#ifndef HEALTH_MONITOR_H_
+#define HEALTH_MONITOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const uint32_t HEALTH_NUM_POPS = 8; // MF, GR, GO, BC, SC, PC, IO, NC
+const uint32_t HEALTH_GR = 1;       // index of the granule population
+const uint32_t HEALTH_GR_HIST_STEPS = 32;
+
+// exit status of a run stopped by a failed check, for sweep scripts
+const int HEALTH_FAILED_EXIT_STATUS = 12;
+
+typedef struct {
+  uint32_t interval;
+  bool background;
+  bool checkpoint;
+  float vm_min;
+  float vm_max;
+  float min_rate_hz[HEALTH_NUM_POPS]; // -1: unbounded
+  float max_rate_hz[HEALTH_NUM_POPS]; // -1: unbounded
+} health_config;
+
+const health_config DEFAULT_HEALTH_CONFIG = {
+    1000,  false, false, -100.0f, 60.0f, {-1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1}};
+
+/*
+ * Description:
+ *     fills cfg from the json file at path, keeping the values cfg already
+ * has (e.g. DEFAULT_HEALTH_CONFIG) for anything the file leaves out. pop_ids
+ * names the populations, in the order above. Returns false, after logging
+ * why, if the file is missing or malformed.
+ */
+bool load_health_config(std::string path, const std::string *pop_ids,
+                        health_config &cfg);
+
+class HealthMonitor {
+public:
+  /*
+   * Description:
+   *     num_cells and pop_ids are indexed by population in the order MF, GR,
+   * GO, BC, SC, PC, IO, NC. ms_per_step converts spike counts to rates.
+   */
+  HealthMonitor(health_config cfg, const uint32_t *num_cells,
+                const std::string *pop_ids, float ms_per_step);
+
+  /*
+   * Description:
+   *     waits for a check still running on the helper thread.
+   */
+  ~HealthMonitor();
+
+  /*
+   * Description:
+   *     counts this step's spikes of the host populations (the gr entry is
+   * ignored) and returns whether a check is due this step.
+   */
+  bool step(const uint8_t *const *spikes);
+
+  /*
+   * Description:
+   *     checks this step's state, or hands it to the helper thread.
+   * gr_ap_buf holds the spike history of every gr, this step in bit 0; a NULL
+   * vm means the population has no membrane potential.
+   */
+  void check(uint32_t trial, uint32_t ts, const uint32_t *gr_ap_buf,
+             const float *const *vms);
+
+  /*
+   * Description:
+   *     whether a check has failed, and what the first failure found.
+   */
+  bool failed() const { return has_failed.load(std::memory_order_acquire); }
+  std::string diagnostic();
+
+  const health_config &config() const { return cfg; }
+
+private:
+  typedef struct {
+    uint32_t trial;
+    uint32_t ts;
+    uint32_t steps; // steps the host spike counts cover
+    uint64_t spike_counts[HEALTH_NUM_POPS];
+  } check_header;
+
+  std::string evaluate(const check_header &head, const uint32_t *gr_ap_buf,
+                       const float *const *vms);
+  void report(const std::string &problems);
+  void work_loop();
+
+  health_config cfg;
+  float ms_per_step;
+  uint32_t num_cells[HEALTH_NUM_POPS];
+  std::string pop_ids[HEALTH_NUM_POPS];
+
+  uint32_t steps_since_check = 0;
+  uint64_t spike_counts[HEALTH_NUM_POPS] = {};
+
+  std::atomic<bool> has_failed{false};
+  uint64_t skipped_checks = 0;
+
+  // the copy of the state of the check step given to the helper thread,
+  // which owns it while check_pending is set
+  check_header pending_head;
+  std::vector<uint32_t> gr_ap_buf_copy;
+  bool has_gr_ap_buf;
+  std::vector<float> vm_copies[HEALTH_NUM_POPS];
+  bool has_vm[HEALTH_NUM_POPS];
+
+  // guard everything below
+  std::mutex lock;
+  std::condition_variable wake;
+  bool check_pending = false;
+  bool stopping = false;
+  std::string first_diagnostic;
+  std::thread worker;
+};
+
+#endif /* HEALTH_MONITOR_H_ */
@@ -35,6 +35,7 @@ const std::string RUN_END_DATE_LBL = "RUN END DATE";
 const std::string RUN_END_TIME_LBL = "RUN END TIME";
 const std::string CBM_SIM_VER_LBL = "CBM SIM VERSION";
 const std::string USERNAME_LBL = "GENERATED BY";
+const std::string EARLY_STOP_LBL = "STOPPED EARLY AT";
 
 const std::string CMD_LBL = "COMMAND";
 const std::string VIS_MODE_LBL = "VISUAL MODE";
@@ -78,6 +79,7 @@ typedef struct {
   std::string end_time;
   std::string sim_version;
   std::string username;
+  std::string early_stop; // empty without a convergence rule
   parsed_commandline p_cl;
 } info_file_data;
 
@@ -175,6 +175,8 @@ cleanup:
   return ok;
 }
 
+int logger_isInitialized(void) { return s_logger != 0 && s_initialized; }
+
 void logger_setLevel(LogLevel level) { s_logLevel = level; }
 
 LogLevel logger_getLevel(void) { return s_logLevel; }
@@ -59,6 +59,13 @@ int logger_initConsoleLogger(FILE *output);
 int logger_initFileLogger(const char *filename, long maxFileSize,
                           unsigned char maxBackupFiles);
 
+/**
+ * Check whether one of the initialize functions has already been called.
+ *
+ * @return Non-zero value if the logger is initialized
+ */
+int logger_isInitialized(void);
+
 /**
  * Set the log level.
  * Message levels lower than this value will be discarded.
@@ -0,0 +1,28 @@
+#include <climits>
+#include <ctime>
+
+#include "rng_seed.h"
+#include "sfmt.h"
+
+static CRandomSFMT0 *master_rng = NULL;
+static uint32_t master_seed = 0;
+
+void set_rng_seed(uint32_t seed) {
+  if (master_rng)
+    delete master_rng;
+  master_seed = seed;
+  master_rng = new CRandomSFMT0(seed);
+}
+
+void rewind_rng_seed() {
+  if (master_rng)
+    set_rng_seed(master_seed);
+}
+
+bool rng_seed_is_set() { return master_rng != NULL; }
+
+int next_rng_seed() {
+  if (master_rng)
+    return master_rng->IRandom(0, INT_MAX);
+  return time(0);
+}
@@ -0,0 +1,44 @@
+/*
+ * File: rng_seed.h
+ *
+ * Description:
+ *     This is the interface file for the process-wide source of random number
+ * generator seeds. By default every generator the simulation constructs is
+ * seeded from the clock, so no two runs are alike. Once set_rng_seed has been
+ * called, seeds are instead drawn in order from a single generator seeded with
+ * the given value, so that building a sim or running a session twice with the
+ * same seed gives the same result (benchmarks, golden traces).
+ */
+#ifndef RNG_SEED_H_
+#define RNG_SEED_H_
+
+#include <cstdint>
+
+/*
+ * Description:
+ *     makes every following call to next_rng_seed deterministic. Must be
+ * called before any state is built or loaded.
+ */
+void set_rng_seed(uint32_t seed);
+
+/*
+ * Description:
+ *     resets the master generator to the state set_rng_seed left it in, so
+ * that the same seeds are drawn again. Does nothing if no seed was set.
+ */
+void rewind_rng_seed();
+
+/*
+ * Description:
+ *     returns whether set_rng_seed has been called.
+ */
+bool rng_seed_is_set();
+
+/*
+ * Description:
+ *     returns a seed for a new random number generator: the next draw from the
+ * master generator if a seed was set, else the current time.
+ */
+int next_rng_seed();
+
+#endif /* RNG_SEED_H_ */
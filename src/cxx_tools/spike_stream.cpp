@@ -0,0 +1,302 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>    // O_* constants (POSIX ONLY)
+#include <sys/mman.h> // shm_open, mmap (POSIX ONLY)
+#include <sys/stat.h> // fstat (POSIX ONLY)
+#include <unistd.h>   // ftruncate, close (POSIX ONLY)
+
+#include "logger.h"
+#include "spike_stream.h"
+
+static inline uint64_t round_up(uint64_t num_bytes, uint64_t align) {
+  return (num_bytes + align - 1) / align * align;
+}
+
+static inline uint32_t packed_bytes(uint32_t num_cells) {
+  return (num_cells + 7) / 8;
+}
+
+/*
+ * Implementation Notes:
+ *     eight spike bytes are loaded as one little-endian word, so spike i sits
+ * in bit 8 * i. Multiplying by the magic constant shifts each of those bits to
+ * position 56 + i, giving the packed byte in the top eight bits. The tail that
+ * does not fill a word is packed a bit at a time.
+ */
+uint32_t pack_spikes(const uint8_t *spikes, uint32_t num_cells,
+                     uint8_t *packed) {
+  uint32_t num_spikes = 0;
+  uint32_t num_words = num_cells / 8;
+  for (uint32_t i = 0; i < num_words; i++) {
+    uint64_t word;
+    memcpy(&word, spikes + 8 * i, sizeof(word));
+    word &= 0x0101010101010101ULL;
+    packed[i] = (uint8_t)((word * 0x0102040810204080ULL) >> 56);
+    num_spikes += __builtin_popcount(packed[i]);
+  }
+  if (num_cells % 8) {
+    uint8_t last = 0;
+    for (uint32_t i = num_words * 8; i < num_cells; i++)
+      last |= (spikes[i] & 1) << (i % 8);
+    packed[num_words] = last;
+    num_spikes += __builtin_popcount(last);
+  }
+  return num_spikes;
+}
+
+static void *map_segment(int fd, uint64_t num_bytes, const char *shm_name) {
+  void *addr =
+      mmap(NULL, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    LOG_FATAL("Could not map spike stream '%s': %s. Exiting...", shm_name,
+              strerror(errno));
+    exit(13);
+  }
+  return addr;
+}
+
+/*
+ * Implementation Notes:
+ *     a slot is sized for every population bit-packed, which is also an upper
+ * bound on the address-event encoding since we only pick it when it is
+ * smaller. The ring gets as many slots as fit in SPIKE_STREAM_MAX_RING_BYTES,
+ * within [SPIKE_STREAM_MIN_SLOTS, SPIKE_STREAM_MAX_SLOTS].
+ */
+SpikeStreamWriter::SpikeStreamWriter(std::string shm_name,
+                                     const spike_stream_pop *pops,
+                                     uint32_t num_pops)
+    : shm_name(shm_name) {
+  if (num_pops == 0 || num_pops > SPIKE_STREAM_MAX_POPS) {
+    LOG_FATAL("Spike stream needs between 1 and %u populations, got %u. "
+              "Exiting...",
+              SPIKE_STREAM_MAX_POPS, num_pops);
+    exit(13);
+  }
+  uint64_t slot_bytes = sizeof(spike_stream_slot) + sizeof(spike_frame_header);
+  uint32_t max_cells = 0;
+  for (uint32_t i = 0; i < num_pops; i++) {
+    slot_bytes += sizeof(spike_pop_header) +
+                  round_up(packed_bytes(pops[i].num_cells), 8);
+    if (pops[i].num_cells > max_cells)
+      max_cells = pops[i].num_cells;
+  }
+  slot_bytes = round_up(slot_bytes, 64);
+  uint64_t num_slots = SPIKE_STREAM_MAX_RING_BYTES / slot_bytes;
+  if (num_slots < SPIKE_STREAM_MIN_SLOTS)
+    num_slots = SPIKE_STREAM_MIN_SLOTS;
+  if (num_slots > SPIKE_STREAM_MAX_SLOTS)
+    num_slots = SPIKE_STREAM_MAX_SLOTS;
+  uint64_t slot_offset = round_up(sizeof(spike_stream_header), 64);
+  segment_bytes = slot_offset + num_slots * slot_bytes;
+
+  shm_unlink(shm_name.c_str());
+  int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+  if (fd == -1) {
+    LOG_FATAL("Could not create spike stream '%s': %s. Exiting...",
+              shm_name.c_str(), strerror(errno));
+    exit(13);
+  }
+  if (ftruncate(fd, segment_bytes) == -1) {
+    LOG_FATAL("Could not size spike stream '%s': %s. Exiting...",
+              shm_name.c_str(), strerror(errno));
+    close(fd);
+    shm_unlink(shm_name.c_str());
+    exit(13);
+  }
+  header = (spike_stream_header *)map_segment(fd, segment_bytes,
+                                              shm_name.c_str());
+  // ftruncate zero-fills: every slot starts at seq 0, i.e. holds no frame
+  header->version = SPIKE_STREAM_VERSION;
+  header->num_pops = num_pops;
+  header->num_slots = num_slots;
+  header->slot_bytes = slot_bytes;
+  header->slot_offset = slot_offset;
+  memcpy(header->pops, pops, num_pops * sizeof(spike_stream_pop));
+  header->state.store(STREAM_WAITING, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(header->magic, SPIKE_STREAM_MAGIC, sizeof(header->magic));
+
+  pack_buf = (uint8_t *)malloc(round_up(packed_bytes(max_cells), 8));
+  LOG_INFO("Streaming spikes to '%s' (%lu slots of %lu bytes).",
+           shm_name.c_str(), num_slots, slot_bytes);
+}
+
+SpikeStreamWriter::~SpikeStreamWriter() {
+  if (header) {
+    set_state(STREAM_DONE);
+    munmap(header, segment_bytes);
+    shm_unlink(shm_name.c_str());
+  }
+  free(pack_buf);
+}
+
+/*
+ * Implementation Notes:
+ *     the frame is encoded straight into its slot between the two sequence
+ * stores, so the only copy is from the scratch packing buffer. The head is
+ * advanced after the slot is complete, so readers never chase a frame that is
+ * still being written.
+ */
+void SpikeStreamWriter::publish(uint32_t trial, uint32_t ts, float cr,
+                                const uint8_t *const *spikes) {
+  uint64_t number = ++num_published;
+  uint8_t *slot = (uint8_t *)header + header->slot_offset +
+                  ((number - 1) % header->num_slots) * header->slot_bytes;
+  spike_stream_slot *slot_head = (spike_stream_slot *)slot;
+  slot_head->seq.store(2 * number - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  spike_frame_header *frame =
+      (spike_frame_header *)(slot + sizeof(spike_stream_slot));
+  uint8_t *block = (uint8_t *)(frame + 1);
+  for (uint32_t i = 0; i < header->num_pops; i++) {
+    spike_pop_header *pop = (spike_pop_header *)block;
+    uint8_t *data = block + sizeof(spike_pop_header);
+    uint32_t num_cells = header->pops[i].num_cells;
+    uint32_t num_bits_bytes = packed_bytes(num_cells);
+    uint32_t num_spikes = pack_spikes(spikes[i], num_cells, pack_buf);
+    pop->cell_id = header->pops[i].cell_id;
+    pop->num_cells = num_cells;
+    if ((uint64_t)num_spikes * sizeof(uint32_t) < num_bits_bytes) {
+      pop->encoding = SPIKE_ENC_AER;
+      pop->num_bytes = num_spikes * sizeof(uint32_t);
+      uint32_t *events = (uint32_t *)data;
+      for (uint32_t j = 0; j < num_bits_bytes; j++) {
+        uint8_t bits = pack_buf[j];
+        while (bits) {
+          *events++ = 8 * j + __builtin_ctz(bits);
+          bits &= bits - 1;
+        }
+      }
+    } else {
+      pop->encoding = SPIKE_ENC_BITS;
+      pop->num_bytes = num_bits_bytes;
+      memcpy(data, pack_buf, num_bits_bytes);
+    }
+    block = data + round_up(pop->num_bytes, 8);
+  }
+  frame->number = number;
+  frame->trial = trial;
+  frame->ts = ts;
+  frame->cr = cr;
+  frame->num_pops = header->num_pops;
+  frame->payload_bytes = block - (uint8_t *)(frame + 1);
+  frame->reserved = 0;
+
+  slot_head->seq.store(2 * number, std::memory_order_release);
+  header->head.store(number, std::memory_order_release);
+}
+
+void SpikeStreamWriter::set_state(enum spike_stream_state state) {
+  header->state.store(state, std::memory_order_release);
+}
+
+/*
+ * Implementation Notes:
+ *     the header is mapped first on its own to learn the segment size, then
+ * the whole segment is mapped.
+ */
+SpikeStreamReader::SpikeStreamReader(std::string shm_name) {
+  int fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+  if (fd == -1) {
+    LOG_FATAL("Could not open spike stream '%s': %s. Is the simulation "
+              "running? Exiting...",
+              shm_name.c_str(), strerror(errno));
+    exit(13);
+  }
+  struct stat seg_stat;
+  if (fstat(fd, &seg_stat) == -1 ||
+      (uint64_t)seg_stat.st_size < sizeof(spike_stream_header)) {
+    LOG_FATAL("'%s' is not a spike stream. Exiting...", shm_name.c_str());
+    close(fd);
+    exit(13);
+  }
+  segment_bytes = seg_stat.st_size;
+  header =
+      (spike_stream_header *)map_segment(fd, segment_bytes, shm_name.c_str());
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (memcmp(header->magic, SPIKE_STREAM_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SPIKE_STREAM_VERSION) {
+    LOG_FATAL("'%s' is not a version %u spike stream. Exiting...",
+              shm_name.c_str(), SPIKE_STREAM_VERSION);
+    munmap(header, segment_bytes);
+    exit(13);
+  }
+  // start from the newest frame rather than replaying the whole ring
+  uint64_t head = header->head.load(std::memory_order_acquire);
+  next_number = head + 1;
+}
+
+SpikeStreamReader::~SpikeStreamReader() {
+  if (header)
+    munmap(header, segment_bytes);
+}
+
+bool SpikeStreamReader::next(uint8_t *frame_buf) {
+  uint64_t num_slots = header->num_slots;
+  uint64_t frame_cap =
+      header->slot_bytes - sizeof(spike_stream_slot) - sizeof(spike_frame_header);
+  while (true) {
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    if (next_number > head)
+      return false;
+    uint64_t oldest = (head > num_slots) ? head - num_slots + 1 : 1;
+    if (next_number < oldest) {
+      dropped += oldest - next_number;
+      next_number = oldest;
+    }
+    uint8_t *slot = (uint8_t *)header + header->slot_offset +
+                    ((next_number - 1) % num_slots) * header->slot_bytes;
+    spike_stream_slot *slot_head = (spike_stream_slot *)slot;
+    uint64_t s1 = slot_head->seq.load(std::memory_order_acquire);
+    if (s1 == 2 * next_number) {
+      spike_frame_header *frame = (spike_frame_header *)frame_buf;
+      memcpy(frame, slot + sizeof(spike_stream_slot), sizeof(*frame));
+      uint64_t payload_bytes =
+          (frame->payload_bytes < frame_cap) ? frame->payload_bytes : frame_cap;
+      memcpy(frame + 1,
+             slot + sizeof(spike_stream_slot) + sizeof(spike_frame_header),
+             payload_bytes);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot_head->seq.load(std::memory_order_relaxed) == s1) {
+        next_number++;
+        return true;
+      }
+    }
+    // the writer lapped us while we were looking at this slot
+    dropped++;
+    next_number++;
+  }
+}
+
+bool SpikeStreamReader::unpack(const uint8_t *frame_buf, uint32_t pop_index,
+                               uint8_t *spikes) {
+  const spike_frame_header *frame = (const spike_frame_header *)frame_buf;
+  if (pop_index >= frame->num_pops)
+    return false;
+  const uint8_t *block = (const uint8_t *)(frame + 1);
+  for (uint32_t i = 0; i < pop_index; i++) {
+    const spike_pop_header *pop = (const spike_pop_header *)block;
+    block += sizeof(spike_pop_header) + round_up(pop->num_bytes, 8);
+  }
+  const spike_pop_header *pop = (const spike_pop_header *)block;
+  const uint8_t *data = block + sizeof(spike_pop_header);
+  if (pop->encoding == SPIKE_ENC_AER) {
+    memset(spikes, 0, pop->num_cells);
+    const uint32_t *events = (const uint32_t *)data;
+    for (uint32_t j = 0; j < pop->num_bytes / sizeof(uint32_t); j++) {
+      if (events[j] < pop->num_cells)
+        spikes[events[j]] = 1;
+    }
+  } else {
+    for (uint32_t j = 0; j < pop->num_cells; j++)
+      spikes[j] = (data[j / 8] >> (j % 8)) & 1;
+  }
+  return true;
+}
+
+enum spike_stream_state SpikeStreamReader::get_state() const {
+  return (enum spike_stream_state)header->state.load(std::memory_order_acquire);
+}
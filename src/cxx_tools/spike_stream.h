@@ -0,0 +1,161 @@
+/*
+ * File: spike_stream.h
+ *
+ * Description:
+ *     This is the interface file for the live spike stream, which publishes
+ * the spikes of selected cell populations and the red nucleus output (the CR
+ * sample) every time step while a session runs, so that dashboards do not
+ * have to wait for the raster files at the end of the session.
+ *
+ *     The stream is a ring of fixed-size frame slots in a POSIX shared-memory
+ * segment, written by the simulation and read by any number of readers. The
+ * writer never waits for a reader: it always overwrites the oldest slot, and
+ * each slot carries its own sequence lock so a reader can tell whether the
+ * frame it copied was overwritten under it. Readers keep their own position
+ * and count the frames they lost to overruns (drop-on-slow-consumer).
+ *
+ *     Each population in a frame is encoded either as a bit-packed array (one
+ * bit per cell, least significant bit first, as in bits.h) or as an address-
+ * event list (uint32_t index of each spiking cell), whichever is smaller for
+ * that step.
+ *
+ *     python/spike_stream.py reads the same layout, so any change here must
+ * bump SPIKE_STREAM_VERSION.
+ */
+#ifndef SPIKE_STREAM_H_
+#define SPIKE_STREAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+const char SPIKE_STREAM_MAGIC[8] = {'C', 'B', 'M', 'S', 'T', 'R', 'M', '1'};
+const uint32_t SPIKE_STREAM_VERSION = 1;
+const uint32_t SPIKE_STREAM_MAX_POPS = 8;
+const uint64_t SPIKE_STREAM_MAX_RING_BYTES = 64 * 1024 * 1024;
+const uint32_t SPIKE_STREAM_MIN_SLOTS = 16;
+const uint32_t SPIKE_STREAM_MAX_SLOTS = 1024;
+
+enum spike_encoding { SPIKE_ENC_BITS = 0, SPIKE_ENC_AER = 1 };
+
+enum spike_stream_state { STREAM_WAITING = 0, STREAM_RUNNING = 1, STREAM_DONE = 2 };
+
+typedef struct {
+  uint32_t cell_id; // index into Control's CELL_IDS
+  uint32_t num_cells;
+} spike_stream_pop;
+
+/* segment header. Slots follow at offset slot_offset, slot_bytes apart */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_pops;
+  uint32_t num_slots;
+  uint32_t slot_bytes;
+  uint64_t slot_offset;
+  spike_stream_pop pops[SPIKE_STREAM_MAX_POPS];
+  alignas(64) std::atomic<uint64_t> head; // number of the newest full frame
+  std::atomic<uint32_t> state;
+} spike_stream_header;
+
+/* start of every slot. Frame n lives in slot (n - 1) % num_slots and is
+ * complete when seq == 2 * n */
+typedef struct {
+  alignas(64) std::atomic<uint64_t> seq;
+} spike_stream_slot;
+
+typedef struct {
+  uint64_t number; // 1-based frame count
+  uint32_t trial;
+  uint32_t ts;
+  float cr;
+  uint32_t num_pops;
+  uint32_t payload_bytes; // bytes of population blocks following this header
+  uint32_t reserved;
+} spike_frame_header;
+
+/* precedes each population's data. Blocks are padded to 8 bytes */
+typedef struct {
+  uint32_t cell_id;
+  uint32_t encoding;  // one of spike_encoding
+  uint32_t num_cells;
+  uint32_t num_bytes; // bytes of data (bits) or 4 * number of events (aer)
+} spike_pop_header;
+
+/*
+ * Description:
+ *     packs num_cells spike bytes (0 or 1) into (num_cells + 7) / 8 bytes,
+ * least significant bit first. Returns the number of spikes.
+ */
+uint32_t pack_spikes(const uint8_t *spikes, uint32_t num_cells, uint8_t *packed);
+
+/*
+ * Description:
+ *     simulation side of the stream. Creates (or replaces) the segment on
+ * construction and unlinks it on destruction.
+ */
+class SpikeStreamWriter {
+public:
+  SpikeStreamWriter(std::string shm_name, const spike_stream_pop *pops,
+                    uint32_t num_pops);
+  ~SpikeStreamWriter();
+
+  /*
+   * Description:
+   *     encodes and publishes one frame. spikes[i] holds the spikes of pops[i]
+   * as given to the constructor. Never blocks.
+   */
+  void publish(uint32_t trial, uint32_t ts, float cr,
+               const uint8_t *const *spikes);
+
+  void set_state(enum spike_stream_state state);
+  uint32_t get_num_slots() const { return header->num_slots; }
+
+private:
+  std::string shm_name;
+  spike_stream_header *header = NULL;
+  uint64_t segment_bytes = 0;
+  uint64_t num_published = 0;
+  uint8_t *pack_buf = NULL; // scratch space for one bit-packed population
+};
+
+/*
+ * Description:
+ *     reader side of the stream. Attaches to an existing segment; exits with a
+ * fatal log if it does not exist or is from a different version.
+ */
+class SpikeStreamReader {
+public:
+  SpikeStreamReader(std::string shm_name);
+  ~SpikeStreamReader();
+
+  /*
+   * Description:
+   *     copies the next frame (header and population blocks) into frame_buf,
+   * which must hold at least get_slot_bytes() bytes. Returns false if there is
+   * no new frame yet. If the writer lapped us, skips ahead to the oldest frame
+   * still in the ring and adds the skipped frames to get_dropped().
+   */
+  bool next(uint8_t *frame_buf);
+
+  /*
+   * Description:
+   *     decodes population pop_index of a frame copied by next into
+   * num_cells bytes of 0/1 spikes. Returns false if there is no such block.
+   */
+  static bool unpack(const uint8_t *frame_buf, uint32_t pop_index,
+                     uint8_t *spikes);
+
+  uint32_t get_slot_bytes() const { return header->slot_bytes; }
+  const spike_stream_header *get_header() const { return header; }
+  enum spike_stream_state get_state() const;
+  uint64_t get_dropped() const { return dropped; }
+
+private:
+  spike_stream_header *header = NULL;
+  uint64_t segment_bytes = 0;
+  uint64_t next_number = 1;
+  uint64_t dropped = 0;
+};
+
+#endif /* SPIKE_STREAM_H_ */
@@ -0,0 +1,231 @@
+#include <cstdio>
+#include <fstream>
+#include <omp.h>
+#include <sstream>
+#include <sys/resource.h> // getrusage (POSIX ONLY)
+#include <sys/time.h>     // gettimeofday (POSIX ONLY)
+#include <unistd.h>       // sysconf (POSIX ONLY)
+
+#include "json.hpp"
+#include "logger.h"
+#include "status_file.h"
+
+using json = nlohmann::json;
+
+typedef struct {
+  uint64_t rss_bytes;
+  uint64_t peak_rss_bytes;
+  uint64_t io_written_bytes; // handed to write() by this process
+  uint64_t io_backlog_bytes; // dirty or under writeback, machine-wide
+} process_usage;
+
+static double unix_time() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+/*
+ * Implementation Notes:
+ *     the kernel does not say how much of one process's output is still
+ * waiting to reach storage (write_bytes in /proc/self/io is counted when a
+ * page is dirtied, not when it is written back), so the backlog is the
+ * machine's dirty and writeback page cache from /proc/meminfo. On a node
+ * running one simulation that is, to a good approximation, the simulation's
+ * own output.
+ */
+static process_usage read_process_usage() {
+  process_usage usage = {};
+  long page_bytes = sysconf(_SC_PAGESIZE);
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size_pages, resident_pages;
+  if (statm >> size_pages >> resident_pages)
+    usage.rss_bytes = resident_pages * page_bytes;
+
+  struct rusage rusage;
+  if (getrusage(RUSAGE_SELF, &rusage) == 0)
+    usage.peak_rss_bytes = (uint64_t)rusage.ru_maxrss * 1024;
+
+  std::ifstream io("/proc/self/io");
+  std::string key;
+  uint64_t value;
+  while (io >> key >> value) {
+    if (key == "wchar:")
+      usage.io_written_bytes = value;
+  }
+
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while (std::getline(meminfo, line)) {
+    std::stringstream fields(line);
+    fields >> key >> value;
+    if (key == "Dirty:" || key == "Writeback:")
+      usage.io_backlog_bytes += value * 1024;
+  }
+  return usage;
+}
+
+static std::string to_json(const run_status &status,
+                           const process_usage &usage,
+                           const std::string &run_name) {
+  json out = {{"run", run_name},
+              {"state", status.state},
+              {"trials_done", status.trials_done},
+              {"num_trials", status.num_trials},
+              {"trial_name", status.trial_name},
+              {"elapsed_s", status.elapsed_s},
+              {"last_trial_s", status.last_trial_s},
+              {"avg_trial_s", status.avg_trial_s},
+              {"sim_ms_per_s", status.sim_ms_per_s},
+              {"eta_s", status.eta_s},
+              {"rss_bytes", usage.rss_bytes},
+              {"peak_rss_bytes", usage.peak_rss_bytes},
+              {"io_written_bytes", usage.io_written_bytes},
+              {"io_backlog_bytes", usage.io_backlog_bytes},
+              {"updated_unix", status.updated_unix}};
+  return out.dump(3) + "\n";
+}
+
+static void prom_metric(std::stringstream &out, const std::string &run_name,
+                        const char *name, const char *help, double value) {
+  out << "# HELP cbm_sim_" << name << " " << help << "\n";
+  out << "# TYPE cbm_sim_" << name << " gauge\n";
+  out << "cbm_sim_" << name << "{run=\"" << run_name << "\"} " << value << "\n";
+}
+
+static std::string to_prometheus(const run_status &status,
+                                 const process_usage &usage,
+                                 const std::string &run_name) {
+  std::stringstream out;
+  out.precision(12);
+  out << "# HELP cbm_sim_state Current state of the run (1 for the current "
+         "state).\n";
+  out << "# TYPE cbm_sim_state gauge\n";
+  out << "cbm_sim_state{run=\"" << run_name << "\",state=\"" << status.state
+      << "\"} 1\n";
+  prom_metric(out, run_name, "trials_done", "Trials completed.",
+              status.trials_done);
+  prom_metric(out, run_name, "trials_total", "Trials in the session.",
+              status.num_trials);
+  prom_metric(out, run_name, "trial_seconds_avg",
+              "Moving average of trial wall time.", status.avg_trial_s);
+  prom_metric(out, run_name, "sim_ms_per_second",
+              "Simulated ms per wall second over the last trial.",
+              status.sim_ms_per_s);
+  prom_metric(out, run_name, "eta_seconds",
+              "Estimated wall time until the last trial ends.", status.eta_s);
+  prom_metric(out, run_name, "rss_bytes", "Resident set size.",
+              usage.rss_bytes);
+  prom_metric(out, run_name, "peak_rss_bytes", "Peak resident set size.",
+              usage.peak_rss_bytes);
+  prom_metric(out, run_name, "io_written_bytes",
+              "Bytes handed to write() by the run.", usage.io_written_bytes);
+  prom_metric(out, run_name, "io_backlog_bytes",
+              "Dirty and writeback page cache of the machine.",
+              usage.io_backlog_bytes);
+  prom_metric(out, run_name, "last_update_timestamp_seconds",
+              "Unix time of the last status update.", status.updated_unix);
+  return out.str();
+}
+
+StatusReporter::StatusReporter(std::string paths, std::string run_name,
+                               uint32_t num_trials, uint32_t trial_ms)
+    : run_name(run_name), trial_ms(trial_ms) {
+  std::stringstream path_buf(paths);
+  std::string path;
+  while (std::getline(path_buf, path, ','))
+    if (!path.empty())
+      this->paths.push_back(path);
+  start_time = omp_get_wtime();
+  status.state = "starting";
+  status.trials_done = 0;
+  status.num_trials = num_trials;
+  status.elapsed_s = 0.0;
+  status.last_trial_s = 0.0;
+  status.avg_trial_s = 0.0;
+  status.sim_ms_per_s = 0.0;
+  status.eta_s = 0.0;
+  writer = std::thread(&StatusReporter::write_loop, this);
+  publish();
+}
+
+StatusReporter::~StatusReporter() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+}
+
+void StatusReporter::set_state(std::string state) {
+  status.state = state;
+  publish();
+}
+
+void StatusReporter::trial_done(const std::string &trial_name,
+                                double trial_s) {
+  recent_trial_s[status.trials_done % STATUS_AVG_TRIALS] = trial_s;
+  status.trials_done++;
+  uint32_t num_recent = (status.trials_done < STATUS_AVG_TRIALS)
+                            ? status.trials_done
+                            : STATUS_AVG_TRIALS;
+  double recent_sum = 0.0;
+  for (uint32_t i = 0; i < num_recent; i++)
+    recent_sum += recent_trial_s[i];
+  status.state = "running";
+  status.trial_name = trial_name;
+  status.last_trial_s = trial_s;
+  status.avg_trial_s = recent_sum / num_recent;
+  status.sim_ms_per_s = (trial_s > 0.0) ? trial_ms / trial_s : 0.0;
+  uint32_t remaining = (status.num_trials > status.trials_done)
+                           ? status.num_trials - status.trials_done
+                           : 0;
+  status.eta_s = remaining * status.avg_trial_s;
+  publish();
+}
+
+void StatusReporter::publish() {
+  status.elapsed_s = omp_get_wtime() - start_time;
+  status.updated_unix = unix_time();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    pending = status;
+    has_pending = true;
+  }
+  wake.notify_one();
+}
+
+void StatusReporter::write_loop() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard, [this] { return has_pending || stopping; });
+    if (has_pending) {
+      run_status to_write = pending;
+      has_pending = false;
+      guard.unlock();
+      write_files(to_write);
+      guard.lock();
+    } else if (stopping) {
+      return;
+    }
+  }
+}
+
+void StatusReporter::write_files(const run_status &to_write) {
+  process_usage usage = read_process_usage();
+  for (const std::string &path : paths) {
+    bool prom = path.size() >= 5 && path.substr(path.size() - 5) == ".prom";
+    std::string tmp_path = path + ".tmp";
+    std::ofstream out_buf(tmp_path, std::ios::trunc);
+    if (!out_buf.is_open()) {
+      LOG_WARN("Couldn't write status file '%s'.", tmp_path.c_str());
+      continue;
+    }
+    out_buf << (prom ? to_prometheus(to_write, usage, run_name)
+                     : to_json(to_write, usage, run_name));
+    out_buf.close();
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+      LOG_WARN("Couldn't replace status file '%s'.", path.c_str());
+  }
+}
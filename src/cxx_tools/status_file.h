@@ -0,0 +1,85 @@
+/*
+ * File: status_file.h
+ *
+ * Description:
+ *     This is the interface file for run status files: a small file, rewritten
+ * at every trial boundary, from which a batch scheduler can read a session's
+ * progress (trials done, simulated ms per wall second, moving-average trial
+ * time, ETA), its memory use and its I/O backlog, and spot a stall from the
+ * age of the last update.
+ *
+ *     A status path ending in '.prom' is written in the Prometheus textfile
+ * collector format; any other path gets json. Every file is replaced
+ * atomically (written to PATH.tmp, then renamed), so readers never see a
+ * partial file. Files are written from a background thread, so that a slow
+ * filesystem never holds up the simulation: if updates arrive faster than
+ * they can be written, only the latest is written.
+ */
+#ifndef STATUS_FILE_H_
+#define STATUS_FILE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// trials in the moving average of trial wall time
+const uint32_t STATUS_AVG_TRIALS = 10;
+
+typedef struct {
+  std::string state; // starting, running, saving, done, terminated, unhealthy
+  uint32_t trials_done;
+  uint32_t num_trials;
+  std::string trial_name; // last completed trial
+  double elapsed_s;       // since the session started
+  double last_trial_s;
+  double avg_trial_s; // over the last STATUS_AVG_TRIALS trials
+  double sim_ms_per_s;
+  double eta_s;
+  double updated_unix; // wall clock time of the update
+} run_status;
+
+class StatusReporter {
+public:
+  /*
+   * Description:
+   *     paths is a comma-separated list of status files. trial_ms is the
+   * simulated length of a trial.
+   */
+  StatusReporter(std::string paths, std::string run_name, uint32_t num_trials,
+                 uint32_t trial_ms);
+
+  /*
+   * Description:
+   *     writes the last update, if still pending, and stops the writer.
+   */
+  ~StatusReporter();
+
+  void set_state(std::string state);
+  void trial_done(const std::string &trial_name, double trial_s);
+
+private:
+  void publish();
+  void write_loop();
+  void write_files(const run_status &status);
+
+  std::vector<std::string> paths;
+  std::string run_name;
+  uint32_t trial_ms;
+  double start_time;
+
+  run_status status;
+  double recent_trial_s[STATUS_AVG_TRIALS];
+
+  // guard the pending update handed to the writer thread
+  std::mutex lock;
+  std::condition_variable wake;
+  run_status pending;
+  bool has_pending = false;
+  bool stopping = false;
+  std::thread writer;
+};
+
+#endif /* STATUS_FILE_H_ */
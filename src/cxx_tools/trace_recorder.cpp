@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "json.hpp"
+#include "logger.h"
+#include "trace_recorder.h"
+
+using json = nlohmann::json;
+
+// the most bytes a LEB128 varint of a uint64_t takes
+const uint32_t MAX_VARINT_BYTES = 10;
+
+static bool load_cells(const json &value, uint32_t num_cells,
+                       trace_spec &spec) {
+  spec.cells.clear();
+  spec.all_cells = false;
+  if (value.is_array()) {
+    for (const json &cell : value) {
+      if (!cell.is_number_unsigned() || cell.get<uint32_t>() >= num_cells)
+        return false;
+      spec.cells.push_back(cell.get<uint32_t>());
+    }
+    std::sort(spec.cells.begin(), spec.cells.end());
+    spec.cells.erase(std::unique(spec.cells.begin(), spec.cells.end()),
+                     spec.cells.end());
+  } else if (value.is_object() && value.size() == 1 &&
+             value.contains("every") && value["every"].is_number_unsigned() &&
+             value["every"].get<uint32_t>() > 0) {
+    uint32_t every = value["every"].get<uint32_t>();
+    for (uint32_t cell = 0; cell < num_cells; cell += every)
+      spec.cells.push_back(cell);
+  } else if (value.is_object() && value.size() == 1 &&
+             value.contains("range") && value["range"].is_array() &&
+             value["range"].size() == 2 &&
+             value["range"][0].is_number_unsigned() &&
+             value["range"][1].is_number_unsigned()) {
+    uint32_t first = value["range"][0].get<uint32_t>();
+    uint32_t end = value["range"][1].get<uint32_t>();
+    if (first >= end || end > num_cells)
+      return false;
+    for (uint32_t cell = first; cell < end; cell++)
+      spec.cells.push_back(cell);
+  } else {
+    return false;
+  }
+  return !spec.cells.empty();
+}
+
+/*
+ * Implementation Notes:
+ *     the populations and variables are taken in the order of the file, and
+ * the traces are then sorted by population and variable, so that the order
+ * of the traces in the output does not depend on how the file was written.
+ */
+bool load_trace_config(std::string path, const uint32_t *num_cells,
+                       const std::string *pop_ids, trace_config &cfg) {
+  std::ifstream in_buf(path);
+  if (!in_buf.is_open()) {
+    LOG_ERROR("Couldn't open trace file '%s'.", path.c_str());
+    return false;
+  }
+  json file = json::parse(in_buf, nullptr, false);
+  if (file.is_discarded() || !file.is_object()) {
+    LOG_ERROR("Trace file '%s' is not a json object.", path.c_str());
+    return false;
+  }
+  cfg.every_ms = 1.0f;
+  cfg.encoding = TRACE_F16;
+  cfg.quantum = 0.01f;
+  cfg.block_samples = 1000;
+  cfg.traces.clear();
+  for (auto &entry : file.items()) {
+    const std::string &key = entry.key();
+    const json &value = entry.value();
+    bool valid = true;
+    if (key == "every_ms") {
+      valid = value.is_number() && value.get<float>() > 0.0f;
+      if (valid)
+        cfg.every_ms = value.get<float>();
+    } else if (key == "encoding" && value.is_string()) {
+      if (value == "f32")
+        cfg.encoding = TRACE_F32;
+      else if (value == "f16")
+        cfg.encoding = TRACE_F16;
+      else if (value == "delta")
+        cfg.encoding = TRACE_DELTA;
+      else
+        valid = false;
+    } else if (key == "quantum") {
+      valid = value.is_number() && value.get<float>() > 0.0f;
+      if (valid)
+        cfg.quantum = value.get<float>();
+    } else if (key == "block_samples") {
+      valid = value.is_number_unsigned() && value.get<uint32_t>() > 0;
+      if (valid)
+        cfg.block_samples = value.get<uint32_t>();
+    } else if (key == "pops" && value.is_object()) {
+      for (auto &pop_entry : value.items()) {
+        uint32_t pop = 0;
+        while (pop < TRACE_NUM_POPS && pop_ids[pop] != pop_entry.key())
+          pop++;
+        const json &pop_cfg = pop_entry.value();
+        trace_spec spec;
+        spec.pop = pop;
+        spec.all_cells = true;
+        valid = pop < TRACE_NUM_POPS && !TRACE_VAR_IDS[pop][0].empty() &&
+                pop_cfg.is_object();
+        for (auto &pop_key : pop_cfg.items()) {
+          if (!valid)
+            break;
+          if (pop_key.key() == "cells")
+            valid = load_cells(pop_key.value(), num_cells[pop], spec);
+          else if (pop_key.key() != "vars" || !pop_key.value().is_array())
+            valid = false;
+        }
+        std::vector<uint32_t> vars;
+        if (valid && pop_cfg.contains("vars")) {
+          for (const json &var_id : pop_cfg["vars"]) {
+            uint32_t var = 0;
+            while (var < TRACE_NUM_VARS &&
+                   (!var_id.is_string() || TRACE_VAR_IDS[pop][var].empty() ||
+                    TRACE_VAR_IDS[pop][var] != var_id.get<std::string>()))
+              var++;
+            valid &= var < TRACE_NUM_VARS &&
+                     std::find(vars.begin(), vars.end(), var) == vars.end();
+            if (valid)
+              vars.push_back(var);
+          }
+          valid &= !vars.empty();
+        } else {
+          vars.push_back(0);
+        }
+        if (!valid) {
+          LOG_ERROR("Invalid trace of '%s' in trace file '%s'.",
+                    pop_entry.key().c_str(), path.c_str());
+          return false;
+        }
+        for (uint32_t var : vars) {
+          spec.var = var;
+          cfg.traces.push_back(spec);
+        }
+      }
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      LOG_ERROR("Invalid or unknown entry '%s' in trace file '%s'.",
+                key.c_str(), path.c_str());
+      return false;
+    }
+  }
+  if (cfg.traces.empty()) {
+    LOG_ERROR("Trace file '%s' traces no population.", path.c_str());
+    return false;
+  }
+  std::sort(cfg.traces.begin(), cfg.traces.end(),
+            [](const trace_spec &a, const trace_spec &b) {
+              return a.pop != b.pop ? a.pop < b.pop : a.var < b.var;
+            });
+  return true;
+}
+
+/*
+ * Implementation Notes:
+ *     rounds to nearest even, as the F16C conversion does, but without it, so
+ * that the recorder builds for any host. Values beyond the half range become
+ * infinities; NaNs stay NaNs.
+ */
+static inline uint16_t float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000u;
+  uint32_t exp = (bits >> 23) & 0xFFu;
+  uint32_t mant = bits & 0x7FFFFFu;
+  if (exp == 0xFFu)
+    return sign | 0x7C00u | (mant ? 0x200u : 0);
+  int32_t half_exp = (int32_t)exp - 127 + 15;
+  if (half_exp >= 0x1F)
+    return sign | 0x7C00u;
+  if (half_exp <= 0) {
+    if (half_exp < -10)
+      return sign;
+    mant |= 0x800000u;
+    uint32_t shift = 14 - half_exp;
+    uint32_t half = mant >> shift;
+    uint32_t rest = mant & ((1u << shift) - 1);
+    uint32_t mid = 1u << (shift - 1);
+    if (rest > mid || (rest == mid && (half & 1u)))
+      half++;
+    return sign | half;
+  }
+  // a carry out of the mantissa rounds up into the exponent, as it should
+  uint32_t half = sign | ((uint32_t)half_exp << 10) | (mant >> 13);
+  uint32_t rest = mant & 0x1FFFu;
+  if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+    half++;
+  return half;
+}
+
+float trace_half_to_float(uint16_t half) {
+  uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+  uint32_t exp = (half >> 10) & 0x1Fu;
+  uint32_t mant = half & 0x3FFu;
+  uint32_t bits;
+  if (exp == 0x1Fu) {
+    bits = sign | 0x7F800000u | (mant << 13);
+  } else if (exp != 0) {
+    bits = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+  } else if (mant == 0) {
+    bits = sign;
+  } else {
+    // a subnormal half is a normal float
+    exp = 127 - 14;
+    while (!(mant & 0x400u)) {
+      mant <<= 1;
+      exp--;
+    }
+    bits = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static inline int32_t quantize(float value, double inv_quantum) {
+  if (!std::isfinite(value))
+    return INT32_MIN;
+  double q = std::nearbyint((double)value * inv_quantum);
+  q = std::min(std::max(q, (double)INT32_MIN + 1), (double)INT32_MAX);
+  return (int32_t)q;
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint64_t val) {
+  while (val >= 0x80) {
+    *out++ = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  *out++ = (uint8_t)val;
+  return out;
+}
+
+TraceRecorder::TraceRecorder(std::string out_file_name, trace_config cfg,
+                             const uint32_t *num_cells, float ms_per_step)
+    : cfg(cfg) {
+  every_steps =
+      std::max(1u, (uint32_t)std::lround(cfg.every_ms / ms_per_step));
+  for (trace_spec &spec : this->cfg.traces) {
+    if (spec.all_cells) {
+      spec.cells.resize(num_cells[spec.pop]);
+      for (uint32_t i = 0; i < num_cells[spec.pop]; i++)
+        spec.cells[i] = i;
+    }
+    frame_len += spec.cells.size();
+  }
+  for (uint32_t i = 0; i < 2; i++)
+    raw_blocks[i].resize(frame_len * cfg.block_samples);
+  uint64_t max_value_bytes = sizeof(float);
+  if (cfg.encoding == TRACE_DELTA)
+    max_value_bytes = MAX_VARINT_BYTES;
+  encoded.resize(sizeof(trace_block_header) + frame_len * sizeof(int32_t) +
+                 frame_len * cfg.block_samples * max_value_bytes);
+
+  trace_file_header head = {};
+  memcpy(head.magic, TRACE_MAGIC, sizeof(head.magic));
+  head.version = TRACE_VERSION;
+  head.encoding = cfg.encoding;
+  head.num_traces = cfg.traces.size();
+  head.ms_per_step = ms_per_step;
+  head.every_steps = every_steps;
+  head.quantum = cfg.quantum;
+  head.block_samples = cfg.block_samples;
+  if (writer.open(out_file_name)) {
+    DirectOutBuf &out_buf = writer.out();
+    out_buf.sputn((const char *)&head, sizeof(head));
+    for (const trace_spec &spec : this->cfg.traces) {
+      trace_desc desc = {spec.pop, spec.var, (uint32_t)spec.cells.size(), 0};
+      out_buf.sputn((const char *)&desc, sizeof(desc));
+      out_buf.sputn((const char *)spec.cells.data(),
+                    spec.cells.size() * sizeof(uint32_t));
+    }
+  }
+  writer.start([this](uint32_t slot) { return encode_block(slot); });
+}
+
+TraceRecorder::~TraceRecorder() {
+  end_block();
+  if (!writer.stop())
+    LOG_ERROR("Could not write every trace block.");
+  LOG_INFO("Recorded %lu trace blocks (%0.1fMB).", writer.chunks_written(),
+           writer.bytes_written() / (1024.0 * 1024.0));
+}
+
+void TraceRecorder::record(uint32_t trial, uint32_t ts,
+                           const float *const *values) {
+  if (cur_samples > 0 && trial != cur_trial)
+    end_block();
+  if (cur_samples == 0) {
+    cur_block = writer.acquire();
+    block_heads[cur_block] = {};
+    block_heads[cur_block].trial = trial;
+    block_heads[cur_block].first_ts = ts;
+    cur_trial = trial;
+  }
+  float *frame = raw_blocks[cur_block].data() + cur_samples * frame_len;
+  for (uint32_t i = 0; i < cfg.traces.size(); i++) {
+    const trace_spec &spec = cfg.traces[i];
+    uint64_t num = spec.cells.size();
+    if (spec.all_cells || gathered(i)) {
+      memcpy(frame, values[i], num * sizeof(float));
+    } else {
+      const float *pop_values = values[i];
+      const uint32_t *cells = spec.cells.data();
+      for (uint64_t j = 0; j < num; j++)
+        frame[j] = pop_values[cells[j]];
+    }
+    frame += num;
+  }
+  if (++cur_samples == cfg.block_samples)
+    end_block();
+}
+
+void TraceRecorder::end_block() {
+  if (cur_samples == 0)
+    return;
+  block_heads[cur_block].num_samples = cur_samples;
+  writer.submit();
+  cur_samples = 0;
+}
+
+/*
+ * Implementation Notes:
+ *     the raw block is sample-major, as it was filled; the encoded one is
+ * cell-major, so that the samples of a cell are neighbours, which is what
+ * makes their differences small. The encoded copy is what gets written, so
+ * the raw block is given back as soon as it is encoded.
+ */
+dbw_chunk TraceRecorder::encode_block(uint32_t slot) {
+  trace_block_header &head = block_heads[slot];
+  const float *raw = raw_blocks[slot].data();
+  uint32_t num_samples = head.num_samples;
+  uint8_t *body = encoded.data() + sizeof(trace_block_header);
+  uint8_t *out = body;
+  double inv_quantum = 1.0 / cfg.quantum;
+  for (uint64_t col = 0; col < frame_len; col++) {
+    const float *cell = raw + col;
+    if (cfg.encoding == TRACE_F32) {
+      for (uint32_t k = 0; k < num_samples; k++) {
+        memcpy(out, &cell[k * frame_len], sizeof(float));
+        out += sizeof(float);
+      }
+    } else if (cfg.encoding == TRACE_F16) {
+      for (uint32_t k = 0; k < num_samples; k++) {
+        uint16_t half = float_to_half(cell[k * frame_len]);
+        memcpy(out, &half, sizeof(half));
+        out += sizeof(half);
+      }
+    } else {
+      int32_t prev = quantize(cell[0], inv_quantum);
+      memcpy(out, &prev, sizeof(prev));
+      out += sizeof(prev);
+      for (uint32_t k = 1; k < num_samples; k++) {
+        int32_t q = quantize(cell[k * frame_len], inv_quantum);
+        int64_t diff = (int64_t)q - prev;
+        out = put_varint(out, ((uint64_t)diff << 1) ^ (uint64_t)(diff >> 63));
+        prev = q;
+      }
+    }
+  }
+  head.body_bytes = out - body;
+  memcpy(encoded.data(), &head, sizeof(head));
+  return {encoded.data(), sizeof(trace_block_header) + head.body_bytes, true};
+}
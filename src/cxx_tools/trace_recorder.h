@@ -0,0 +1,207 @@
+/*
+ * File: trace_recorder.h
+ *
+ * Description:
+ *     This is the interface file for the trace recorder, which records
+ * membrane potentials and conductances of any population, or of a subset of
+ * its cells, over a whole session. Values are sampled every every_ms and
+ * gathered into blocks of samples; a helper thread encodes each full block
+ * and writes it to OUTPUT_BASE.vtr, so that the step only pays for the
+ * gather. Blocks end at trial boundaries, so a block never spans two trials.
+ * Encodings:
+ *
+ *     f32   - the floats as they are
+ *     f16   - IEEE half floats, rounded to nearest even: 2 bytes a value, with
+ *             about 3 significant digits (0.03mV at -65mV)
+ *     delta - each value rounded to a multiple of quantum, and stored per cell
+ *             as the difference to its previous sample, a zigzag LEB128 varint
+ *             (see con_edges.h); the error is at most quantum / 2, and most
+ *             samples of a slowly changing value take 1 byte
+ *
+ *     The configuration is a json file:
+ *
+ *     {
+ *       "every_ms": 1,
+ *       "encoding": "delta",          "f32", "f16" or "delta"
+ *       "quantum": 0.01,              for "delta", in the unit of the values
+ *       "block_samples": 1000,        samples per block, at most
+ *       "pops": {
+ *         "PC": { "vars": ["vm", "g_pf", "g_bc"] },
+ *         "GR": { "cells": { "every": 1000 } },
+ *         "GO": { "cells": [0, 1, 2, 3], "vars": ["vm", "g_gr"] },
+ *         "NC": {}
+ *       }
+ *     }
+ *
+ *     "cells" is a list of cells, { "every": N } for every N-th cell from 0,
+ * or { "range": [first, end) }; all cells if left out. "vars" defaults to
+ * ["vm"]; the variables of each population are in TRACE_VAR_IDS. Every
+ * variable of a population is recorded for the same cells.
+ *
+ *     File layout: a trace_file_header, then for each of its num_traces
+ * traces a trace_desc followed by num_cells uint32 cell ids, then blocks.
+ * Each block is a trace_block_header followed by body_bytes holding, for each
+ * trace, for each of its cells, the cell's num_samples samples:
+ *
+ *     f32   - num_samples floats
+ *     f16   - num_samples uint16 halves (see trace_half_to_float)
+ *     delta - int32 q of the first sample, then num_samples - 1 varints of
+ *             zigzag(q[k] - q[k - 1]); the value is q * quantum. A non-finite
+ *             value is stored as q = INT32_MIN
+ *
+ *     Sample k of a block was taken at ts first_ts + k * every_steps.
+ */
+#ifndef TRACE_RECORDER_H_
+#define TRACE_RECORDER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "double_buf_writer.h"
+
+const char TRACE_MAGIC[4] = {'C', 'B', 'M', 'V'};
+const uint32_t TRACE_VERSION = 1;
+const uint32_t TRACE_NUM_POPS = 8; // MF, GR, GO, BC, SC, PC, IO, NC
+const uint32_t TRACE_GR = 1;       // the population kept on the device
+const uint32_t TRACE_NUM_VARS = 3;
+
+/*
+ * the variables a population can be traced by, indexed by population and
+ * variable id; "" where there is none. Variable 0 is the membrane potential.
+ */
+const std::string TRACE_VAR_IDS[TRACE_NUM_POPS][TRACE_NUM_VARS] = {
+    {"", "", ""},          {"vm", "g_e", "g_i"}, {"vm", "g_mf", "g_gr"},
+    {"vm", "", ""},        {"vm", "", ""},       {"vm", "g_pf", "g_bc"},
+    {"vm", "", ""},        {"vm", "", ""}};
+
+enum trace_encoding { TRACE_F32, TRACE_F16, TRACE_DELTA };
+
+typedef struct {
+  uint32_t pop;
+  uint32_t var;
+  std::vector<uint32_t> cells; // ascending
+  bool all_cells;
+} trace_spec;
+
+typedef struct {
+  float every_ms;
+  enum trace_encoding encoding;
+  float quantum;
+  uint32_t block_samples;
+  std::vector<trace_spec> traces; // by population, then variable
+} trace_config;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t encoding;
+  uint32_t num_traces;
+  float ms_per_step;
+  uint32_t every_steps;
+  float quantum;
+  uint32_t block_samples;
+} trace_file_header;
+
+typedef struct {
+  uint32_t pop;
+  uint32_t var;
+  uint32_t num_cells;
+  uint32_t reserved;
+} trace_desc;
+
+typedef struct {
+  uint32_t trial; // counted from 0
+  uint32_t first_ts;
+  uint32_t num_samples;
+  uint32_t reserved;
+  uint64_t body_bytes;
+} trace_block_header;
+
+/*
+ * Description:
+ *     fills cfg from the json file at path. num_cells and pop_ids are indexed
+ * by population in the order above. Returns false, after logging why, if the
+ * file is missing or malformed, or traces nothing.
+ */
+bool load_trace_config(std::string path, const uint32_t *num_cells,
+                       const std::string *pop_ids, trace_config &cfg);
+
+/*
+ * Description:
+ *     the float a half from an f16 trace stands for.
+ */
+float trace_half_to_float(uint16_t half);
+
+class TraceRecorder {
+public:
+  /*
+   * Description:
+   *     opens out_file_name, writes the header and the trace descriptions,
+   * and sizes every buffer. num_cells is indexed by population.
+   */
+  TraceRecorder(std::string out_file_name, trace_config cfg,
+                const uint32_t *num_cells, float ms_per_step);
+
+  /*
+   * Description:
+   *     writes the block being filled and every block still waiting, and
+   * closes the file.
+   */
+  ~TraceRecorder();
+
+  /*
+   * Description:
+   *     whether a sample is taken at time step ts of a trial.
+   */
+  bool sample_due(uint32_t ts) const { return ts % every_steps == 0; }
+
+  /*
+   * Description:
+   *     whether trace i is handed over already gathered to its cells, in
+   * order (a gr subset, gathered on the device), rather than as the whole
+   * population.
+   */
+  bool gathered(uint32_t i) const {
+    return cfg.traces[i].pop == TRACE_GR && !cfg.traces[i].all_cells;
+  }
+
+  /*
+   * Description:
+   *     appends the sample of time step ts. values[i] holds trace i's
+   * population, or its cells only if gathered(i). Hands the block to the
+   * helper thread once it is full.
+   */
+  void record(uint32_t trial, uint32_t ts, const float *const *values);
+
+  /*
+   * Description:
+   *     hands the block being filled to the helper thread, at the end of a
+   * trial or session.
+   */
+  void end_block();
+
+  const trace_config &config() const { return cfg; }
+
+private:
+  dbw_chunk encode_block(uint32_t slot);
+
+  trace_config cfg;
+  uint32_t every_steps;
+  uint64_t frame_len = 0; // values per sample, over all traces
+
+  // blocks of raw samples, sample-major; the helper thread owns a block
+  // while it is busy
+  std::vector<float> raw_blocks[2];
+  trace_block_header block_heads[2];
+  uint32_t cur_block = 0;
+  uint32_t cur_samples = 0;
+  uint32_t cur_trial = 0;
+
+  // the encoded block, helper thread only
+  std::vector<uint8_t> encoded;
+
+  DoubleBufWriter writer;
+};
+
+#endif /* TRACE_RECORDER_H_ */
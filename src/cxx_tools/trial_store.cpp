@@ -0,0 +1,256 @@
+#include <cstring>
+
+#include "logger.h"
+#include "trial_store.h"
+
+/*
+ * Implementation Notes:
+ *     the index key packs the population id into the upper 32 bits and the
+ * trial number into the lower 32 bits.
+ */
+static inline uint64_t trial_store_key(uint32_t pop_id, uint32_t trial) {
+  return ((uint64_t)pop_id << 32) | trial;
+}
+
+/*
+ * Implementation Notes:
+ *     the file is truncated on open: a trial store belongs to exactly one
+ * session, and the output directory is freshly created for every session.
+ */
+TrialStoreWriter::TrialStoreWriter(std::string out_file_name) {
+  if (!out_file.open(out_file_name)) {
+    LOG_FATAL("Couldn't open '%s' for writing. Exiting...",
+              out_file_name.c_str());
+    exit(-1);
+  }
+  trial_store_header header;
+  memcpy(header.magic, TRIAL_STORE_MAGIC, sizeof(header.magic));
+  header.version = TRIAL_STORE_VERSION;
+  header.reserved = 0;
+  out_buf.write((const char *)&header, sizeof(header));
+  write_offset = sizeof(header);
+}
+
+TrialStoreWriter::~TrialStoreWriter() {
+  if (!pending.empty())
+    commit();
+  out_file.close();
+}
+
+void TrialStoreWriter::append_chunk(uint32_t pop_id, uint32_t trial,
+                                    const void *data, uint64_t num_rows,
+                                    uint64_t num_cols, uint32_t elem_size) {
+  trial_store_chunk_header chunk_header = {
+      TRIAL_STORE_CHUNK_MAGIC, pop_id, trial, elem_size, num_rows, num_cols};
+  out_buf.write((const char *)&chunk_header, sizeof(chunk_header));
+  write_offset += sizeof(chunk_header);
+
+  trial_store_entry entry = {pop_id,       trial,    elem_size, 0,
+                             write_offset, num_rows, num_cols};
+  out_buf.write((const char *)data, trial_store_entry_bytes(entry));
+  write_offset += trial_store_entry_bytes(entry);
+  pending.push_back(entry);
+}
+
+/*
+ * Implementation Notes:
+ *     the trailer is written last and in a single call so that a reader which
+ * catches the file mid-commit sees either the previous trailer's bytes at the
+ * end of the file (not yet extended) or a trailer whose magic does not check
+ * out, in which case it falls back to a forward scan. The zero padding that
+ * the flush briefly leaves after the trailer under O_DIRECT reads as the
+ * latter.
+ */
+void TrialStoreWriter::commit() {
+  if (pending.empty())
+    return;
+  uint64_t index_offset = write_offset;
+  trial_store_index_header index_header = {
+      TRIAL_STORE_INDEX_MAGIC, (uint32_t)pending.size(), last_index_offset};
+  out_buf.write((const char *)&index_header, sizeof(index_header));
+  out_buf.write((const char *)pending.data(),
+                pending.size() * sizeof(trial_store_entry));
+  write_offset +=
+      sizeof(index_header) + pending.size() * sizeof(trial_store_entry);
+
+  total_entries += pending.size();
+  trial_store_trailer trailer;
+  trailer.index_offset = index_offset;
+  trailer.total_entries = total_entries;
+  memcpy(trailer.magic, TRIAL_STORE_TRAILER_MAGIC, sizeof(trailer.magic));
+  out_buf.write((const char *)&trailer, sizeof(trailer));
+  write_offset += sizeof(trailer);
+  out_buf.flush();
+
+  last_index_offset = index_offset;
+  pending.clear();
+}
+
+TrialStoreReader::TrialStoreReader(std::string in_file_name)
+    : file_name(in_file_name) {
+  if (!refresh()) {
+    LOG_ERROR("Could not load trial store '%s'.", in_file_name.c_str());
+  }
+}
+
+TrialStoreReader::~TrialStoreReader() {
+  if (in_buf.is_open())
+    in_buf.close();
+}
+
+/*
+ * Implementation Notes:
+ *     the stream is re-opened on every refresh so that the reported file size
+ * reflects everything the writer has flushed since the last call.
+ */
+bool TrialStoreReader::refresh() {
+  if (in_buf.is_open())
+    in_buf.close();
+  in_buf.open(file_name.c_str(), std::ios::in | std::ios::binary);
+  if (!in_buf.is_open())
+    return false;
+
+  in_buf.seekg(0, std::ios::end);
+  uint64_t file_size = in_buf.tellg();
+  in_buf.seekg(0, std::ios::beg);
+
+  trial_store_header header;
+  if (file_size < sizeof(header))
+    return false;
+  in_buf.read((char *)&header, sizeof(header));
+  if (memcmp(header.magic, TRIAL_STORE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRIAL_STORE_VERSION) {
+    LOG_ERROR("'%s' is not a version %u trial store.", file_name.c_str(),
+              TRIAL_STORE_VERSION);
+    return false;
+  }
+
+  index.clear();
+  if (!load_index_from_trailer(file_size)) {
+    LOG_DEBUG("No valid trailer in '%s': scanning chunks instead.",
+              file_name.c_str());
+    index.clear();
+    load_index_by_scan(file_size);
+  }
+  return true;
+}
+
+/*
+ * Implementation Notes:
+ *     walks the chain of index blocks from the most recent one backwards. Any
+ * inconsistency (bad magic, offsets past the end of the file, a count that
+ * does not match the trailer) causes the caller to fall back to a scan.
+ */
+bool TrialStoreReader::load_index_from_trailer(uint64_t file_size) {
+  trial_store_trailer trailer;
+  if (file_size < sizeof(trial_store_header) + sizeof(trailer))
+    return false;
+  in_buf.clear();
+  in_buf.seekg(file_size - sizeof(trailer), std::ios::beg);
+  in_buf.read((char *)&trailer, sizeof(trailer));
+  if (!in_buf || memcmp(trailer.magic, TRIAL_STORE_TRAILER_MAGIC,
+                        sizeof(trailer.magic)) != 0)
+    return false;
+
+  uint64_t index_offset = trailer.index_offset;
+  uint64_t entries_read = 0;
+  std::vector<trial_store_entry> block;
+  while (index_offset != 0) {
+    trial_store_index_header index_header;
+    if (index_offset + sizeof(index_header) > file_size)
+      return false;
+    in_buf.seekg(index_offset, std::ios::beg);
+    in_buf.read((char *)&index_header, sizeof(index_header));
+    if (!in_buf || index_header.magic != TRIAL_STORE_INDEX_MAGIC ||
+        index_header.prev_index_offset >= index_offset)
+      return false;
+    block.resize(index_header.num_entries);
+    in_buf.read((char *)block.data(),
+                index_header.num_entries * sizeof(trial_store_entry));
+    if (!in_buf)
+      return false;
+    for (const trial_store_entry &entry : block) {
+      if (entry.offset + trial_store_entry_bytes(entry) > index_offset)
+        return false;
+      insert_entry(entry);
+    }
+    entries_read += index_header.num_entries;
+    index_offset = index_header.prev_index_offset;
+  }
+  return entries_read == trailer.total_entries;
+}
+
+/*
+ * Implementation Notes:
+ *     recovery path: chunks and index blocks both begin with a 4-byte magic, so
+ * we hop from record to record until we reach a record that is truncated or
+ * unrecognized. Only chunks whose payload lies entirely within the file are
+ * indexed.
+ */
+void TrialStoreReader::load_index_by_scan(uint64_t file_size) {
+  uint64_t offset = sizeof(trial_store_header);
+  while (offset + sizeof(uint32_t) <= file_size) {
+    uint32_t magic;
+    in_buf.clear();
+    in_buf.seekg(offset, std::ios::beg);
+    in_buf.read((char *)&magic, sizeof(magic));
+    if (!in_buf)
+      break;
+    if (magic == TRIAL_STORE_CHUNK_MAGIC) {
+      trial_store_chunk_header chunk_header;
+      if (offset + sizeof(chunk_header) > file_size)
+        break;
+      in_buf.seekg(offset, std::ios::beg);
+      in_buf.read((char *)&chunk_header, sizeof(chunk_header));
+      trial_store_entry entry = {chunk_header.pop_id,
+                                 chunk_header.trial,
+                                 chunk_header.elem_size,
+                                 0,
+                                 offset + sizeof(chunk_header),
+                                 chunk_header.num_rows,
+                                 chunk_header.num_cols};
+      if (entry.offset + trial_store_entry_bytes(entry) > file_size)
+        break;
+      insert_entry(entry);
+      offset = entry.offset + trial_store_entry_bytes(entry);
+    } else if (magic == TRIAL_STORE_INDEX_MAGIC) {
+      trial_store_index_header index_header;
+      if (offset + sizeof(index_header) > file_size)
+        break;
+      in_buf.seekg(offset, std::ios::beg);
+      in_buf.read((char *)&index_header, sizeof(index_header));
+      offset += sizeof(index_header) +
+                index_header.num_entries * sizeof(trial_store_entry) +
+                sizeof(trial_store_trailer);
+    } else {
+      break;
+    }
+  }
+}
+
+void TrialStoreReader::insert_entry(const trial_store_entry &entry) {
+  index[trial_store_key(entry.pop_id, entry.trial)] = entry;
+}
+
+const trial_store_entry *TrialStoreReader::find(uint32_t pop_id,
+                                                uint32_t trial) const {
+  auto it = index.find(trial_store_key(pop_id, trial));
+  return (it != index.end()) ? &it->second : NULL;
+}
+
+bool TrialStoreReader::read_chunk(uint32_t pop_id, uint32_t trial, void *dst) {
+  const trial_store_entry *entry = find(pop_id, trial);
+  if (!entry)
+    return false;
+  in_buf.clear();
+  in_buf.seekg(entry->offset, std::ios::beg);
+  in_buf.read((char *)dst, trial_store_entry_bytes(*entry));
+  return (bool)in_buf;
+}
+
+uint32_t TrialStoreReader::num_trials(uint32_t pop_id) const {
+  uint32_t trial = 0;
+  while (find(pop_id, trial))
+    trial++;
+  return trial;
+}
@@ -0,0 +1,183 @@
+/*
+ * File: trial_store.h
+ *
+ * Description:
+ *     This is the interface file for the chunked trial store, a single-file
+ * container for time-series session outputs (rasters for now). Each
+ * (population, trial) pair is written as its own chunk, appended to the end of
+ * the file as soon as the trial finishes. After every batch of chunks the
+ * writer appends an index block and a fixed-size trailer, so the last bytes of
+ * the file always locate the most recent index. The on-disk layout is:
+ *
+ *     [file header][chunk][chunk]...[index block][trailer]
+ *                  [chunk][chunk]...[index block][trailer] ...
+ *
+ * where each index block only lists the chunks written since the previous one
+ * and points back at its predecessor. A reader walks this chain once on open
+ * (or refresh) and afterwards can seek to any (population, trial) chunk in
+ * O(1). Because nothing is ever overwritten, readers may open the store while
+ * a session is still running: they simply see every trial committed so far.
+ * If the trailer is missing or torn (the writer crashed or is mid-commit) the
+ * reader falls back to scanning the chunk headers from the front of the file.
+ *
+ *     All integers are written in host byte order.
+ */
+#ifndef TRIAL_STORE_H_
+#define TRIAL_STORE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "direct_out.h"
+
+const char TRIAL_STORE_MAGIC[8] = {'C', 'B', 'M', 'T', 'R', 'S', '0', '1'};
+const char TRIAL_STORE_TRAILER_MAGIC[8] = {'C', 'B', 'M', 'T',
+                                           'R', 'S', 'I', 'X'};
+const uint32_t TRIAL_STORE_VERSION = 1;
+const uint32_t TRIAL_STORE_CHUNK_MAGIC = 0x4B4E4843;  // "CHNK"
+const uint32_t TRIAL_STORE_INDEX_MAGIC = 0x58444954;  // "TIDX"
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+} trial_store_header;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t pop_id;
+  uint32_t trial;
+  uint32_t elem_size;
+  uint64_t num_rows;
+  uint64_t num_cols;
+} trial_store_chunk_header;
+
+/* one index entry per chunk: offset points at the payload, not the header */
+typedef struct {
+  uint32_t pop_id;
+  uint32_t trial;
+  uint32_t elem_size;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t num_rows;
+  uint64_t num_cols;
+} trial_store_entry;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t num_entries;
+  uint64_t prev_index_offset; // 0 if this is the first index block
+} trial_store_index_header;
+
+typedef struct {
+  uint64_t index_offset;
+  uint64_t total_entries;
+  char magic[8];
+} trial_store_trailer;
+
+/*
+ * Description:
+ *     returns the number of payload bytes described by the given entry.
+ */
+inline uint64_t trial_store_entry_bytes(const trial_store_entry &entry) {
+  return entry.num_rows * entry.num_cols * entry.elem_size;
+}
+
+/*
+ * Description:
+ *     append-only writer for the trial store. Chunks are appended with
+ * append_chunk and become visible to readers once commit is called. The
+ * destructor commits any chunks that have not yet been committed.
+ */
+class TrialStoreWriter {
+public:
+  TrialStoreWriter(std::string out_file_name);
+  ~TrialStoreWriter();
+
+  /*
+   * Description:
+   *     appends num_rows * num_cols elements of elem_size bytes, starting at
+   * data, as the chunk for (pop_id, trial). data is expected to be contiguous.
+   */
+  void append_chunk(uint32_t pop_id, uint32_t trial, const void *data,
+                    uint64_t num_rows, uint64_t num_cols, uint32_t elem_size);
+
+  /*
+   * Description:
+   *     writes an index block for all chunks appended since the previous
+   * commit, followed by a trailer, and flushes the file so that concurrent
+   * readers can see the new chunks.
+   */
+  void commit();
+
+  uint64_t get_total_entries() const { return total_entries; }
+
+private:
+  DirectOutBuf out_file;
+  std::ostream out_buf{&out_file};
+  uint64_t write_offset = 0;
+  uint64_t last_index_offset = 0;
+  uint64_t total_entries = 0;
+  std::vector<trial_store_entry> pending;
+};
+
+/*
+ * Description:
+ *     read-only view of a trial store. The index is loaded on construction and
+ * may be reloaded with refresh to pick up trials committed after the store was
+ * opened.
+ */
+class TrialStoreReader {
+public:
+  TrialStoreReader(std::string in_file_name);
+  ~TrialStoreReader();
+
+  /*
+   * Description:
+   *     reloads the index from the end of the file. Returns false if the file
+   * could not be read or is not a trial store.
+   */
+  bool refresh();
+
+  /*
+   * Description:
+   *     returns a pointer to the index entry for (pop_id, trial), or NULL if no
+   * such chunk has been committed.
+   */
+  const trial_store_entry *find(uint32_t pop_id, uint32_t trial) const;
+
+  /*
+   * Description:
+   *     copies the payload for (pop_id, trial) into dst, which must be at least
+   * trial_store_entry_bytes(*find(pop_id, trial)) bytes long. Returns false if
+   * the chunk does not exist or could not be read.
+   */
+  bool read_chunk(uint32_t pop_id, uint32_t trial, void *dst);
+
+  /*
+   * Description:
+   *     returns the number of chunks the reader currently knows about.
+   */
+  uint64_t num_entries() const { return index.size(); }
+
+  /*
+   * Description:
+   *     returns the number of consecutive trials, starting at trial 0, that
+   * are available for the given population.
+   */
+  uint32_t num_trials(uint32_t pop_id) const;
+
+private:
+  std::string file_name;
+  std::ifstream in_buf;
+  std::unordered_map<uint64_t, trial_store_entry> index;
+
+  bool load_index_from_trailer(uint64_t file_size);
+  void load_index_by_scan(uint64_t file_size);
+  void insert_entry(const trial_store_entry &entry);
+};
+
+#endif /* TRIAL_STORE_H_ */
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cstring>
+
+#include "json.hpp"
+#include "logger.h"
+#include "weight_stats.h"
+
+using json = nlohmann::json;
+
+static bool load_tracked(const json &value, uint32_t num_syns,
+                         std::vector<uint32_t> &tracked) {
+  tracked.clear();
+  if (value.is_array()) {
+    for (const json &syn : value) {
+      if (!syn.is_number_unsigned() || syn.get<uint32_t>() >= num_syns)
+        return false;
+      tracked.push_back(syn.get<uint32_t>());
+    }
+    std::sort(tracked.begin(), tracked.end());
+    tracked.erase(std::unique(tracked.begin(), tracked.end()), tracked.end());
+    return true;
+  }
+  if (!value.is_object() || value.size() != 1 || !value.contains("every") ||
+      !value["every"].is_number_unsigned() ||
+      value["every"].get<uint32_t>() == 0)
+    return false;
+  uint32_t every = value["every"].get<uint32_t>();
+  for (uint32_t syn = 0; syn < num_syns; syn += every)
+    tracked.push_back(syn);
+  return true;
+}
+
+static bool load_class(const json &value, uint32_t num_syns,
+                       weight_class_config &cls) {
+  if (!value.is_object())
+    return false;
+  cls.on = true;
+  for (auto &entry : value.items()) {
+    const json &param = entry.value();
+    if (entry.key() == "bounds" && param.is_array() && param.size() == 2 &&
+        param[0].is_number() && param[1].is_number() &&
+        param[0].get<float>() < param[1].get<float>()) {
+      cls.low = param[0].get<float>();
+      cls.high = param[1].get<float>();
+    } else if (entry.key() != "track" ||
+               !load_tracked(param, num_syns, cls.tracked)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool load_weight_stats_config(std::string path, const uint32_t *num_syns,
+                              weight_stats_config &cfg) {
+  std::ifstream in_buf(path);
+  if (!in_buf.is_open()) {
+    LOG_ERROR("Couldn't open weight statistics file '%s'.", path.c_str());
+    return false;
+  }
+  json file = json::parse(in_buf, nullptr, false);
+  if (file.is_discarded() || !file.is_object()) {
+    LOG_ERROR("Weight statistics file '%s' is not a json object.",
+              path.c_str());
+    return false;
+  }
+  for (uint32_t i = 0; i < WEIGHT_NUM_CLASSES; i++) {
+    cfg.classes[i].on = false;
+    cfg.classes[i].tracked.clear();
+  }
+  for (auto &entry : file.items()) {
+    const std::string &key = entry.key();
+    const json &value = entry.value();
+    uint32_t cls = 0;
+    while (cls < WEIGHT_NUM_CLASSES && WEIGHT_CLASS_IDS[cls] != key)
+      cls++;
+    bool valid = true;
+    if (key == "every_trials" && value.is_number_unsigned() &&
+        value.get<uint32_t>() > 0) {
+      cfg.every_trials = value.get<uint32_t>();
+    } else if (key == "bins" && value.is_number_unsigned() &&
+               value.get<uint32_t>() > 0 &&
+               value.get<uint32_t>() <= WEIGHT_MAX_BINS) {
+      cfg.num_bins = value.get<uint32_t>();
+    } else if (cls < WEIGHT_NUM_CLASSES) {
+      valid = load_class(value, num_syns[cls], cfg.classes[cls]);
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      LOG_ERROR("Invalid or unknown entry '%s' in weight statistics file "
+                "'%s'.",
+                key.c_str(), path.c_str());
+      return false;
+    }
+  }
+  if (!cfg.classes[WEIGHT_PFPC].on && !cfg.classes[WEIGHT_MFNC].on) {
+    LOG_ERROR("Weight statistics file '%s' logs neither 'PFPC' nor 'MFNC'.",
+              path.c_str());
+    return false;
+  }
+  return true;
+}
+
+WeightStats::WeightStats(std::string out_file_name, weight_stats_config cfg,
+                         const uint32_t *num_syns,
+                         const uint32_t *syns_per_post,
+                         const uint32_t *num_states)
+    : cfg(cfg) {
+  out_buf.open(out_file_name.c_str(),
+               std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out_buf.is_open()) {
+    LOG_FATAL("Couldn't open '%s' for writing. Exiting...",
+              out_file_name.c_str());
+    exit(-1);
+  }
+  weight_stats_header head = {};
+  memcpy(head.magic, WEIGHT_STATS_MAGIC, sizeof(head.magic));
+  head.version = WEIGHT_STATS_VERSION;
+  head.num_bins = cfg.num_bins;
+  uint64_t body_bytes = 0;
+  for (uint32_t i = 0; i < WEIGHT_NUM_CLASSES; i++) {
+    const weight_class_config &cls = cfg.classes[i];
+    descs[i] = {i,
+                num_syns[i],
+                num_syns[i] / syns_per_post[i],
+                syns_per_post[i],
+                std::min(num_states[i], WEIGHT_MAX_STATES),
+                (uint32_t)cls.tracked.size(),
+                cls.low,
+                cls.high};
+    if (!cls.on)
+      continue;
+    head.class_mask |= 1 << i;
+    body_bytes += 4 * sizeof(float) +
+                  (cfg.num_bins + descs[i].num_posts + descs[i].num_states +
+                   descs[i].num_tracked) *
+                      sizeof(uint32_t);
+  }
+  body.resize(body_bytes);
+  out_buf.write((const char *)&head, sizeof(head));
+  for (uint32_t i = 0; i < WEIGHT_NUM_CLASSES; i++) {
+    if (!cfg.classes[i].on)
+      continue;
+    out_buf.write((const char *)&descs[i], sizeof(descs[i]));
+    out_buf.write((const char *)cfg.classes[i].tracked.data(),
+                  descs[i].num_tracked * sizeof(uint32_t));
+  }
+  out_buf.flush();
+}
+
+WeightStats::~WeightStats() {
+  out_buf.close();
+  LOG_INFO("Logged the weight statistics of %lu trials.", num_records);
+}
+
+void WeightStats::record(uint32_t trial, const float *const *weights,
+                         const uint8_t *const *states) {
+  uint8_t *out = body.data();
+  for (uint32_t i = 0; i < WEIGHT_NUM_CLASSES; i++) {
+    if (cfg.classes[i].on)
+      out = summarize(i, weights[i], states[i], out);
+  }
+  weight_stats_record rec = {trial, 0, (uint64_t)(out - body.data())};
+  out_buf.write((const char *)&rec, sizeof(rec));
+  out_buf.write((const char *)body.data(), rec.body_bytes);
+  out_buf.flush();
+  num_records++;
+}
+
+/*
+ * Implementation Notes:
+ *     the synapses onto a post-synaptic cell are contiguous, so the cells are
+ * shared out among the threads, and each thread keeps its own histogram
+ * until the reduction. A weight counts as at a bound within a millionth of
+ * the bounds' span, so that float rounding in the plasticity rules does not
+ * hide it. Sums are taken in double, as over a million synapses float would
+ * lose the small weights.
+ */
+uint8_t *WeightStats::summarize(uint32_t cls, const float *weights,
+                                const uint8_t *states, uint8_t *out) {
+  const weight_class_desc &desc = descs[cls];
+  uint32_t num_bins = cfg.num_bins;
+  uint32_t num_posts = desc.num_posts;
+  uint32_t per_post = desc.syns_per_post;
+  float *head = (float *)out;
+  uint32_t *hist = (uint32_t *)(head + 4);
+  float *post_means = (float *)(hist + num_bins);
+  uint32_t *state_counts = (uint32_t *)(post_means + num_posts);
+  float *tracked = (float *)(state_counts + desc.num_states);
+  memset(hist, 0, num_bins * sizeof(uint32_t));
+  memset(state_counts, 0, desc.num_states * sizeof(uint32_t));
+
+  float low = desc.low;
+  float high = desc.high;
+  float tol = 1e-6f * (high - low);
+  float scale = num_bins / (high - low);
+  float last_bin = num_bins - 1;
+  double sum = 0.0;
+  uint64_t num_low = 0;
+  uint64_t num_high = 0;
+#pragma omp parallel for schedule(static)                                     \
+    reduction(+ : sum, num_low, num_high) reduction(+ : hist[:num_bins])
+  for (uint32_t i = 0; i < num_posts; i++) {
+    const float *post_weights = weights + (uint64_t)i * per_post;
+    double post_sum = 0.0;
+    for (uint32_t j = 0; j < per_post; j++) {
+      float weight = post_weights[j];
+      post_sum += weight;
+      num_low += weight <= low + tol;
+      num_high += weight >= high - tol;
+      // NaNs and weights below low fall in the first bin
+      float bin = (weight - low) * scale;
+      hist[bin > 0.0f ? (uint32_t)std::min(bin, last_bin) : 0]++;
+    }
+    post_means[i] = post_sum / per_post;
+    sum += post_sum;
+  }
+  if (desc.num_states > 0 && states) {
+    uint32_t num_states = desc.num_states;
+    uint8_t last_state = num_states - 1;
+#pragma omp parallel for schedule(static)                                     \
+    reduction(+ : state_counts[:num_states])
+    for (uint32_t i = 0; i < desc.num_syns; i++)
+      state_counts[std::min(states[i], last_state)]++;
+  }
+  head[0] = sum / desc.num_syns;
+  head[1] = (double)num_low / desc.num_syns;
+  head[2] = (double)num_high / desc.num_syns;
+  head[3] = 0.0f;
+
+  const std::vector<uint32_t> &tracked_ids = cfg.classes[cls].tracked;
+  for (uint32_t i = 0; i < desc.num_tracked; i++)
+    tracked[i] = weights[tracked_ids[i]];
+  return (uint8_t *)(tracked + desc.num_tracked);
+}
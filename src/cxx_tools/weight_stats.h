@@ -0,0 +1,157 @@
+/*
+ * File: weight_stats.h
+ *
+ * Description:
+ *     This is the interface file for the weight statistics log, which follows
+ * learning over a session without dumping every weight every trial. At the
+ * end of every every_trials-th trial it summarizes the pf -> pc and mf -> nc
+ * weights and appends one record to OUTPUT_BASE.wst:
+ *
+ *     - a histogram of the weights over [low, high], values outside the
+ *       bounds counted in the end bins
+ *     - the mean weight, and the mean weight onto each post-synaptic cell
+ *     - the fractions of weights at the low and the high bound
+ *     - the number of synapses in each cascade state, for pf -> pc under a
+ *       cascade plasticity rule
+ *     - the weights of a chosen subset of synapses, traced in full
+ *
+ *     The summaries are taken in parallel over the post-synaptic cells.
+ * Records are small (a few KB) and flushed as written, so that the log can
+ * be read while the session goes on.
+ *
+ *     The configuration is a json file; a synapse class is logged if its
+ * entry is given, and every entry within it is optional:
+ *
+ *     {
+ *       "every_trials": 1,
+ *       "bins": 64,
+ *       "PFPC": { "bounds": [0, 1], "track": [0, 17, 4096] },
+ *       "MFNC": { "track": { "every": 100 } }
+ *     }
+ *
+ *     "bounds" defaults to the bounds of the class's plasticity rule. "track"
+ * is a list of synapses, or { "every": N } for every N-th synapse from 0: a
+ * pf -> pc synapse is numbered by its granule, an mf -> nc synapse by
+ * nc * num_p_nc_from_mf_to_nc + its index among the nc's inputs.
+ *
+ *     File layout: a weight_stats_header, then for each logged class a
+ * weight_class_desc followed by num_tracked uint32 synapse ids, then records.
+ * Each record is a weight_stats_record followed by body_bytes holding, for
+ * each logged class, in the order of WEIGHT_CLASS_IDS:
+ *
+ *     float mean, frac_low, frac_high, reserved
+ *     num_bins uint32 counts, bin k covering low + [k, k + 1) * width
+ *     num_posts floats, the mean weight onto each post-synaptic cell
+ *     num_states uint32 counts, the synapses in each cascade state
+ *     num_tracked floats, the weights of the tracked synapses
+ */
+#ifndef WEIGHT_STATS_H_
+#define WEIGHT_STATS_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+const char WEIGHT_STATS_MAGIC[4] = {'C', 'B', 'M', 'W'};
+const uint32_t WEIGHT_STATS_VERSION = 1;
+const uint32_t WEIGHT_NUM_CLASSES = 2;
+const uint32_t WEIGHT_PFPC = 0;
+const uint32_t WEIGHT_MFNC = 1;
+const std::string WEIGHT_CLASS_IDS[WEIGHT_NUM_CLASSES] = {"PFPC", "MFNC"};
+const uint32_t WEIGHT_MAX_STATES = 8; // of the cascade rules
+const uint32_t WEIGHT_MAX_BINS = 4096;
+
+typedef struct {
+  bool on;
+  float low;
+  float high;
+  std::vector<uint32_t> tracked; // ascending
+} weight_class_config;
+
+typedef struct {
+  uint32_t every_trials;
+  uint32_t num_bins;
+  weight_class_config classes[WEIGHT_NUM_CLASSES];
+} weight_stats_config;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_bins;
+  uint32_t class_mask; // bit i: class i is logged
+} weight_stats_header;
+
+typedef struct {
+  uint32_t cls;
+  uint32_t num_syns;
+  uint32_t num_posts;
+  uint32_t syns_per_post;
+  uint32_t num_states; // 0 without a cascade rule
+  uint32_t num_tracked;
+  float low;
+  float high;
+} weight_class_desc;
+
+typedef struct {
+  uint32_t trial; // counted from 0
+  uint32_t reserved;
+  uint64_t body_bytes;
+} weight_stats_record;
+
+/*
+ * Description:
+ *     fills cfg from the json file at path, keeping the bounds cfg already
+ * has for a class that leaves them out. num_syns is indexed by class. Returns
+ * false, after logging why, if the file is missing or malformed, or logs no
+ * class.
+ */
+bool load_weight_stats_config(std::string path, const uint32_t *num_syns,
+                              weight_stats_config &cfg);
+
+class WeightStats {
+public:
+  /*
+   * Description:
+   *     opens out_file_name and writes the header and the class descriptions.
+   * Indexed by class: num_syns synapses, syns_per_post of them onto each
+   * post-synaptic cell, in order, and num_states cascade states (0 for none).
+   */
+  WeightStats(std::string out_file_name, weight_stats_config cfg,
+              const uint32_t *num_syns, const uint32_t *syns_per_post,
+              const uint32_t *num_states);
+
+  ~WeightStats();
+
+  /*
+   * Description:
+   *     whether the trial that just ended is logged.
+   */
+  bool due(uint32_t trial) const {
+    return (trial + 1) % cfg.every_trials == 0;
+  }
+
+  /*
+   * Description:
+   *     appends the record of the trial that just ended. weights and states
+   * are indexed by class; states[i] may be NULL if class i has no states, or
+   * is not logged, as may weights[i] if class i is not logged.
+   */
+  void record(uint32_t trial, const float *const *weights,
+              const uint8_t *const *states);
+
+private:
+  uint8_t *summarize(uint32_t cls, const float *weights, const uint8_t *states,
+                     uint8_t *out);
+
+  weight_stats_config cfg;
+  weight_class_desc descs[WEIGHT_NUM_CLASSES];
+  uint64_t num_records = 0;
+
+  // the body of a record, sized for the largest
+  std::vector<uint8_t> body;
+
+  std::fstream out_buf;
+};
+
+#endif /* WEIGHT_STATS_H_ */
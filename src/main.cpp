@@ -14,6 +14,7 @@
 #include <omp.h>
 #include <time.h>
 
+#include "autotune.h"
 #include "commandline.h"
 #include "control.h"
 #include "file_parse.h"
@@ -32,14 +33,16 @@ int main(int argc, char **argv) {
   parsed_commandline p_cl = {};
   parse_and_validate_parsed_commandline(&argc, &argv, p_cl);
 
+  // loading a sim in run mode replaces this with the machine's tuned config
+  apply_autotune_config(DEFAULT_AUTOTUNE_CONFIG);
   Control control(p_cl);
   int exit_status = 0;
 
-  omp_set_num_threads(1); /* for 4 gpus, 8 is the sweet spot. Unsure for 2. */
-
   if (p_cl.vis_mode == "TUI") {
     if (!p_cl.session_file.empty()) {
       control.runSession(NULL); // saving is done at the end of runSession.
+      if (control.health_failed)
+        exit_status = HEALTH_FAILED_EXIT_STATUS;
     } else if (!p_cl.output_basename.empty()) {
       control.build_sim();
       control.save_sim_to_file();
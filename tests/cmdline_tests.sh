@@ -1,7 +1,7 @@
 #!/usr/bin/bash
 
 # globals
-root_dir="/home/seang/Dev/Git/CbmSim/"
+root_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/"
 data_in_dir="${root_dir}data/inputs/"
 data_out_dir="${root_dir}data/outputs/"
 build_dir="${root_dir}build/"
@@ -28,9 +28,34 @@ declare -A psth_exts=( \
 passed_tests=0
 num_tests=
 
+# runs a command that has to be refused, and checks both its exit status and
+# its fatal message
+# usage: expect_fatal CASE_NUM STATUS MESSAGE COMMAND...
+expect_fatal() {
+	local case_num=$1
+	local status=$2
+	local msg=$3
+	shift 3
+	local err
+	err="$( { "$@" > /dev/null; } 2>&1 )"
+	local ret=$?
+	if [ $ret -ne $status ]
+	then
+		printf "TEST CASE ${case_num} \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: expected exit status ${status}, got ${ret}\n"
+	elif ! [[ $err =~ "$msg" ]]
+	then
+		printf "TEST CASE ${case_num} \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: expected message \"${msg}\"\n"
+	else
+		printf "TEST CASE ${case_num} \e[1;32mPASSED\e[0m\n"
+		(( passed_tests++ ))
+	fi
+}
+
 if [ $# -eq 0 ]; then
 	printf "Running all tests...\n"
-	num_tests=59
+	num_tests=95
 elif [ $# -eq 1 ]; then
 	if [ "$1" == "build" ]; then
 		printf "Running only build-mode tests...\n"
@@ -41,6 +66,12 @@ elif [ $# -eq 1 ]; then
 	elif [ "$1" == "connect" ]; then
 		printf "Running only connectivity-mode tests...\n"
 		num_tests=9
+	elif [ "$1" == "options" ]; then
+		printf "Running only option validation tests...\n"
+		num_tests=33
+	elif [ "$1" == "tools" ]; then
+		printf "Running only tool tests...\n"
+		num_tests=3
 	fi
 fi
 
@@ -859,6 +890,148 @@ if [[ $# -eq 0 || ( $# -eq 1 && "$1" == "connect" ) ]]; then
 	fi
 fi
 
+if [[ $# -eq 0 || ( $# -eq 1 && "$1" == "options" ) ]]; then
+	# workflow 3 test cases: validating the options added on top of the three
+	# workflows above. Every case here must be refused before anything runs
+	workflow_3_basename="WORKFLOW_3_INPUT"
+	workflow_3_input="${workflow_3_basename}.sim"
+	if [ -e "${data_out_dir}${workflow_3_basename}/${workflow_3_input}" ]; then
+		printf "workflow 3 input sim found. No need to generate a new one...\n"
+	else
+		printf "Generating simulation for workflow 3 test cases...\n"
+		$binary -b $build_file -o $workflow_3_basename
+	fi
+	act_params_file="TEST_ACT_PARAMS.json"
+	printf "{}\n" > "${data_in_dir}${act_params_file}"
+
+	## invalid test cases, any mode
+	expect_fatal 60 8 "'--edges' needs the connectivity arrays to save, given with '-c'. Exiting..." \
+		$binary -o TEST_CASE_60 --edges
+	expect_fatal 61 7 "Invalid seed 'abc': expected a non-negative integer below 10^9. Exiting..." \
+		$binary -o TEST_CASE_61 -e abc
+	expect_fatal 62 1 "Mutually exclusive arguments '--retune' and '--no-tune' found. Exiting..." \
+		$binary -o TEST_CASE_62 --retune --no-tune
+
+	## invalid test cases, build mode
+	expect_fatal 63 7 "A closed-loop mailbox can only be used in run mode. Exiting..." \
+		$binary -o TEST_CASE_63 -l TEST_BOX
+	expect_fatal 64 7 "Spikes can only be streamed in run mode. Exiting..." \
+		$binary -o TEST_CASE_64 -m PC
+	expect_fatal 65 7 "Golden traces can only be recorded in run mode. Exiting..." \
+		$binary -o TEST_CASE_65 -t hash
+	expect_fatal 66 7 "Status files can only be written in run mode. Exiting..." \
+		$binary -o TEST_CASE_66 -u status.json
+	expect_fatal 67 7 "Parameter files can only be watched in run mode. Exiting..." \
+		$binary -o TEST_CASE_67 -a $act_params_file
+	expect_fatal 68 7 "Health checks can only be run in run mode. Exiting..." \
+		$binary -o TEST_CASE_68 -k health.json
+	expect_fatal 69 7 "Sessions can only be stopped early in run mode. Exiting..." \
+		$binary -o TEST_CASE_69 -x convergence.json
+	expect_fatal 70 7 "Runs can only be checkpointed and replayed in run mode. Exiting..." \
+		$binary -o TEST_CASE_70 -n 5
+	expect_fatal 71 7 "Runs can only be checkpointed and replayed in run mode. Exiting..." \
+		$binary -o TEST_CASE_71 -y TEST_RUN:3
+	expect_fatal 72 7 "Events can only be recorded in run mode. Exiting..." \
+		$binary -o TEST_CASE_72 -g events.json
+	expect_fatal 73 7 "Traces can only be recorded in run mode. Exiting..." \
+		$binary -o TEST_CASE_73 -d traces.json
+	expect_fatal 74 7 "Weight statistics can only be logged in run mode. Exiting..." \
+		$binary -o TEST_CASE_74 -f weight_stats.json
+
+	## invalid test cases, connectivity collect mode
+	expect_fatal 75 7 "'--procedural' can only be given in build mode: a sim file records how it was built. Exiting..." \
+		$binary -i $workflow_3_input -o TEST_CASE_75 -c MFGR --procedural
+	expect_fatal 76 7 "'--thin' has no effect in connectivity collect mode, where no sim file is saved. Exiting..." \
+		$binary -i $workflow_3_input -o TEST_CASE_76 -c MFGR --thin
+
+	## invalid test cases, run mode
+	expect_fatal 77 7 "'--procedural' can only be given in build mode: a sim file records how it was built. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_77 --procedural
+	expect_fatal 78 7 "'--lockstep' requires a closed-loop mailbox (-l). Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_78 --lockstep
+	expect_fatal 79 7 "Closed-loop mailbox name 'TEST/BOX' may not contain '/'. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_79 -l TEST/BOX
+	expect_fatal 80 7 "Invalid trace mode 'all': expected 'hash' or 'full'. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_80 -t all
+	expect_fatal 81 11 "Could not find health check file 'TEST_MISSING.json'. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_81 -k TEST_MISSING.json
+	expect_fatal 82 7 "Invalid checkpoint interval '0': expected a positive number of trials. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_82 -n 0
+	expect_fatal 83 7 "A run driven from outside ('-l', '-a') cannot be replayed, so it can neither be checkpointed nor be a replay. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_83 -n 5 -l TEST_BOX
+	expect_fatal 84 7 "A run driven from outside ('-l', '-a') cannot be replayed, so it can neither be checkpointed nor be a replay. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_84 -n 5 -a $act_params_file
+	expect_fatal 85 7 "A replay starts from a checkpoint of the run it replays, so '-i' may not be given with '-y'. Exiting..." \
+		$binary -i $workflow_3_input -s $sess_file -o TEST_CASE_85 -y TEST_RUN:3
+	expect_fatal 86 7 "Invalid replay 'TEST_RUN': expected RUN:K, with K the number of the trial to re-simulate, counted from 1. Exiting..." \
+		$binary -s $sess_file -o TEST_CASE_86 -y TEST_RUN
+	expect_fatal 87 7 "A replay runs up to its trial and no further, so it neither saves checkpoints ('-n') nor stops early ('-x'). Exiting..." \
+		$binary -s $sess_file -o TEST_CASE_87 -y TEST_RUN:3 -n 5
+	expect_fatal 88 7 "A replay runs up to its trial and no further, so it neither saves checkpoints ('-n') nor stops early ('-x'). Exiting..." \
+		$binary -s $sess_file -o TEST_CASE_88 -y TEST_RUN:3 -x convergence.json
+	expect_fatal 89 7 "A run driven from outside ('-l', '-a') cannot be replayed, so it can neither be checkpointed nor be a replay. Exiting..." \
+		$binary -s $sess_file -o TEST_CASE_89 -y TEST_RUN:3 -l TEST_BOX
+	expect_fatal 90 7 "Replays run in visual mode 'TUI' only. Exiting..." \
+		$binary -v GUI -s $sess_file -o TEST_CASE_90 -y TEST_RUN:3
+	expect_fatal 91 7 "Event-triggered recording runs in visual mode 'TUI' only. Exiting..." \
+		$binary -v GUI -i $workflow_3_input -s $sess_file -o TEST_CASE_91 -g events.json
+	expect_fatal 92 7 "Trace recording runs in visual mode 'TUI' only. Exiting..." \
+		$binary -v GUI -i $workflow_3_input -s $sess_file -o TEST_CASE_92 -d traces.json
+
+	rm -f "${data_in_dir}${act_params_file}"
+fi
+
+if [[ $# -eq 0 || ( $# -eq 1 && "$1" == "tools" ) ]]; then
+	# tool checks, against the tools built with 'make tools'
+	alloc_check="${build_dir}alloc_check"
+	edge_check="${build_dir}edge_check"
+	workflow_3_basename="WORKFLOW_3_INPUT"
+	workflow_3_input="${workflow_3_basename}.sim"
+	if ! [ -e "${data_out_dir}${workflow_3_basename}/${workflow_3_input}" ]; then
+		printf "Generating simulation for tool test cases...\n"
+		$binary -b $build_file -o $workflow_3_basename
+	fi
+
+	if ! [ -x "$alloc_check" ]
+	then
+		printf "TEST CASE 93 \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: '${alloc_check}' was not found. Run 'make tools' first\n"
+	elif ! $alloc_check > /dev/null 2>&1
+	then
+		printf "TEST CASE 93 \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: a time step of a built simulation allocated memory\n"
+	else
+		printf "TEST CASE 93 \e[1;32mPASSED\e[0m\n"
+		(( passed_tests++ ))
+	fi
+
+	if ! [ -x "$alloc_check" ]
+	then
+		printf "TEST CASE 94 \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: '${alloc_check}' was not found. Run 'make tools' first\n"
+	elif ! $alloc_check -i "${data_out_dir}${workflow_3_basename}/${workflow_3_input}" > /dev/null 2>&1
+	then
+		printf "TEST CASE 94 \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: a time step of a loaded simulation allocated memory\n"
+	else
+		printf "TEST CASE 94 \e[1;32mPASSED\e[0m\n"
+		(( passed_tests++ ))
+	fi
+
+	if ! [ -x "$edge_check" ]
+	then
+		printf "TEST CASE 95 \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: '${edge_check}' was not found. Run 'make tools' first\n"
+	elif ! $edge_check -i "${data_out_dir}${workflow_3_basename}/${workflow_3_input}" > /dev/null 2>&1
+	then
+		printf "TEST CASE 95 \e[1;31mFAILED\e[0m\n"
+		printf "\tREASON: the edge lists of a loaded simulation did not load back as saved\n"
+	else
+		printf "TEST CASE 95 \e[1;32mPASSED\e[0m\n"
+		(( passed_tests++ ))
+	fi
+fi
+
 if [ $# -eq 0 ]; then
 	printf "All tests finished.\n"
 elif [ $# -eq 1 ];then
@@ -868,6 +1041,10 @@ elif [ $# -eq 1 ];then
 		printf "Run-mode tests finished.\n"
 	elif [ "$1" == "connect" ]; then
 		printf "Connectivity-mode tests finished.\n"
+	elif [ "$1" == "options" ]; then
+		printf "Option validation tests finished.\n"
+	elif [ "$1" == "tools" ]; then
+		printf "Tool tests finished.\n"
 	fi
 fi
 
@@ -0,0 +1,338 @@
+/*
+ * File: alloc_check.cpp
+ *
+ * Description:
+ *     Checks that a time step allocates nothing once a simulation is set up.
+ * The tool replaces malloc, calloc, realloc, the aligned allocators and
+ * operator new for the whole process, then drives a simulation through the
+ * library (see src/cbm_api/cbmsim.h) in two stretches:
+ *
+ *     warm-up - allocations are allowed. First uses allocate once and for all
+ *               (the OpenMP thread pool, the lazy setup of the CUDA runtime,
+ *               stdio buffers, the helper thread of the health monitor).
+ *     checked - every allocation, on any thread, is counted.
+ *
+ *     Every step runs calcActivity and then the per-step recorders that a
+ * session may turn on: the golden trace, the spike stream, the health
+ * monitor (inline and on its helper thread, checking every step), the event
+ * recorder (every population, triggered by any golgi spike so that windows
+ * are committed and written during the checked steps), the trace recorder
+ * (a gathered subset of grs, every variable of go and pc, delta-encoded in
+ * blocks short enough to be written during the checked steps) and the red
+ * nucleus.
+ * The health bounds are left open, as a failing check is allowed to allocate
+ * for its diagnostic.
+ *
+ *     Usage: ./alloc_check [-i IN_SIM] [--warmup N] [--steps N]
+ *
+ *     Without -i a new simulation is built. Exits with 0 if the checked steps
+ * allocated nothing, 1 if they did and 2 on bad usage.
+ */
+#include <atomic>
+#include <cerrno>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <unistd.h> // getpid (POSIX ONLY)
+
+#include "cbmsim.h"
+#include "event_recorder.h"
+#include "file_utility.h"
+#include "golden_trace.h"
+#include "health_monitor.h"
+#include "logger.h"
+#include "red_nucleus.h"
+#include "spike_stream.h"
+#include "trace_recorder.h"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+// sizes of the first allocations seen while armed, for the report
+static const uint32_t MAX_RECORDED_ALLOCS = 16;
+
+static std::atomic<bool> armed{false};
+static std::atomic<uint64_t> num_allocs{0};
+static size_t alloc_sizes[MAX_RECORDED_ALLOCS];
+
+static inline void count_alloc(size_t size) {
+  if (!armed.load(std::memory_order_relaxed))
+    return;
+  uint64_t n = num_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (n < MAX_RECORDED_ALLOCS)
+    alloc_sizes[n] = size;
+}
+
+/*
+ * Implementation Notes:
+ *     everything forwards to glibc's own entry points, so that counting never
+ * recurses into itself. operator new goes straight to __libc_malloc for the
+ * same reason, and so that it is not counted twice.
+ */
+extern "C" {
+void *malloc(size_t size) {
+  count_alloc(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+  count_alloc(num * size);
+  return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count_alloc(size);
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  count_alloc(size);
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  count_alloc(size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  count_alloc(size);
+  void *mem = __libc_memalign(alignment, size);
+  if (!mem)
+    return ENOMEM;
+  *ptr = mem;
+  return 0;
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+}
+
+static void *counted_new(size_t size) {
+  count_alloc(size);
+  void *mem = __libc_malloc(size ? size : 1);
+  if (!mem)
+    throw std::bad_alloc();
+  return mem;
+}
+
+void *operator new(size_t size) { return counted_new(size); }
+void *operator new[](size_t size) { return counted_new(size); }
+void operator delete(void *ptr) noexcept { __libc_free(ptr); }
+void operator delete[](void *ptr) noexcept { __libc_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { __libc_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { __libc_free(ptr); }
+
+const std::string POP_IDS[HEALTH_NUM_POPS] = {"MF", "GR", "GO", "BC",
+                                              "SC", "PC", "IO", "NC"};
+
+/*
+ * Description:
+ *     the recorders that Control runs every step, set up as a session with
+ * all of them turned on would.
+ */
+class StepRecorders {
+public:
+  StepRecorders(CBMSim &sim, std::string trace_name, std::string event_name,
+                std::string vtr_name)
+      : sim(sim), rn(sim.num_cells(CBM_NC)) {
+    spike_stream_pop pops[HEALTH_NUM_POPS];
+    for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++) {
+      num_cells[i] = sim.num_cells((enum cbm_cell)i);
+      pops[i].cell_id = i;
+      pops[i].num_cells = num_cells[i];
+    }
+    trace = new GoldenTraceWriter(trace_name, num_cells, true);
+    stream = new SpikeStreamWriter(
+        "/cbm_alloc_check_" + std::to_string(getpid()), pops,
+        HEALTH_NUM_POPS);
+    health_config cfg = DEFAULT_HEALTH_CONFIG;
+    cfg.interval = 1;
+    cfg.vm_min = -FLT_MAX;
+    cfg.vm_max = FLT_MAX;
+    health = new HealthMonitor(cfg, num_cells, POP_IDS, msPerTimeStep);
+    cfg.background = true;
+    background_health =
+        new HealthMonitor(cfg, num_cells, POP_IDS, msPerTimeStep);
+    event_config event_cfg = DEFAULT_EVENT_CONFIG;
+    for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++)
+      event_cfg.pops[i] = true;
+    event_cfg.pre_ms = 20.0f;
+    event_cfg.post_ms = 10.0f;
+    event_cfg.vm_every_ms = 5.0f;
+    event_cfg.spike_trigger[CBM_GO] = true;
+    events = new EventRecorder(event_name, event_cfg, num_cells, POP_IDS,
+                               msPerTimeStep);
+    trace_config trace_cfg = {1.0f, TRACE_DELTA, 0.01f, 50, {}};
+    trace_spec gr_spec = {CBM_GR, 0, {}, false};
+    for (uint32_t i = 0; i < num_cells[CBM_GR]; i += 1000)
+      gr_spec.cells.push_back(i);
+    trace_spec all_spec = {CBM_GO, 0, {}, true};
+    for (uint32_t var = 0; var < TRACE_NUM_VARS; var++) {
+      gr_spec.var = var;
+      trace_cfg.traces.push_back(gr_spec);
+    }
+    for (uint32_t pop : {CBM_GO, CBM_PC}) {
+      all_spec.pop = pop;
+      for (uint32_t var = 0; var < TRACE_NUM_VARS; var++) {
+        all_spec.var = var;
+        trace_cfg.traces.push_back(all_spec);
+      }
+    }
+    sim.get_sim_core()->getInputNet()->setSubsetGR(gr_spec.cells.data(),
+                                                   gr_spec.cells.size());
+    traces =
+        new TraceRecorder(vtr_name, trace_cfg, num_cells, msPerTimeStep);
+  }
+
+  ~StepRecorders() {
+    delete traces;
+    delete events;
+    delete background_health;
+    delete health;
+    delete stream;
+    delete trace;
+  }
+
+  /*
+   * Description:
+   *     mirrors what Control::runSession does after calcActivity, and how
+   * record_golden_trace, check_health and record_traces gather the state of
+   * the step.
+   */
+  void record(uint32_t ts) {
+    CBMSimCore *core = sim.get_sim_core();
+    const uint8_t *spikes[HEALTH_NUM_POPS];
+    const float *vms[HEALTH_NUM_POPS];
+    for (uint32_t i = 0; i < HEALTH_NUM_POPS; i++)
+      spikes[i] = sim.spikes((enum cbm_cell)i).data;
+    vms[CBM_MF] = NULL;
+    vms[CBM_GR] = core->getInputNet()->exportVmGR();
+    vms[CBM_GO] = core->getInputNet()->exportVmGO();
+    vms[CBM_BC] = core->getMZoneList()[0]->exportVmBC();
+    vms[CBM_SC] = core->getMZoneList()[0]->exportVmSC();
+    vms[CBM_PC] = core->getMZoneList()[0]->exportVmPC();
+    vms[CBM_IO] = core->getMZoneList()[0]->exportVmIO();
+    vms[CBM_NC] = core->getMZoneList()[0]->exportVmNC();
+    uint32_t trial = sim.get_trial();
+
+    float cr = rn.calc_step(spikes[CBM_NC]);
+    trace->record(trial, ts, spikes, vms);
+    stream->publish(trial, ts, cr, spikes);
+    const uint32_t *gr_ap_buf = core->getInputNet()->exportAPBufGR();
+    if (health->step(spikes))
+      health->check(trial, ts, gr_ap_buf, vms);
+    if (background_health->step(spikes))
+      background_health->check(trial, ts, gr_ap_buf, vms);
+    events->step(trial, ts, spikes);
+    events->commit_step(gr_ap_buf, vms);
+    InNet *inNet = core->getInputNet();
+    MZone *mZone = core->getMZoneList()[0];
+    const float *values[] = {inNet->exportVmSubsetGR(),
+                             inNet->exportGESumSubsetGR(),
+                             inNet->exportGISumSubsetGR(),
+                             vms[CBM_GO],
+                             inNet->exportgSum_MFGO(),
+                             inNet->exportgSum_GRGO(),
+                             vms[CBM_PC],
+                             mZone->exportgPFPC(),
+                             mZone->exportgBCPC()};
+    traces->record(trial, ts, values);
+  }
+
+private:
+  CBMSim &sim;
+  uint32_t num_cells[HEALTH_NUM_POPS];
+  RedNucleus rn;
+  GoldenTraceWriter *trace;
+  SpikeStreamWriter *stream;
+  HealthMonitor *health;
+  HealthMonitor *background_health;
+  EventRecorder *events;
+  TraceRecorder *traces;
+};
+
+int main(int argc, char **argv) {
+  logger_initConsoleLogger(stderr);
+  std::string in_sim_file;
+  uint32_t num_warmup = 100;
+  uint32_t num_steps = 1000;
+  for (int i = 1; i < argc; i++) {
+    std::string opt(argv[i]);
+    if (i + 1 >= argc) {
+      LOG_FATAL("No parameter given for option '%s'. Exiting...", argv[i]);
+      return 2;
+    }
+    std::string param(argv[++i]);
+    if (opt == "-i") {
+      in_sim_file = param;
+    } else if (opt == "--warmup") {
+      num_warmup = strtoul(param.c_str(), NULL, 10);
+    } else if (opt == "--steps") {
+      num_steps = strtoul(param.c_str(), NULL, 10);
+    } else {
+      LOG_FATAL("Usage: %s [-i IN_SIM] [--warmup N] [--steps N]", argv[0]);
+      return 2;
+    }
+  }
+  if (num_steps == 0) {
+    LOG_FATAL("Nothing to check: --steps must be at least 1. Exiting...");
+    return 2;
+  }
+
+  CBMSim sim;
+  sim.set_plasticity(GRADED, GRADED, true);
+  bool ready = in_sim_file.empty() ? sim.build() : sim.load(in_sim_file);
+  if (!ready) {
+    LOG_FATAL("Could not set up the simulation. Exiting...");
+    return 2;
+  }
+  std::string trace_name =
+      "alloc_check_" + std::to_string(getpid()) + GTR_EXT;
+  std::string event_name =
+      "alloc_check_" + std::to_string(getpid()) + EVT_EXT;
+  std::string vtr_name =
+      "alloc_check_" + std::to_string(getpid()) + VTR_EXT;
+  uint64_t allocs = 0;
+  {
+    StepRecorders recorders(sim, trace_name, event_name, vtr_name);
+    sim.on_step(
+        [&recorders](CBMSim &, uint32_t ts) { recorders.record(ts); });
+    // alternate the cs so that both kinds of mf input are exercised
+    sim.begin_trial(true, true);
+    LOG_INFO("Warming up for %u steps...", num_warmup);
+    for (uint32_t ts = 0; ts < num_warmup; ts++) {
+      sim.set_cs(ts % 2);
+      sim.step();
+    }
+    LOG_INFO("Checking %u steps...", num_steps);
+    armed.store(true);
+    for (uint32_t ts = 0; ts < num_steps; ts++) {
+      sim.set_cs(ts % 2);
+      if (ts == num_steps / 2)
+        sim.set_us();
+      sim.step();
+    }
+    armed.store(false);
+    allocs = num_allocs.load();
+  }
+  remove(trace_name.c_str());
+  remove(event_name.c_str());
+  remove(vtr_name.c_str());
+
+  if (allocs == 0) {
+    LOG_INFO("No allocations in %u steps.", num_steps);
+    return 0;
+  }
+  LOG_ERROR("%lu allocations in %u steps. Sizes of the first ones:", allocs,
+            num_steps);
+  for (uint32_t i = 0; i < allocs && i < MAX_RECORDED_ALLOCS; i++)
+    LOG_ERROR("  %zu bytes", alloc_sizes[i]);
+  return 1;
+}
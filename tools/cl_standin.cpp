@@ -0,0 +1,111 @@
+/*
+ * File: cl_standin.cpp
+ *
+ * Description:
+ *     A stand-in for the external controller of a closed-loop session (see
+ * src/cxx_tools/closed_loop.h). It attaches to the mailbox of a running
+ * cbm_sim, answers every observation it sees, and reports the gaps it saw in
+ * the observation stream once the simulation is done. Three policies are
+ * available:
+ *
+ *     echo   - acknowledge every observation and leave the cs and us to the
+ *              session file. Useful to measure round-trip latency on its own.
+ *     fixed  - take over the us and deliver it DELAY ms after every cs onset
+ *              seen in the observation stream.
+ *     cr     - take over the us and deliver it when the red nucleus output
+ *              crosses THRESH while the cs is on, at most once per trial.
+ *
+ *     Usage: ./cl_standin NAME [echo|fixed DELAY|cr THRESH] [ERR_DRIVE]
+ *
+ * where NAME is the name given to cbm_sim with -l.
+ */
+#include <cstdlib>
+#include <string>
+
+#include "closed_loop.h"
+#include "logger.h"
+
+enum standin_policy { ECHO, FIXED, CR };
+
+int main(int argc, char **argv) {
+  logger_initConsoleLogger(stderr);
+  if (argc < 2) {
+    LOG_FATAL("Usage: %s NAME [echo|fixed DELAY|cr THRESH] [ERR_DRIVE]",
+              argv[0]);
+    exit(1);
+  }
+  enum standin_policy policy = ECHO;
+  float policy_param = 0.0;
+  int next_arg = 2;
+  if (argc > 2) {
+    std::string policy_name(argv[2]);
+    if (policy_name == "fixed")
+      policy = FIXED;
+    else if (policy_name == "cr")
+      policy = CR;
+    else if (policy_name != "echo") {
+      LOG_FATAL("Unknown policy '%s'. Exiting...", argv[2]);
+      exit(1);
+    }
+    next_arg = 3;
+    if (policy != ECHO) {
+      if (argc < 4) {
+        LOG_FATAL("Policy '%s' needs a parameter. Exiting...", argv[2]);
+        exit(1);
+      }
+      policy_param = atof(argv[3]);
+      next_arg = 4;
+    }
+  }
+  float err_drive = (argc > next_arg) ? atof(argv[next_arg]) : 0.3;
+
+  ClosedLoopClient client("/" + std::string(argv[1]));
+  LOG_INFO("Attached to '/%s'. Waiting for the simulation to start...",
+           argv[1]);
+
+  cl_command cmd = {};
+  cmd.cs_mode = CL_FOLLOW_SESSION;
+  cmd.us_mode = (policy == ECHO) ? CL_FOLLOW_SESSION : CL_FORCE_ON;
+  cmd.err_drive = err_drive;
+
+  cl_observation obs;
+  uint64_t num_seen = 0;
+  uint64_t num_missed = 0;
+  uint64_t last_number = 0;
+  uint32_t last_trial = UINT32_MAX;
+  bool prev_cs_on = false;
+  bool us_sent = false;
+  uint32_t cs_onset_ts = 0;
+  while (client.get_sim_state() != CL_SIM_DONE) {
+    if (!client.poll_observation(obs))
+      continue;
+    num_seen++;
+    if (last_number > 0 && obs.number > last_number + 1)
+      num_missed += obs.number - last_number - 1;
+    last_number = obs.number;
+    if (obs.trial != last_trial) {
+      last_trial = obs.trial;
+      prev_cs_on = false;
+      us_sent = false;
+    }
+    if (obs.cs_on && !prev_cs_on)
+      cs_onset_ts = obs.ts;
+    prev_cs_on = obs.cs_on;
+
+    if (!us_sent && obs.cs_on) {
+      if ((policy == FIXED && obs.ts - cs_onset_ts + 1 >= policy_param) ||
+          (policy == CR && obs.cr >= policy_param)) {
+        cmd.us_count++;
+        us_sent = true;
+        LOG_DEBUG("Delivering us in trial %u at ts %u (cr = %0.3f)",
+                  obs.trial + 1, obs.ts + 1, obs.cr);
+      }
+    }
+    cmd.ack_number = obs.number;
+    client.send_command(cmd);
+  }
+  LOG_INFO("Simulation done. Answered %lu observations, missed %lu, "
+           "delivered %u us.",
+           num_seen, num_missed, cmd.us_count);
+  return 0;
+}
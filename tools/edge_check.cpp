@@ -0,0 +1,170 @@
+/*
+ * File: edge_check.cpp
+ *
+ * Description:
+ *     Checks that the edge lists written with '--edges' load back as the
+ * connectivity they were written from. For every synapse type, the tool
+ * writes the edge list of a simulation's pre-synaptic array (as '--edges'
+ * does), reads it back with read_edge_list and compares it with that array,
+ * then transposes it with transpose_edge_list and compares the result with
+ * the simulation's own post-synaptic array. The post-synaptic arrays are
+ * never written as edge lists, so the second comparison checks the encoding,
+ * the decoding and the transpose against connectivity that was built
+ * independently of all three. The few synapse types that the simulation only
+ * connects on one side (see CBMState::getConTable) are compared with that
+ * side, turned around here.
+ *
+ *     Rows are compared as sorted lists of cell ids, as the dense arrays keep
+ * a cell's synapses in the order they were made.
+ *
+ *     Usage: ./edge_check [-i IN_SIM]
+ *
+ *     Without -i a new simulation is built. Only the connectivity is set up,
+ * so no gpu is needed. Exits with 0 if every synapse type matches, 1 if any
+ * does not and 2 on bad usage.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h> // getpid (POSIX ONLY)
+#include <vector>
+
+#include "cbmstate.h"
+#include "con_edges.h"
+#include "connectivityparams.h"
+#include "ecmfpopulation.h"
+#include "logger.h"
+
+// the synapse types of CBMState::getConTable, with the extensions that
+// control.h gives their '-c' files
+static const uint32_t NUM_SYN_TYPES = 12;
+static const std::string SYN_IDS[NUM_SYN_TYPES] = {
+    "MFGR", "GRGO", "MFGO", "GOGO", "GOGR", "BCPC",
+    "SCPC", "PCBC", "PCNC", "IOIO", "NCIO", "MFNC"};
+static const std::string SYN_EXTS[NUM_SYN_TYPES] = {
+    ".mfgr", ".grgo", ".mfgo", ".gogo", ".gogr", ".bcpc",
+    ".scpc", ".pcbc", ".pcnc", ".ioio", ".ncio", ".mfnc"};
+
+typedef std::vector<std::vector<uint32_t>> cell_rows;
+
+/*
+ * Implementation Notes:
+ *     a row's synapses are its first row_counts[i] entries when there are
+ * counts, and its ids below num_cols otherwise. The result has a row per
+ * post-synaptic cell with by_post and per pre-synaptic cell without, so a
+ * table whose rows are the other side is turned around.
+ */
+static cell_rows table_rows(const con_table &table, bool by_post) {
+  bool as_is = by_post == table.rows_are_post;
+  cell_rows rows(as_is ? table.num_rows : table.num_cols);
+  for (uint32_t i = 0; i < table.num_rows; i++) {
+    const uint32_t *row = table.table + (uint64_t)i * table.row_len;
+    uint32_t len = table.row_counts ? table.row_counts[i] : table.row_len;
+    for (uint32_t j = 0; j < len; j++) {
+      if (row[j] >= table.num_cols)
+        continue;
+      if (as_is)
+        rows[i].push_back(row[j]);
+      else
+        rows[row[j]].push_back(i);
+    }
+  }
+  for (auto &row : rows)
+    std::sort(row.begin(), row.end());
+  return rows;
+}
+
+static cell_rows edge_rows(const edge_list &edges) {
+  cell_rows rows(edges.num_pre);
+  for (uint32_t i = 0; i < edges.num_pre; i++)
+    rows[i].assign(edges.targets.begin() + edges.offsets[i],
+                   edges.targets.begin() + edges.offsets[i + 1]);
+  return rows;
+}
+
+static bool same_rows(const std::string &syn_id, const char *view,
+                      const cell_rows &expected, const cell_rows &got) {
+  if (expected.size() != got.size()) {
+    LOG_ERROR("%s %s: %zu cells, expected %zu.", syn_id.c_str(), view,
+              got.size(), expected.size());
+    return false;
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (expected[i] != got[i]) {
+      LOG_ERROR("%s %s: cell %zu has %zu synapses, expected %zu, or "
+                "different ones.",
+                syn_id.c_str(), view, i, got[i].size(), expected[i].size());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool check_syn_type(CBMState &state, const std::string &syn_id,
+                           const std::string &path) {
+  con_table pre = state.getConTable(syn_id);
+  con_table post = state.getConTable(syn_id, true);
+  if (!write_edge_list(path, pre))
+    return false;
+  edge_list edges;
+  bool read = read_edge_list(path, edges);
+  remove(path.c_str());
+  if (!read)
+    return false;
+  edge_list transposed;
+  transpose_edge_list(edges, transposed);
+  LOG_INFO("%s: %u pre, %u post, %zu edges", syn_id.c_str(), edges.num_pre,
+           edges.num_post, edges.targets.size());
+  return same_rows(syn_id, "pre", table_rows(pre, false), edge_rows(edges)) &&
+         same_rows(syn_id, "post", table_rows(post, true),
+                   edge_rows(transposed));
+}
+
+int main(int argc, char **argv) {
+  logger_initConsoleLogger(stderr);
+  std::string in_sim_file;
+  if (argc == 3 && std::string(argv[1]) == "-i") {
+    in_sim_file = argv[2];
+  } else if (argc != 1) {
+    LOG_FATAL("Usage: %s [-i IN_SIM]", argv[0]);
+    return 2;
+  }
+
+  CBMState *state;
+  if (in_sim_file.empty()) {
+    state = new CBMState(1);
+  } else {
+    std::fstream sim_file_buf(in_sim_file.c_str(),
+                              std::ios::in | std::ios::binary);
+    if (!sim_file_buf.is_open()) {
+      LOG_FATAL("Could not open simulation file '%s'. Exiting...",
+                in_sim_file.c_str());
+      return 2;
+    }
+    // the mf population comes first in a sim file
+    ECMFPopulation mfs(sim_file_buf);
+    state = new CBMState(1, OFF, sim_file_buf);
+    sim_file_buf.close();
+  }
+  // a no-op unless the sim was built procedurally
+  state->getInnetConStateInternal()->materializeGRInputs();
+
+  uint32_t num_failed = 0;
+  for (uint32_t i = 0; i < NUM_SYN_TYPES; i++) {
+    std::string path =
+        "edge_check_" + std::to_string(getpid()) + SYN_EXTS[i] + "e";
+    if (!check_syn_type(*state, SYN_IDS[i], path))
+      num_failed++;
+  }
+  state->getInnetConStateInternal()->releaseGRInputs();
+  delete state;
+
+  if (num_failed > 0) {
+    LOG_FATAL("%u of %u synapse types do not load back as saved.", num_failed,
+              NUM_SYN_TYPES);
+    return 1;
+  }
+  LOG_INFO("Every synapse type loads back as saved.");
+  return 0;
+}
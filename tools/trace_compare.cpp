@@ -0,0 +1,242 @@
+/*
+ * File: trace_compare.cpp
+ *
+ * Description:
+ *     Compares two golden traces (see src/cxx_tools/golden_trace.h) step by
+ * step and reports the first step, and the populations, at which they diverge,
+ * followed by a per-population count of diverging steps. Modes:
+ *
+ *     exact  - step hashes must be equal. This is what two runs of the same
+ *              build give, and what a pure refactor should give.
+ *     spikes - spikes must be identical, membrane potentials need only agree
+ *              to within the tolerance. For changes that reassociate float
+ *              arithmetic (SIMD, reordered reductions) without changing any
+ *              spike. Needs detailed traces.
+ *     counts - per-population spike counts may differ by up to --count-tol
+ *              and potentials agree to within the tolerance. For changes
+ *              expected to move individual spikes. Needs detailed traces.
+ *
+ *     Voltages agree when |a - b| <= atol + rtol * max(|a|, |b|) for both the
+ * sum and the sum of squares of the population's potentials.
+ *
+ *     With --trial K, only the steps of trial K (counted from 1) of either
+ * trace are compared, such as those of a run and of a replay of its trial K
+ * (see '-y' of cbm_sim), which records that trial only.
+ *
+ *     Usage: ./trace_compare A.gtr B.gtr [--mode exact|spikes|counts]
+ *                            [--rtol R] [--atol A] [--count-tol N]
+ *                            [--trial K]
+ *
+ * Exits with 0 if the traces are equivalent, 1 if they diverge and 2 if they
+ * cannot be compared.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "golden_trace.h"
+#include "logger.h"
+
+const std::string POP_IDS[GT_NUM_POPS] = {"MF", "GR", "GO", "BC",
+                                          "SC", "PC", "IO", "NC"};
+
+enum compare_mode { EXACT, SPIKES, COUNTS };
+
+typedef struct {
+  enum compare_mode mode;
+  double rtol;
+  double atol;
+  uint32_t count_tol;
+  uint32_t trial; // counted from 1, 0 for every trial
+} compare_opts;
+
+/*
+ * Description:
+ *     reads the next record of trace, skipping those of other trials than
+ * opts.trial. Returns false at the end of the trace.
+ */
+static bool next_compared(GoldenTraceReader &trace, golden_trace_step &step,
+                          golden_trace_pop *pops, const compare_opts &opts) {
+  while (trace.next(step, pops)) {
+    if (opts.trial == 0 || step.trial + 1 == opts.trial)
+      return true;
+  }
+  return false;
+}
+
+static bool close_enough(double a, double b, const compare_opts &opts) {
+  return fabs(a - b) <= opts.atol + opts.rtol * fmax(fabs(a), fabs(b));
+}
+
+/*
+ * Description:
+ *     fills diverged[i] for each population and returns whether any diverged.
+ * Without detail, only the step hash can be compared, and a mismatch is
+ * attributed to no population in particular.
+ */
+static bool compare_step(const golden_trace_step &a_step,
+                         const golden_trace_pop *a_pops,
+                         const golden_trace_step &b_step,
+                         const golden_trace_pop *b_pops, bool detailed,
+                         const compare_opts &opts, bool *diverged) {
+  bool any = false;
+  memset(diverged, 0, GT_NUM_POPS * sizeof(bool));
+  if (!detailed)
+    return a_step.step_hash != b_step.step_hash;
+  for (uint32_t i = 0; i < GT_NUM_POPS; i++) {
+    const golden_trace_pop &a = a_pops[i];
+    const golden_trace_pop &b = b_pops[i];
+    switch (opts.mode) {
+    case EXACT:
+      diverged[i] = a.spike_hash != b.spike_hash || a.vm_hash != b.vm_hash;
+      break;
+    case SPIKES:
+      diverged[i] = a.spike_hash != b.spike_hash ||
+                    !close_enough(a.vm_sum, b.vm_sum, opts) ||
+                    !close_enough(a.vm_sq_sum, b.vm_sq_sum, opts);
+      break;
+    case COUNTS: {
+      uint32_t count_diff = (a.spike_count > b.spike_count)
+                                ? a.spike_count - b.spike_count
+                                : b.spike_count - a.spike_count;
+      diverged[i] = count_diff > opts.count_tol ||
+                    !close_enough(a.vm_sum, b.vm_sum, opts) ||
+                    !close_enough(a.vm_sq_sum, b.vm_sq_sum, opts);
+      break;
+    }
+    }
+    any |= diverged[i];
+  }
+  return any;
+}
+
+static void report_first(const golden_trace_step &step,
+                         const golden_trace_pop *a_pops,
+                         const golden_trace_pop *b_pops, bool detailed,
+                         const bool *diverged) {
+  LOG_INFO("First divergence at trial %u, ts %u:", step.trial + 1, step.ts);
+  if (!detailed) {
+    LOG_INFO("  step hash differs (record detailed traces with '-t full' to "
+             "name the population)");
+    return;
+  }
+  for (uint32_t i = 0; i < GT_NUM_POPS; i++) {
+    if (!diverged[i])
+      continue;
+    const golden_trace_pop &a = a_pops[i];
+    const golden_trace_pop &b = b_pops[i];
+    LOG_INFO("  %s: spikes %u vs %u%s, vm sum %0.9g vs %0.9g, vm sq sum "
+             "%0.9g vs %0.9g%s",
+             POP_IDS[i].c_str(), a.spike_count, b.spike_count,
+             (a.spike_hash != b.spike_hash) ? " (spike pattern differs)" : "",
+             a.vm_sum, b.vm_sum, a.vm_sq_sum, b.vm_sq_sum,
+             (a.vm_hash != b.vm_hash) ? " (vm bits differ)" : "");
+  }
+}
+
+int main(int argc, char **argv) {
+  logger_initConsoleLogger(stderr);
+  if (argc < 3) {
+    LOG_FATAL("Usage: %s A.gtr B.gtr [--mode exact|spikes|counts] [--rtol R] "
+              "[--atol A] [--count-tol N] [--trial K]",
+              argv[0]);
+    exit(2);
+  }
+  compare_opts opts = {EXACT, 1e-6, 1e-6, 0, 0};
+  for (int i = 3; i < argc; i++) {
+    std::string opt(argv[i]);
+    if (i + 1 >= argc) {
+      LOG_FATAL("No parameter given for option '%s'. Exiting...", argv[i]);
+      exit(2);
+    }
+    std::string param(argv[++i]);
+    if (opt == "--mode") {
+      if (param == "exact")
+        opts.mode = EXACT;
+      else if (param == "spikes")
+        opts.mode = SPIKES;
+      else if (param == "counts")
+        opts.mode = COUNTS;
+      else {
+        LOG_FATAL("Unknown mode '%s'. Exiting...", param.c_str());
+        exit(2);
+      }
+    } else if (opt == "--rtol")
+      opts.rtol = atof(param.c_str());
+    else if (opt == "--atol")
+      opts.atol = atof(param.c_str());
+    else if (opt == "--count-tol")
+      opts.count_tol = atoi(param.c_str());
+    else if (opt == "--trial")
+      opts.trial = atoi(param.c_str());
+    else {
+      LOG_FATAL("Unknown option '%s'. Exiting...", opt.c_str());
+      exit(2);
+    }
+  }
+
+  GoldenTraceReader a(argv[1]);
+  GoldenTraceReader b(argv[2]);
+  if (memcmp(a.get_header().num_cells, b.get_header().num_cells,
+             sizeof(a.get_header().num_cells)) != 0) {
+    LOG_FATAL("Traces were recorded from simulations of different sizes.");
+    exit(2);
+  }
+  bool detailed = a.is_detailed() && b.is_detailed();
+  if (opts.mode != EXACT && !detailed) {
+    LOG_FATAL("Tolerant modes need two detailed traces ('-t full').");
+    exit(2);
+  }
+
+  golden_trace_step a_step, b_step;
+  golden_trace_pop a_pops[GT_NUM_POPS], b_pops[GT_NUM_POPS];
+  bool diverged[GT_NUM_POPS];
+  uint64_t num_steps = 0, num_diverged = 0;
+  uint64_t pop_diverged[GT_NUM_POPS] = {0};
+  while (true) {
+    bool a_more = next_compared(a, a_step, a_pops, opts);
+    bool b_more = next_compared(b, b_step, b_pops, opts);
+    if (a_more != b_more) {
+      LOG_INFO("Traces have different lengths: '%s' ends after %lu steps.",
+               a_more ? argv[2] : argv[1], num_steps);
+      num_diverged++;
+      break;
+    }
+    if (!a_more)
+      break;
+    if (a_step.trial != b_step.trial || a_step.ts != b_step.ts) {
+      LOG_FATAL("Traces are misaligned at record %lu (trial %u ts %u vs trial "
+                "%u ts %u).",
+                num_steps, a_step.trial + 1, a_step.ts, b_step.trial + 1,
+                b_step.ts);
+      exit(2);
+    }
+    if (compare_step(a_step, a_pops, b_step, b_pops, detailed, opts,
+                     diverged)) {
+      if (num_diverged == 0)
+        report_first(a_step, a_pops, b_pops, detailed, diverged);
+      num_diverged++;
+      for (uint32_t i = 0; i < GT_NUM_POPS; i++)
+        pop_diverged[i] += diverged[i];
+    }
+    num_steps++;
+  }
+
+  if (num_steps == 0 && opts.trial > 0) {
+    LOG_FATAL("Neither trace holds steps of trial %u.", opts.trial);
+    exit(2);
+  }
+  if (num_diverged == 0) {
+    LOG_INFO("Traces are equivalent over %lu steps.", num_steps);
+    return 0;
+  }
+  LOG_INFO("%lu of %lu steps diverge.", num_diverged, num_steps);
+  if (detailed) {
+    for (uint32_t i = 0; i < GT_NUM_POPS; i++) {
+      if (pop_diverged[i] > 0)
+        LOG_INFO("  %s: %lu steps", POP_IDS[i].c_str(), pop_diverged[i]);
+    }
+  }
+  return 1;
+}